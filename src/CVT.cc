@@ -44,6 +44,8 @@ static char _CVT_cc[] = "University of Edinburgh $Id$";
 #include "Log.h"
 #include "Task.h"
 #include "ColourTransforms.h"
+#include "StripEncoder.h"
+#include "Environment.h"
 
 
 using namespace std;
@@ -172,21 +174,24 @@ void CVT::run( Session* session, std::string argument ){
     unsigned int o_channels = channels;
     if( session->view->shaded ) o_channels = 1;
 
-    unsigned char* buf = new unsigned char[view_width * src_tile_height * o_channels + 4000]; // If image to small then 4000 bytes 
-                                                                              // should be enought to cover the compression overhead
-
-    unsigned char* bufDest = buf;                                  // destination buffer. PNGs need destination different from source
-    if(requestType == PNG) { // png added by Zsolt Husz, 8/05/2009
-        bufDest = new unsigned char[view_width * src_tile_height * o_channels + 4000]; // If image to small then 4000 bytes
-    }                                                                                     // should be enought to cover the compression overhead
+    unsigned int strip_size = view_width * src_tile_height * o_channels + 4000; // If image to small then 4000 bytes
+                                                                                // should be enought to cover the compression overhead
+    unsigned char* buf = new unsigned char[strip_size];
 
 
     // Create a RawTile for the entire image
     RawTile complete_image( 0, 0, 0, 0, view_width, view_height, o_channels, 8 );
 
-    complete_image.dataLength = view_width * src_tile_height * o_channels + 4000;
+    complete_image.dataLength = strip_size;
     complete_image.data = buf;
 
+    // Images taller than a band may have their JPEG encoded in bands on the
+    // work pool, the bands being joined by restart markers
+    unsigned int jpeg_band_height = Environment::getCVTJPEGBandHeight();
+    bool parallel_jpeg = (requestType == JPEG) && (jpeg_band_height > 0) &&
+                         (view_height > jpeg_band_height);
+    ParallelJPEGCompressor pjpeg( session->jpeg->getQuality(), jpeg_band_height );
+
     if(requestType == PNG) { // png added by Zsolt Husz, 8/05/2009
 
     // Initialise our PNH compression object
@@ -206,7 +211,8 @@ void CVT::run( Session* session, std::string argument ){
     } else { //JPEG
       // Initialise our JPEG compression object
 
-        session->jpeg->InitCompression( complete_image, src_tile_height );
+      if( parallel_jpeg ) pjpeg.InitCompression( complete_image );
+      else session->jpeg->InitCompression( complete_image, src_tile_height );
 #ifndef DEBUG
       session->out->printf( // 			  "Pragma: no-cache\r\n"
 			 "Last-Modified: Mon, 1 Jan 2000 00:00:00 GMT\r\n"
@@ -216,25 +222,55 @@ void CVT::run( Session* session, std::string argument ){
 			 "\r\n\r\n" );
 #endif
     // Send the JPEG header to the client
-      len = session->jpeg->getHeaderSize();
-      if( session->out->putStr( (const char*) session->jpeg->getHeader(), len ) != len ){
+      const unsigned char* header;
+      if( parallel_jpeg ){
+        len = pjpeg.getHeaderSize();
+        header = pjpeg.getHeader();
+      }
+      else{
+        len = session->jpeg->getHeaderSize();
+        header = session->jpeg->getHeader();
+      }
+      if( session->out->putStr( (const char*) header, len ) != len ){
 	LOG_ERROR("CVT :: Error writing jpeg header");
       }
     }
 
+    // The strips are assembled here and then compressed and sent to the
+    // client by the encoder, on its own thread, while the following strips
+    // are assembled. The encoder has a fixed number of strip buffers, so
+    // assembly waits for the encoder if it gets too far ahead.
+    int pipeline_depth = Environment::getCVTPipelineDepth();
+    StripEncoder encoder( session->out, session->jpeg, session->png,
+			  (parallel_jpeg)? &pjpeg: NULL, requestType,
+			  buf, strip_size, pipeline_depth );
+
+    // Queue all of the tiles of the view port so that they may be
+    // rendered concurrently, rows of tiles being rendered ahead of the
+    // strips being assembled. They are taken in strip order.
+    TileQueue tilequeue( session->tileCache, *session->image, session->jpeg, session->png,
+			 requested_res, session->view->xangle, session->view->yangle, UNCOMPRESSED,
+			 (endx - startx) * (pipeline_depth + 1) );
+    for( unsigned int i=starty; i<endy; i++ ){
+      for( unsigned int j=startx; j<endx; j++ ){
+	tilequeue.add( (i*ntlx) + j );
+      }
+    }
+
     // Decode the image strip by strip and dynamically compress with JPEG
 
     for( unsigned int i=starty; i<endy; i++ ){
       unsigned int buffer_index = 0;
+      // Get a strip buffer, waiting for the encoder if all are in use
+      unsigned char* bufDest = encoder.getStrip();
       // Keep track of the current pixel boundary horizontally. ie. only up
       //  to the beginning of the current tile boundary.
       int current_width = 0;
 
       for( unsigned int j=startx; j<endx; j++ ){
         LOG_COND_INFO(tile_timer.start());
-	// Get an uncompressed tile from our TileManager
-	TileManager tilemanager( session->tileCache, *session->image, session->jpeg, session->png);
-	RawTile rawtile = tilemanager.getTile( requested_res, (i*ntlx) + j, session->view->xangle, session->view->yangle, UNCOMPRESSED );
+	// Get the next uncompressed tile from our queue
+	RawTile rawtile = tilequeue.next();
 
 	LOG_INFO("CVT :: Tile access time " << tile_timer.getTime() << "us");
 
@@ -348,48 +384,20 @@ void CVT::run( Session* session, std::string argument ){
 	current_width += dst_tile_width;
       }
 
-      // Compress the strip
-      if(requestType == PNG) // png added by Zsolt Husz, 8/05/2009
-        len = session->png->CompressStrip( bufDest, dst_tile_height );
-      else
-        len = session->jpeg->CompressStrip( bufDest, dst_tile_height );  // bug fix 15/05/2009
-
-      LOG_INFO("CVT :: Compressed data strip length is " << len);
-
-      // Send this strip out to the client
-      if(len != session->out->putStr((const char* )complete_image.data, len)){
-	LOG_ERROR("CVT :: Error writing jpeg strip data: " << len);
-      }
-
-      if( session->out->flush() == -1 ) {
-	LOG_ERROR("CVT :: Error flushing jpeg tile");
-      }
+      // Pass the strip to the encoder to be compressed and sent out to the client
+      encoder.putStrip( bufDest, dst_tile_height );  // bug fix 15/05/2009
     }
 
-    // Finish off the image compression
-    if(requestType == PNG)  // png added by Zsolt Husz, 8/05/2009
-      len = session->png->Finish();
-    else
-      len = session->jpeg->Finish();
-
-    if(session->out->putStr((const char* )complete_image.data, len) != len){
-      LOG_ERROR("CVT :: Error writing jpeg EOI markers");
-    }
-
-    // Finish off the flush the buffer
+    // Wait for the encoder to send all of the strips, then finish off the
+    // image compression and flush the buffer
     //session->out->printf( "\r\n" ); //was possible bug: causes incorrect packet length, that results in crash, Z Husz 16/04/2010
-
-    if( session->out->flush()  == -1 ) {
-      LOG_ERROR("CVT :: Error flushing image");
-    }
+    encoder.finish();
 
     // Inform our response object that we have sent something to the client
     session->response->setImageSent();
 
 
     // Don't forget to delete our strip of memory
-    if (bufDest!=buf)
-       delete[] bufDest;
     delete[] buf;
 
   } // End of if( argument == "jpeg" || argument == "png")
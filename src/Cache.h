@@ -66,18 +66,61 @@ namespace __gnu_cxx
 #include <ext/pool_allocator.h>
 #endif
 
+#include <cstdio>
 #include <iostream>
 #include <list>
 #include <string>
+#include <vector>
 #include "RawTile.h"
+#include "TileKey.h"
+#include "Mutex.h"
+#include "Trace.h"
 
 /// Cache to store raw tile data
+/** The cache is shared by all of the server's worker threads, so all
+ *  public methods serialise access through an internal mutex.
+ *  Tiles are keyed on a fixed size TileKey which is held in an open
+ *  addressing (linear probing) index, so looking a tile up requires
+ *  no string building or heap allocation.
+ *
+ *  Tiles are held in up to three segments, each an LRU list with its
+ *  most recently used tile at the head, and the eviction policy decides
+ *  how tiles move between them:
+ *  - LRU: all tiles are in the probation segment, which is a plain LRU.
+ *  - SLRU: new tiles enter the probation segment and are promoted to the
+ *    protected segment (80% of the cache) when they are hit again, so a
+ *    scan through many tiles which are used once only evicts other tiles
+ *    on probation.
+ *  - TINYLFU: new tiles enter a small LRU window (1% of the cache). A tile
+ *    leaving the window is only admitted to the SLRU main cache, in place
+ *    of the probation segment's LRU tile, if it has been requested more
+ *    often. Request frequencies are estimated by a count-min sketch whose
+ *    counts are periodically halved so that old popularity fades.
+ */
 
 class Cache {
 
 
+ public:
+
+  /// Eviction policies
+  enum Policy { LRU, SLRU, TINYLFU };
+
+
  private:
 
+  /// Segments, see the class description
+  enum Segment { WINDOW = 0, PROBATION = 1, PROTECTED = 2, N_SEGMENTS = 3 };
+
+  /// Number of rows of the frequency sketch
+  static const int SKETCH_DEPTH = 4;
+
+  /// Maximum count of the frequency sketch
+  static const unsigned char SKETCH_MAX = 15;
+
+  /// Eviction policy
+  Policy policy;
+
   /// Max memory size in bytes
   unsigned long maxSize;
 
@@ -87,67 +130,281 @@ class Cache {
   /// Current memory running total
   unsigned long currentSize;
 
+  /// Memory used by each segment
+  unsigned long segmentSize[N_SEGMENTS];
+
+  /// Max memory size of the window segment
+  unsigned long windowMax;
+
+  /// Max memory size of the protected segment
+  unsigned long protectedMax;
+
   /// Main cache storage typedef
 #ifdef POOL_ALLOCATOR
-  typedef std::list < std::pair<const std::string,RawTile>,
-    __gnu_cxx::__pool_alloc< std::pair<const std::string,RawTile> > > TileList;
+  typedef std::list < std::pair<TileKey,RawTile>,
+    __gnu_cxx::__pool_alloc< std::pair<TileKey,RawTile> > > TileList;
 #else
-  typedef std::list < std::pair<const std::string,RawTile> > TileList;
+  typedef std::list < std::pair<TileKey,RawTile> > TileList;
 #endif
 
   /// Main cache list iterator typedef
-  typedef std::list < std::pair<const std::string,RawTile> >::iterator List_Iter;
+  typedef TileList::iterator List_Iter;
+
+  /// Slot of the open addressing index
+  struct IndexSlot {
+    TileKey key;
+    unsigned long long hash;
+    List_Iter liter;
+    int segment;
+    bool used;
+  };
 
   /// Index typedef
-#ifdef HAVE_EXT_POOL_ALLOCATOR
-  typedef HASHMAP < std::string, List_Iter,
-    __gnu_cxx::hash< const std::string >,
-    std::equal_to< const std::string >,
-    __gnu_cxx::__pool_alloc< std::pair<const std::string, List_Iter> >
-    > TileMap;
-#else
-  typedef HASHMAP < std::string,List_Iter > TileMap;
-#endif
+  typedef std::vector < IndexSlot > TileIndex;
+
+  /// Main cache storage objects, one for each segment
+  TileList tileList[N_SEGMENTS];
+
+  /// Main Cache storage index object, the size is always a power of two
+  TileIndex tileIndex;
+
+  /// Number of used index slots
+  size_t indexUsed;
+
+  /// Count-min sketch of request frequencies, SKETCH_DEPTH rows
+  std::vector < unsigned char > sketch;
+
+  /// Mask for a column of a sketch row, the row width is a power of two
+  size_t sketchMask;
+
+  /// Number of sketch increments since the counts were last halved
+  unsigned long sketchCount;
+
+  /// Number of sketch increments after which the counts are halved
+  unsigned long sketchSample;
+
+  /// Request counts, updated atomically without the mutex
+  volatile unsigned long nRequests, nHits;
+
+  /// Request bytes, updated atomically without the mutex
+  volatile unsigned long long nRequestBytes, nHitBytes;
+
+  /// Tiles evicted to make room, updated atomically
+  volatile unsigned long nEvictions;
+
+  /// Mutex protecting the lists, index, sketch and size counters
+  Mutex mutex;
+
+
+  /// Internal function giving the memory used by a tile
+  unsigned long _size( const RawTile &r ) const {
+    return r.dataLength + r.filename.length()*sizeof(char) + tileSize;
+  }
+
+
+  /// Internal index search function
+  /** @param key to search for
+   *  @param hash of the key
+   *  @return index of the slot holding the key or of the free slot
+   *          at which the search stopped
+   */
+  size_t _probe( const TileKey &key, unsigned long long hash ) const {
+    const size_t mask = tileIndex.size() - 1;
+    size_t i = (size_t )hash & mask;
+    while( tileIndex[i].used &&
+	   ((tileIndex[i].hash != hash) || (tileIndex[i].key != key)) ){
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+
+  /// Internal index resize function
+  /** @param n new number of index slots, which must be a power of two */
+  void _rehash( size_t n ) {
+    TileIndex old;
+    old.swap( tileIndex );
+    IndexSlot empty;
+    empty.used = false;
+    tileIndex.assign( n, empty );
+    for( size_t i = 0; i < old.size(); ++i ){
+      if( old[i].used ){
+	tileIndex[this->_probe( old[i].key, old[i].hash )] = old[i];
+      }
+    }
+  }
+
+
+  /// Internal index erase function
+  /** Removes the slot and shifts back any following slots of the probe
+   *  sequence so that no tombstones are needed.
+   *  @param i index of the slot to erase
+   */
+  void _unindex( size_t i ) {
+    const size_t mask = tileIndex.size() - 1;
+    size_t j = i;
+    for(;;){
+      j = (j + 1) & mask;
+      if( !tileIndex[j].used ) break;
+      size_t k = (size_t )tileIndex[j].hash & mask;
+      // Leave the entry if its home slot is cyclically within (i,j]
+      if( (i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)) ) continue;
+      tileIndex[i] = tileIndex[j];
+      i = j;
+    }
+    tileIndex[i].used = false;
+    --indexUsed;
+  }
+
+
+  /// Internal sketch column function
+  /** @param hash of the key
+   *  @param row of the sketch
+   *  @return index of the row's counter for the key
+   */
+  size_t _column( unsigned long long hash, int row ) const {
+    // Double hashing with the two halves of the key's hash
+    size_t h1 = (size_t )(hash & 0xffffffffULL),
+           h2 = (size_t )(hash >> 32) | 1;
+    return row * (sketchMask + 1) + ((h1 + row * h2) & sketchMask);
+  }
+
+
+  /// Internal sketch increment function
+  /** @param hash of the requested key */
+  void _record( unsigned long long hash ) {
+    for( int r = 0; r < SKETCH_DEPTH; ++r ){
+      unsigned char &c = sketch[this->_column( hash, r )];
+      if( c < SKETCH_MAX ) ++c;
+    }
+    // Age the counts so that tiles which are no longer requested lose
+    // their advantage
+    if( ++sketchCount >= sketchSample ){
+      for( size_t i = 0; i < sketch.size(); ++i ) sketch[i] >>= 1;
+      sketchCount /= 2;
+    }
+  }
+
+
+  /// Internal sketch frequency function
+  /** @param hash of the key
+   *  @return estimated number of recent requests for the key
+   */
+  int _frequency( unsigned long long hash ) const {
+    int f = SKETCH_MAX;
+    for( int r = 0; r < SKETCH_DEPTH; ++r ){
+      int c = sketch[this->_column( hash, r )];
+      if( c < f ) f = c;
+    }
+    return f;
+  }
 
-  /// Main cache storage object
-  TileList tileList;
 
-  /// Main Cache storage index object
-  TileMap tileMap;
+  /// Internal segment move function
+  /** Moves a tile to the head of the given segment
+   *  @param i index of the tile's slot
+   *  @param segment to move the tile to
+   */
+  void _move( size_t i, int segment ) {
+    IndexSlot &slot = tileIndex[i];
+    if( slot.segment != segment ){
+      unsigned long sz = this->_size( slot.liter->second );
+      segmentSize[slot.segment] -= sz;
+      segmentSize[segment] += sz;
+    }
+    tileList[segment].splice( tileList[segment].begin(),
+			      tileList[slot.segment], slot.liter );
+    slot.segment = segment;
+  }
 
 
   /// Internal touch function
-  /** Touches a key in the Cache and makes it the most recently used
-   *  @param key to be touched
-   *  @return a Map_Iter pointing to the key that was touched.
+  /** Touches a tile in the Cache, making it the most recently used in its
+   *  segment or promoting it from probation
+   *  @param i index of the tile's slot
    */
-  TileMap::iterator _touch( const std::string &key ) {
-    TileMap::iterator miter = tileMap.find( key );
-    if( miter == tileMap.end() ) return miter;
-    // Move the found node to the head of the list.
-    tileList.splice( tileList.begin(), tileList, miter->second );
-    return miter;
+  void _touch( size_t i ) {
+    if( (policy == LRU) || (tileIndex[i].segment != PROBATION) ){
+      this->_move( i, tileIndex[i].segment );
+      return;
+    }
+    this->_move( i, PROTECTED );
+    // Demote the protected segment's least recently used tiles
+    while( (segmentSize[PROTECTED] > protectedMax) &&
+	   (tileList[PROTECTED].size() > 1) ){
+      List_Iter liter = tileList[PROTECTED].end();
+      --liter;
+      this->_move( this->_probe( liter->first, liter->first.hash() ),
+		   PROBATION );
+    }
   }
 
 
   /// Interal remove function
   /**
-   *  @param miter Map_Iter that points to the key to remove
-   *  @warning miter is now longer usable after being passed to this function.
+   *  @param segment holding the entry
+   *  @param liter iterator that points to the entry to remove
+   *  @warning liter is now longer usable after being passed to this function.
    */
-  void _remove( const TileMap::iterator &miter ) {
-    // Reduce our current size counter
-    currentSize -= ( (miter->second->second).dataLength + (miter->second->second).filename.length()*sizeof(char) + tileSize );
-    tileList.erase( miter->second );
-    tileMap.erase( miter );
+  void _remove( int segment, const List_Iter &liter ) {
+    // Reduce our current size counters
+    unsigned long sz = this->_size( liter->second );
+    currentSize -= sz;
+    segmentSize[segment] -= sz;
+    this->_unindex( this->_probe( liter->first, liter->first.hash() ) );
+    tileList[segment].erase( liter );
   }
 
 
-  /// Interal remove function
-  /** @param key to remove */
-  void _remove( const std::string &key ) {
-    TileMap::iterator miter = tileMap.find( key );
-    this->_remove( miter );
+  /// Internal function giving the segment from which to evict
+  /** @return the first non empty segment of probation, protected and
+   *          window or N_SEGMENTS if the cache is empty
+   */
+  int _victimSegment() const {
+    if( !tileList[PROBATION].empty() ) return PROBATION;
+    if( !tileList[PROTECTED].empty() ) return PROTECTED;
+    if( !tileList[WINDOW].empty() ) return WINDOW;
+    return N_SEGMENTS;
+  }
+
+
+  /// Internal eviction function
+  /** Moves tiles out of the window and evicts tiles until the cache is
+   *  within its maximum size
+   */
+  void _evict() {
+    // A candidate leaving the window enters the main cache while there
+    // is room, otherwise the less frequently requested of it and the
+    // main cache's victim is evicted
+    while( (segmentSize[WINDOW] > windowMax) && !tileList[WINDOW].empty() ){
+      List_Iter cand = tileList[WINDOW].end();
+      --cand;
+      int s = ( currentSize > maxSize )? this->_victimSegment(): WINDOW;
+      if( s == WINDOW ){
+	this->_move( this->_probe( cand->first, cand->first.hash() ),
+		     PROBATION );
+	continue;
+      }
+      List_Iter victim = tileList[s].end();
+      --victim;
+      if( this->_frequency( cand->first.hash() ) >
+	  this->_frequency( victim->first.hash() ) ){
+	this->_remove( s, victim );
+      }
+      else{
+	this->_remove( WINDOW, cand );
+      }
+      this->countEviction();
+    }
+    // Check to see if we need to remove an element due to exceeding max_size
+    while( currentSize > maxSize ) {
+      // Remove the last element.
+      int s = this->_victimSegment();
+      List_Iter liter = tileList[s].end();
+      --liter;
+      this->_remove( s, liter );
+      this->countEviction();
+    }
   }
 
 
@@ -155,107 +412,200 @@ class Cache {
  public:
 
   /// Constructor
-  /** @param max Maximum cache size in MB */
-  Cache( float max ) {
+  /** @param max Maximum cache size in MB
+   *  @param p eviction policy
+   */
+  Cache( float max, Policy p = LRU ) {
+    policy = p;
     maxSize = (unsigned long)(max*1024000) ; currentSize = 0;
-    // 128 added at the end represents 2*average strings lengths
-    tileSize = sizeof( RawTile ) + sizeof( std::pair<const std::string,RawTile> ) +
-      sizeof( std::pair<const std::string, List_Iter> ) + 128;
+    // 64 added at the end represents an average filename length
+    tileSize = sizeof( RawTile ) + sizeof( std::pair<TileKey,RawTile> ) +
+      2 * sizeof( IndexSlot ) + 64;
+    for( int s = 0; s < N_SEGMENTS; ++s ) segmentSize[s] = 0;
+    windowMax = ( policy == TINYLFU )? maxSize / 100: 0;
+    protectedMax = ( policy == LRU )? 0: (maxSize - windowMax) / 5 * 4;
+    indexUsed = 0;
+    IndexSlot empty;
+    empty.used = false;
+    tileIndex.assign( (maxSize > 0)? 1024: 1, empty );
+    // Size the sketch for about one column per 4kB cached tile
+    sketchMask = 0;
+    sketchCount = 0;
+    sketchSample = 0;
+    if( policy == TINYLFU ){
+      size_t width = 1024;
+      while( (width < (1UL << 20)) && (width * 4096 < maxSize) ) width *= 2;
+      sketch.assign( SKETCH_DEPTH * width, 0 );
+      sketchMask = width - 1;
+      sketchSample = 10 * width;
+    }
+    nRequests = nHits = nEvictions = 0;
+    nRequestBytes = nHitBytes = 0;
   };
 
 
   /// Destructor
-  ~Cache() {
-    tileList.clear();
-    tileMap.clear();
+  virtual ~Cache() {
+    for( int s = 0; s < N_SEGMENTS; ++s ) tileList[s].clear();
+    tileIndex.clear();
+  }
+
+
+  /// Parse the name of an eviction policy
+  /** @param name policy name: lru, slru or tinylfu
+   *  @param p set to the named policy
+   *  @return true if the name is that of a policy
+   */
+  static bool parsePolicy( const std::string& name, Policy& p ) {
+    if( name == "lru" ) p = LRU;
+    else if( name == "slru" ) p = SLRU;
+    else if( name == "tinylfu" ) p = TINYLFU;
+    else return false;
+    return true;
   }
 
 
   /// Insert a tile
-  /** @param r Tile to be inserted */
-  void insert( const RawTile& r ) {
+  /** The tile's key is made from its fingerprint and tile fields.
+   *  @param r Tile to be inserted
+   */
+  virtual void insert( const RawTile& r ) {
 
     if( maxSize == 0 ) return;
 
-    std::string key = this->getIndex( r.filename, r.resolution, r.tileNum,
-				      r.hSequence, r.vSequence, r.compressionType, r.quality );
+    TraceSpan span( "Cache::insert" );
+
+    TileKey key = TileKey::ofTile( r );
+    unsigned long long hash = key.hash();
 
-    // Touch the key, if it exists
-    TileMap::iterator miter = this->_touch( key );
+    MutexLock lock( mutex );
 
-    // If this index already exists, do nothing
-    if( miter != tileMap.end() ) return;
+    // If this key already exists, touch it and do nothing more
+    size_t i = this->_probe( key, hash );
+    if( tileIndex[i].used ){
+      this->_touch( i );
+      return;
+    }
 
     // Store the key if it doesn't already exist in our cache
-    // Ok, do the actual insert at the head of the list
-    tileList.push_front( std::make_pair(key,r) );
+    // Ok, do the actual insert at the head of its first segment
+    int segment = ( policy == TINYLFU )? WINDOW: PROBATION;
+    tileList[segment].push_front( std::make_pair(key,r) );
+
+    // Keep the index at most half full
+    if( 2 * (indexUsed + 1) > tileIndex.size() ){
+      this->_rehash( 2 * tileIndex.size() );
+      i = this->_probe( key, hash );
+    }
 
-    // And store this in our map
-    List_Iter liter = tileList.begin();
-    tileMap[ key ] = liter;
+    // And store this in our index
+    tileIndex[i].key = key;
+    tileIndex[i].hash = hash;
+    tileIndex[i].liter = tileList[segment].begin();
+    tileIndex[i].segment = segment;
+    tileIndex[i].used = true;
+    ++indexUsed;
 
-    // Update our total current size variable
-    currentSize += (r.dataLength + r.filename.length()*sizeof(char) + tileSize);
+    // Update our total current size variables
+    unsigned long sz = this->_size( r );
+    currentSize += sz;
+    segmentSize[segment] += sz;
 
-    // Check to see if we need to remove an element due to exceeding max_size
-    while( currentSize > maxSize ) {
-      // Remove the last element.
-      liter = tileList.end();
-      --liter;
-      this->_remove( liter->first );
-    }
+    this->_evict();
 
   }
 
 
   /// Return the number of tiles in the cache
-  unsigned int getNumElements() { return tileList.size(); }
+  virtual unsigned int getNumElements() {
+    MutexLock lock( mutex );
+    return indexUsed;
+  }
 
 
   /// Return the number of MB stored
-  float getMemorySize() { return (float) ( currentSize / 1024000.0 ); }
+  virtual float getMemorySize() {
+    MutexLock lock( mutex );
+    return (float) ( currentSize / 1024000.0 );
+  }
 
 
   /// Get a tile from the cache
-  /** 
-   *  @param f filename
-   *  @param r resolution number
-   *  @param t tile number
-   *  @param h horizontal sequence number
-   *  @param v vertical sequence number
-   *  @param c compression type
-   *  @param q compression quality
-   *  @return pointer to data or NULL on error
+  /** The tile is copied out while the cache is locked, as a pointer into
+   *  the cache could be invalidated by another thread's insertion. The copy
+   *  shares the cached tile's data buffer, so no data is copied and the
+   *  data remains valid even if the tile is then evicted.
+   *  @param key tile key
+   *  @param tile set to a copy of the cached tile if found
+   *  @return true if the tile was found in the cache
    */
-  RawTile* getTile( std::string f, int r, int t, int h, int v, CompressionType c, int q ) {
+  virtual bool getTile( const TileKey& key, RawTile& tile ) {
 
-    if( maxSize == 0 ) return NULL;
+    if( maxSize == 0 ) return false;
 
-    std::string key = this->getIndex( f, r, t, h, v, c, q );
+    unsigned long long hash = key.hash();
 
-    TileMap::iterator miter = tileMap.find( key );
-    if( miter == tileMap.end() ) return NULL;
-    this->_touch( key );
+    MutexLock lock( mutex );
+    size_t i = this->_probe( key, hash );
+    if( !tileIndex[i].used ) return false;
 
-    return &(miter->second->second);
+    this->_touch( i );
+    tile = tileIndex[i].liter->second;
+    return true;
   }
 
 
-  /// Create a hash index
-  /** 
-   *  @param f filename
-   *  @param r resolution number
-   *  @param t tile number
-   *  @param h horizontal sequence number
-   *  @param v vertical sequence number
-   *  @param c compression type
-   *  @param q compression quality
-   *  @return string
+  /// Count a tile request
+  /** Called once for each tile requested by a client, however many keys
+   *  were looked up for it, to give the cache's hit rates. This is also
+   *  where the W-TinyLFU policy records the request's frequency, so that
+   *  probes of fallback keys and prefetches do not inflate it.
+   *  @param key key of the tile which answered the request
+   *  @param hit true if the tile was found without being rendered
+   *  @param bytes size of the tile's data
    */
-  std::string getIndex( std::string f, int r, int t, int h, int v, CompressionType c, int q ) {
-    char tmp[100];
-    snprintf( tmp, 100, ":%d:%d:%d:%d:%d:%d", r, t, h, v, c, q );
-    return f+std::string( tmp );
+  void countRequest( const TileKey& key, bool hit, int bytes ) {
+    if( policy == TINYLFU && maxSize > 0 ){
+      unsigned long long hash = key.hash();
+      MutexLock lock( mutex );
+      this->_record( hash );
+    }
+    (void )__sync_add_and_fetch( &nRequests, 1 );
+    (void )__sync_add_and_fetch( &nRequestBytes, (unsigned long long )bytes );
+    if( hit ){
+      (void )__sync_add_and_fetch( &nHits, 1 );
+      (void )__sync_add_and_fetch( &nHitBytes, (unsigned long long )bytes );
+    }
+  }
+
+
+  /// Return the number of tile requests counted
+  unsigned long getRequestCount() { return nRequests; }
+
+
+  /// Return the number of tile requests which hit the cache
+  unsigned long getHitCount() { return nHits; }
+
+
+  /// Count a tile evicted to make room for others
+  void countEviction() { (void )__sync_add_and_fetch( &nEvictions, 1 ); }
+
+
+  /// Return the number of tiles evicted
+  unsigned long getEvictionCount() { return nEvictions; }
+
+
+  /// Return the fraction of tile requests which hit the cache
+  double getHitRate() {
+    unsigned long n = nRequests;
+    return ( n > 0 )? (double )nHits / n: 0.0;
+  }
+
+
+  /// Return the fraction of requested tile bytes which hit the cache
+  double getByteHitRate() {
+    unsigned long long n = nRequestBytes;
+    return ( n > 0 )? (double )nHitBytes / n: 0.0;
   }
 
 
@@ -0,0 +1,806 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _Compositor_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         Compositor.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Compositing of rendered Woolz objects into tile buffers.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string.h>
+#include <math.h>
+#include "Compositor.h"
+#include "ImageMapLUT.h"
+
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define COMPOSITOR_SIMD
+#include <immintrin.h>
+#endif
+
+/*!
+* \brief	Conversion of grey values to fixed point. Values are
+* 		clamped to +/-65536 which, as weights are at least 1,
+* 		is enough to saturate the blended result. Byte values
+* 		are truncated after blending (as they always have been)
+* 		while all other types are rounded.
+* \ingroup	WlzIIPServer
+*/
+template <typename T>
+struct CompositorTraits
+{
+  enum {frac = 0, bias = 127};
+  static inline int	fixed(T v)
+			{
+			  return((v < -65536)? -65536:
+			         (v > 65536)? 65536: (int )v);
+			}
+};
+
+template <>
+struct CompositorTraits<WlzUByte>
+{
+  enum {frac = 0, bias = 0};
+  static inline int	fixed(WlzUByte v)
+			{
+			  return(v);
+			}
+};
+
+template <>
+struct CompositorTraits<float>
+{
+  enum {frac = 7, bias = 255 * 64};
+  static inline int	fixed(float v)
+			{
+			  return((v < -65536.0f)? -65536 * 128:
+			         (v > 65536.0f)? 65536 * 128:
+				 (int )floor(v * 128.0f + 0.5f));
+			}
+};
+
+template <>
+struct CompositorTraits<double>
+{
+  enum {frac = 7, bias = 255 * 64};
+  static inline int	fixed(double v)
+			{
+			  return((v < -65536.0)? -65536 * 128:
+			         (v > 65536.0)? 65536 * 128:
+				 (int )floor(v * 128.0 + 0.5));
+			}
+};
+
+/*!
+* \return	Blended channel value.
+* \ingroup	WlzIIPServer
+* \brief	Blends a single colour channel.
+* \param	w			Weight of the value.
+* \param	v			Fixed point value.
+* \param	o			Constant offset.
+* \param	a1			Weight of the buffer.
+* \param	c			Buffer value.
+*/
+template <typename T, int MODE>
+static inline WlzUByte CompositorChannel(int w, int v, int o, int a1,
+					 unsigned int c)
+{
+  long long	n;
+  const long long d = 255LL << CompositorTraits<T>::frac;
+
+  n = ((long long )w * v) + CompositorTraits<T>::bias +
+      ((long long )((MODE == COMPOSITOR_BLEND)? o + (a1 * c): o) <<
+       CompositorTraits<T>::frac);
+  return((n <= 0)? 0: (n >= (d << 8))? 255: (WlzUByte )(n / d));
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Blends a run of grey values into a tile buffer with NCH
+* 		channels.
+* \param	knl			Kernel parameters.
+* \param	dst			Tile buffer.
+* \param	src			Grey values.
+* \param	n			Number of pixels.
+*/
+template <typename T, int NCH, int MODE>
+static void	CompositorGrey(const CompositorKernel *knl, WlzUByte *dst,
+			       const void *src, int n)
+{
+  const T	*s = (const T *)src;
+  const int	nCol = (NCH < 3)? 1: 3,
+  		a1 = knl->a1;
+
+  for(int i = 0; i < n; ++i)
+  {
+    int		v;
+
+    v = CompositorTraits<T>::fixed(s[i]);
+    for(int k = 0; k < nCol; ++k)
+    {
+      if((MODE == COMPOSITOR_COPY) && (CompositorTraits<T>::frac == 0) &&
+         (CompositorTraits<T>::bias == 0))
+      {
+	dst[k] = (WlzUByte )v;
+      }
+      else
+      {
+	dst[k] = CompositorChannel<T, MODE>(knl->wgt[k], v, knl->off[k],
+					    a1, dst[k]);
+      }
+    }
+    if(nCol != NCH)
+    {
+      dst[nCol] = (MODE == COMPOSITOR_BLEND)?
+		  (knl->off[nCol] + a1 * dst[nCol]) / 255:
+		  knl->off[nCol] / 255;
+    }
+    dst += NCH;
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Blends a run of RGBA values into a tile buffer with NCH
+* 		channels. Only the red component is used for 1 and 2
+* 		channel buffers, as for grey maps which give RGBA values
+* 		with equal components.
+* \param	knl			Kernel parameters.
+* \param	dst			Tile buffer.
+* \param	src			RGBA values.
+* \param	n			Number of pixels.
+*/
+template <int NCH, int MODE>
+static void	CompositorRGBA(const CompositorKernel *knl, WlzUByte *dst,
+			       const void *src, int n)
+{
+  const unsigned int *s = (const unsigned int *)src;
+  const int	nCol = (NCH < 3)? 1: 3,
+  		a1 = knl->a1;
+
+  for(int i = 0; i < n; ++i)
+  {
+    unsigned int v[3];
+
+    v[0] = WLZ_RGBA_RED_GET(s[i]);
+    v[1] = WLZ_RGBA_GREEN_GET(s[i]);
+    v[2] = WLZ_RGBA_BLUE_GET(s[i]);
+    for(int k = 0; k < nCol; ++k)
+    {
+      if(MODE == COMPOSITOR_COPY)
+      {
+        dst[k] = (WlzUByte )v[k];
+      }
+      else
+      {
+	dst[k] = CompositorChannel<WlzUByte, MODE>(knl->wgt[k], v[k],
+						   knl->off[k], a1, dst[k]);
+      }
+    }
+    if(nCol != NCH)
+    {
+      dst[nCol] = (MODE == COMPOSITOR_BLEND)?
+	          (knl->off[nCol] + a1 * dst[nCol]) / 255:
+	          knl->off[nCol] / 255;
+    }
+    dst += NCH;
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Blends a run of domain pixels, ie the selector's colour,
+* 		into a tile buffer with NCH channels.
+* \param	knl			Kernel parameters.
+* \param	dst			Tile buffer.
+* \param	src			Unused.
+* \param	n			Number of pixels.
+*/
+template <int NCH, int MODE>
+static void	CompositorDomain(const CompositorKernel *knl, WlzUByte *dst,
+				 const void *src, int n)
+{
+  const int	a1 = knl->a1;
+
+  if(MODE == COMPOSITOR_BLEND)
+  {
+    for(int i = 0; i < n; ++i)
+    {
+      for(int k = 0; k < NCH; ++k)
+      {
+	dst[k] = (knl->off[k] + a1 * dst[k]) / 255;
+      }
+      dst += NCH;
+    }
+  }
+  else if(n > 0)
+  {
+    unsigned char pix[4];
+
+    for(int k = 0; k < NCH; ++k)
+    {
+      pix[k] = knl->off[k] / 255;
+    }
+    Compositor::fill(dst, n, pix, NCH);
+  }
+}
+
+#ifdef COMPOSITOR_SIMD
+/*!
+* \ingroup	WlzIIPServer
+* \brief	SSE4.1 kernel for byte sources and domains. Each 16 pixel
+* 		step blends NCH chunks of 16 bytes, the source bytes for
+* 		each chunk being gathered with a shuffle. Remaining pixels
+* 		are blended by the scalar kernel.
+* \param	knl			Kernel parameters.
+* \param	dst			Tile buffer.
+* \param	src			Byte or RGBA values, NULL for a
+* 					domain.
+* \param	n			Number of pixels.
+*/
+template <int NCH, int SRCSTRIDE>
+__attribute__((target("sse4.1")))
+static void	CompositorBytesSSE41(const CompositorKernel *knl, WlzUByte *dst,
+				     const void *src, int n)
+{
+  int		p = 0;
+  const WlzUByte *s = (const WlzUByte *)src;
+  const __m128i	one = _mm_set1_epi16(1),
+  		a1 = _mm_set1_epi16((short )(knl->a1)),
+		zero = _mm_setzero_si128();
+
+  for(; p + knl->simdNeed <= n; p += 16)
+  {
+    for(int j = 0; j < NCH; ++j)
+    {
+      __m128i	c,
+      		v,
+		x0,
+		x1;
+      WlzUByte	*d = dst + (p * NCH) + (16 * j);
+
+      c = _mm_loadu_si128((const __m128i *)d);
+      v = (s)? _mm_shuffle_epi8(
+                 _mm_loadu_si128((const __m128i *)
+		                 (s + (p * SRCSTRIDE) + knl->simdSrc[j])),
+                 _mm_loadu_si128((const __m128i *)(knl->simdShf[j]))):
+	       zero;
+      x0 = _mm_add_epi16(
+	     _mm_add_epi16(
+	       _mm_mullo_epi16(_mm_cvtepu8_epi16(v),
+			       _mm_loadu_si128((const __m128i *)
+			                       (knl->simdWgt[j] + 0))),
+	       _mm_loadu_si128((const __m128i *)(knl->simdOff[j] + 0))),
+	     _mm_mullo_epi16(_mm_cvtepu8_epi16(c), a1));
+      x1 = _mm_add_epi16(
+	     _mm_add_epi16(
+	       _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero),
+			       _mm_loadu_si128((const __m128i *)
+			                       (knl->simdWgt[j] + 8))),
+	       _mm_loadu_si128((const __m128i *)(knl->simdOff[j] + 8))),
+	     _mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), a1));
+      /* Exact division by 255 for values up to 65025. */
+      x0 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x0, one),
+					_mm_srli_epi16(x0, 8)), 8);
+      x1 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x1, one),
+					_mm_srli_epi16(x1, 8)), 8);
+      _mm_storeu_si128((__m128i *)d, _mm_packus_epi16(x0, x1));
+    }
+  }
+  if(p < n)
+  {
+    (*(knl->tail))(knl, dst + (p * NCH),
+                       (s)? s + (p * SRCSTRIDE): NULL, n - p);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	AVX2 kernel for byte sources and domains, as for
+* 		CompositorBytesSSE41() but blending each 16 byte chunk
+* 		in a single 256 bit register.
+* \param	knl			Kernel parameters.
+* \param	dst			Tile buffer.
+* \param	src			Byte or RGBA values, NULL for a
+* 					domain.
+* \param	n			Number of pixels.
+*/
+template <int NCH, int SRCSTRIDE>
+__attribute__((target("avx2")))
+static void	CompositorBytesAVX2(const CompositorKernel *knl, WlzUByte *dst,
+				    const void *src, int n)
+{
+  int		p = 0;
+  const WlzUByte *s = (const WlzUByte *)src;
+  const __m256i	one = _mm256_set1_epi16(1),
+  		a1 = _mm256_set1_epi16((short )(knl->a1));
+
+  for(; p + knl->simdNeed <= n; p += 16)
+  {
+    for(int j = 0; j < NCH; ++j)
+    {
+      __m128i	v;
+      __m256i	x;
+      WlzUByte	*d = dst + (p * NCH) + (16 * j);
+
+      v = (s)? _mm_shuffle_epi8(
+                 _mm_loadu_si128((const __m128i *)
+		                 (s + (p * SRCSTRIDE) + knl->simdSrc[j])),
+                 _mm_loadu_si128((const __m128i *)(knl->simdShf[j]))):
+	       _mm_setzero_si128();
+      x = _mm256_add_epi16(
+	    _mm256_add_epi16(
+	      _mm256_mullo_epi16(_mm256_cvtepu8_epi16(v),
+	      			 _mm256_loadu_si256((const __m256i *)
+				                    (knl->simdWgt[j]))),
+	      _mm256_loadu_si256((const __m256i *)(knl->simdOff[j]))),
+	    _mm256_mullo_epi16(
+	      _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)d)), a1));
+      x = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, one),
+					     _mm256_srli_epi16(x, 8)), 8);
+      x = _mm256_permute4x64_epi64(_mm256_packus_epi16(x, x), 0x08);
+      _mm_storeu_si128((__m128i *)d, _mm256_castsi256_si128(x));
+    }
+  }
+  if(p < n)
+  {
+    (*(knl->tail))(knl, dst + (p * NCH),
+                       (s)? s + (p * SRCSTRIDE): NULL, n - p);
+  }
+}
+#endif /* COMPOSITOR_SIMD */
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Copies a run of byte values into a single channel tile
+* 		buffer.
+* \param	knl			Kernel parameters.
+* \param	dst			Tile buffer.
+* \param	src			Byte values.
+* \param	n			Number of pixels.
+*/
+static void	CompositorCopy(const CompositorKernel *knl, WlzUByte *dst,
+			       const void *src, int n)
+{
+  (void )memcpy(dst, src, n);
+}
+
+/*!
+* \return	Scalar kernel or NULL if the grey type is not supported.
+* \ingroup	WlzIIPServer
+* \brief	Selects the scalar value kernel for the given grey type.
+* \param	gType			Grey type.
+*/
+template <int NCH, int MODE>
+static CompositorFn CompositorSelectValue(WlzGreyType gType)
+{
+  CompositorFn	fn = NULL;
+
+  switch(gType)
+  {
+    case WLZ_GREY_LONG:
+      fn = &CompositorGrey<WlzLong, NCH, MODE>;
+      break;
+    case WLZ_GREY_INT:
+      fn = &CompositorGrey<int, NCH, MODE>;
+      break;
+    case WLZ_GREY_SHORT:
+      fn = &CompositorGrey<short, NCH, MODE>;
+      break;
+    case WLZ_GREY_UBYTE:
+      fn = ((NCH == 1) && (MODE == COMPOSITOR_COPY))?
+           &CompositorCopy: &CompositorGrey<WlzUByte, NCH, MODE>;
+      break;
+    case WLZ_GREY_FLOAT:
+      fn = &CompositorGrey<float, NCH, MODE>;
+      break;
+    case WLZ_GREY_DOUBLE:
+      fn = &CompositorGrey<double, NCH, MODE>;
+      break;
+    case WLZ_GREY_RGBA:
+      fn = &CompositorRGBA<NCH, MODE>;
+      break;
+    default:
+      break;
+  }
+  return(fn);
+}
+
+/*!
+* \return	Scalar kernel or NULL if the grey type is not supported.
+* \ingroup	WlzIIPServer
+* \brief	Selects a scalar kernel for the given blending mode.
+* \param	mode			Blending mode.
+* \param	gType			Grey type, WLZ_GREY_ERROR for the
+* 					domain kernel.
+*/
+template <int NCH>
+static CompositorFn CompositorSelectMode(CompositorMode mode,
+					 WlzGreyType gType)
+{
+  CompositorFn	fn = NULL;
+
+  switch(mode)
+  {
+    case COMPOSITOR_COPY:
+      fn = (gType == WLZ_GREY_ERROR)?
+           &CompositorDomain<NCH, COMPOSITOR_COPY>:
+	   CompositorSelectValue<NCH, COMPOSITOR_COPY>(gType);
+      break;
+    case COMPOSITOR_OPAQUE:
+      fn = (gType == WLZ_GREY_ERROR)?
+           &CompositorDomain<NCH, COMPOSITOR_OPAQUE>:
+	   CompositorSelectValue<NCH, COMPOSITOR_OPAQUE>(gType);
+      break;
+    case COMPOSITOR_BLEND:
+      fn = (gType == WLZ_GREY_ERROR)?
+           &CompositorDomain<NCH, COMPOSITOR_BLEND>:
+	   CompositorSelectValue<NCH, COMPOSITOR_BLEND>(gType);
+      break;
+  }
+  return(fn);
+}
+
+/*!
+* \return	Scalar kernel or NULL if not supported.
+* \ingroup	WlzIIPServer
+* \brief	Selects a scalar kernel for the given number of channels.
+* \param	nCh			Number of channels.
+* \param	mode			Blending mode.
+* \param	gType			Grey type, WLZ_GREY_ERROR for the
+* 					domain kernel.
+*/
+static CompositorFn CompositorSelect(int nCh, CompositorMode mode,
+				     WlzGreyType gType)
+{
+  CompositorFn	fn = NULL;
+
+  switch(nCh)
+  {
+    case 1:
+      fn = CompositorSelectMode<1>(mode, gType);
+      break;
+    case 2:
+      fn = CompositorSelectMode<2>(mode, gType);
+      break;
+    case 3:
+      fn = CompositorSelectMode<3>(mode, gType);
+      break;
+    case 4:
+      fn = CompositorSelectMode<4>(mode, gType);
+      break;
+    default:
+      break;
+  }
+  return(fn);
+}
+
+#ifdef COMPOSITOR_SIMD
+/*!
+* \return	SIMD kernel or NULL if not supported.
+* \ingroup	WlzIIPServer
+* \brief	Selects a SIMD kernel for the given source stride and
+* 		number of channels.
+* \param	level			SIMD level, 1 for SSE4.1 and 2 for
+* 					AVX2.
+* \param	nCh			Number of channels.
+*/
+template <int SRCSTRIDE>
+static CompositorFn CompositorSelectSimd(int level, int nCh)
+{
+  CompositorFn	fn = NULL;
+
+  switch(nCh)
+  {
+    case 1:
+      fn = (level > 1)? &CompositorBytesAVX2<1, SRCSTRIDE>:
+                        &CompositorBytesSSE41<1, SRCSTRIDE>;
+      break;
+    case 2:
+      fn = (level > 1)? &CompositorBytesAVX2<2, SRCSTRIDE>:
+                        &CompositorBytesSSE41<2, SRCSTRIDE>;
+      break;
+    case 3:
+      fn = (level > 1)? &CompositorBytesAVX2<3, SRCSTRIDE>:
+                        &CompositorBytesSSE41<3, SRCSTRIDE>;
+      break;
+    case 4:
+      fn = (level > 1)? &CompositorBytesAVX2<4, SRCSTRIDE>:
+                        &CompositorBytesSSE41<4, SRCSTRIDE>;
+      break;
+    default:
+      break;
+  }
+  return(fn);
+}
+#endif /* COMPOSITOR_SIMD */
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructs a compositor for the given number of channels
+* 		and selector colour.
+* \param	nCh			Number of channels in the tile
+* 					buffer (1-4).
+* \param	selected		True if the colour and alpha are
+* 					given by a selector, otherwise values
+* 					are copied and opaque.
+* \param	r			Selector red (0-255).
+* \param	g			Selector green (0-255).
+* \param	b			Selector blue (0-255).
+* \param	a			Selector alpha (0-255).
+*/
+Compositor::Compositor(int nCh, bool selected,
+		       unsigned int r, unsigned int g,
+		       unsigned int b, unsigned int a)
+{
+  int		k,
+  		nCol,
+		level;
+  unsigned int	col[3];
+  CompositorKernel valKnl;
+
+  if(!selected)
+  {
+    r = g = b = a = 255;
+  }
+  a = WLZ_MIN(a, 255);
+  col[0] = WLZ_MIN(r, 255);
+  col[1] = WLZ_MIN(g, 255);
+  col[2] = WLZ_MIN(b, 255);
+  mode = (!selected)? COMPOSITOR_COPY:
+         (a == 255)? COMPOSITOR_OPAQUE: COMPOSITOR_BLEND;
+  nCol = (nCh < 3)? 1: 3;
+  (void )memset(&domainKnl, 0, sizeof(CompositorKernel));
+  (void )memset(&valKnl, 0, sizeof(CompositorKernel));
+  domainKnl.nCh = valKnl.nCh = nCh;
+  domainKnl.a1 = valKnl.a1 = 255 - a;
+  for(k = 0; k < nCol; ++k)
+  {
+    domainKnl.off[k] = col[k] * a;
+    valKnl.wgt[k] = (col[k] * a) / 255;
+  }
+  if(nCh > nCol)
+  {
+    domainKnl.off[nCol] = valKnl.off[nCol] = 255 * a;
+  }
+  domainKnl.fn = domainKnl.tail = CompositorSelect(nCh, mode, WLZ_GREY_ERROR);
+  for(k = 0; k < WLZ_GREY_ERROR; ++k)
+  {
+    valueKnl[k] = valKnl;
+    valueKnl[k].fn = valueKnl[k].tail =
+    		     CompositorSelect(nCh, mode, (WlzGreyType )k);
+  }
+  if((level = simdLevel()) > 0)
+  {
+#ifdef COMPOSITOR_SIMD
+    CompositorKernel *knl;
+
+    /* Opaque domains are filled and single channel byte values are
+     * copied, these don't need SIMD kernels. */
+    if((mode == COMPOSITOR_BLEND) && setSimd(&domainKnl, 0, 0))
+    {
+      domainKnl.fn = CompositorSelectSimd<1>(level, nCh);
+    }
+    knl = valueKnl + WLZ_GREY_UBYTE;
+    if(!((mode == COMPOSITOR_COPY) && (nCh == 1)) && setSimd(knl, 1, 1))
+    {
+      knl->fn = CompositorSelectSimd<1>(level, nCh);
+    }
+    knl = valueKnl + WLZ_GREY_RGBA;
+    if((knl->fn != NULL) && setSimd(knl, 4, 3))
+    {
+      knl->fn = CompositorSelectSimd<4>(level, nCh);
+    }
+#endif /* COMPOSITOR_SIMD */
+  }
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Maps a run of grey values through the given compiled image
+* 		map and blends the mapped values into the tile buffer.
+* 		The values are mapped a block at a time into a small
+* 		buffer on the stack which is then blended by the byte or
+* 		RGBA kernel, so avoiding a mapped copy of the object.
+* \param	dst			First pixel of the run in the tile
+* 					buffer.
+* \param	src			Grey values of the run.
+* \param	gType			Grey type of the values, which must
+* 					not be WLZ_GREY_RGBA.
+* \param	n			Number of pixels in the run.
+* \param	lut			Compiled image map.
+*/
+WlzErrorNum	Compositor::mapped(WlzUByte *dst, WlzGreyP src,
+				   WlzGreyType gType, int n,
+				   const ImageMapLUT *lut) const
+{
+  int		gSz;
+  unsigned int	buf[256];
+  const CompositorKernel *knl;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  knl = valueKnl + ((lut->isRGBA())? WLZ_GREY_RGBA: WLZ_GREY_UBYTE);
+  if((knl->fn == NULL) || ((gSz = WlzGreySize(gType)) <= 0))
+  {
+    errNum = WLZ_ERR_GREY_TYPE;
+  }
+  while((errNum == WLZ_ERR_NONE) && (n > 0))
+  {
+    int		m;
+
+    m = WLZ_MIN(n, 256);
+    if(!lut->apply(src, gType, m, buf))
+    {
+      errNum = WLZ_ERR_GREY_TYPE;
+    }
+    else
+    {
+      (*(knl->fn))(knl, dst, buf, m);
+      dst += m * knl->nCh;
+      src.ubp += m * gSz;
+      n -= m;
+    }
+  }
+  return(errNum);
+}
+
+/*!
+* \return	True if the SIMD parameters could be set.
+* \ingroup	WlzIIPServer
+* \brief	Sets the SIMD parameters of a kernel, expanding the
+* 		per channel weights and offsets to each byte of the
+* 		chunks of a 16 pixel step and computing the shuffles
+* 		which gather the source bytes of each chunk. This fails
+* 		if the source bytes of a chunk do not fit in a single
+* 		16 byte load.
+* \param	knl			Kernel with the scalar parameters set.
+* \param	srcStride		Number of bytes per source pixel, 0
+* 					for a domain.
+* \param	nSrcCh			Number of source channels which are
+* 					used.
+*/
+bool		Compositor::setSimd(CompositorKernel *knl, int srcStride,
+				    int nSrcCh)
+{
+  int		j,
+  		nCh;
+  bool		ok = true;
+
+  nCh = knl->nCh;
+  knl->simdNeed = 16;
+  for(j = 0; ok && (j < nCh); ++j)
+  {
+    int		b,
+    		pj;
+
+    pj = (16 * j) / nCh;
+    knl->simdSrc[j] = pj * srcStride;
+    if(srcStride > 0)
+    {
+      knl->simdNeed = WLZ_MAX(knl->simdNeed,
+      			      pj + ((16 + srcStride - 1) / srcStride));
+    }
+    for(b = 0; b < 16; ++b)
+    {
+      int	i,
+      		c,
+		idx;
+
+      i = (16 * j) + b;
+      c = i % nCh;
+      idx = (((i / nCh) - pj) * srcStride) + ((nSrcCh > 1)? c: 0);
+      if((c < nSrcCh) || (nSrcCh == 1))
+      {
+	if(idx > 15)
+	{
+	  ok = false;
+	  break;
+	}
+        knl->simdShf[j][b] = (unsigned char )idx;
+      }
+      else
+      {
+	/* Channel not taken from the source, its weight is zero. */
+        knl->simdShf[j][b] = 0x80;
+      }
+      knl->simdWgt[j][b] = (unsigned short )(knl->wgt[c]);
+      knl->simdOff[j][b] = (unsigned short )(knl->off[c]);
+    }
+  }
+  return(ok);
+}
+
+/*!
+* \return	0 if no SIMD kernels are available, 1 for SSE4.1 and 2
+* 		for AVX2.
+* \ingroup	WlzIIPServer
+* \brief	Determines (once) which SIMD kernels this CPU supports.
+*/
+int		Compositor::simdLevel()
+{
+  static int	level = -1;
+
+  if(level < 0)
+  {
+    int		l = 0;
+
+#ifdef COMPOSITOR_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+      l = 2;
+    }
+    else if(__builtin_cpu_supports("sse4.1"))
+    {
+      l = 1;
+    }
+#endif /* COMPOSITOR_SIMD */
+    level = l;
+  }
+  return(level);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Fills a buffer with copies of a single pixel, doubling
+* 		the filled region with each copy.
+* \param	buf			Buffer to fill.
+* \param	nPix			Number of pixels in the buffer.
+* \param	pix			The pixel.
+* \param	nCh			Number of channels (bytes) per pixel.
+*/
+void		Compositor::fill(WlzUByte *buf, size_t nPix,
+				 const WlzUByte *pix, int nCh)
+{
+  size_t	done,
+  		total;
+
+  total = nPix * nCh;
+  if(total > 0)
+  {
+    (void )memcpy(buf, pix, nCh);
+    done = nCh;
+    while(done < total)
+    {
+      size_t	n;
+
+      n = WLZ_MIN(done, total - done);
+      (void )memcpy(buf + done, buf, n);
+      done += n;
+    }
+  }
+}
@@ -0,0 +1,193 @@
+#ifndef _COMPOSITOR_H
+#define _COMPOSITOR_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _Compositor_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         Compositor.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Compositing of rendered Woolz objects into tile buffers.
+* \ingroup	WlzIIPServer
+*/
+
+#include <Wlz.h>
+
+class ImageMapLUT;
+
+/*!
+* \brief	Alpha blending modes of a compositor.
+* \ingroup	WlzIIPServer
+*/
+typedef enum _CompositorMode
+{
+  COMPOSITOR_COPY	= 0,		/*!< No selector, values are copied
+  					     to the colour channels and the
+					     alpha channel is opaque. */
+  COMPOSITOR_OPAQUE,			/*!< Opaque selector, the tile buffer
+  					     is overwritten. */
+  COMPOSITOR_BLEND			/*!< Translucent selector, blended
+  					     with the tile buffer. */
+} CompositorMode;
+
+struct _CompositorKernel;
+
+/*!
+* \brief	Compositing kernel which blends a run of n source values
+* 		into the tile buffer.
+* \ingroup	WlzIIPServer
+*/
+typedef void (*CompositorFn)(const struct _CompositorKernel *knl,
+			     WlzUByte *dst, const void *src, int n);
+
+/*!
+* \brief	A compositing kernel together with its parameters. The
+* 		blended value of each channel is
+* 		(wgt * v + off + a1 * c) / 255 where v is the source value
+* 		and c the tile buffer value. The SIMD parameters are
+* 		expanded to a byte (or 16 bit word) for each byte of
+* 		the NCH chunks of 16 bytes blended per 16 pixel step.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _CompositorKernel
+{
+  CompositorFn		fn;			/*!< The kernel. */
+  CompositorFn		tail;			/*!< Scalar kernel used for
+  						     pixels which remain after
+						     the SIMD steps. */
+  int			nCh;			/*!< Number of channels. */
+  int			a1;			/*!< Weight of the tile
+  						     buffer, 255 - alpha. */
+  int			wgt[4];			/*!< Weight of the source
+  						     value for each channel,
+						     0-255. */
+  int			off[4];			/*!< Constant added for each
+  						     channel, 0-65025. */
+  int			simdNeed;		/*!< Number of source pixels
+  						     read by a 16 pixel SIMD
+						     step. */
+  int			simdSrc[4];		/*!< Per chunk source byte
+  						     offsets. */
+  unsigned char		simdShf[4][16];		/*!< Per chunk source
+  						     shuffles. */
+  unsigned short	simdWgt[4][16];		/*!< Per chunk weights. */
+  unsigned short	simdOff[4][16];		/*!< Per chunk offsets. */
+} CompositorKernel;
+
+/*!
+* \brief	Composites the intervals of rendered objects into a tile
+* 		buffer with 1 (grey), 2 (grey, alpha), 3 (RGB) or 4 (RGBA)
+* 		interleaved byte channels.
+*
+* 		Each source pixel is blended with the buffer in the
+* 		Porter Duff src over dst fashion using the (optional)
+* 		selector's colour and alpha. Grey values are spread over
+* 		the colour channels of 3 and 4 channel buffers.
+*
+* 		The kernels are specialised at compile time for the
+* 		source grey type, number of channels and blending mode,
+* 		use integer fixed point arithmetic and are chosen once
+* 		when the compositor is constructed. Byte and RGBA
+* 		sources and domains use SSE4.1 or AVX2 kernels when the
+* 		CPU supports them.
+* \ingroup	WlzIIPServer
+*/
+class Compositor
+{
+  private:
+    CompositorMode	mode;			/*!< Blending mode. */
+    CompositorKernel	domainKnl;		/*!< Domain kernel. */
+    CompositorKernel	valueKnl[WLZ_GREY_ERROR]; /*!< Value kernels for
+    						     each grey type. */
+
+    bool		setSimd(CompositorKernel *knl, int srcStride,
+    				int nSrcCh);
+
+  public:
+    			Compositor(int nCh, bool selected,
+				   unsigned int r, unsigned int g,
+				   unsigned int b, unsigned int a);
+    /*!
+    * \return	The blending mode.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the blending mode.
+    */
+    CompositorMode	getMode() const
+			{
+			  return(mode);
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Blends a run of domain pixels, ie the selector's colour,
+    * 		into the tile buffer.
+    * \param	dst			First pixel of the run in the tile
+    * 					buffer.
+    * \param	n			Number of pixels in the run.
+    */
+    void		domain(WlzUByte *dst, int n) const
+			{
+			  (*(domainKnl.fn))(&domainKnl, dst, NULL, n);
+			}
+    /*!
+    * \return	Woolz error code.
+    * \ingroup	WlzIIPServer
+    * \brief	Blends a run of grey values into the tile buffer.
+    * \param	dst			First pixel of the run in the tile
+    * 					buffer.
+    * \param	src			Grey values of the run.
+    * \param	gType			Grey type of the values.
+    * \param	n			Number of pixels in the run.
+    */
+    WlzErrorNum		values(WlzUByte *dst, WlzGreyP src,
+			       WlzGreyType gType, int n) const
+			{
+			  WlzErrorNum errNum = WLZ_ERR_GREY_TYPE;
+
+			  if((gType >= 0) && (gType < WLZ_GREY_ERROR) &&
+			     (valueKnl[gType].fn != NULL))
+			  {
+			    (*(valueKnl[gType].fn))(valueKnl + gType, dst,
+			    			    src.v, n);
+			    errNum = WLZ_ERR_NONE;
+			  }
+			  return(errNum);
+			}
+    WlzErrorNum		mapped(WlzUByte *dst, WlzGreyP src,
+			       WlzGreyType gType, int n,
+			       const ImageMapLUT *lut) const;
+    static void		fill(WlzUByte *buf, size_t nPix,
+    			     const WlzUByte *pix, int nCh);
+    static int		simdLevel();
+};
+
+#endif
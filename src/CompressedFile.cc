@@ -0,0 +1,545 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _CompressedFile_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         CompressedFile.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	In process decompression of gzip and zstd compressed files
+* 		through a stdio stream, so that compressed Woolz objects
+* 		can be read by WlzEffReadObj() without running gunzip.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "Log.h"
+#include "CompressedFile.h"
+
+using namespace std;
+
+const size_t	CompressedFile::bufSize = 1 << 20;
+
+/*!
+* \struct	_CompressedFileMem
+* \ingroup	WlzIIPServer
+* \brief	Cookie for a stream reading from a malloc'd buffer which
+* 		is freed when the stream is closed.
+*/
+typedef struct _CompressedFileMem
+{
+  unsigned char		*buf;		/*!< Decompressed data. */
+  size_t		len;		/*!< Bytes of data. */
+  size_t		pos;		/*!< Read position. */
+} CompressedFileMem;
+
+/*!
+* \struct	_CompressedFileBlock
+* \ingroup	WlzIIPServer
+* \brief	A BGZF block.
+*/
+typedef struct _CompressedFileBlock
+{
+  size_t		inOff;		/*!< Offset of the deflate data. */
+  size_t		inLen;		/*!< Bytes of deflate data. */
+  size_t		outOff;		/*!< Offset of the inflated data. */
+  size_t		outLen;		/*!< Bytes of inflated data. */
+  unsigned int		crc;		/*!< CRC32 of the inflated data. */
+} CompressedFileBlock;
+
+/*!
+* \struct	_CompressedFileJob
+* \ingroup	WlzIIPServer
+* \brief	Work shared by the threads inflating BGZF blocks.
+*/
+typedef struct _CompressedFileJob
+{
+  const unsigned char	*in;		/*!< The mapped file. */
+  unsigned char		*out;		/*!< The output buffer. */
+  std::vector<CompressedFileBlock> *blocks; /*!< The blocks. */
+  volatile long		next;		/*!< Next block to inflate. */
+  volatile int		failed;		/*!< Set if any block failed. */
+} CompressedFileJob;
+
+static ssize_t	CompressedFileGzRead(void *cookie, char *buf, size_t n)
+{
+  int		r;
+
+  r = gzread((gzFile )cookie, buf, (unsigned int )n);
+  return((r < 0)? -1: r);
+}
+
+static int	CompressedFileGzClose(void *cookie)
+{
+  return((gzclose((gzFile )cookie) == Z_OK)? 0: EOF);
+}
+
+static ssize_t	CompressedFileMemRead(void *cookie, char *buf, size_t n)
+{
+  CompressedFileMem *m = (CompressedFileMem *)cookie;
+
+  if(n > m->len - m->pos)
+  {
+    n = m->len - m->pos;
+  }
+  memcpy(buf, m->buf + m->pos, n);
+  m->pos += n;
+  return(n);
+}
+
+static int	CompressedFileMemClose(void *cookie)
+{
+  CompressedFileMem *m = (CompressedFileMem *)cookie;
+
+  free(m->buf);
+  free(m);
+  return(0);
+}
+
+/*!
+* \return	Null.
+* \ingroup	WlzIIPServer
+* \brief	Thread which inflates BGZF blocks until none are left.
+* \param	data			The shared job.
+*/
+static void	*CompressedFileInflateThread(void *data)
+{
+  CompressedFileJob *job = (CompressedFileJob *)data;
+  long		nBlk = (long )(job->blocks->size());
+  z_stream	strm;
+
+  memset(&strm, 0, sizeof(strm));
+  if(inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+  {
+    job->failed = 1;
+    return(NULL);
+  }
+  for(;;)
+  {
+    long	i;
+    CompressedFileBlock *b;
+
+    i = __sync_fetch_and_add(&(job->next), 1);
+    if((i >= nBlk) || job->failed)
+    {
+      break;
+    }
+    b = &((*(job->blocks))[i]);
+    (void )inflateReset(&strm);
+    strm.next_in = (Bytef *)(job->in + b->inOff);
+    strm.avail_in = (uInt )(b->inLen);
+    strm.next_out = (Bytef *)(job->out + b->outOff);
+    strm.avail_out = (uInt )(b->outLen);
+    if((inflate(&strm, Z_FINISH) != Z_STREAM_END) ||
+       (strm.avail_out != 0) ||
+       (crc32(crc32(0L, Z_NULL, 0), job->out + b->outOff,
+              (uInt )(b->outLen)) != b->crc))
+    {
+      job->failed = 1;
+    }
+  }
+  (void )inflateEnd(&strm);
+  return(NULL);
+}
+
+/*!
+* \return	Stream to read the decompressed data from.
+* \ingroup	WlzIIPServer
+* \brief	Opens a file which may be compressed.
+* \param	path			Path of the file.
+* \param	nThreads		Maximum number of threads to use
+* 					for parallel decompression.
+* \exception	An error string if the file can not be opened or is not
+* 		a valid compressed file.
+*/
+FILE		*CompressedFile::open(const std::string &path, int nThreads)
+		throw(std::string)
+{
+  int		fd;
+  ssize_t	n;
+  unsigned char	magic[4];
+  FILE		*fp = NULL;
+
+  if((fd = ::open(path.c_str(), O_RDONLY)) < 0)
+  {
+    throw string("CompressedFile: failed to open " + path);
+  }
+  n = pread(fd, magic, 4, 0);
+  if((n >= 2) && (magic[0] == 0x1f) && (magic[1] == 0x8b))
+  {
+    if(nThreads > 1)
+    {
+      try
+      {
+	fp = openBgzf(fd, nThreads);
+      }
+      catch(const string &)
+      {
+        (void )close(fd);
+	throw;
+      }
+    }
+    if(fp == NULL)
+    {
+      fp = openGzip(fd);
+    }
+    else
+    {
+      (void )close(fd);
+    }
+  }
+#ifdef HAVE_ZSTD
+  else if((n == 4) && (magic[0] == 0x28) && (magic[1] == 0xb5) &&
+          (magic[2] == 0x2f) && (magic[3] == 0xfd))
+  {
+    fp = openZstd(fd);
+  }
+#endif
+  else
+  {
+    if((fp = fdopen(fd, "r")) != NULL)
+    {
+      (void )setvbuf(fp, NULL, _IOFBF, bufSize);
+    }
+    else
+    {
+      (void )close(fd);
+    }
+  }
+  if(fp == NULL)
+  {
+    throw string("CompressedFile: failed to read " + path);
+  }
+  return(fp);
+}
+
+/*!
+* \return	Stream or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Opens a stream which reads through zlib. Concatenated gzip
+* 		members are read as a single stream. On success the file
+* 		descriptor is owned by the stream, otherwise it is closed.
+* \param	fd			Open file descriptor.
+*/
+FILE		*CompressedFile::openGzip(int fd)
+{
+  gzFile	gz;
+  FILE		*fp = NULL;
+  cookie_io_functions_t io;
+
+  (void )lseek(fd, 0, SEEK_SET);
+  if((gz = gzdopen(fd, "rb")) != NULL)
+  {
+    (void )gzbuffer(gz, (unsigned int )bufSize);
+    io.read = CompressedFileGzRead;
+    io.write = NULL;
+    io.seek = NULL;
+    io.close = CompressedFileGzClose;
+    if((fp = fopencookie(gz, "r", io)) == NULL)
+    {
+      (void )gzclose(gz);
+    }
+    else
+    {
+      (void )setvbuf(fp, NULL, _IOFBF, bufSize);
+    }
+  }
+  else
+  {
+    (void )close(fd);
+  }
+  return(fp);
+}
+
+/*!
+* \return	Stream or NULL if the file is not in BGZF format.
+* \ingroup	WlzIIPServer
+* \brief	Decompresses a BGZF file using several threads into memory
+* 		and opens a stream reading from the decompressed data.
+* 		BGZF files are sequences of gzip members each of which has
+* 		its compressed size in an extra field, so the members can
+* 		be located without decompressing them and then inflated
+* 		independently. The file descriptor is not closed.
+* \param	fd			Open file descriptor.
+* \param	nThreads		Maximum number of threads.
+* \exception	An error string if the file is BGZF but can not be
+* 		decompressed.
+*/
+FILE		*CompressedFile::openBgzf(int fd, int nThreads)
+		throw(std::string)
+{
+  int		i;
+  size_t	off = 0,
+  		outLen = 0;
+  struct stat	st;
+  const unsigned char *in;
+  unsigned char	*out = NULL;
+  FILE		*fp = NULL;
+  std::vector<CompressedFileBlock> blocks;
+  CompressedFileJob job;
+
+  if((fstat(fd, &st) != 0) || (st.st_size < 28))
+  {
+    return(NULL);
+  }
+  in = (const unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+  				   fd, 0);
+  if(in == (const unsigned char *)MAP_FAILED)
+  {
+    return(NULL);
+  }
+  // Walk the members, giving up if any is not a BGZF block.
+  while(off < (size_t )(st.st_size))
+  {
+    const unsigned char *h = in + off;
+    size_t	bSz,
+    		xLen;
+    CompressedFileBlock b;
+
+    if((off + 28 > (size_t )(st.st_size)) ||
+       (h[0] != 0x1f) || (h[1] != 0x8b) || (h[2] != 8) ||
+       ((h[3] & 0x04) == 0) ||
+       ((xLen = h[10] | (h[11] << 8)) < 6) ||
+       (h[12] != 'B') || (h[13] != 'C') || (h[14] != 2) || (h[15] != 0))
+    {
+      break;
+    }
+    bSz = (h[16] | (h[17] << 8)) + 1;
+    if((bSz < 12 + xLen + 8) || (off + bSz > (size_t )(st.st_size)))
+    {
+      break;
+    }
+    b.inOff = off + 12 + xLen;
+    b.inLen = bSz - 12 - xLen - 8;
+    b.crc = h[bSz - 8] | (h[bSz - 7] << 8) | (h[bSz - 6] << 16) |
+	    ((unsigned int )(h[bSz - 5]) << 24);
+    b.outLen = h[bSz - 4] | (h[bSz - 3] << 8) | (h[bSz - 2] << 16) |
+	       ((size_t )(h[bSz - 1]) << 24);
+    b.outOff = outLen;
+    outLen += b.outLen;
+    blocks.push_back(b);
+    off += bSz;
+  }
+  if((off != (size_t )(st.st_size)) || blocks.empty())
+  {
+    (void )munmap((void *)in, st.st_size);
+    return(NULL);
+  }
+  if((out = (unsigned char *)malloc((outLen > 0)? outLen: 1)) == NULL)
+  {
+    (void )munmap((void *)in, st.st_size);
+    throw string("CompressedFile: failed to allocate decompression buffer.");
+  }
+  job.in = in;
+  job.out = out;
+  job.blocks = &blocks;
+  job.next = 0;
+  job.failed = 0;
+  if((size_t )nThreads > blocks.size())
+  {
+    nThreads = (int )(blocks.size());
+  }
+  {
+    std::vector<pthread_t> thr(nThreads);
+
+    for(i = 1; i < nThreads; ++i)
+    {
+      if(pthread_create(&(thr[i]), NULL, CompressedFileInflateThread,
+                        &job) != 0)
+      {
+	break;
+      }
+    }
+    nThreads = i;
+    (void )CompressedFileInflateThread(&job);
+    for(i = 1; i < nThreads; ++i)
+    {
+      (void )pthread_join(thr[i], NULL);
+    }
+  }
+  (void )munmap((void *)in, st.st_size);
+  if(job.failed)
+  {
+    free(out);
+    throw string("CompressedFile: corrupt BGZF data.");
+  }
+  else
+  {
+    CompressedFileMem *m;
+    cookie_io_functions_t io;
+
+    if((m = (CompressedFileMem *)malloc(sizeof(CompressedFileMem))) != NULL)
+    {
+      m->buf = out;
+      m->len = outLen;
+      m->pos = 0;
+      io.read = CompressedFileMemRead;
+      io.write = NULL;
+      io.seek = NULL;
+      io.close = CompressedFileMemClose;
+      fp = fopencookie(m, "r", io);
+    }
+    if(fp == NULL)
+    {
+      free(m);
+      free(out);
+      throw string("CompressedFile: failed to open decompressed stream.");
+    }
+    LOG_INFO("CompressedFile: inflated " << blocks.size() <<
+             " BGZF blocks to " << outLen << " bytes using " <<
+	     nThreads << " threads");
+  }
+  return(fp);
+}
+
+#ifdef HAVE_ZSTD
+/*!
+* \struct	_CompressedFileZstd
+* \ingroup	WlzIIPServer
+* \brief	Cookie for a stream reading through libzstd.
+*/
+typedef struct _CompressedFileZstd
+{
+  int			fd;		/*!< Compressed file. */
+  ZSTD_DStream		*strm;		/*!< Decompression stream. */
+  ZSTD_inBuffer		in;		/*!< Input buffer. */
+  int			eof;		/*!< Set at end of file. */
+} CompressedFileZstd;
+
+static ssize_t	CompressedFileZstdRead(void *cookie, char *buf, size_t n)
+{
+  CompressedFileZstd *z = (CompressedFileZstd *)cookie;
+  ZSTD_outBuffer out;
+
+  out.dst = buf;
+  out.size = n;
+  out.pos = 0;
+  while(out.pos == 0)
+  {
+    size_t	r;
+
+    if((z->in.pos == z->in.size) && !(z->eof))
+    {
+      ssize_t	nr;
+
+      nr = read(z->fd, (void *)(z->in.src), CompressedFile::bufSize);
+      if(nr < 0)
+      {
+        return(-1);
+      }
+      z->eof = (nr == 0);
+      z->in.size = nr;
+      z->in.pos = 0;
+    }
+    if((z->in.pos == z->in.size) && z->eof)
+    {
+      break;
+    }
+    r = ZSTD_decompressStream(z->strm, &out, &(z->in));
+    if(ZSTD_isError(r))
+    {
+      return(-1);
+    }
+  }
+  return(out.pos);
+}
+
+static int	CompressedFileZstdClose(void *cookie)
+{
+  CompressedFileZstd *z = (CompressedFileZstd *)cookie;
+
+  (void )ZSTD_freeDStream(z->strm);
+  (void )close(z->fd);
+  free((void *)(z->in.src));
+  free(z);
+  return(0);
+}
+
+/*!
+* \return	Stream or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Opens a stream which reads through libzstd. On success the
+* 		file descriptor is owned by the stream, otherwise it is
+* 		closed.
+* \param	fd			Open file descriptor.
+*/
+FILE		*CompressedFile::openZstd(int fd)
+{
+  CompressedFileZstd *z;
+  FILE		*fp = NULL;
+
+  if((z = (CompressedFileZstd *)calloc(1, sizeof(CompressedFileZstd))) != NULL)
+  {
+    z->fd = fd;
+    z->in.src = malloc(bufSize);
+    z->strm = ZSTD_createDStream();
+    if(z->in.src && z->strm && !ZSTD_isError(ZSTD_initDStream(z->strm)))
+    {
+      cookie_io_functions_t io;
+
+      io.read = CompressedFileZstdRead;
+      io.write = NULL;
+      io.seek = NULL;
+      io.close = CompressedFileZstdClose;
+      if((fp = fopencookie(z, "r", io)) != NULL)
+      {
+        (void )setvbuf(fp, NULL, _IOFBF, bufSize);
+      }
+    }
+    if(fp == NULL)
+    {
+      if(z->strm)
+      {
+        (void )ZSTD_freeDStream(z->strm);
+      }
+      free((void *)(z->in.src));
+      free(z);
+    }
+  }
+  if(fp == NULL)
+  {
+    (void )close(fd);
+  }
+  return(fp);
+}
+#endif
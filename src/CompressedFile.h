@@ -0,0 +1,74 @@
+#ifndef _COMPRESSEDFILE_H
+#define _COMPRESSEDFILE_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _CompressedFile_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         CompressedFile.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	In process decompression of gzip and zstd compressed files
+* 		through a stdio stream, so that compressed Woolz objects
+* 		can be read by WlzEffReadObj() without running gunzip.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdio>
+#include <string>
+
+/*!
+* \brief	Opens files which may be compressed, returning a stdio stream
+* 		from which the decompressed data are read. The compression
+* 		is found from the file's magic number: gzip files are read
+* 		through zlib and (if the server was built with libzstd)
+* 		zstd files through libzstd, all other files are read as
+* 		they are. Gzip files in the blocked gzip format (BGZF, as
+* 		written by bgzip) may be decompressed in parallel. The
+* 		stream is closed using fclose().
+* \ingroup	WlzIIPServer
+*/
+class CompressedFile
+{
+  public:
+    static FILE		*open(const std::string &path, int nThreads)
+    			throw(std::string);
+    static FILE		*openGzip(int fd);
+    static FILE		*openBgzf(int fd, int nThreads)
+    			throw(std::string);
+#ifdef HAVE_ZSTD
+    static FILE		*openZstd(int fd);
+#endif
+    static const size_t	bufSize;		/*!< Size of read buffers. */
+};
+
+#endif
@@ -0,0 +1,728 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _DiskCache_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         DiskCache.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Persistent second level tile cache held in a directory on
+* 		local disk.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/file.h>
+#include "Log.h"
+#include "DiskCache.h"
+
+using namespace std;
+
+#define DISK_CACHE_MAGIC	(0x574c5a44)	/* "WLZD" */
+#define DISK_CACHE_VERSION	(1)
+#define DISK_CACHE_DIRS		(256)
+#define DISK_CACHE_SLOTS	(64)	/* Maximum processes which may have
+					   a directory from the same name. */
+#define DISK_CACHE_BLOCK	(4096)	/* Size granularity of files. */
+#define DISK_CACHE_TOUCH	(60)	/* Seconds between touches of a
+					   file's modification time. */
+#define DISK_CACHE_TMP_AGE	(600)	/* Seconds after which temporary
+					   files are treated as left by a
+					   crash. */
+
+/*!
+* \struct	_DiskCacheHeader
+* \ingroup	WlzIIPServer
+* \brief	Header at the start of each tile file, followed by the
+* 		tile's data.
+*/
+typedef struct _DiskCacheHeader
+{
+  unsigned int		magic;			/*!< DISK_CACHE_MAGIC. */
+  unsigned int		version;		/*!< DISK_CACHE_VERSION. */
+  TileKey		key;			/*!< Key of the tile. */
+  int			width;			/*!< Tile width. */
+  int			height;			/*!< Tile height. */
+  int			channels;		/*!< Tile channels. */
+  int			bpc;			/*!< Bits per channel. */
+  int			widthPadding;		/*!< Tile width padding. */
+  int			dataLength;		/*!< Bytes of tile data. */
+  Fingerprint		checksum;		/*!< Fingerprint of the
+  						     tile data. */
+} DiskCacheHeader;
+
+/*!
+* \struct	_DiskCacheFile
+* \ingroup	WlzIIPServer
+* \brief	A tile file found when recovering the cache.
+*/
+typedef struct _DiskCacheFile
+{
+  time_t		mtime;			/*!< Modification time. */
+  Fingerprint		name;			/*!< File name. */
+  unsigned long		size;			/*!< File size in bytes. */
+
+  bool			operator<(const struct _DiskCacheFile &f) const
+			{
+			  return(mtime < f.mtime);
+			}
+} DiskCacheFile;
+
+DiskCache		*DiskCache::cache = NULL;
+
+/*!
+* \return	True if all the bytes were read.
+* \ingroup	WlzIIPServer
+* \brief	Reads the given number of bytes, retrying after signals
+* 		and short reads.
+* \param	fd			File descriptor.
+* \param	buf			Buffer for the bytes.
+* \param	n			Number of bytes.
+*/
+static bool	DiskCacheRead(int fd, void *buf, size_t n)
+{
+  unsigned char	*p = (unsigned char *)buf;
+
+  while(n > 0)
+  {
+    ssize_t	r = read(fd, p, n);
+
+    if(r < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      return(false);
+    }
+    if(r == 0)
+    {
+      return(false);
+    }
+    p += r;
+    n -= r;
+  }
+  return(true);
+}
+
+/*!
+* \return	True if all the bytes were written.
+* \ingroup	WlzIIPServer
+* \brief	Writes the given number of bytes, retrying after signals
+* 		and short writes.
+* \param	fd			File descriptor.
+* \param	buf			The bytes.
+* \param	n			Number of bytes.
+*/
+static bool	DiskCacheWrite(int fd, const void *buf, size_t n)
+{
+  const unsigned char *p = (const unsigned char *)buf;
+
+  while(n > 0)
+  {
+    ssize_t	r = ::write(fd, p, n);
+
+    if(r < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      return(false);
+    }
+    p += r;
+    n -= r;
+  }
+  return(true);
+}
+
+/*!
+* \return	Size of a file rounded up to a whole number of blocks.
+* \ingroup	WlzIIPServer
+* \brief	Gives the disk space used by a file of the given size.
+* \param	n			File size in bytes.
+*/
+static unsigned long DiskCacheBlocks(unsigned long n)
+{
+  return((n + DISK_CACHE_BLOCK - 1) / DISK_CACHE_BLOCK * DISK_CACHE_BLOCK);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructor which creates the cache's directories and
+* 		starts the writer thread, which first recovers the tiles
+* 		already in the directory. The directory is locked for
+* 		the life of the cache, as its index and size are only
+* 		known to this process. If the given directory is locked
+* 		by another process then the first unlocked of d-1, d-2,
+* 		... is used instead.
+* \param	d			Cache directory.
+* \param	max			Maximum size in MB.
+* \param	q			Maximum number of tiles waiting to
+* 					be written.
+*/
+DiskCache::DiskCache(const string &d, float max, int q)
+throw(string)
+{
+  string	base = d;
+
+  while((base.length() > 1) && (base[base.length() - 1] == '/'))
+  {
+    base.erase(base.length() - 1);
+  }
+  maxSize = (unsigned long long )(max * 1024000.0);
+  curSize = 0;
+  maxQueue = (q > 0)? q: 1;
+  stopping = false;
+  hasWriter = false;
+  nHits = nMisses = nWritten = nDropped = nEvicted = 0;
+  lockFd = -1;
+  for(int i = 0; (lockFd < 0) && (i < DISK_CACHE_SLOTS); ++i)
+  {
+    int		fd;
+    char	sfx[16];
+
+    dir = base;
+    if(i > 0)
+    {
+      (void )sprintf(sfx, "-%d", i);
+      dir += sfx;
+    }
+    if((mkdir(dir.c_str(), 0755) != 0) && (errno != EEXIST))
+    {
+      throw string("DiskCache :: Unable to create " + dir + ": " +
+		   strerror(errno));
+    }
+    if((fd = open((dir + "/lock").c_str(), O_RDWR | O_CREAT, 0644)) < 0)
+    {
+      throw string("DiskCache :: Unable to open " + dir + "/lock: " +
+		   strerror(errno));
+    }
+    if(flock(fd, LOCK_EX | LOCK_NB) == 0)
+    {
+      lockFd = fd;
+    }
+    else
+    {
+      (void )close(fd);
+    }
+  }
+  if(lockFd < 0)
+  {
+    throw string("DiskCache :: " + base +
+                 " and its alternatives are in use by other processes");
+  }
+  for(int i = 0; i < DISK_CACHE_DIRS; ++i)
+  {
+    char	sub[8];
+
+    (void )sprintf(sub, "/%02x", i);
+    if((mkdir((dir + sub).c_str(), 0755) != 0) && (errno != EEXIST))
+    {
+      (void )close(lockFd);
+      throw string("DiskCache :: Unable to create " + dir + sub + ": " +
+                   strerror(errno));
+    }
+  }
+  pthread_cond_init(&queueCnd, NULL);
+  if(pthread_create(&writer, NULL, writerThread, this) != 0)
+  {
+    pthread_cond_destroy(&queueCnd);
+    (void )close(lockFd);
+    throw string("DiskCache :: Unable to create writer thread");
+  }
+  hasWriter = true;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Destructor which stops the writer thread once it has
+* 		written the tiles queued, then unlocks the directory.
+*/
+DiskCache::~DiskCache()
+{
+  mtx.lock();
+  stopping = true;
+  pthread_cond_broadcast(&queueCnd);
+  mtx.unlock();
+  if(hasWriter)
+  {
+    (void )pthread_join(writer, NULL);
+  }
+  pthread_cond_destroy(&queueCnd);
+  (void )close(lockFd);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Creates the process's disk cache if it does not yet exist.
+* 		This should be called before any requests are processed.
+* 		Errors are logged and leave the process without a disk
+* 		cache.
+* \param	d			Cache directory, no cache is created
+* 					if this is empty.
+* \param	max			Maximum size in MB, no cache is
+* 					created if this is not positive.
+* \param	q			Maximum number of tiles waiting to
+* 					be written.
+*/
+void		DiskCache::start(const string &d, float max, int q)
+{
+  if((cache == NULL) && !d.empty() && (max > 0.0f))
+  {
+    try
+    {
+      cache = new DiskCache(d, max, q);
+      LOG_NOTICE("Using disk tile cache " << cache->dir << " of " <<
+                 max << "MB");
+    }
+    catch(const string &error)
+    {
+      LOG_ERROR(error);
+      cache = NULL;
+    }
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Stops and destroys the process's disk cache. This should
+* 		only be called once no requests are being processed.
+*/
+void		DiskCache::stop()
+{
+  delete cache;
+  cache = NULL;
+}
+
+/*!
+* \return	File name fingerprint.
+* \ingroup	WlzIIPServer
+* \brief	Gives the fingerprint which names the file of a tile.
+* \param	key			Tile key.
+*/
+Fingerprint	DiskCache::nameOf(const TileKey &key)
+{
+  FingerprintBuilder fb;
+
+  fb.add(key.fingerprint);
+  fb.add(key.resolution);
+  fb.add(key.tileNum);
+  fb.add(key.hSequence);
+  fb.add(key.vSequence);
+  fb.add(key.compressionType);
+  fb.add(key.quality);
+  return(fb.get());
+}
+
+/*!
+* \return	Path of the file.
+* \ingroup	WlzIIPServer
+* \brief	Gives the path of the file with the given name, which is
+* 		in the sub-directory given by its first byte.
+* \param	name			File name fingerprint.
+*/
+string		DiskCache::pathOf(const Fingerprint &name) const
+{
+  char		buf[64];
+
+  (void )sprintf(buf, "/%02x/%016llx%016llx", (unsigned int )(name.hi >> 56),
+                 name.hi, name.lo);
+  return(dir + buf);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Makes a tile file the most recently used, adding it to the
+* 		index if it is not already there (eg it was written by
+* 		another process), and trims the cache.
+* \param	name			File name fingerprint.
+* \param	size			File size in bytes.
+*/
+void		DiskCache::use(const Fingerprint &name, unsigned long size)
+{
+  MutexLock	lock(mtx);
+  Index::iterator it = index.find(name);
+
+  size = DiskCacheBlocks(size);
+  if(it != index.end())
+  {
+    lru.splice(lru.begin(), lru, it->second.lru);
+    curSize -= it->second.size;
+    it->second.size = size;
+  }
+  else
+  {
+    Entry	ent;
+
+    lru.push_front(name);
+    ent.size = size;
+    ent.lru = lru.begin();
+    index[name] = ent;
+  }
+  curSize += size;
+  trim();
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Removes a tile file from the index, eg because it has been
+* 		removed by another process or found to be corrupt.
+* \param	name			File name fingerprint.
+*/
+void		DiskCache::forget(const Fingerprint &name)
+{
+  MutexLock	lock(mtx);
+  Index::iterator it = index.find(name);
+
+  if(it != index.end())
+  {
+    curSize -= it->second.size;
+    lru.erase(it->second.lru);
+    index.erase(it);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Removes the least recently used tile files until the cache
+* 		is within its maximum size. The mutex must be held.
+*/
+void		DiskCache::trim()
+{
+  while((curSize > maxSize) && !lru.empty())
+  {
+    Index::iterator it = index.find(lru.back());
+
+    (void )unlink(pathOf(lru.back()).c_str());
+    curSize -= it->second.size;
+    index.erase(it);
+    lru.pop_back();
+    ++nEvicted;
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Recovers the index from the files in the cache directory,
+* 		removing temporary files left by a crash, and trims the
+* 		cache to its maximum size.
+*/
+void		DiskCache::recover()
+{
+  time_t	now = time(NULL);
+  vector<DiskCacheFile> files;
+
+  for(int i = 0; i < DISK_CACHE_DIRS; ++i)
+  {
+    char	sub[8];
+    string	path;
+    DIR		*dP;
+    struct dirent *dE;
+
+    (void )sprintf(sub, "/%02x", i);
+    path = dir + sub;
+    if((dP = opendir(path.c_str())) == NULL)
+    {
+      continue;
+    }
+    while((dE = readdir(dP)) != NULL)
+    {
+      struct stat st;
+      string	file = path + "/" + dE->d_name;
+      size_t	len = strlen(dE->d_name);
+
+      if((dE->d_name[0] == '.') || (stat(file.c_str(), &st) != 0) ||
+         !S_ISREG(st.st_mode))
+      {
+        continue;
+      }
+      if(len == 32)
+      {
+	DiskCacheFile f;
+	char	hi[17];
+
+	(void )strncpy(hi, dE->d_name, 16);
+	hi[16] = '\0';
+	f.mtime = st.st_mtime;
+	f.name.hi = strtoull(hi, NULL, 16);
+	f.name.lo = strtoull(dE->d_name + 16, NULL, 16);
+	f.size = DiskCacheBlocks(st.st_size);
+	files.push_back(f);
+      }
+      else if((len > 4) && (strcmp(dE->d_name + len - 4, ".tmp") == 0) &&
+              (now - st.st_mtime > DISK_CACHE_TMP_AGE))
+      {
+        (void )unlink(file.c_str());
+      }
+    }
+    (void )closedir(dP);
+  }
+  // Add the files oldest first, so that the most recently used are at
+  // the front of the LRU list.
+  std::sort(files.begin(), files.end());
+  {
+    MutexLock	lock(mtx);
+
+    for(vector<DiskCacheFile>::iterator it = files.begin();
+        it != files.end(); ++it)
+    {
+      if(index.find(it->name) == index.end())
+      {
+	Entry	ent;
+
+	lru.push_front(it->name);
+	ent.size = it->size;
+	ent.lru = lru.begin();
+	index[it->name] = ent;
+	curSize += it->size;
+      }
+    }
+    trim();
+    LOG_NOTICE("DiskCache :: Recovered " << index.size() << " tiles, " <<
+               (curSize / 1024000.0) << "MB");
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Writes a tile to a temporary file and renames it to its
+* 		name, so that the file appears complete or not at all.
+* \param	tile			Tile to write.
+*/
+void		DiskCache::write(const RawTile &tile)
+{
+  int		fd;
+  bool		ok;
+  char		sfx[32];
+  DiskCacheHeader hdr;
+  FingerprintBuilder fb;
+  Fingerprint	name;
+  string	path,
+  		tmp;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = DISK_CACHE_MAGIC;
+  hdr.version = DISK_CACHE_VERSION;
+  hdr.key = TileKey::ofTile(tile);
+  hdr.width = tile.width;
+  hdr.height = tile.height;
+  hdr.channels = tile.channels;
+  hdr.bpc = tile.bpc;
+  hdr.widthPadding = tile.width_padding;
+  hdr.dataLength = tile.dataLength;
+  fb.add(tile.data, tile.dataLength);
+  hdr.checksum = fb.get();
+  name = nameOf(hdr.key);
+  path = pathOf(name);
+  (void )sprintf(sfx, ".%d.tmp", (int )getpid());
+  tmp = path + sfx;
+  if((fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+  {
+    LOG_WARN("DiskCache :: Unable to create " << tmp << ": " <<
+             strerror(errno));
+    return;
+  }
+  ok = DiskCacheWrite(fd, &hdr, sizeof(hdr)) &&
+       DiskCacheWrite(fd, tile.data, tile.dataLength);
+  ok = (close(fd) == 0) && ok;
+  if(ok && (rename(tmp.c_str(), path.c_str()) == 0))
+  {
+    ++nWritten;
+    use(name, sizeof(hdr) + tile.dataLength);
+  }
+  else
+  {
+    LOG_WARN("DiskCache :: Unable to write " << path << ": " <<
+             strerror(errno));
+    (void )unlink(tmp.c_str());
+  }
+}
+
+/*!
+* \return	Always NULL.
+* \ingroup	WlzIIPServer
+* \brief	Writer thread which recovers the index and then writes the
+* 		queued tiles until the cache is stopped.
+* \param	arg			The cache.
+*/
+void		*DiskCache::writerThread(void *arg)
+{
+  DiskCache	*dc = (DiskCache *)arg;
+
+  dc->recover();
+  dc->mtx.lock();
+  for(;;)
+  {
+    while(!dc->stopping && dc->queue.empty())
+    {
+      pthread_cond_wait(&(dc->queueCnd), dc->mtx.native());
+    }
+    if(dc->queue.empty())
+    {
+      break;
+    }
+    RawTile	tile = dc->queue.front();
+
+    dc->queue.pop_front();
+    dc->mtx.unlock();
+    dc->write(tile);
+    dc->mtx.lock();
+  }
+  dc->mtx.unlock();
+  return(NULL);
+}
+
+/*!
+* \return	True if the tile was found.
+* \ingroup	WlzIIPServer
+* \brief	Reads a tile from the cache. A file which fails its checks
+* 		is removed.
+* \param	key			Tile key.
+* \param	tile			Set to the tile if it was found.
+*/
+bool		DiskCache::getTile(const TileKey &key, RawTile &tile)
+{
+  int		fd;
+  bool		ok = false;
+  void		*data = NULL;
+  struct stat	st;
+  DiskCacheHeader hdr;
+  Fingerprint	name = nameOf(key);
+  string	path = pathOf(name);
+
+  if((fd = open(path.c_str(), O_RDONLY)) < 0)
+  {
+    if(errno == ENOENT)
+    {
+      forget(name);
+    }
+    __sync_add_and_fetch(&nMisses, 1);
+    return(false);
+  }
+  if((fstat(fd, &st) == 0) && ((size_t )st.st_size > sizeof(hdr)) &&
+     DiskCacheRead(fd, &hdr, sizeof(hdr)) &&
+     (hdr.magic == DISK_CACHE_MAGIC) &&
+     (hdr.version == DISK_CACHE_VERSION) &&
+     (hdr.key == key) && (hdr.dataLength > 0) &&
+     ((size_t )st.st_size == sizeof(hdr) + hdr.dataLength) &&
+     ((data = malloc(hdr.dataLength)) != NULL) &&
+     DiskCacheRead(fd, data, hdr.dataLength))
+  {
+    FingerprintBuilder fb;
+
+    fb.add(data, hdr.dataLength);
+    ok = (fb.get() == hdr.checksum);
+  }
+  if(ok)
+  {
+    // Touch the file so its use is remembered across restarts
+    if(time(NULL) - st.st_mtime > DISK_CACHE_TOUCH)
+    {
+      (void )futimes(fd, NULL);
+    }
+    (void )close(fd);
+    tile.adopt(data, hdr.dataLength);
+    tile.filename.clear();
+    tile.fingerprint = key.fingerprint;
+    tile.resolution = key.resolution;
+    tile.tileNum = key.tileNum;
+    tile.hSequence = key.hSequence;
+    tile.vSequence = key.vSequence;
+    tile.compressionType = (CompressionType )(key.compressionType);
+    tile.quality = key.quality;
+    tile.width = hdr.width;
+    tile.height = hdr.height;
+    tile.channels = hdr.channels;
+    tile.bpc = hdr.bpc;
+    tile.width_padding = hdr.widthPadding;
+    use(name, st.st_size);
+    __sync_add_and_fetch(&nHits, 1);
+  }
+  else
+  {
+    (void )close(fd);
+    free(data);
+    LOG_WARN("DiskCache :: Removing invalid tile file " << path);
+    (void )unlink(path.c_str());
+    forget(name);
+    __sync_add_and_fetch(&nMisses, 1);
+  }
+  return(ok);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Queues a tile to be written to the cache. The tile's data is
+* 		shared rather than copied, and the tile is dropped if the
+* 		queue is full.
+* \param	tile			Tile to write.
+*/
+void		DiskCache::insert(const RawTile &tile)
+{
+  if((tile.data == NULL) || (tile.dataLength <= 0))
+  {
+    return;
+  }
+  MutexLock	lock(mtx);
+
+  if((int )queue.size() >= maxQueue)
+  {
+    ++nDropped;
+    return;
+  }
+  queue.push_back(tile);
+  pthread_cond_signal(&queueCnd);
+}
+
+/*!
+* \return	Size of the cache in MB.
+* \ingroup	WlzIIPServer
+* \brief	Gives the size of the tile files in the index.
+*/
+float		DiskCache::getMemorySize()
+{
+  MutexLock	lock(mtx);
+
+  return((float )(curSize / 1024000.0));
+}
@@ -0,0 +1,217 @@
+#ifndef _DISKCACHE_H
+#define _DISKCACHE_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _DiskCache_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         DiskCache.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Persistent second level tile cache held in a directory on
+* 		local disk, so that rendered tiles survive server restarts.
+* \ingroup	WlzIIPServer
+*/
+
+#include <list>
+#include <map>
+#include <deque>
+#include <string>
+#include <pthread.h>
+#include "RawTile.h"
+#include "TileKey.h"
+#include "Mutex.h"
+
+/*!
+* \brief	Tile cache in a directory on local disk.
+*
+* 		Each tile is held in its own file, named by a fingerprint
+* 		of its key, in one of 256 sub-directories. Keys should
+* 		include the identity (modification time and size) of the
+* 		file from which the tile was rendered, so that tiles of a
+* 		replaced file are never found. A file holds a header with
+* 		the tile's key, fields and a checksum of its data, then
+* 		the data. Files are written to a temporary name and then
+* 		renamed, so a file is either complete or absent, and
+* 		files which are truncated or corrupt (eg after a crash)
+* 		fail their checks when read and are removed.
+*
+* 		The directory itself is the index: when the cache is
+* 		started it is scanned to recover the tiles, most recently
+* 		used first by their file modification times which are
+* 		touched (at most once a minute) when they are read. The
+* 		total size of the files is then kept within a maximum by
+* 		removing the least recently used. Tiles are written by a
+* 		single background thread from a bounded queue, so filling
+* 		the cache never delays a request.
+*
+* 		There is a single cache for the process, created by
+* 		start(). The index and total size are only known to the
+* 		process, so a directory must not be shared: it is locked
+* 		while in use, and a process which finds it locked uses
+* 		the first free of dir-1, dir-2, ... instead. Each
+* 		directory is bounded separately, so several processes
+* 		may use up to their number times the maximum size.
+* \ingroup	WlzIIPServer
+*/
+class DiskCache
+{
+  private:
+    /*!
+    * \brief	Ordering of fingerprints for the index.
+    */
+    struct FingerprintLess
+    {
+      bool		operator()(const Fingerprint &a,
+      				   const Fingerprint &b) const
+      			{
+			  return((a.hi < b.hi) ||
+			         ((a.hi == b.hi) && (a.lo < b.lo)));
+			}
+    };
+    /*!
+    * \brief	Index entry of a tile file.
+    */
+    struct Entry
+    {
+      unsigned long	size;			/*!< File size in bytes. */
+      std::list<Fingerprint>::iterator lru;	/*!< Position in the LRU
+      						     list. */
+    };
+    typedef std::map<Fingerprint, Entry, FingerprintLess> Index;
+
+    std::string		dir;			/*!< Cache directory. */
+    int			lockFd;			/*!< Descriptor holding the
+    						     directory's lock. */
+    unsigned long long	maxSize;		/*!< Maximum size in bytes. */
+    unsigned long long	curSize;		/*!< Size of the files in the
+    						     index. */
+    int			maxQueue;		/*!< Maximum tiles waiting to
+    						     be written. */
+    Index		index;			/*!< Tile files by name. */
+    std::list<Fingerprint> lru;			/*!< Tile file names, most
+    						     recently used first. */
+    std::deque<RawTile>	queue;			/*!< Tiles to be written. */
+    bool		stopping;		/*!< Set to stop the writer. */
+    Mutex		mtx;			/*!< Protects the index, LRU
+    						     list and queue. */
+    pthread_cond_t	queueCnd;		/*!< Signalled on insert. */
+    pthread_t		writer;			/*!< Writer thread. */
+    bool		hasWriter;		/*!< Writer thread created. */
+    volatile unsigned long nHits;		/*!< Tiles found. */
+    volatile unsigned long nMisses;		/*!< Tiles not found. */
+    volatile unsigned long nWritten;		/*!< Tiles written. */
+    volatile unsigned long nDropped;		/*!< Tiles not written as the
+    						     queue was full. */
+    volatile unsigned long nEvicted;		/*!< Tile files removed to
+    						     bound the size. */
+    static DiskCache	*cache;			/*!< The process's cache. */
+
+    			DiskCache(const std::string &d, float max, int q)
+			throw(std::string);
+			~DiskCache();
+    static Fingerprint	nameOf(const TileKey &key);
+    std::string		pathOf(const Fingerprint &name) const;
+    void		recover();
+    void		write(const RawTile &tile);
+    void		use(const Fingerprint &name, unsigned long size);
+    void		forget(const Fingerprint &name);
+    void		trim();
+    static void		*writerThread(void *arg);
+    			DiskCache(const DiskCache &);
+    DiskCache		&operator=(const DiskCache &);
+
+  public:
+    static void		start(const std::string &d, float max, int q);
+    static void		stop();
+    /*!
+    * \return	The process's disk cache or NULL if there is none.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the disk cache.
+    */
+    static DiskCache	*get()
+    			{
+			  return(cache);
+			}
+    bool		getTile(const TileKey &key, RawTile &tile);
+    void		insert(const RawTile &tile);
+    /*!
+    * \return	Number of tiles found.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the number of tiles found in the cache.
+    */
+    unsigned long	getHitCount() const
+    			{
+			  return(nHits);
+			}
+    /*!
+    * \return	Number of tiles not found.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the number of tiles not found in the cache.
+    */
+    unsigned long	getMissCount() const
+    			{
+			  return(nMisses);
+			}
+    /*!
+    * \return	Number of tiles written.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the number of tiles written to the cache.
+    */
+    unsigned long	getWrittenCount() const
+    			{
+			  return(nWritten);
+			}
+    /*!
+    * \return	Number of tiles dropped.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the number of tiles which were not written because
+    * 		the write queue was full.
+    */
+    unsigned long	getDroppedCount() const
+    			{
+			  return(nDropped);
+			}
+    /*!
+    * \return	Number of tile files removed.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the number of tile files removed to keep the cache
+    * 		within its maximum size.
+    */
+    unsigned long	getEvictedCount() const
+    			{
+			  return(nEvicted);
+			}
+    float		getMemorySize();
+};
+
+#endif
@@ -56,6 +56,29 @@ static char _Environment_h[] = "University of Edinburgh $Id$";
 #define JPEG_QUALITY 		75
 #define MAX_CVT 		5000
 #define COMPLEX_SELECTION       0
+#define WORKER_THREADS		1
+#define RENDER_THREADS		0 /* tile render pool, 0 renders serially */
+#define CVT_PIPELINE_DEPTH	2 /* strips queued for encoding, 0 disables */
+#define CVT_JPEG_BAND_HEIGHT	0 /* rows per parallel JPEG band, 0 disables */
+#define PREFETCH_RADIUS		0 /* tiles prefetched ahead, 0 disables */
+#define PREFETCH_QUEUE		64 /* maximum pending prefetches */
+#define TILE_CACHE_SHM		""
+#define TILE_CACHE_POLICY	"lru" /* lru, slru or tinylfu */
+#define DISK_CACHE_DIR		"" /* per process disk tile cache, "" disables */
+#define DISK_CACHE_SIZE		1024 /* in MB per process */
+#define DISK_CACHE_QUEUE	256 /* maximum tiles waiting to be written */
+#define WLZ_SECTION_CACHE_SIZE	0 /* in MB, 0 disables */
+#define WLZ_SECTION_CACHE_BAND	0 /* in tile rows, 0 for whole sections */
+#define WLZ_DECOMPRESS_THREADS	1
+#define WLZ_PRELOAD		""
+#define WLZ_PRELOAD_THREADS	4
+#define WLZ_MIP_LEVELS		0 /* downsampled levels, 0 disables */
+#define WLZ_FILE_CHECK_INTERVAL	10 /* seconds between checks for replaced files */
+#define TRACE_SAMPLE		0 /* trace 1 in N requests, 0 disables */
+#define TRACE_BUFFER		8192 /* spans kept per thread */
+#define TRACE_DIR		"/tmp"
+#define SLOW_REQUEST_MS		0 /* log requests slower than this, 0 disables */
+#define SLOW_REQUEST_LOG	"/tmp/iipsrv-slow.log"
 
 #define WLZ_TILE_HEIGHT		100
 #define WLZ_TILE_WIDTH 		100
@@ -242,6 +265,232 @@ class Environment {
     return complex_selection;
   }
 
+  static std::string getTileCacheShm(){
+    char* envpara = getenv( "TILE_CACHE_SHM" );
+    std::string tile_cache_shm;
+    if(envpara){
+      tile_cache_shm = std::string( envpara );
+    }
+    else tile_cache_shm = TILE_CACHE_SHM;
+    return tile_cache_shm;
+  }
+
+  static std::string getTileCachePolicy(){
+    char* envpara = getenv( "TILE_CACHE_POLICY" );
+    std::string tile_cache_policy;
+    if(envpara){
+      tile_cache_policy = std::string( envpara );
+    }
+    else tile_cache_policy = TILE_CACHE_POLICY;
+    return tile_cache_policy;
+  }
+
+  static std::string getDiskCacheDir(){
+    char* envpara = getenv( "DISK_CACHE_DIR" );
+    std::string disk_cache_dir;
+    if(envpara){
+      disk_cache_dir = std::string( envpara );
+    }
+    else disk_cache_dir = DISK_CACHE_DIR;
+    return disk_cache_dir;
+  }
+
+  static float getDiskCacheSize(){
+    float disk_cache_size = DISK_CACHE_SIZE;
+    char* envpara = getenv( "DISK_CACHE_SIZE" );
+    if( envpara ){
+      disk_cache_size = atof( envpara );
+    }
+    return disk_cache_size;
+  }
+
+  static int getDiskCacheQueue(){
+    int queue = DISK_CACHE_QUEUE;
+    char* envpara = getenv( "DISK_CACHE_QUEUE" );
+    if(envpara){
+      queue = atoi(envpara);
+      if(queue < 1) queue = 1;
+    }
+    return queue;
+  }
+
+  static int getWlzSectionCacheSize(){
+    int section_cache_size = WLZ_SECTION_CACHE_SIZE;
+    char* envpara = getenv( "WLZ_SECTION_CACHE_SIZE" );
+    if(envpara){
+      section_cache_size = atoi(envpara);
+      if(section_cache_size < 0) section_cache_size = 0;
+    }
+    return section_cache_size;
+  }
+
+  static int getWlzSectionCacheBand(){
+    int section_cache_band = WLZ_SECTION_CACHE_BAND;
+    char* envpara = getenv( "WLZ_SECTION_CACHE_BAND" );
+    if(envpara){
+      section_cache_band = atoi(envpara);
+      if(section_cache_band < 0) section_cache_band = 0;
+    }
+    return section_cache_band;
+  }
+
+  static std::string getWlzPreload(){
+    char* envpara = getenv( "WLZ_PRELOAD" );
+    std::string wlz_preload;
+    if(envpara){
+      wlz_preload = std::string( envpara );
+    }
+    else wlz_preload = WLZ_PRELOAD;
+    return wlz_preload;
+  }
+
+  static int getWlzPreloadThreads(){
+    int preload_threads = WLZ_PRELOAD_THREADS;
+    char* envpara = getenv( "WLZ_PRELOAD_THREADS" );
+    if(envpara){
+      preload_threads = atoi(envpara);
+      if(preload_threads < 1) preload_threads = 1;
+    }
+    return preload_threads;
+  }
+
+  static int getWlzMipLevels(){
+    int mip_levels = WLZ_MIP_LEVELS;
+    char* envpara = getenv( "WLZ_MIP_LEVELS" );
+    if(envpara){
+      mip_levels = atoi(envpara);
+      if(mip_levels < 0) mip_levels = 0;
+      else if(mip_levels > 8) mip_levels = 8;
+    }
+    return mip_levels;
+  }
+
+  static int getWlzFileCheckInterval(){
+    int check_interval = WLZ_FILE_CHECK_INTERVAL;
+    char* envpara = getenv( "WLZ_FILE_CHECK_INTERVAL" );
+    if(envpara){
+      check_interval = atoi(envpara);
+      if(check_interval < 0) check_interval = 0;
+    }
+    return check_interval;
+  }
+
+  static int getWlzDecompressThreads(){
+    int decompress_threads = WLZ_DECOMPRESS_THREADS;
+    char* envpara = getenv( "WLZ_DECOMPRESS_THREADS" );
+    if(envpara){
+      decompress_threads = atoi(envpara);
+      if(decompress_threads < 1) decompress_threads = 1;
+    }
+    return decompress_threads;
+  }
+
+  static int getRenderThreads(){
+    int render_threads = RENDER_THREADS;
+    char* envpara = getenv( "RENDER_THREADS" );
+    if(envpara){
+      render_threads = atoi(envpara);
+      if(render_threads < 0) render_threads = 0;
+    }
+    return render_threads;
+  }
+
+  static int getCVTPipelineDepth(){
+    int depth = CVT_PIPELINE_DEPTH;
+    char* envpara = getenv( "CVT_PIPELINE_DEPTH" );
+    if(envpara){
+      depth = atoi(envpara);
+      if(depth < 0) depth = 0;
+    }
+    return depth;
+  }
+
+  static unsigned int getCVTJPEGBandHeight(){
+    int band_height = CVT_JPEG_BAND_HEIGHT;
+    char* envpara = getenv( "CVT_JPEG_BAND_HEIGHT" );
+    if(envpara){
+      band_height = atoi(envpara);
+      if(band_height < 0) band_height = 0;
+    }
+    return band_height;
+  }
+
+  static int getPrefetchRadius(){
+    int radius = PREFETCH_RADIUS;
+    char* envpara = getenv( "PREFETCH_RADIUS" );
+    if(envpara){
+      radius = atoi(envpara);
+      if(radius < 0) radius = 0;
+    }
+    return radius;
+  }
+
+  static int getPrefetchQueue(){
+    int queue = PREFETCH_QUEUE;
+    char* envpara = getenv( "PREFETCH_QUEUE" );
+    if(envpara){
+      queue = atoi(envpara);
+      if(queue < 1) queue = 1;
+    }
+    return queue;
+  }
+
+  static int getWorkerThreads(){
+    int worker_threads = WORKER_THREADS;
+    char* envpara = getenv( "WORKER_THREADS" );
+    if(envpara){
+      worker_threads = atoi(envpara);
+      if(worker_threads < 1) worker_threads = 1;
+    }
+    return worker_threads;
+  }
+
+  static int getTraceSample(){
+    int trace_sample = TRACE_SAMPLE;
+    char* envpara = getenv( "TRACE_SAMPLE" );
+    if(envpara){
+      trace_sample = atoi(envpara);
+      if(trace_sample < 0) trace_sample = 0;
+    }
+    return trace_sample;
+  }
+
+  static int getTraceBuffer(){
+    int trace_buffer = TRACE_BUFFER;
+    char* envpara = getenv( "TRACE_BUFFER" );
+    if(envpara){
+      trace_buffer = atoi(envpara);
+      if(trace_buffer < 16) trace_buffer = 16;
+    }
+    return trace_buffer;
+  }
+
+  static std::string getTraceDir(){
+    char* envpara = getenv( "TRACE_DIR" );
+    std::string trace_dir;
+    if(envpara){
+      trace_dir = std::string( envpara );
+    }
+    else trace_dir = TRACE_DIR;
+    return trace_dir;
+  }
+
+  static int getSlowRequestThreshold(){
+    int slow_request_ms = SLOW_REQUEST_MS;
+    char* envpara = getenv( "SLOW_REQUEST_MS" );
+    if(envpara){
+      slow_request_ms = atoi(envpara);
+      if(slow_request_ms < 0) slow_request_ms = 0;
+    }
+    return slow_request_ms;
+  }
+
+  static std::string getSlowRequestLog(){
+    char* envpara = getenv( "SLOW_REQUEST_LOG" );
+    if( envpara ) return std::string( envpara );
+    else return SLOW_REQUEST_LOG;
+  }
+
 };
 
 #endif
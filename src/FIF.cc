@@ -116,33 +116,38 @@ void FIF::run( Session* session, std::string argument ){
     // TODO: Try to use a reference to this list, so that we can
     //  keep track of the current sequence between runs
 
-    if(session->imageCache->empty()){
-      test = IIPImage( argument );
-      test.setFileNamePattern( filename_pattern );
-      test.setFileSystemPrefix( filesystem_prefix );
-      test.Initialise();
-      (*session->imageCache)[argument] = test;
-      LOG_INFO("Image cache initialisation");
-    }
-    else{
-      // Cache hit
-      if(session->imageCache->find(argument) != session->imageCache->end()){
-	test = (*session->imageCache)[ argument ];
-	LOG_INFO("Image cache hit. Number of elements: " <<
-	          session->imageCache->size());
-      }
-      else{
-	// Cache miss
+    // The image cache is shared by all worker threads
+    {
+      MutexLock lock( *session->imageCacheMutex );
+
+      if(session->imageCache->empty()){
 	test = IIPImage( argument );
 	test.setFileNamePattern( filename_pattern );
 	test.setFileSystemPrefix( filesystem_prefix );
 	test.Initialise();
-	LOG_INFO("Image cache miss");
-	if(session->imageCache->size() >= 100)
-	{
-	  session->imageCache->erase(session->imageCache->end());
-	}
 	(*session->imageCache)[argument] = test;
+	LOG_INFO("Image cache initialisation");
+      }
+      else{
+	// Cache hit
+	if(session->imageCache->find(argument) != session->imageCache->end()){
+	  test = (*session->imageCache)[ argument ];
+	  LOG_INFO("Image cache hit. Number of elements: " <<
+		    session->imageCache->size());
+	}
+	else{
+	  // Cache miss
+	  test = IIPImage( argument );
+	  test.setFileNamePattern( filename_pattern );
+	  test.setFileSystemPrefix( filesystem_prefix );
+	  test.Initialise();
+	  LOG_INFO("Image cache miss");
+	  if(session->imageCache->size() >= 100)
+	  {
+	    session->imageCache->erase(session->imageCache->end());
+	  }
+	  (*session->imageCache)[argument] = test;
+	}
       }
     }
 
@@ -0,0 +1,217 @@
+#ifndef _FINGERPRINT_H
+#define _FINGERPRINT_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _Fingerprint_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         Fingerprint.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	128 bit fingerprints used to identify cache entries without
+* 		having to store or compare long key strings.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstddef>
+#include <string>
+
+/*!
+* \brief	A 128 bit fingerprint. This is a POD so that it may be
+* 		stored in shared memory or written to disk.
+* \ingroup	WlzIIPServer
+*/
+struct Fingerprint
+{
+  unsigned long long	hi;			/*!< Most significant 64 bits.*/
+  unsigned long long	lo;			/*!< Least significant 64
+  						     bits. */
+
+  bool			operator==(const Fingerprint &f) const
+			{
+			  return((hi == f.hi) && (lo == f.lo));
+			}
+  bool			operator!=(const Fingerprint &f) const
+			{
+			  return((hi != f.hi) || (lo != f.lo));
+			}
+  bool			isZero() const
+			{
+			  return((hi == 0) && (lo == 0));
+			}
+};
+
+/*!
+* \brief	Incremental builder for 128 bit fingerprints. The mixing
+* 		follows the body and finalisation of MurmurHash3_x64_128
+* 		but accepts data a piece at a time, so that a fingerprint
+* 		can be computed directly from view parameters without
+* 		first formatting them into a string.
+* \ingroup	WlzIIPServer
+*/
+class FingerprintBuilder
+{
+  private:
+    unsigned long long	h1;			/*!< First hash state. */
+    unsigned long long	h2;			/*!< Second hash state. */
+    unsigned long long	buf[2];			/*!< Partial block. */
+    size_t		nBuf;			/*!< Bytes in partial block. */
+    size_t		len;			/*!< Total bytes added. */
+
+    static inline unsigned long long rotl(unsigned long long x, int r)
+			{
+			  return((x << r) | (x >> (64 - r)));
+			}
+    static inline unsigned long long fmix(unsigned long long k)
+			{
+			  k ^= k >> 33;
+			  k *= 0xff51afd7ed558ccdULL;
+			  k ^= k >> 33;
+			  k *= 0xc4ceb9fe1a85ec53ULL;
+			  k ^= k >> 33;
+			  return(k);
+			}
+    inline void		block(unsigned long long k1, unsigned long long k2)
+			{
+			  const unsigned long long c1 = 0x87c37b91114253d5ULL,
+			  			   c2 = 0x4cf5ad432745937fULL;
+
+			  k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+			  h1 = rotl(h1, 27); h1 += h2;
+			  h1 = h1 * 5 + 0x52dce729;
+			  k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+			  h2 = rotl(h2, 31); h2 += h1;
+			  h2 = h2 * 5 + 0x38495ab5;
+			}
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor.
+    * \param	seed			Optional seed.
+    */
+    			FingerprintBuilder(unsigned long long seed = 0)
+			{
+			  h1 = h2 = seed;
+			  buf[0] = buf[1] = 0;
+			  nBuf = len = 0;
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Adds bytes to the fingerprint.
+    * \param	data			Bytes to add.
+    * \param	n			Number of bytes.
+    */
+    void		add(const void *data, size_t n)
+			{
+			  const unsigned char *p = (const unsigned char *)data;
+			  unsigned char *b = (unsigned char *)buf;
+
+			  len += n;
+			  while(n > 0)
+			  {
+			    b[nBuf++] = *p++;
+			    --n;
+			    if(nBuf == 16)
+			    {
+			      block(buf[0], buf[1]);
+			      buf[0] = buf[1] = 0;
+			      nBuf = 0;
+			    }
+			  }
+			}
+    void		add(int i)
+			{
+			  add(&i, sizeof(i));
+			}
+    void		add(double d)
+			{
+			  add(&d, sizeof(d));
+			}
+    void		add(const std::string &s)
+			{
+			  size_t n = s.length();
+
+			  add(&n, sizeof(n));
+			  add(s.data(), n);
+			}
+    void		add(const Fingerprint &f)
+			{
+			  add(&f, sizeof(f));
+			}
+    /*!
+    * \return	The fingerprint of all data added so far.
+    * \ingroup	WlzIIPServer
+    * \brief	Finalises the fingerprint. The builder may continue to
+    * 		be used after this.
+    */
+    Fingerprint		get() const
+			{
+			  Fingerprint f;
+			  unsigned long long a = h1,
+			  		     b = h2;
+
+			  if(nBuf > 0)
+			  {
+			    const unsigned long long c1 = 0x87c37b91114253d5ULL,
+			    			     c2 = 0x4cf5ad432745937fULL;
+			    unsigned long long k1 = buf[0],
+			    		       k2 = buf[1];
+
+			    k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; b ^= k2;
+			    k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; a ^= k1;
+			  }
+			  a ^= (unsigned long long )len;
+			  b ^= (unsigned long long )len;
+			  a += b; b += a;
+			  a = fmix(a); b = fmix(b);
+			  a += b; b += a;
+			  f.hi = a;
+			  f.lo = b;
+			  return(f);
+			}
+    /*!
+    * \return	Fingerprint of the given string.
+    * \ingroup	WlzIIPServer
+    * \brief	Convenience function to fingerprint a string.
+    * \param	s			Given string.
+    */
+    static Fingerprint	ofString(const std::string &s)
+			{
+			  FingerprintBuilder b;
+
+			  b.add(s.data(), s.length());
+			  return(b.get());
+			}
+};
+
+#endif
@@ -49,6 +49,7 @@ static char _IIPImage_h[] = "University of Edinburgh $Id$";
 #include <map>
 
 #include "RawTile.h"
+#include "Fingerprint.h"
 
 /// Main class to handle the pyramidal image source
 /** Provides functions to open, get various information from an image source
@@ -234,6 +235,18 @@ class IIPImage {
   virtual RawTile getTile( int h, int v, unsigned int r, unsigned int t ) { return RawTile(); };
 
 
+  /// Return whether a tile lies wholly in the image background
+  /** If it does the tile need not be rendered and the uncompressed
+      background tile is given: Overloaded by child class.
+      \param h horizontal angle
+      \param v vertical angle
+      \param r resolution
+      \param t tile number
+      \param bg set to the background tile if true is returned
+   */
+  virtual bool getBackgroundTile( int h, int v, unsigned int r, unsigned int t, RawTile& bg ) { return false; };
+
+
   /// Assignment operator
   const IIPImage& operator = ( const IIPImage& );
 
@@ -246,9 +259,21 @@ class IIPImage {
   /// Return the image hash
   virtual const std::string getHash() { return getImagePath(); };
 
+  /// Return a fixed size fingerprint of the image hash, used to key tiles
+  virtual Fingerprint getFingerprint() { return FingerprintBuilder::ofString( getHash() ); };
+
+  /// Return a fingerprint of the image file's path and identity (device,
+  /// inode, modification time and size), used to key tiles which outlive the
+  /// process, or a zero fingerprint if this is not known
+  virtual Fingerprint getFileFingerprint() { Fingerprint f = { 0, 0 }; return f; };
+
   /// Forces channel no update to alpha value 
   /// add by Zsolt Husz 12/05/2009
   virtual void recomputeChannel(bool alpha) { };
+
+  /// Return a new copy of this image which may be used to render tiles
+  /// concurrently with this one, or NULL if the image can not be copied
+  virtual IIPImage* clone() { return NULL; };
 };
 
 #endif
@@ -0,0 +1,267 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _IIPServer_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         IIPServer.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Processing of single IIP requests, shared by the FCGI server
+* 		and the offline query replay benchmark.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string>
+#include <list>
+#include <utility>
+#include <algorithm>
+#include <cctype>
+#include "Log.h"
+#include "IIPServer.h"
+#include "IIPResponse.h"
+#include "ServerStats.h"
+#include "SlowLog.h"
+#include "Timer.h"
+#include "Tokenizer.h"
+#include "Trace.h"
+#include "View.h"
+#include "ViewParameters.h"
+
+using namespace std;
+
+/* Number of requests processed. */
+unsigned long accessCount = 0;
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Parses and runs the commands of a single IIP request, writing
+* 		the response to the given writer.
+* \param	state			Server state shared by all workers.
+* \param	jpeg			The worker's JPEG compressor.
+* \param	png			The worker's PNG compressor.
+* \param	writer			Writer for the response.
+* \param	request_string		The query string of the request.
+* \param	client			Identifies the client, eg by its
+* 					address.
+*/
+void		IIPProcessRequest(IIPServerState *state,
+				  JPEGCompressor *jpeg, PNGCompressor *png,
+				  IIPWriter *writer,
+				  const string &request_string,
+				  const string &client)
+{
+  Timer request_timer;
+  Task* task = NULL;
+
+  request_timer.start();
+  // Every request has a record of its costs while slow requests are
+  // logged
+  SlowLogRecord slow_log_record;
+  SlowLogContext slow_log_ctx((SlowLog::isEnabled())? &slow_log_record: NULL);
+  // Decide whether this request is traced, its span is recorded
+  // explicitly so that it ends before the trace is written
+  long long trace_start = (Trace::beginRequest() != 0)? Trace::now(): 0;
+  // Declare our image pointer here outside of the try scope
+  //  so that we can close the image on exceptions
+  IIPImage *image = NULL;
+
+  // The compressors are reused by the worker, so reset any quality
+  // set by a previous request
+  jpeg->setQuality(state->jpegQuality);
+
+  // View object for use with the CVT command etc
+  View view;
+  if(state->maxCVT != -1)
+  {
+    view.setMaxSize(state->maxCVT);
+    LOG_INFO("CVT maximum viewport size set to " << state->maxCVT);
+  }
+
+  // Create an IIPResponse object - we use this for the OBJ requests.
+  // As the commands return images etc, they handle their own responses.
+  IIPResponse response;
+  ViewParameters viewParams;
+  try
+  {
+
+    // Check that we actually have a request string
+    if(request_string.length() == 0)
+    {
+      throw string( "QUERY_STRING not set" );
+    }
+    LOG_INFO("Full Request is " << request_string);
+
+    // Set up our session data object
+    Session session;
+    session.image = &image;
+    session.response = &response;
+    session.view = &view;
+    session.viewParams = &viewParams;
+    session.jpeg = jpeg;
+    session.png = png;
+    session.imageCache = state->imageCache;
+    session.imageCacheMutex = state->imageCacheMutex;
+    session.tileCache = state->tileCache;
+    session.complexSelection = state->complexSelection;
+    session.out = writer;
+    session.client = client;
+
+    // Parse up the command list
+    list < pair<string,string> > requests;
+    list < pair<string,string> > :: const_iterator commands;
+    {
+      TraceSpan span("parse");
+      Tokenizer izer(request_string, "&");
+      while(izer.hasMoreTokens())
+      {
+	pair <string,string> p;
+	string token = izer.nextToken();
+	int n = token.find_first_of("=");
+	p.first = token.substr(0, n);
+	p.second = token.substr(n + 1, token.length());
+	if(p.first.length() && p.second.length())
+	{
+	  requests.push_back(p);
+	}
+      }
+    }
+    int i = 0;
+    for(commands = requests.begin(); commands != requests.end(); commands++)
+    {
+      string command = (*commands).first;
+      string argument = (*commands).second;
+
+#ifdef WLZ_IIP_LOG
+      ++i;
+      LOG_INFO("[" << i << "/" << requests.size() <<
+	       "]: Command / Argument is " << command << " : " << argument);
+#endif
+      task = Task::factory( command );
+      if(task)
+      {
+	// Only the names of valid commands are counted and interned,
+	// the latter only for traced requests
+	Timer command_timer;
+	string name = command;
+	transform(name.begin(), name.end(), name.begin(), ::toupper);
+	command_timer.start();
+	{
+	  TraceSpan span((Trace::isActive())? Trace::intern(name): "");
+	  task->run(&session, argument);
+	}
+	ServerStats::observeCommand(name, command_timer.getTime());
+	delete task;
+	task = NULL;
+      }
+      else
+      {
+	LOG_WARN("Unsupported command: " << command);
+	// Unsupported command error code is 2 2
+	response.setError("2 2", command);
+      }
+    }
+
+    ////////// Send out our Errors if necessary ////////////
+
+    // Make sure something has actually been sent to the client
+    // If no response has been sent by now, we must have a malformed
+    // command.
+    if((!response.imageSent()) && (!response.isSet()))
+    {
+      // Malformed command syntax error code is 2 1
+      response.setError( "2 1", request_string );
+    }
+
+    // Once we have finished parsing all our OBJ and COMMAND requests
+    // send out our response.
+    if(response.isSet())
+    {
+      LOG_INFO("---" << endl << response.formatResponse() << endl << "---");
+      if(writer->putS(response.formatResponse().c_str()) == -1)
+      {
+	LOG_ERROR("Error sending IIPResponse");
+      }
+    }
+
+    //////////////// End of try block ////////////////////
+  }
+  catch( const string& error )
+  {
+    LOG_ERROR("Error " << error);
+    if(response.errorIsSet())
+    {
+      LOG_INFO("---" << endl << response.formatResponse() << endl << "---");
+      if(writer->putS(response.formatResponse().c_str()) == -1)
+      {
+	LOG_ERROR("Error sending IIPResponse");
+      }
+    }
+    else
+    {
+      // Display our advertising banner ;-)
+      writer->putS(response.getAdvert(state->version).c_str());
+    }
+  }
+  catch( ... ) /* Default catch */
+  {
+    LOG_ERROR("Error: Default Catch: ");
+    // Display our advertising banner ;-)
+    writer->putS( response.getAdvert( state->version ).c_str() );
+
+  }
+  // Do some cleaning up etc. here after all the potential exceptions
+  // have been handled
+  if(task)
+  {
+    delete task;
+    task = NULL;
+  }
+  if(image)
+  {
+    delete image;
+    image = NULL;
+  }
+  (void )__sync_add_and_fetch(&accessCount, 1);
+  ServerStats::observeRequest(request_timer.getTime());
+  SlowLog::endRequest((SlowLog::isEnabled())? &slow_log_record: NULL,
+		      request_string, request_timer.getTime());
+  if(trace_start)
+  {
+    Trace::record("request", trace_start, Trace::now());
+  }
+  Trace::endRequest();
+
+  // How long did this request take?
+  LOG_INFO("Total Request Time: " << request_timer.getTime() << "us");
+  LOG_INFO("Image closed and deleted" << endl << "Server count is " <<
+	    accessCount);
+}
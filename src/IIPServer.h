@@ -0,0 +1,84 @@
+#ifndef _IIPSERVER_H
+#define _IIPSERVER_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _IIPServer_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         IIPServer.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Processing of single IIP requests, shared by the FCGI server
+* 		and the offline query replay benchmark.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string>
+#include "Task.h"
+#include "Writer.h"
+#include "Mutex.h"
+#include "Cache.h"
+#include "JPEGCompressor.h"
+#include "PNGCompressor.h"
+
+#ifdef DEBUG
+typedef FileWriter IIPWriter;
+#else
+typedef FCGIWriter IIPWriter;
+#endif
+
+/*!
+* \brief	Server state which is shared by all of the worker threads.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _IIPServerState
+{
+  int			listenSocket;	/*!< FCGI listen socket. */
+  std::string		version;	/*!< Server version. */
+  int			jpegQuality;	/*!< Default JPEG quality. */
+  int			maxCVT;		/*!< Maximum CVT size. */
+  int			complexSelection; /*!< Complex selections allowed. */
+  imageCacheMapType	*imageCache;	/*!< Shared FIF image cache. */
+  Mutex			*imageCacheMutex; /*!< Protects the image cache. */
+  Cache			*tileCache;	/*!< Shared tile cache. */
+  Mutex			*acceptMutex;	/*!< Serialises FCGX_Accept_r(). */
+} IIPServerState;
+
+extern unsigned long accessCount;
+
+extern void	IIPProcessRequest(IIPServerState *state,
+				  JPEGCompressor *jpeg, PNGCompressor *png,
+				  IIPWriter *writer,
+				  const std::string &request_string,
+				  const std::string &client);
+
+#endif
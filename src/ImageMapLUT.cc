@@ -0,0 +1,408 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _ImageMapLUT_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         ImageMapLUT.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Compositing of rendered Woolz objects into tile buffers.
+* \ingroup	WlzIIPServer
+* \brief	Image value maps compiled into flat look up tables.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string.h>
+#include <map>
+#include "ImageMapLUT.h"
+#include "Mutex.h"
+
+/*!
+* \brief	Maximum number of compiled maps which are kept.
+* \ingroup	WlzIIPServer
+*/
+#define IMAGEMAP_LUT_CACHE_MAX	(32)
+
+static Mutex	imageMapLUTMutex;
+static std::map<std::string, ImageMapLUT *> imageMapLUTCache;
+static unsigned int imageMapLUTClock = 0;
+
+/*!
+* \brief	Clamping of grey values to a map's input range.
+* \ingroup	WlzIIPServer
+*/
+template <typename T>
+struct ImageMapLUTIndex
+{
+  static inline int	index(T v, int bin1, int lastBin)
+			{
+			  return((v < bin1)? 0:
+			         (v > lastBin)? lastBin - bin1: (int )v - bin1);
+			}
+};
+
+template <>
+struct ImageMapLUTIndex<float>
+{
+  static inline int	index(float v, int bin1, int lastBin)
+			{
+			  int	i;
+
+			  i = (v < bin1)? bin1:
+			      (v > lastBin)? lastBin: WLZ_NINT(v);
+			  return(WLZ_CLAMP(i, bin1, lastBin) - bin1);
+			}
+};
+
+template <>
+struct ImageMapLUTIndex<double>
+{
+  static inline int	index(double v, int bin1, int lastBin)
+			{
+			  int	i;
+
+			  i = (v < bin1)? bin1:
+			      (v > lastBin)? lastBin: WLZ_NINT(v);
+			  return(WLZ_CLAMP(i, bin1, lastBin) - bin1);
+			}
+};
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Maps values which are clamped to the input range.
+* \param	tab			Table for the input range.
+* \param	bin1			First input value.
+* \param	lastBin			Last input value.
+* \param	src			Values to map.
+* \param	n			Number of values.
+* \param	dst			Destination for the mapped values.
+*/
+template <typename T, typename O>
+static void	ImageMapLUTRange(const unsigned int *tab, int bin1,
+				 int lastBin, const T *src, int n, O *dst)
+{
+  for(int i = 0; i < n; ++i)
+  {
+    dst[i] = (O )(tab[ImageMapLUTIndex<T>::index(src[i], bin1, lastBin)]);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Maps values using a table which covers all of their range.
+* \param	tab			Table.
+* \param	off			Offset of the values in the table.
+* \param	src			Values to map.
+* \param	n			Number of values.
+* \param	dst			Destination for the mapped values.
+*/
+template <typename T, typename O>
+static void	ImageMapLUTFull(const unsigned int *tab, int off,
+				const T *src, int n, O *dst)
+{
+  for(int i = 0; i < n; ++i)
+  {
+    dst[i] = (O )(tab[src[i] + off]);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructor which compiles the tables from a Woolz LUT
+* 		object. On error the tables are not valid.
+* \param	obj			Woolz LUT object, which is assigned.
+* \param	dstErr			Destination error pointer.
+*/
+ImageMapLUT::ImageMapLUT(WlzObject *obj, WlzErrorNum *dstErr)
+{
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  refCount = 1;
+  useStamp = 0;
+  rgba = false;
+  bin1 = lastBin = 0;
+  tab = tab16 = NULL;
+  lutObj = WlzAssignObject(obj, NULL);
+  if((obj == NULL) || (obj->type != WLZ_LUT) ||
+     (obj->domain.core == NULL) || (obj->values.core == NULL))
+  {
+    errNum = WLZ_ERR_OBJECT_DATA;
+  }
+  else
+  {
+    int		n;
+    WlzLUTValues *lut;
+
+    lut = obj->values.lut;
+    bin1 = obj->domain.lut->bin1;
+    lastBin = obj->domain.lut->lastbin;
+    n = lastBin - bin1 + 1;
+    if(n < 1)
+    {
+      errNum = WLZ_ERR_DOMAIN_DATA;
+    }
+    else if(((tab = new unsigned int [n]) == NULL) ||
+            ((tab16 = new unsigned int [65536]) == NULL))
+    {
+      errNum = WLZ_ERR_MEM_ALLOC;
+    }
+    else
+    {
+      switch(lut->vType)
+      {
+	case WLZ_GREY_INT:
+	  for(int i = 0; i < n; ++i)
+	  {
+	    tab[i] = WLZ_CLAMP(lut->val.inp[i], 0, 255);
+	  }
+	  break;
+	case WLZ_GREY_UBYTE:
+	  for(int i = 0; i < n; ++i)
+	  {
+	    tab[i] = lut->val.ubp[i];
+	  }
+	  break;
+	case WLZ_GREY_RGBA:
+	  rgba = true;
+	  (void )memcpy(tab, lut->val.rgbp, n * sizeof(unsigned int));
+	  break;
+	default:
+	  errNum = WLZ_ERR_GREY_TYPE;
+	  break;
+      }
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      for(int i = 0; i < 256; ++i)
+      {
+	tab8[i] = lookup(i);
+      }
+      for(int i = 0; i < 65536; ++i)
+      {
+	tab16[i] = lookup(i - 32768);
+      }
+    }
+  }
+  *dstErr = errNum;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Destructor.
+*/
+ImageMapLUT::~ImageMapLUT()
+{
+  delete[] tab;
+  delete[] tab16;
+  (void )WlzFreeObj(lutObj);
+}
+
+/*!
+* \return	Compiled map with an incremented reference count, which
+* 		should be released using ImageMapLUT::release(), or NULL
+* 		on error or if the map has no channels.
+* \ingroup	WlzIIPServer
+* \brief	Gets the compiled tables for the given map, compiling
+* 		and caching them if they are not already cached.
+* \param	map			Given image map.
+* \param	dstErr			Destination error pointer, may be NULL.
+*/
+ImageMapLUT	*ImageMapLUT::get(const ImageMap &map, WlzErrorNum *dstErr)
+{
+  ImageMapLUT	*lut = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  if(map.getNChan() > 0)
+  {
+    const std::string mapS = map.toString();
+    std::map<std::string, ImageMapLUT *>::iterator it;
+
+    imageMapLUTMutex.lock();
+    if((it = imageMapLUTCache.find(mapS)) != imageMapLUTCache.end())
+    {
+      lut = it->second;
+      lut->useStamp = ++imageMapLUTClock;
+      __sync_add_and_fetch(&(lut->refCount), 1);
+    }
+    imageMapLUTMutex.unlock();
+    if(lut == NULL)
+    {
+      WlzObject	*obj;
+
+      obj = map.createLUT(&errNum);
+      if(errNum == WLZ_ERR_NONE)
+      {
+	lut = new ImageMapLUT(obj, &errNum);
+	if(errNum != WLZ_ERR_NONE)
+	{
+	  lut->release();
+	  lut = NULL;
+	}
+      }
+      else
+      {
+        (void )WlzFreeObj(obj);
+      }
+    }
+    if(lut && (lut->useStamp == 0))
+    {
+      /* Newly compiled, add it to the cache unless another thread
+       * has already done so, replacing the least recently used map
+       * if the cache is full. */
+      MutexLock	lock(imageMapLUTMutex);
+
+      if((it = imageMapLUTCache.find(mapS)) != imageMapLUTCache.end())
+      {
+	lut->release();
+	lut = it->second;
+	__sync_add_and_fetch(&(lut->refCount), 1);
+      }
+      else
+      {
+	if(imageMapLUTCache.size() >= IMAGEMAP_LUT_CACHE_MAX)
+	{
+	  std::map<std::string, ImageMapLUT *>::iterator old;
+
+	  old = imageMapLUTCache.begin();
+	  for(it = old; it != imageMapLUTCache.end(); ++it)
+	  {
+	    if(it->second->useStamp < old->second->useStamp)
+	    {
+	      old = it;
+	    }
+	  }
+	  old->second->release();
+	  imageMapLUTCache.erase(old);
+	}
+	__sync_add_and_fetch(&(lut->refCount), 1);
+	imageMapLUTCache[mapS] = lut;
+      }
+      lut->useStamp = ++imageMapLUTClock;
+    }
+  }
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return(lut);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Releases a reference to the compiled map, deleting it
+* 		when there are no more references.
+*/
+void		ImageMapLUT::release()
+{
+  if(__sync_sub_and_fetch(&refCount, 1) == 0)
+  {
+    delete this;
+  }
+}
+
+/*!
+* \return	True if the values were mapped, false if they are of a
+* 		type which can not be mapped.
+* \ingroup	WlzIIPServer
+* \brief	Maps a run of grey values. The mapped values are bytes
+* 		or, if isRGBA() is true, RGBA values.
+* \param	src			Grey values to map.
+* \param	gType			Grey type of the values, which must
+* 					not be WLZ_GREY_RGBA.
+* \param	n			Number of values.
+* \param	dst			Destination for the mapped values.
+*/
+bool		ImageMapLUT::apply(WlzGreyP src, WlzGreyType gType, int n,
+				   void *dst) const
+{
+  bool		ok = true;
+
+  if(rgba)
+  {
+    unsigned int *d = (unsigned int *)dst;
+
+    switch(gType)
+    {
+      case WLZ_GREY_LONG:
+	ImageMapLUTRange(tab, bin1, lastBin, src.lnp, n, d);
+	break;
+      case WLZ_GREY_INT:
+	ImageMapLUTRange(tab, bin1, lastBin, src.inp, n, d);
+	break;
+      case WLZ_GREY_SHORT:
+	ImageMapLUTFull(tab16, 32768, src.shp, n, d);
+	break;
+      case WLZ_GREY_UBYTE:
+	ImageMapLUTFull(tab8, 0, src.ubp, n, d);
+	break;
+      case WLZ_GREY_FLOAT:
+	ImageMapLUTRange(tab, bin1, lastBin, src.flp, n, d);
+	break;
+      case WLZ_GREY_DOUBLE:
+	ImageMapLUTRange(tab, bin1, lastBin, src.dbp, n, d);
+	break;
+      default:
+	ok = false;
+	break;
+    }
+  }
+  else
+  {
+    WlzUByte	*d = (WlzUByte *)dst;
+
+    switch(gType)
+    {
+      case WLZ_GREY_LONG:
+	ImageMapLUTRange(tab, bin1, lastBin, src.lnp, n, d);
+	break;
+      case WLZ_GREY_INT:
+	ImageMapLUTRange(tab, bin1, lastBin, src.inp, n, d);
+	break;
+      case WLZ_GREY_SHORT:
+	ImageMapLUTFull(tab16, 32768, src.shp, n, d);
+	break;
+      case WLZ_GREY_UBYTE:
+	ImageMapLUTFull(tab8, 0, src.ubp, n, d);
+	break;
+      case WLZ_GREY_FLOAT:
+	ImageMapLUTRange(tab, bin1, lastBin, src.flp, n, d);
+	break;
+      case WLZ_GREY_DOUBLE:
+	ImageMapLUTRange(tab, bin1, lastBin, src.dbp, n, d);
+	break;
+      default:
+	ok = false;
+	break;
+    }
+  }
+  return(ok);
+}
@@ -0,0 +1,128 @@
+#ifndef _IMAGEMAPLUT_H
+#define _IMAGEMAPLUT_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _ImageMapLUT_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         ImageMapLUT.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Image value maps compiled into flat look up tables.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string>
+#include <Wlz.h>
+#include "ViewParameters.h"
+
+/*!
+* \brief	An image value map (see ImageMap) compiled into flat look
+* 		up tables which can be applied directly to the grey
+* 		values of a rendered section as it is composited.
+*
+* 		The tables are computed from the Woolz LUT object for the
+* 		map, so giving the same values as WlzLUTTransformObj().
+* 		Each entry holds the mapped byte, or the mapped RGBA value
+* 		for maps with more than one channel. There is a 256 entry
+* 		table for byte values and a 65536 entry table for short
+* 		values, all other values are clamped to the map's input
+* 		range and then looked up.
+*
+* 		Compiled maps are shared, being kept in a small cache
+* 		keyed by the map string, and are reference counted.
+* \ingroup	WlzIIPServer
+*/
+class ImageMapLUT
+{
+  private:
+    int			refCount;		/*!< Reference count. */
+    unsigned int	useStamp;		/*!< Last use, for cache
+    						     replacement. */
+    bool		rgba;			/*!< True if mapped to RGBA
+    						     values. */
+    int			bin1;			/*!< First input value. */
+    int			lastBin;		/*!< Last input value. */
+    unsigned int	*tab;			/*!< Table for the input
+    						     range. */
+    unsigned int	tab8[256];		/*!< Table for byte values. */
+    unsigned int	*tab16;			/*!< Table for short values,
+    						     indexed by the value
+						     + 32768. */
+    WlzObject		*lutObj;		/*!< The Woolz LUT object. */
+
+    			ImageMapLUT(WlzObject *obj, WlzErrorNum *dstErr);
+    			~ImageMapLUT();
+    			ImageMapLUT(const ImageMapLUT &);
+    ImageMapLUT		&operator=(const ImageMapLUT &);
+
+    /*!
+    * \return	Table entry for the given value.
+    * \ingroup	WlzIIPServer
+    * \brief	Looks up a value clamped to the map's input range.
+    * \param	v			Given value.
+    */
+    unsigned int	lookup(int v) const
+			{
+			  return(tab[((v < bin1)? bin1:
+			              (v > lastBin)? lastBin: v) - bin1]);
+			}
+
+  public:
+    static ImageMapLUT	*get(const ImageMap &map, WlzErrorNum *dstErr);
+    void		release();
+    bool		apply(WlzGreyP src, WlzGreyType gType, int n,
+    			      void *dst) const;
+    /*!
+    * \return	True if the map gives RGBA values, false if it gives
+    * 		byte values.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the type of the mapped values.
+    */
+    bool		isRGBA() const
+			{
+			  return(rgba);
+			}
+    /*!
+    * \return	The Woolz LUT object, which should not be freed.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the Woolz LUT object for use with
+    * 		WlzLUTTransformObj() when the values can not be mapped
+    * 		by apply().
+    */
+    WlzObject		*getLUTObj() const
+			{
+			  return(lutObj);
+			}
+};
+
+#endif
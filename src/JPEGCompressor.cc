@@ -42,6 +42,9 @@ static char _JPEGCompressor_cc[] = "University of Edinburgh $Id$";
 */
 
 #include "JPEGCompressor.h"
+#include "Trace.h"
+#include "ServerStats.h"
+#include "SlowLog.h"
 
 //for debug only
 //#include "Task.h"
@@ -164,10 +167,9 @@ void iip_term_destination( j_compress_ptr cinfo )
   // Copy the JPEG data to our output tile buffer
   if( datacount > 0 ){
 
-    //reallocate if needed
+    //reallocate if needed, the old source belongs to the caller
     if (datacount > dest->sourcesize )
     {
-      free(dest->source);
       dest->source = (unsigned char*)malloc(datacount);
       dest->sourcesize=datacount;
     }
@@ -295,6 +297,8 @@ void JPEGCompressor::InitCompression( RawTile& rawtile, unsigned int strip_heigh
  */
 unsigned int JPEGCompressor::CompressStrip( unsigned char* buf, unsigned int tile_height ) throw (string)
 {
+  TraceSpan span( "JPEGCompressor::CompressStrip" );
+  SlowLogSpan slowSpan( SlowLog::ENCODE );
   bool localData = false;
   int channels_real=channels;
 
@@ -343,6 +347,7 @@ unsigned int JPEGCompressor::CompressStrip( unsigned char* buf, unsigned int til
   if (localData) { //added by Zsolt Husz 14/05/2009 to remove alpha channel
     channels=channels_real;
   }
+  ServerStats::countCompression( false, (unsigned long long) width * tile_height * channels_real, datacount );
   return datacount; 
 }
 
@@ -378,15 +383,18 @@ unsigned int JPEGCompressor::Finish() throw (string)
 
 int JPEGCompressor::Compress( RawTile& rawtile ) throw (string)
 {
+  TraceSpan span( "JPEGCompressor::Compress" );
+  SlowLogSpan slowSpan( SlowLog::ENCODE );
 
-  // Do some initialisation
+  // Do some initialisation, the tile's data is compressed in place
   
-  data = (unsigned char*) rawtile.data;
+  data = (unsigned char*) rawtile.writable();
   struct jpeg_compress_struct cinfo;
   struct jpeg_error_mgr jerr;
   iip_destination_mgr dest_mgr;
   iip_dest_ptr dest = &dest_mgr;
   int dataLength = rawtile.dataLength;
+  int uncompressedLength = dataLength;
 
   // Set up the correct width and height for this particular tile
   width = rawtile.width;
@@ -509,9 +517,7 @@ int JPEGCompressor::Compress( RawTile& rawtile ) throw (string)
   // check if more space was needed and data tile was reallocated
   if (rawtile.data != dest->source)
   {
-    // no free is needed, because the was already freed in
-    // iip_term_destination, just before reallocation
-    rawtile.data = dest->source;
+    rawtile.adopt(dest->source, y);
   }
   rawtile.dataLength = y;
 
@@ -520,6 +526,7 @@ int JPEGCompressor::Compress( RawTile& rawtile ) throw (string)
   // Set the tile compression type
   rawtile.compressionType = JPEG;
   rawtile.quality = Q;
+  ServerStats::countCompression( false, uncompressedLength, y );
 
   // Return the size of the data we have compressed
   return y;
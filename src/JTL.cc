@@ -43,6 +43,7 @@ static char _JTL_cc[] = "University of Edinburgh $Id$";
 
 #include "Log.h"
 #include "Task.h"
+#include "TilePrefetcher.h"
 
 using namespace std;
 
@@ -101,6 +102,9 @@ void JTL::run( Session* session, std::string argument ){
   // Inform our response object that we have sent something to the client
   session->response->setImageSent();
 
+  // Prefetch the tiles the client is likely to want next
+  TilePrefetcher::served( session, resolution, tile, JPEG );
+
   // Total JTLS response time
   LOG_INFO("JTL :: Total command time " << command_timer.getTime() << "us");
 }
@@ -53,7 +53,9 @@ static char _Main_cc[] = "University of Edinburgh $Id$";
 #include <string>
 #include <utility>
 #include <map>
+#include <vector>
 #include <sys/time.h>
+#include <pthread.h>
 
 
 #include <fcgiapp.h>
@@ -72,6 +74,14 @@ static char _Main_cc[] = "University of Edinburgh $Id$";
 #include "Environment.h"
 #include "Writer.h"
 #include "WlzImage.h"
+#include "Mutex.h"
+#include "IIPServer.h"
+#include "DiskCache.h"
+#include "SharedCache.h"
+#include "TilePrefetcher.h"
+#include "WorkPool.h"
+#include "Trace.h"
+#include "SlowLog.h"
 
 
 #ifdef ENABLE_DL
@@ -82,8 +92,6 @@ static char _Main_cc[] = "University of Edinburgh $Id$";
 
 using namespace std;
 
-unsigned long accessCount;
-
 /* Handle a signal - print out some stats and exit
  */
 /*!
@@ -98,6 +106,63 @@ void		IIPSignalHandler(int signal)
   exit(1);
 }
 
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Signal handler which requests a dump of the trace ring
+* 		buffers, written when the next request ends.
+* \param	signal			Signal caught.
+*/
+void		IIPTraceSignalHandler(int signal)
+{
+  Trace::requestDump();
+}
+
+#ifndef DEBUG
+/*!
+* \return	Always NULL.
+* \ingroup	WlzIIPServer
+* \brief	Worker thread main loop. Each worker has its own FCGI
+* 		request and compressors, accepting and processing requests
+* 		until FCGX_Accept_r() fails.
+* \param	data			Server state shared by all workers.
+*/
+static void	*IIPWorkerThread(void *data)
+{
+  IIPServerState *state = (IIPServerState *)data;
+  FCGX_Request request;
+  JPEGCompressor jpeg(state->jpegQuality);
+  PNGCompressor png;
+
+  if(FCGX_InitRequest(&request, state->listenSocket, 0))
+  {
+    LOG_FATAL("FCGI initialisation failed.");
+    exit(1);
+  }
+  for(;;)
+  {
+    int		accepted;
+
+    // Only one thread may wait in accept at a time
+    state->acceptMutex->lock();
+    accepted = FCGX_Accept_r(&request);
+    state->acceptMutex->unlock();
+    if(accepted < 0)
+    {
+      break;
+    }
+    FCGIWriter writer(request.out);
+    const char *query = FCGX_GetParam("QUERY_STRING", request.envp);
+    const char *client = FCGX_GetParam("REMOTE_ADDR", request.envp);
+
+    IIPProcessRequest(state, &jpeg, &png, &writer,
+                      string((query)? query: ""),
+		      string((client)? client: ""));
+    FCGX_Finish_r(&request);
+  }
+  return(NULL);
+}
+#endif
+
 int main( int argc, char *argv[] )
 {
 
@@ -127,11 +192,12 @@ int main( int argc, char *argv[] )
 #endif
 
   // Set up some FCGI items and make sure we are in FCGI mode
-#ifndef DEBUG
-  FCGX_Request request;
   int listen_socket = 0;
+#ifndef DEBUG
   int usePort = 0;
 
+  FCGX_Init();
+
   if(argv[1] && (string(argv[1]) == "--standalone"))
   {
     string socket = argv[2];
@@ -168,11 +234,6 @@ int main( int argc, char *argv[] )
     LOG_NOTICE("Server started on port '" << port << "'");
     usePort = 1;
   }
-  if(FCGX_InitRequest(&request, listen_socket, 0))
-  {
-    LOG_FATAL("FCGI initialisation failed.");
-    exit(1);
-  }
   if(FCGX_IsCGI() && (usePort == 0))
   {
     LOG_FATAL("CGI-only mode detected.");
@@ -222,6 +283,10 @@ int main( int argc, char *argv[] )
 	   Environment::getWlzTileHeight());
   LOG_INFO("Complex selection " << Environment::getComplexSelection() << 
            complex_selection);
+  LOG_INFO("Setting number of worker threads to " <<
+           Environment::getWorkerThreads());
+  LOG_INFO("Setting number of tile render threads to " <<
+           Environment::getRenderThreads());
 
   // Check for loadable modules, but only if enabled by configure
 #ifdef ENABLE_DL
@@ -266,188 +331,172 @@ int main( int argc, char *argv[] )
 #endif
   signal(SIGTERM, IIPSignalHandler);
 
-  LOG_INFO("Initialisation Complete.");
+  // Trace a sample of requests, SIGUSR2 dumps the recent spans of all
+  // threads.
+  Trace::configure(Environment::getTraceSample(),
+                   Environment::getTraceBuffer(),
+                   Environment::getTraceDir());
+#ifndef WIN32
+  signal(SIGUSR2, IIPTraceSignalHandler);
+#endif
+  if(Environment::getTraceSample() > 0)
+  {
+    LOG_INFO("Tracing 1 in " << Environment::getTraceSample() <<
+             " requests to " << Environment::getTraceDir());
+  }
 
-  // Set up some timers and create our tile cache
-  Timer request_timer;
-  Cache tileCache(max_image_cache_size);
-  Task* task = NULL;
+  // Log requests which take longer than the threshold.
+  SlowLog::configure(Environment::getSlowRequestThreshold(),
+                     Environment::getSlowRequestLog());
 
-  // Main FCGI loop
-#ifdef DEBUG
-  int status = true;
-  while(status)
-  {
-    status = false;
-#else
-  while( FCGX_Accept_r( &request ) >= 0 )
+  // Preload and pin the configured Woolz objects before accepting any
+  // requests.
+  string wlz_preload = Environment::getWlzPreload();
+  if(wlz_preload.length())
   {
-    FCGIWriter writer( request.out );
-#endif
-    LOG_COND_INFO(request_timer.start());
-    // Declare our image pointer here outside of the try scope
-    //  so that we can close the image on exceptions
-    IIPImage *image = NULL;
-    JPEGCompressor jpeg( jpeg_quality );
-    PNGCompressor png;
+    WlzImage::preload(wlz_preload, Environment::getWlzPreloadThreads());
+  }
 
-    // View object for use with the CVT command etc
-    View view;
-    if(max_CVT != -1)
-    {
-      view.setMaxSize(max_CVT);
-      LOG_INFO("CVT maximum viewport size set to " << max_CVT);
-    }
+  // Keep rendered tiles on local disk so that they survive restarts.
+  DiskCache::start(Environment::getDiskCacheDir(),
+                   Environment::getDiskCacheSize(),
+                   Environment::getDiskCacheQueue());
 
-    // Create an IIPResponse object - we use this for the OBJ requests.
-    // As the commands return images etc, they handle their own responses.
-    IIPResponse response;
-    ViewParameters viewParams;
-    try
-    {
+  // Start the pool used to render the tiles of multi-tile requests
+  // concurrently.
+  WorkPool::start(Environment::getRenderThreads());
 
-      // Get the query into a string
-#ifdef DEBUG
-      string request_string = argv[1];
-#else
-      string request_string = FCGX_GetParam( "QUERY_STRING", request.envp );
-#endif
+  // Prefetch the tiles that clients are likely to request next using
+  // the pool when it is otherwise idle.
+  TilePrefetcher::start(Environment::getPrefetchRadius(),
+                        Environment::getPrefetchQueue());
 
-      // Check that we actually have a request string
-      if(request_string.length() == 0)
-      {
-	throw string( "QUERY_STRING not set" );
-      }
-      LOG_INFO("Full Request is " << request_string);
-
-      // Set up our session data object
-      Session session;
-      session.image = &image;
-      session.response = &response;
-      session.view = &view;
-      session.viewParams = &viewParams;
-      session.jpeg = &jpeg;
-      session.png = &png;
-      session.imageCache = &imageCache;
-      session.tileCache = &tileCache;
-      session.complexSelection = complex_selection;
-      session.out = &writer;
-
-      // Parse up the command list
-      list < pair<string,string> > requests;
-      list < pair<string,string> > :: const_iterator commands;
-      Tokenizer izer(request_string, "&");
-      while(izer.hasMoreTokens())
-      {
-	pair <string,string> p;
-	string token = izer.nextToken();
-	int n = token.find_first_of("=");
-	p.first = token.substr(0, n);
-	p.second = token.substr(n + 1, token.length());
-	if(p.first.length() && p.second.length())
-	{
-	  requests.push_back(p);
-        }
-      }
-      int i = 0;
-      for(commands = requests.begin(); commands != requests.end(); commands++)
-      {
-	string command = (*commands).first;
-	string argument = (*commands).second;
+  LOG_INFO("Initialisation Complete.");
 
-#ifdef WLZ_IIP_LOG
-	++i;
-	LOG_INFO("[" << i << "/" << requests.size() <<
-	         "]: Command / Argument is " << command << " : " << argument);
-#endif
-	task = Task::factory( command );
-	if(task)
-	{
-	  task->run(&session, argument);
-	  delete task;
-	  task = NULL;
-	}
-	else
-	{
-	  LOG_WARN("Unsupported command: " << command);
-	  // Unsupported command error code is 2 2
-	  response.setError("2 2", command);
-	}
-      }
+  // Create our tile cache and the state shared by the worker threads.
+  // The tile cache may be in shared memory for use by all server
+  // processes, otherwise it is private to this process.
+  Cache *tileCache = NULL;
+  string tile_cache_shm = Environment::getTileCacheShm();
+  if(tile_cache_shm.length())
+  {
+    size_t max_tile_size = Environment::getWlzTileWidth() *
+                           Environment::getWlzTileHeight() * 4 + 4096;
+    try
+    {
+      tileCache = new SharedCache(tile_cache_shm, max_image_cache_size,
+                                  max_tile_size);
+      LOG_INFO("Using shared memory tile cache " << tile_cache_shm);
+    }
+    catch(const string& error)
+    {
+      LOG_ERROR(error << " Using a private tile cache.");
+      tileCache = NULL;
+    }
+  }
+  if(tileCache == NULL)
+  {
+    // The shared memory cache always uses CLOCK replacement, only a
+    // private cache uses the configured eviction policy.
+    Cache::Policy policy = Cache::LRU;
+    string tile_cache_policy = Environment::getTileCachePolicy();
+    if(!Cache::parsePolicy(tile_cache_policy, policy))
+    {
+      LOG_ERROR("Unknown tile cache policy " << tile_cache_policy <<
+                ", using lru.");
+      tile_cache_policy = "lru";
+    }
+    tileCache = new Cache(max_image_cache_size, policy);
+    LOG_INFO("Using private " << tile_cache_policy << " tile cache");
+  }
+  Mutex imageCacheMutex;
+  Mutex acceptMutex;
+  IIPServerState state;
+
+  state.listenSocket = listen_socket;
+  state.version = version;
+  state.jpegQuality = jpeg_quality;
+  state.maxCVT = max_CVT;
+  state.complexSelection = complex_selection;
+  state.imageCache = &imageCache;
+  state.imageCacheMutex = &imageCacheMutex;
+  state.tileCache = tileCache;
+  state.acceptMutex = &acceptMutex;
 
-      ////////// Send out our Errors if necessary ////////////
+#ifdef DEBUG
+  {
+    JPEGCompressor jpeg(jpeg_quality);
+    PNGCompressor png;
+    FileWriter writer(stdout);
 
-      // Make sure something has actually been sent to the client
-      // If no response has been sent by now, we must have a malformed
-      // command.
-      if((!response.imageSent()) && (!response.isSet()))
-      {
-	// Malformed command syntax error code is 2 1
-	response.setError( "2 1", request_string );
-      }
+    IIPProcessRequest(&state, &jpeg, &png, &writer,
+                      (argv[1])? argv[1]: "", "");
+  }
+#else
+  // Number of worker threads accepting requests
+  int worker_threads = Environment::getWorkerThreads();
 
-      // Once we have finished parsing all our OBJ and COMMAND requests
-      // send out our response.
-      if(response.isSet())
-      {
-	LOG_INFO("---" << endl << response.formatResponse() << endl << "---");
-	if(writer.putS(response.formatResponse().c_str()) == -1)
-	{
-	  LOG_ERROR("Error sending IIPResponse");
-	}
-      }
+  if(worker_threads < 2)
+  {
+    (void )IIPWorkerThread(&state);
+  }
+  else
+  {
+    // Each worker thread has its own FCGI request, compressors and
+    // session, only the caches are shared.
+    std::vector<pthread_t> workers(worker_threads);
+    int nWorkers = 0;
 
-      //////////////// End of try block ////////////////////
-    }
-    catch( const string& error )
+    for(int i = 0; i < worker_threads; ++i)
     {
-      LOG_ERROR("Error " << error);
-      if(response.errorIsSet())
+      if(pthread_create(&(workers[nWorkers]), NULL,
+                        IIPWorkerThread, &state) == 0)
       {
-	LOG_INFO("---" << endl << response.formatResponse() << endl << "---");
-	if(writer.putS(response.formatResponse().c_str()) == -1)
-	{
-	  LOG_ERROR("Error sending IIPResponse");
-	}
+        ++nWorkers;
       }
       else
       {
-	// Display our advertising banner ;-)
-	writer.putS(response.getAdvert(version).c_str());
+        LOG_ERROR("Failed to create worker thread " << i);
       }
     }
-    catch( ... ) /* Default catch */
-    {
-      LOG_ERROR("Error: Default Catch: ");
-      // Display our advertising banner ;-)
-      writer.putS( response.getAdvert( version ).c_str() );
-
-    }
-    // Do some cleaning up etc. here after all the potential exceptions
-    // have been handled
-    if(task)
+    if(nWorkers == 0)
     {
-      delete task;
-      task = NULL;
+      LOG_FATAL("Unable to create any worker threads.");
+      exit(1);
     }
-    if(image)
+    LOG_NOTICE("Started " << nWorkers << " worker threads");
+    for(int i = 0; i < nWorkers; ++i)
     {
-      delete image;
-      image = NULL;
+      (void )pthread_join(workers[i], NULL);
     }
-    ++accessCount;
-
-    // How long did this request take?
-    LOG_INFO("Total Request Time: " << request_timer.getTime() << "us");
-    LOG_INFO("Image closed and deleted" << endl << "Server count is " <<
-              accessCount);
-    ///////// End of FCGI_ACCEPT while loop or for loop in debug mode //////////
-#ifdef DEBUG //  keeps bracematching sane for editing.
-  }
-#else
   }
 #endif
+  WorkPool::stop();
+  LOG_NOTICE("Tile requests: " << tileCache->getRequestCount() <<
+             ", hits: " << tileCache->getHitCount() <<
+             ", hit rate: " << tileCache->getHitRate() <<
+             ", byte hit rate: " << tileCache->getByteHitRate());
+  delete tileCache;
+  if(DiskCache::get())
+  {
+    LOG_NOTICE("Disk cache hits: " << DiskCache::get()->getHitCount() <<
+               ", misses: " << DiskCache::get()->getMissCount() <<
+               ", written: " << DiskCache::get()->getWrittenCount() <<
+               ", dropped: " << DiskCache::get()->getDroppedCount() <<
+               ", evicted: " << DiskCache::get()->getEvictedCount());
+  }
+  DiskCache::stop();
   LOG_NOTICE("Terminating after " << accessCount << " iterations");
+  LOG_NOTICE("Tiles rendered: " << TileManager::getRenderCount() <<
+             ", renders coalesced: " << TileManager::getCoalescedCount());
+  if(TilePrefetcher::isEnabled())
+  {
+    LOG_NOTICE("Tiles prefetched: " << TilePrefetcher::getIssuedCount() <<
+               ", dropped: " << TilePrefetcher::getDroppedCount() <<
+               ", rendered: " << TilePrefetcher::getRenderedCount() <<
+               ", hits: " << TilePrefetcher::getHitCount() <<
+               ", wasted: " << TilePrefetcher::getWastedCount());
+  }
 #ifdef WLZ_IIP_LOG
   log4cpp::Category::shutdown();
 #endif
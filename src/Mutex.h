@@ -0,0 +1,139 @@
+#ifndef _MUTEX_H
+#define _MUTEX_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _Mutex_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         Mutex.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Simple pthread mutex wrappers used to protect the caches
+* 		which are shared between the server's worker threads.
+* \ingroup	WlzIIPServer
+*/
+
+#include <pthread.h>
+
+/*!
+* \brief	Wrapper for a (non-recursive) pthread mutex.
+* \ingroup	WlzIIPServer
+*/
+class Mutex
+{
+  private:
+    pthread_mutex_t	mtx;			/*!< The pthread mutex. */
+
+    /* Mutexes may not be copied. */
+    			Mutex(const Mutex &);
+    Mutex		&operator=(const Mutex &);
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor.
+    */
+    			Mutex()
+			{
+			  pthread_mutex_init(&mtx, NULL);
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Destructor.
+    */
+    			~Mutex()
+			{
+			  pthread_mutex_destroy(&mtx);
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Locks the mutex, blocking until it is available.
+    */
+    void		lock()
+			{
+			  pthread_mutex_lock(&mtx);
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Unlocks the mutex.
+    */
+    void		unlock()
+			{
+			  pthread_mutex_unlock(&mtx);
+			}
+    /*!
+    * \return	The underlying pthread mutex.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives access to the pthread mutex, eg for use with a
+    * 		condition variable.
+    */
+    pthread_mutex_t	*native()
+			{
+			  return(&mtx);
+			}
+};
+
+/*!
+* \brief	Scoped lock: locks the given mutex on construction and
+* 		unlocks it on destruction, so that the mutex is released
+* 		when exceptions are thrown.
+* \ingroup	WlzIIPServer
+*/
+class MutexLock
+{
+  private:
+    Mutex		&mtx;			/*!< The locked mutex. */
+
+    			MutexLock(const MutexLock &);
+    MutexLock		&operator=(const MutexLock &);
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor which locks the mutex.
+    * \param	m			Mutex to lock.
+    */
+    			MutexLock(Mutex &m): mtx(m)
+			{
+			  mtx.lock();
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Destructor which unlocks the mutex.
+    */
+    			~MutexLock()
+			{
+			  mtx.unlock();
+			}
+};
+
+#endif
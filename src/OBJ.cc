@@ -43,6 +43,9 @@ static char _OBJ_cc[] = "University of Edinburgh $Id$";
 
 #include "Log.h"
 #include "Task.h"
+#include "DiskCache.h"
+#include "ServerStats.h"
+#include "TilePrefetcher.h"
 #include <iostream>
 #include <algorithm>
 
@@ -73,6 +76,11 @@ void OBJ::run(Session* s, std::string a)
   {
     iip_server();
   }
+  // Server statistics, these do not need an image
+  else if(argument == "server-stats")
+  {
+    server_stats();
+  }
   // IIP optional commands
   else if(argument == "iip-opt-comm")
   {
@@ -109,6 +117,7 @@ void OBJ::run(Session* s, std::string a)
       "IIP-opt-obj: "
       "Horizontal-views "
       "Vertical-views "
+      "Server-stats "
       "Tile-size "
       "Wlz-3d-bounding-box "
       "Wlz-foreground-objects "
@@ -492,6 +501,119 @@ void OBJ::wlz_foreground_objects()
   }
 }
 
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Writes the server's counters, latency histograms and cache
+* 		statistics in the Prometheus text exposition format. The
+* 		statistics are those of the process which handles the
+* 		request.
+*/
+void OBJ::server_stats()
+{
+  string body;
+  Cache *tileCache = session->tileCache;
+  const char *name;
+
+  ServerStats::format(body);
+  if(tileCache)
+  {
+    unsigned long requests = tileCache->getRequestCount(),
+    		  hits = tileCache->getHitCount();
+
+    name = "wlziipsrv_tile_cache_hits_total";
+    ServerStats::formatHeader(body, name, "counter",
+			      "Tile requests found in the tile cache.");
+    ServerStats::formatSample(body, name, "", hits);
+    name = "wlziipsrv_tile_cache_misses_total";
+    ServerStats::formatHeader(body, name, "counter",
+			      "Tile requests not found in the tile cache.");
+    ServerStats::formatSample(body, name, "", requests - hits);
+    name = "wlziipsrv_tile_cache_evictions_total";
+    ServerStats::formatHeader(body, name, "counter",
+			      "Tiles evicted from the tile cache.");
+    ServerStats::formatSample(body, name, "",
+			      tileCache->getEvictionCount());
+    name = "wlziipsrv_tile_cache_byte_hit_ratio";
+    ServerStats::formatHeader(body, name, "gauge",
+			      "Fraction of requested tile bytes found in "
+			      "the tile cache.");
+    ServerStats::formatSample(body, name, "",
+			      tileCache->getByteHitRate());
+    name = "wlziipsrv_tile_cache_entries";
+    ServerStats::formatHeader(body, name, "gauge",
+			      "Tiles held in the tile cache.");
+    ServerStats::formatSample(body, name, "",
+			      tileCache->getNumElements());
+    name = "wlziipsrv_tile_cache_bytes";
+    ServerStats::formatHeader(body, name, "gauge",
+			      "Bytes held in the tile cache.");
+    ServerStats::formatSample(body, name, "",
+			      tileCache->getMemorySize() * 1024000.0);
+  }
+  name = "wlziipsrv_object_cache_entries";
+  ServerStats::formatHeader(body, name, "gauge",
+			    "Objects, sections and view structures held in "
+			    "the object cache.");
+  ServerStats::formatSample(body, name, "",
+			    WlzImage::getObjectCacheCount());
+  name = "wlziipsrv_object_cache_bytes";
+  ServerStats::formatHeader(body, name, "gauge",
+			    "Bytes held in the object cache.");
+  ServerStats::formatSample(body, name, "",
+			    WlzImage::getObjectCacheBytes());
+  name = "wlziipsrv_tiles_rendered_total";
+  ServerStats::formatHeader(body, name, "counter", "Tiles rendered.");
+  ServerStats::formatSample(body, name, "", TileManager::getRenderCount());
+  name = "wlziipsrv_tile_renders_coalesced_total";
+  ServerStats::formatHeader(body, name, "counter",
+			    "Tile requests which waited for another's "
+			    "render.");
+  ServerStats::formatSample(body, name, "",
+			    TileManager::getCoalescedCount());
+  if(DiskCache::get())
+  {
+    name = "wlziipsrv_disk_cache_hits_total";
+    ServerStats::formatHeader(body, name, "counter",
+			      "Tiles found in the disk cache.");
+    ServerStats::formatSample(body, name, "",
+			      DiskCache::get()->getHitCount());
+    name = "wlziipsrv_disk_cache_misses_total";
+    ServerStats::formatHeader(body, name, "counter",
+			      "Tiles not found in the disk cache.");
+    ServerStats::formatSample(body, name, "",
+			      DiskCache::get()->getMissCount());
+  }
+  if(TilePrefetcher::isEnabled())
+  {
+    name = "wlziipsrv_prefetch_rendered_total";
+    ServerStats::formatHeader(body, name, "counter", "Tiles prefetched.");
+    ServerStats::formatSample(body, name, "",
+			      TilePrefetcher::getRenderedCount());
+    name = "wlziipsrv_prefetch_hits_total";
+    ServerStats::formatHeader(body, name, "counter",
+			      "Prefetched tiles which were requested.");
+    ServerStats::formatSample(body, name, "",
+			      TilePrefetcher::getHitCount());
+  }
+  LOG_INFO("OBJ :: Server-stats " << body.length() << " bytes");
+#ifndef DEBUG
+  session->out->printf("Pragma: no-cache\r\n"
+		       "Content-type: text/plain; version=0.0.4\r\n"
+		       "\r\n");
+#endif
+  if(session->out->putStr(body.c_str(), body.length()) !=
+     (int )body.length())
+  {
+    LOG_ERROR("OBJ :: Error writing server stats");
+  }
+  if(session->out->flush() == -1)
+  {
+    LOG_ERROR("OBJ :: Error flushing server stats");
+  }
+  // The statistics are not an IIP response
+  session->response->setImageSent();
+}
+
 void OBJ::tile_size()
 {
   checkImage();
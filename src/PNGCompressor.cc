@@ -40,6 +40,9 @@ static char _PNGCompressor_cc[] = "University of Edinburgh $Id$";
 */
 
 #include "PNGCompressor.h"
+#include "Trace.h"
+#include "ServerStats.h"
+#include "SlowLog.h"
 
 using namespace std;
 
@@ -131,6 +134,8 @@ int PNGCompressor::InitCompression( RawTile& rawtile, unsigned int strip_height
  */
 unsigned int PNGCompressor::CompressStrip( unsigned char* buf, unsigned int tile_height ) throw (string)
 {
+  TraceSpan span( "PNGCompressor::CompressStrip" );
+  SlowLogSpan slowSpan( SlowLog::ENCODE );
   png_uint_32     ulRowBytes = width * channels;
   png_byte        **ppbRowPointers = NULL;
 
@@ -148,6 +153,7 @@ unsigned int PNGCompressor::CompressStrip( unsigned char* buf, unsigned int tile
   free (ppbRowPointers);
   ppbRowPointers = NULL;
 
+  ServerStats::countCompression( true, (unsigned long long) ulRowBytes * tile_height, dest.size );
   return dest.size;
 }
 
@@ -166,6 +172,8 @@ unsigned int PNGCompressor::Finish() throw (string) {
 }
 
 int PNGCompressor::Compress( RawTile& rawtile ) throw (string) {
+  TraceSpan span( "PNGCompressor::Compress" );
+  SlowLogSpan slowSpan( SlowLog::ENCODE );
   png_byte   **ppbRowPointers = NULL;
   const int           ciBitDepth = 8;
   png_uint_32         ulRowBytes;
@@ -239,14 +247,9 @@ int PNGCompressor::Compress( RawTile& rawtile ) throw (string) {
     return 0;
   }
 
-  //if dest is bigger, then realloate
-  if (dest.size > rawtile.dataLength ) {
-      free(rawtile.data);
-      rawtile.data = (unsigned char*)malloc(dest.size);
-  }
-  rawtile.dataLength = dest.size;
-  memcpy(rawtile.data, dest.data, rawtile.dataLength);
-  free(dest.data);
+  // the tile takes the compressed data, so any data it shares is untouched
+  ServerStats::countCompression( true, rawtile.dataLength, dest.size );
+  rawtile.adopt(dest.data, dest.size);
   dest.data = NULL;
   dest.size = 0;
   dest.mx   = 0;
@@ -126,6 +126,15 @@ public:
   */
   unsigned int Finish() throw (std::string);
 
+ /*!
+  * \ingroup      WlzIIPServer
+  * \brief        Return the buffer holding the output of strip based
+  *               compression, which may have been reallocated since
+  *               InitCompression if the output did not fit
+  * \return       output buffer
+  */
+  unsigned char* getData() { return dest.data; };
+
 
  /*!
   * \ingroup      WlzIIPServer
@@ -41,6 +41,7 @@ static char _PTL_cc[] = "University of Edinburgh $Id$";
 
 #include "Log.h"
 #include "Task.h"
+#include "TilePrefetcher.h"
 
 using namespace std;
 
@@ -91,6 +92,8 @@ void PTL::run( Session* session, std::string argument)
   }
   // Inform our response object that we have sent something to the client
   session->response->setImageSent();
+  // Prefetch the tiles the client is likely to want next
+  TilePrefetcher::served(session, resolution, tile, PNG);
   // Total JTLS response time
   LOG_INFO("PNG :: Total command time " << command_timer.getTime() << "us");
 }
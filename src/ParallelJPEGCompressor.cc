@@ -0,0 +1,558 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _ParallelJPEGCompressor_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         ParallelJPEGCompressor.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	JPEG compression of large images in horizontal bands which
+* 		are encoded concurrently and joined using restart markers.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include "ParallelJPEGCompressor.h"
+#include "Trace.h"
+#include "ServerStats.h"
+#include "SlowLog.h"
+
+extern "C"{
+  /* Undefine this to prevent compiler warning
+   */
+#undef HAVE_STDLIB_H
+#include <jpeglib.h>
+
+  /* Sets the error handler to throw, defined with the JPEGCompressor.
+   */
+  void setup_error_functions( jpeg_compress_struct *a );
+}
+
+using namespace std;
+
+/*!
+* \brief	Growable memory destination for the IJG library.
+* \ingroup	WlzIIPServer
+*/
+typedef struct
+{
+  struct jpeg_destination_mgr pub;		/*!< Public fields. */
+  JOCTET		*buf;			/*!< Output buffer. */
+  size_t		size;			/*!< Allocated size. */
+} pjpeg_destination_mgr;
+
+/*!
+* \brief	Encodes one band of the image.
+* \ingroup	WlzIIPServer
+*/
+class ParallelJPEGCompressor::Band: public WorkPoolJob
+{
+  public:
+    int			Q;			/*!< JPEG quality factor. */
+    unsigned int	width;			/*!< Image width. */
+    unsigned int	jpegChannels;		/*!< Channels encoded. */
+    unsigned int	index;			/*!< Index of the band. */
+    unsigned int	firstMCURow;		/*!< MCU row of the image at
+    						     which the band starts. */
+    unsigned int	nRows;			/*!< Rows in the band. */
+    bool		last;			/*!< Last band of the image.*/
+    std::vector<unsigned char> rows;		/*!< The band's rows. */
+    std::vector<unsigned char> out;		/*!< Entropy coded data. */
+    bool		failed;			/*!< Encoding failed. */
+    std::string		error;			/*!< Error if failed. */
+
+    			Band(int q, unsigned int w, unsigned int jc,
+			     unsigned int maxRows):
+			  Q(q), width(w), jpegChannels(jc), index(0),
+			  firstMCURow(0), nRows(0), last(false),
+			  rows(w * jc * maxRows), failed(false)
+			{
+			}
+    void		run()
+    			{
+			  try
+			  {
+			    encode();
+			  }
+			  catch(const std::string &e)
+			  {
+			    failed = true;
+			    error = e;
+			  }
+			}
+    void		encode()
+			throw(std::string);
+};
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Initialises the destination, allocating a buffer if there
+* 		is not one already.
+* \param	cinfo			Compressor.
+*/
+METHODDEF(void) ParallelJPEGInitDestination(j_compress_ptr cinfo)
+{
+  pjpeg_destination_mgr *dest = (pjpeg_destination_mgr *)cinfo->dest;
+
+  if(dest->buf == NULL)
+  {
+    dest->size = 65536;
+    if((dest->buf = (JOCTET *)malloc(dest->size)) == NULL)
+    {
+      throw string("ParallelJPEGCompressor: Failed to allocate buffer");
+    }
+  }
+  dest->pub.next_output_byte = dest->buf;
+  dest->pub.free_in_buffer = dest->size;
+}
+
+/*!
+* \return	TRUE.
+* \ingroup	WlzIIPServer
+* \brief	Doubles the size of the full output buffer.
+* \param	cinfo			Compressor.
+*/
+METHODDEF(boolean) ParallelJPEGEmptyOutputBuffer(j_compress_ptr cinfo)
+{
+  JOCTET *buf;
+  pjpeg_destination_mgr *dest = (pjpeg_destination_mgr *)cinfo->dest;
+
+  if((buf = (JOCTET *)realloc(dest->buf, 2 * dest->size)) == NULL)
+  {
+    throw string("ParallelJPEGCompressor: Failed to allocate buffer");
+  }
+  dest->buf = buf;
+  dest->pub.next_output_byte = dest->buf + dest->size;
+  dest->pub.free_in_buffer = dest->size;
+  dest->size *= 2;
+  return(TRUE);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Terminates the destination, the data is left in the buffer.
+* \param	cinfo			Compressor.
+*/
+METHODDEF(void) ParallelJPEGTermDestination(j_compress_ptr cinfo)
+{
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Creates and sets up a compressor. All compressors for an
+* 		image must be set up in the same way so that their tables
+* 		and MCUs match.
+* \param	cinfo			Compressor.
+* \param	jerr			Error manager.
+* \param	dest			Destination, the buffer of which
+* 					must be freed by the caller.
+* \param	Q			Quality factor.
+* \param	width			Image width.
+* \param	height			Image height.
+* \param	jc			Number of channels, 1 or 3.
+*/
+static void	ParallelJPEGSetup(jpeg_compress_struct *cinfo,
+				  jpeg_error_mgr *jerr,
+				  pjpeg_destination_mgr *dest,
+				  int Q, unsigned int width,
+				  unsigned int height, unsigned int jc)
+{
+  cinfo->err = jpeg_std_error(jerr);
+  setup_error_functions(cinfo);
+  jpeg_create_compress(cinfo);
+  dest->pub.init_destination = ParallelJPEGInitDestination;
+  dest->pub.empty_output_buffer = ParallelJPEGEmptyOutputBuffer;
+  dest->pub.term_destination = ParallelJPEGTermDestination;
+  cinfo->dest = &(dest->pub);
+  cinfo->image_width = width;
+  cinfo->image_height = height;
+  cinfo->input_components = jc;
+  cinfo->in_color_space = (jc == 3)? JCS_RGB: JCS_GRAYSCALE;
+  jpeg_set_defaults(cinfo);
+  cinfo->dct_method = JDCT_FASTEST;
+  jpeg_set_quality(cinfo, Q, TRUE);
+  // A restart marker after every MCU row
+  cinfo->restart_in_rows = 1;
+}
+
+/*!
+* \return	Offset of the first byte of entropy coded data.
+* \ingroup	WlzIIPServer
+* \brief	Finds the end of the start of scan marker segment of a
+* 		JPEG datastream.
+* \param	buf			The datastream.
+* \param	n			Number of bytes in the datastream.
+*/
+static size_t	ParallelJPEGScanStart(const unsigned char *buf, size_t n)
+throw(string)
+{
+  size_t	p = 2;
+
+  while(p + 4 <= n)
+  {
+    unsigned int m;
+
+    if(buf[p] != 0xff)
+    {
+      break;
+    }
+    m = buf[p + 1];
+    p += 2 + ((buf[p + 2] << 8) | buf[p + 3]);
+    if(m == 0xda)
+    {
+      return(p);
+    }
+  }
+  throw string("ParallelJPEGCompressor: No start of scan");
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Encodes the band and extracts its entropy coded data,
+* 		renumbering the restart markers for the band's position in
+* 		the image. All but the first band are preceded by the
+* 		restart marker which ends the previous band and the last
+* 		band is followed by the end of image marker.
+*/
+void ParallelJPEGCompressor::Band::encode()
+throw(string)
+{
+  TraceSpan	span("ParallelJPEGCompressor::Band::encode");
+  SlowLogSpan	slowSpan(SlowLog::ENCODE);
+
+  out.clear();
+  if(nRows > 0)
+  {
+    size_t	used,
+		start;
+    unsigned int r = firstMCURow;
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    pjpeg_destination_mgr dest;
+
+    dest.buf = NULL;
+    try
+    {
+      unsigned int stride = width * jpegChannels;
+      JSAMPROW row[1];
+
+      ParallelJPEGSetup(&cinfo, &jerr, &dest, Q, width, nRows, jpegChannels);
+      jpeg_start_compress(&cinfo, TRUE);
+      while(cinfo.next_scanline < nRows)
+      {
+        row[0] = &(rows[cinfo.next_scanline * stride]);
+	jpeg_write_scanlines(&cinfo, row, 1);
+      }
+      jpeg_finish_compress(&cinfo);
+      used = dest.size - dest.pub.free_in_buffer;
+      jpeg_destroy_compress(&cinfo);
+      start = ParallelJPEGScanStart(dest.buf, used);
+    }
+    catch(...)
+    {
+      // Destroying the compressor again is harmless
+      jpeg_destroy_compress(&cinfo);
+      free(dest.buf);
+      throw;
+    }
+    // Drop the end of image marker
+    used -= 2;
+    out.reserve(used - start + 4);
+    if(index > 0)
+    {
+      out.push_back(0xff);
+      out.push_back(0xd0 + ((r - 1) & 7));
+    }
+    // Byte stuffing means that an 0xff followed by RSTn is always a marker
+    for(size_t i = start; i < used; ++i)
+    {
+      out.push_back(dest.buf[i]);
+      if((dest.buf[i] == 0xff) && (i + 1 < used) &&
+         ((dest.buf[i + 1] & 0xf8) == 0xd0))
+      {
+        out.push_back(0xd0 + (r & 7));
+	++r;
+	++i;
+      }
+    }
+    free(dest.buf);
+    ServerStats::countCompression(false,
+                                  (unsigned long long )width * nRows *
+				  jpegChannels, out.size());
+  }
+  if(last)
+  {
+    out.push_back(0xff);
+    out.push_back(0xd9);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructor.
+* \param	quality			JPEG quality factor.
+* \param	bandRows		Number of rows in each band, this is
+* 					rounded up to a whole number of MCU
+* 					rows.
+*/
+ParallelJPEGCompressor::ParallelJPEGCompressor(int quality,
+					       unsigned int bandRows)
+{
+  Q = quality;
+  width = height = 0;
+  channels = jpegChannels = 0;
+  bandHeight = (bandRows > 0)? bandRows: 1;
+  mcuRowsPerBand = 0;
+  pool = WorkPool::get();
+  // Bound the bands in flight and so the memory used
+  window = (pool)? pool->getNumThreads() + 2: 1;
+  nBands = 0;
+  cur = NULL;
+  taken = NULL;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Destructor which waits for any bands still being encoded.
+*/
+ParallelJPEGCompressor::~ParallelJPEGCompressor()
+{
+  while(!bands.empty())
+  {
+    if(pool)
+    {
+      pool->wait(bands.front());
+    }
+    delete bands.front();
+    bands.pop_front();
+  }
+  delete taken;
+  delete cur;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Initialises the compression of an image and creates the
+* 		JPEG header.
+* \param	rawtile			Gives the width, height and number of
+* 					channels of the image. An alpha
+* 					channel is not encoded.
+*/
+void ParallelJPEGCompressor::InitCompression(const RawTile &rawtile)
+throw(string)
+{
+  unsigned int mcuHeight;
+  size_t	used,
+		start;
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  pjpeg_destination_mgr dest;
+
+  width = rawtile.width;
+  height = rawtile.height;
+  channels = rawtile.channels;
+  jpegChannels = ((channels == 2) || (channels == 4))? channels - 1: channels;
+  if(!((jpegChannels == 1) || (jpegChannels == 3)))
+  {
+    throw string("ParallelJPEGCompressor: JPEG can only handle images of "
+                 "either 1 or 3 channels");
+  }
+  // The header is written before the first MCU row is complete, so
+  // encode a single row of the whole image to get it.
+  dest.buf = NULL;
+  try
+  {
+    std::vector<unsigned char> blank(width * jpegChannels, 0);
+    JSAMPROW row[1];
+
+    ParallelJPEGSetup(&cinfo, &jerr, &dest, Q, width, height, jpegChannels);
+    jpeg_start_compress(&cinfo, TRUE);
+    mcuHeight = cinfo.max_v_samp_factor * DCTSIZE;
+    row[0] = &(blank[0]);
+    jpeg_write_scanlines(&cinfo, row, 1);
+    used = dest.size - dest.pub.free_in_buffer;
+    jpeg_destroy_compress(&cinfo);
+    start = ParallelJPEGScanStart(dest.buf, used);
+  }
+  catch(...)
+  {
+    jpeg_destroy_compress(&cinfo);
+    free(dest.buf);
+    throw;
+  }
+  header.assign(dest.buf, dest.buf + start);
+  free(dest.buf);
+  mcuRowsPerBand = (bandHeight + mcuHeight - 1) / mcuHeight;
+  bandHeight = mcuRowsPerBand * mcuHeight;
+  nBands = 0;
+  delete cur;
+  cur = new Band(Q, width, jpegChannels, bandHeight);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Adds rows to the image, submitting each band for encoding
+* 		as it is filled.
+* \param	rows			Rows with the number of channels given
+* 					to InitCompression().
+* \param	nRows			Number of rows.
+*/
+void ParallelJPEGCompressor::addRows(const unsigned char *rows,
+				     unsigned int nRows)
+throw(string)
+{
+  unsigned int srcStride = width * channels,
+  		dstStride = width * jpegChannels;
+
+  if(cur == NULL)
+  {
+    throw string("ParallelJPEGCompressor: Compression not initialised");
+  }
+  for(unsigned int k = 0; k < nRows; ++k)
+  {
+    const unsigned char *src = rows + k * srcStride;
+    unsigned char *dst = &(cur->rows[cur->nRows * dstStride]);
+
+    if(channels == jpegChannels)
+    {
+      memcpy(dst, src, dstStride);
+    }
+    else
+    {
+      // Remove the alpha channel, transparent pixels become white
+      for(unsigned int i = 0; i < width; ++i)
+      {
+        if(src[jpegChannels] == 0)
+	{
+	  memset(dst, 255, jpegChannels);
+	}
+	else
+	{
+	  memcpy(dst, src, jpegChannels);
+	}
+	src += channels;
+	dst += jpegChannels;
+      }
+    }
+    if(++(cur->nRows) == bandHeight)
+    {
+      submit(false);
+    }
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Submits the last, possibly empty, band. The remaining bands
+* 		should then be taken with takeBand().
+*/
+void ParallelJPEGCompressor::Finish()
+throw(string)
+{
+  if(cur == NULL)
+  {
+    throw string("ParallelJPEGCompressor: Compression not initialised");
+  }
+  submit(true);
+}
+
+/*!
+* \return	True if a band was taken, false if there are no more or
+* 		the next band has not yet been encoded.
+* \ingroup	WlzIIPServer
+* \brief	Takes the next band's data in order. The data remain valid
+* 		until the next call. If the next band is still being
+* 		encoded this waits for it when requested or when the
+* 		number of bands in flight has reached its limit.
+* \param	data			Destination pointer for the data.
+* \param	len			Destination pointer for the number of
+* 					bytes of data.
+* \param	wait			Wait for the next band if it is not
+* 					yet encoded.
+*/
+bool ParallelJPEGCompressor::takeBand(const unsigned char **data,
+				      unsigned int *len, bool wait)
+throw(string)
+{
+  Band *b;
+
+  delete taken;
+  taken = NULL;
+  if(bands.empty())
+  {
+    return(false);
+  }
+  b = bands.front();
+  if(pool && !(b->isDone()))
+  {
+    if(!wait && (bands.size() < window))
+    {
+      return(false);
+    }
+    pool->wait(b);
+  }
+  bands.pop_front();
+  taken = b;
+  if(b->failed)
+  {
+    throw(b->error);
+  }
+  *data = &(b->out[0]);
+  *len = b->out.size();
+  return(true);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Submits the current band for encoding and starts a new
+* 		band unless this is the last.
+* \param	last			True for the last band of the image.
+*/
+void ParallelJPEGCompressor::submit(bool last)
+{
+  Band *b = cur;
+
+  b->last = last;
+  b->index = nBands++;
+  b->firstMCURow = b->index * mcuRowsPerBand;
+  cur = (last)? NULL: new Band(Q, width, jpegChannels, bandHeight);
+  bands.push_back(b);
+  if(pool)
+  {
+    pool->submit(b);
+  }
+  else
+  {
+    b->run();
+  }
+}
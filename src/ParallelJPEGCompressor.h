@@ -0,0 +1,134 @@
+#ifndef _PARALLELJPEGCOMPRESSOR_H
+#define _PARALLELJPEGCOMPRESSOR_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _ParallelJPEGCompressor_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         ParallelJPEGCompressor.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	JPEG compression of large images in horizontal bands which
+* 		are encoded concurrently and joined using restart markers.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string>
+#include <deque>
+#include <vector>
+#include "RawTile.h"
+#include "WorkPool.h"
+
+/*!
+* \brief	Baseline JPEG compressor which encodes an image in
+* 		horizontal bands on the work pool. The image is given a
+* 		restart interval of one MCU row, so each band is an
+* 		independent run of MCU rows which starts with the DC
+* 		predictors reset. Each band is encoded by its own IJG
+* 		compressor using the same (standard) tables and its
+* 		restart markers are renumbered to follow on from the
+* 		previous band, so the joined bands are byte for byte the
+* 		stream that a single compressor with the same restart
+* 		interval would produce.
+*
+* 		Rows are added a strip at a time and copied into the
+* 		current band, any alpha channel being removed as by the
+* 		JPEGCompressor. Full bands are encoded as they are added
+* 		and taken in order with takeBand(). Bands are encoded
+* 		serially by the calling thread if there is no work pool.
+* \ingroup	WlzIIPServer
+*/
+class ParallelJPEGCompressor
+{
+  private:
+    class Band;
+
+    int			Q;			/*!< JPEG quality factor. */
+    unsigned int	width;			/*!< Image width. */
+    unsigned int	height;			/*!< Image height. */
+    unsigned int	channels;		/*!< Channels in the rows
+    						     added. */
+    unsigned int	jpegChannels;		/*!< Channels encoded. */
+    unsigned int	bandHeight;		/*!< Rows in each band, a
+    						     multiple of the MCU
+						     height. */
+    unsigned int	mcuRowsPerBand;		/*!< MCU rows in each band. */
+    std::vector<unsigned char> header;		/*!< JPEG header up to and
+    						     including the SOS. */
+    WorkPool		*pool;			/*!< Work pool or NULL. */
+    unsigned int	window;			/*!< Maximum bands in
+    						     flight. */
+    unsigned int	nBands;			/*!< Bands submitted. */
+    Band		*cur;			/*!< Band being filled. */
+    Band		*taken;			/*!< Band last taken. */
+    std::deque<Band *>	bands;			/*!< Bands submitted but not
+    						     yet taken. */
+
+    void		submit(bool last);
+
+    			ParallelJPEGCompressor(const ParallelJPEGCompressor &);
+    ParallelJPEGCompressor &operator=(const ParallelJPEGCompressor &);
+
+  public:
+    			ParallelJPEGCompressor(int quality,
+					       unsigned int bandRows);
+			~ParallelJPEGCompressor();
+    void		InitCompression(const RawTile &rawtile)
+			throw(std::string);
+    /*!
+    * \return	The JPEG header.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the header, which is valid after InitCompression().
+    */
+    const unsigned char	*getHeader() const
+    			{
+			  return(&(header[0]));
+			}
+    /*!
+    * \return	Size of the JPEG header.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the size of the header.
+    */
+    unsigned int	getHeaderSize() const
+    			{
+			  return(header.size());
+			}
+    void		addRows(const unsigned char *rows, unsigned int nRows)
+			throw(std::string);
+    void		Finish()
+			throw(std::string);
+    bool		takeBand(const unsigned char **data, unsigned int *len,
+    				 bool wait)
+			throw(std::string);
+};
+
+#endif
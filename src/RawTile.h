@@ -31,6 +31,7 @@ static char _RawTile_h[] = "University of Edinburgh $Id$";
 #include <string>
 #include <alloca.h>
 #include <cstdlib>
+#include "Fingerprint.h"
 
 
 /// Colour spaces - GREYSCALE, sRGB and CIELAB
@@ -41,6 +42,25 @@ enum CompressionType { UNCOMPRESSED, JPEG, DEFLATE, PNG }; // added PNG by Zsolt
 
 
 
+/// Reference counted buffer holding the data of a RawTile
+/** A buffer is shared by all of the copies of a tile, so copying a tile, for
+ *  example in to or out of the tile cache, does not copy its data. Copies
+ *  may be held by different threads, so the count is updated atomically.
+ *  The data of a shared buffer must not be modified: RawTile::writable()
+ *  gives a private copy first.
+ */
+struct RawTileBuffer {
+
+  /// The data, allocated using malloc
+  void *data;
+
+  /// Number of tiles sharing the buffer
+  volatile int refCount;
+
+};
+
+
+
 /// Class to represent a single image tile
 
 class RawTile{
@@ -68,18 +88,104 @@ class RawTile{
   /// Name of the file from which this tile comes
   std::string filename;
 
+  /// Fingerprint of the image and view state from which this tile comes,
+  /// used together with the fields above as the tile cache key
+  Fingerprint fingerprint;
+
+
+ private:
+
+  /// The buffer holding the data or NULL if the data is not owned by the tile
+  RawTileBuffer *buffer;
+
+
+  /// Count of the buffers allocated to copy tile data
+  static volatile unsigned long& copyCount() {
+    static volatile unsigned long n = 0;
+    return n;
+  }
+
+
+  /// Count of the bytes of tile data copied
+  static volatile unsigned long long& copyBytes() {
+    static volatile unsigned long long n = 0;
+    return n;
+  }
+
+
+  /// Release the tile's reference to its buffer, freeing it if unshared
+  void release() {
+    if( buffer && (__sync_sub_and_fetch( &(buffer->refCount), 1 ) == 0) ){
+      free( buffer->data );
+      delete buffer;
+    }
+    buffer = NULL;
+  }
+
+
+  /// Copy data in to a new buffer owned by the tile
+  /** @param d data to copy
+   *  @param len number of bytes
+   */
+  void copyData( const void *d, int len ) {
+    void *c = malloc( len );
+    if( c ){
+      memcpy( c, d, len );
+      (void )__sync_add_and_fetch( &copyCount(), 1 );
+      (void )__sync_add_and_fetch( &copyBytes(), (unsigned long long )len );
+    }
+    this->adopt( c, len );
+  }
+
+
+  /// Share the data of the given tile
+  /** The data of a tile which owns its buffer is shared, any other data
+   *  (such as an image's tile buffer, which is reused) is copied.
+   */
+  void shareData( const RawTile& tile ) {
+    if( tile.buffer ){
+      (void )__sync_add_and_fetch( &(tile.buffer->refCount), 1 );
+      buffer = tile.buffer;
+      data = tile.data;
+    }
+    else if( tile.data && (tile.dataLength > 0) ){
+      this->copyData( tile.data, tile.dataLength );
+    }
+    else{
+      data = NULL;
+    }
+  }
+
+
+  /// Copy the fields other than the data from the given tile
+  void copyFields( const RawTile& tile ) {
+    dataLength = tile.dataLength;
+    width = tile.width;
+    height = tile.height;
+    channels = tile.channels;
+    bpc = tile.bpc;
+    tileNum = tile.tileNum;
+    resolution = tile.resolution;
+    hSequence = tile.hSequence;
+    vSequence = tile.vSequence;
+    compressionType = tile.compressionType;
+    quality = tile.quality;
+    filename = tile.filename;
+    fingerprint = tile.fingerprint;
+    width_padding = tile.width_padding;
+  }
+
 
  public:
 
 
   /// Pointer to the image data
+  /** This is either in a buffer owned (and possibly shared) by the tile or
+   *  is simply a pointer to data owned by something else, eg an image's
+   *  tile buffer. It must only be modified through writable().
+   */
   void *data;
 
-  /// This tracks whether we have allocated memory locally for data
-  /// or whether it is simply a pointer
-  /** This is used in the destructor to make sure we deallocate correctly */
-  int localData;
-
   /// The size of the data pointed to by data
   int dataLength;
 
@@ -113,71 +219,85 @@ class RawTile{
 	   int w = 0, int h = 0, int c = 0, int b = 0) {
     width = w; height = h; bpc = b; dataLength = 0; data = NULL;
     tileNum = tn; resolution = res; hSequence = hs ; vSequence = vs;
-    localData = 0; channels = c; compressionType = UNCOMPRESSED; quality = 0;
-    width_padding = 0;
+    buffer = NULL; channels = c; compressionType = UNCOMPRESSED; quality = 0;
+    width_padding = 0; fingerprint.hi = fingerprint.lo = 0;
   };
 
 
-  /// Destructor to free the data array if is has previously be allocated locally
+  /// Destructor to release the data buffer if the tile has one
   ~RawTile() {
-    if( data && localData ) free( data );
+    this->release();
   }
 
 
-  /// Copy constructor - handles copying of data buffer
+  /// Copy constructor - shares the data buffer
   RawTile( const RawTile& tile ) {
+    buffer = NULL;
+    this->copyFields( tile );
+    this->shareData( tile );
+  }
 
-    dataLength = tile.dataLength;
-    width = tile.width;
-    height = tile.height;
-    channels = tile.channels;
-    bpc = tile.bpc;
-    tileNum = tile.tileNum;
-    resolution = tile.resolution;
-    hSequence = tile.hSequence;
-    vSequence = tile.vSequence;
-    compressionType = tile.compressionType;
-    quality = tile.quality;
-    filename = tile.filename;
-    width_padding = tile.width_padding;
-
-    data = malloc( dataLength );
 
-    if( data && (dataLength > 0) && tile.data ){
-      memcpy( data, tile.data, dataLength );
-      localData = 1;
+  /// Copy assignment constructor - shares the data buffer
+  RawTile& operator= ( const RawTile& tile ) {
+    if( this != &tile ){
+      this->release();
+      this->copyFields( tile );
+      this->shareData( tile );
     }
+    return *this;
   }
 
 
-  /// Copy assignment constructor
-  RawTile& operator= ( const RawTile& tile ) {
+  /// Take ownership of data allocated using malloc
+  /** Any previous data is released.
+   *  @param d data, which will be freed by the tile
+   *  @param len number of bytes of data
+   */
+  void adopt( void *d, int len ) {
+    this->release();
+    if( d ){
+      buffer = new RawTileBuffer;
+      buffer->data = d;
+      buffer->refCount = 1;
+    }
+    data = d;
+    dataLength = d ? len : 0;
+  }
 
-    dataLength = tile.dataLength;
-    width = tile.width;
-    height = tile.height;
-    channels = tile.channels;
-    bpc = tile.bpc;
-    tileNum = tile.tileNum;
-    resolution = tile.resolution;
-    hSequence = tile.hSequence;
-    vSequence = tile.vSequence;
-    compressionType = tile.compressionType;
-    quality = tile.quality;
-    filename = tile.filename;
-    width_padding = tile.width_padding;
 
-    data = malloc( dataLength );
+  /// Copy data in to a new buffer owned by the tile
+  /** Any previous data is released.
+   *  @param d data to copy
+   *  @param len number of bytes of data
+   */
+  void assign( const void *d, int len ) {
+    this->copyData( d, len );
+  }
 
-    if( data && (dataLength > 0) && tile.data ){
-      memcpy( data, tile.data, dataLength );
-      localData = 1;
-    }
 
-    return *this;
+  /// Return the data for modification in place
+  /** If the buffer is shared with other tiles the data is first copied to
+   *  a buffer of the tile's own. Data not owned by the tile is modified
+   *  in place, as its owner has given it to the tile for that.
+   *  @return pointer to the data
+   */
+  void* writable() {
+    if( buffer && (buffer->refCount > 1) ){
+      this->copyData( data, dataLength );
+    }
+    return data;
   }
 
 
+  /// Return the number of buffers allocated to copy tile data
+  static unsigned long getCopyCount() { return copyCount(); }
+
+
+  /// Return the number of bytes of tile data copied
+  static unsigned long long getCopyBytes() { return copyBytes(); }
+
+
   /// Return the size of the data
   int size() { return dataLength; }
 
@@ -0,0 +1,271 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _ServerStats_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         ServerStats.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Process wide counters and latency histograms reported in
+* 		the Prometheus text exposition format.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdio>
+#include <cstring>
+#include "ServerStats.h"
+
+using namespace std;
+
+/* Upper bounds of the latency histogram buckets in microseconds. */
+static const long serverStatsBounds[SERVER_STATS_BUCKETS] =
+{
+  1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000
+};
+
+volatile unsigned long long ServerStats::counters[N_COUNTERS];
+ServerStatsHistogram	ServerStats::requests;
+ServerStatsHistogram	ServerStats::objectLoads;
+Mutex			ServerStats::commandsMtx;
+map<string, ServerStatsHistogram *> ServerStats::commands;
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Adds an observation to a histogram.
+* \param	h			Histogram.
+* \param	us			Observed time in microseconds.
+*/
+void		ServerStats::observe(ServerStatsHistogram *h, long us)
+{
+  int		i = 0;
+
+  if(us < 0)
+  {
+    us = 0;
+  }
+  while((i < SERVER_STATS_BUCKETS) && (us > serverStatsBounds[i]))
+  {
+    ++i;
+  }
+  (void )__sync_add_and_fetch(&(h->bucket[i]), 1);
+  (void )__sync_add_and_fetch(&(h->sum), (unsigned long long )us);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Records the time taken to process a request.
+* \param	us			Time in microseconds.
+*/
+void		ServerStats::observeRequest(long us)
+{
+  observe(&requests, us);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Records the time taken to run a command. Only the names
+* 		of supported commands should be given, as each name has
+* 		its own histogram.
+* \param	command			Command name, eg JTL.
+* \param	us			Time in microseconds.
+*/
+void		ServerStats::observeCommand(const string &command, long us)
+{
+  ServerStatsHistogram *h;
+
+  {
+    MutexLock lock(commandsMtx);
+    map<string, ServerStatsHistogram *>::iterator it =
+        commands.find(command);
+
+    if(it == commands.end())
+    {
+      h = new ServerStatsHistogram;
+      (void )memset((void *)h, 0, sizeof(ServerStatsHistogram));
+      it = commands.insert(make_pair(command, h)).first;
+    }
+    h = it->second;
+  }
+  observe(h, us);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Records the time taken to read a Woolz object which was
+* 		not in the object cache.
+* \param	us			Time in microseconds.
+*/
+void		ServerStats::observeObjectLoad(long us)
+{
+  observe(&objectLoads, us);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Appends the HELP and TYPE lines of a metric.
+* \param	out			Output string.
+* \param	name			Metric name.
+* \param	type			Metric type, eg counter or gauge.
+* \param	help			Description of the metric.
+*/
+void		ServerStats::formatHeader(string &out, const char *name,
+					  const char *type, const char *help)
+{
+  out += string("# HELP ") + name + " " + help + "\n";
+  out += string("# TYPE ") + name + " " + type + "\n";
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Appends a sample of a metric.
+* \param	out			Output string.
+* \param	name			Metric name.
+* \param	labels			Labels without the enclosing braces,
+* 					eg format="jpeg", may be empty.
+* \param	value			Sample value.
+*/
+void		ServerStats::formatSample(string &out, const char *name,
+					  const string &labels, double value)
+{
+  char		buf[64];
+
+  (void )snprintf(buf, sizeof(buf), " %.15g\n", value);
+  out += name;
+  if(labels.length() > 0)
+  {
+    out += "{" + labels + "}";
+  }
+  out += buf;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Appends the samples of a histogram, with cumulative bucket
+* 		counts and the sum in seconds.
+* \param	out			Output string.
+* \param	name			Metric name.
+* \param	labels			Labels of the histogram, may be empty.
+* \param	h			Histogram.
+*/
+void		ServerStats::formatHistogram(string &out, const char *name,
+					     const string &labels,
+					     const ServerStatsHistogram *h)
+{
+  char		buf[32];
+  unsigned long	n = 0;
+  string	sep = (labels.length() > 0)? ",": "";
+  string	bucket = string(name) + "_bucket",
+  		sum = string(name) + "_sum",
+		cnt = string(name) + "_count";
+
+  for(int i = 0; i <= SERVER_STATS_BUCKETS; ++i)
+  {
+    n += h->bucket[i];
+    if(i < SERVER_STATS_BUCKETS)
+    {
+      (void )snprintf(buf, sizeof(buf), "le=\"%g\"",
+		      1.0e-06 * serverStatsBounds[i]);
+    }
+    else
+    {
+      (void )strcpy(buf, "le=\"+Inf\"");
+    }
+    formatSample(out, bucket.c_str(), labels + sep + buf, n);
+  }
+  formatSample(out, sum.c_str(), labels, 1.0e-06 * h->sum);
+  formatSample(out, cnt.c_str(), labels, n);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Appends all of the counters and histograms.
+* \param	out			Output string.
+*/
+void		ServerStats::format(string &out)
+{
+  formatHeader(out, "wlziipsrv_request_duration_seconds", "histogram",
+	       "Time taken to process requests.");
+  formatHistogram(out, "wlziipsrv_request_duration_seconds", "", &requests);
+  formatHeader(out, "wlziipsrv_command_duration_seconds", "histogram",
+	       "Time taken to run the commands of requests.");
+  {
+    MutexLock lock(commandsMtx);
+
+    for(map<string, ServerStatsHistogram *>::const_iterator it =
+	commands.begin(); it != commands.end(); ++it)
+    {
+      formatHistogram(out, "wlziipsrv_command_duration_seconds",
+		      "command=\"" + it->first + "\"", it->second);
+    }
+  }
+  formatHeader(out, "wlziipsrv_object_load_duration_seconds", "histogram",
+	       "Time taken to read Woolz objects not in the object cache.");
+  formatHistogram(out, "wlziipsrv_object_load_duration_seconds", "",
+		  &objectLoads);
+  formatHeader(out, "wlziipsrv_object_cache_hits_total", "counter",
+	       "Woolz objects found in the object cache.");
+  formatSample(out, "wlziipsrv_object_cache_hits_total", "",
+	       counters[OBJECT_CACHE_HITS]);
+  formatHeader(out, "wlziipsrv_object_cache_misses_total", "counter",
+	       "Woolz objects not found in the object cache.");
+  formatSample(out, "wlziipsrv_object_cache_misses_total", "",
+	       counters[OBJECT_CACHE_MISSES]);
+  formatHeader(out, "wlziipsrv_view_cache_hits_total", "counter",
+	       "View structures found in the object cache.");
+  formatSample(out, "wlziipsrv_view_cache_hits_total", "",
+	       counters[VIEW_CACHE_HITS]);
+  formatHeader(out, "wlziipsrv_view_cache_misses_total", "counter",
+	       "View structures not found in the object cache.");
+  formatSample(out, "wlziipsrv_view_cache_misses_total", "",
+	       counters[VIEW_CACHE_MISSES]);
+  formatHeader(out, "wlziipsrv_expression_cache_hits_total", "counter",
+	       "Evaluated selection expressions found in the object cache.");
+  formatSample(out, "wlziipsrv_expression_cache_hits_total", "",
+	       counters[EXPRESSION_CACHE_HITS]);
+  formatHeader(out, "wlziipsrv_expression_cache_misses_total", "counter",
+	       "Selection expressions evaluated.");
+  formatSample(out, "wlziipsrv_expression_cache_misses_total", "",
+	       counters[EXPRESSION_CACHE_MISSES]);
+  formatHeader(out, "wlziipsrv_compress_input_bytes_total", "counter",
+	       "Uncompressed bytes given to the compressors.");
+  formatSample(out, "wlziipsrv_compress_input_bytes_total",
+	       "format=\"jpeg\"", counters[JPEG_BYTES_IN]);
+  formatSample(out, "wlziipsrv_compress_input_bytes_total",
+	       "format=\"png\"", counters[PNG_BYTES_IN]);
+  formatHeader(out, "wlziipsrv_compress_output_bytes_total", "counter",
+	       "Compressed bytes produced by the compressors.");
+  formatSample(out, "wlziipsrv_compress_output_bytes_total",
+	       "format=\"jpeg\"", counters[JPEG_BYTES_OUT]);
+  formatSample(out, "wlziipsrv_compress_output_bytes_total",
+	       "format=\"png\"", counters[PNG_BYTES_OUT]);
+}
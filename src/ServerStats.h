@@ -0,0 +1,143 @@
+#ifndef _SERVERSTATS_H
+#define _SERVERSTATS_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _ServerStats_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         ServerStats.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Process wide counters and latency histograms reported in
+* 		the Prometheus text exposition format by OBJ=server-stats.
+* \ingroup	WlzIIPServer
+*/
+
+#include <map>
+#include <string>
+#include "Mutex.h"
+
+/* Number of finite latency histogram buckets. */
+#define SERVER_STATS_BUCKETS	13
+
+/*!
+* \brief	A latency histogram. The bucket counts are not cumulative,
+* 		the last bucket counts observations above all of the
+* 		bounds. All fields are updated atomically.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _ServerStatsHistogram
+{
+  volatile unsigned long bucket[SERVER_STATS_BUCKETS + 1]; /*!< Counts. */
+  volatile unsigned long long sum;		/*!< Sum in microseconds. */
+} ServerStatsHistogram;
+
+/*!
+* \brief	Counters and histograms of the requests processed by this
+* 		process. The counters are updated atomically so that
+* 		counting costs no more than an atomic add, only the
+* 		histograms of commands are found under a mutex. Each
+* 		server process has its own statistics, except for those
+* 		of a shared memory tile cache which are gathered by the
+* 		caller.
+* \ingroup	WlzIIPServer
+*/
+class ServerStats
+{
+  public:
+    /*!
+    * \brief	Event counters.
+    */
+    typedef enum _Counter
+    {
+      OBJECT_CACHE_HITS = 0,
+      OBJECT_CACHE_MISSES,
+      VIEW_CACHE_HITS,
+      VIEW_CACHE_MISSES,
+      EXPRESSION_CACHE_HITS,
+      EXPRESSION_CACHE_MISSES,
+      JPEG_BYTES_IN,
+      JPEG_BYTES_OUT,
+      PNG_BYTES_IN,
+      PNG_BYTES_OUT,
+      N_COUNTERS
+    } Counter;
+
+  private:
+    static volatile unsigned long long counters[N_COUNTERS];
+    static ServerStatsHistogram requests;	/*!< Request latency. */
+    static ServerStatsHistogram objectLoads;	/*!< Object load time. */
+    static Mutex	commandsMtx;		/*!< Protects commands. */
+    static std::map<std::string, ServerStatsHistogram *> commands;
+    						/*!< Latency of each
+						     command. */
+
+    static void		observe(ServerStatsHistogram *h, long us);
+    static void		formatHistogram(std::string &out, const char *name,
+    					const std::string &labels,
+					const ServerStatsHistogram *h);
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Adds to a counter.
+    * \param	c			Counter.
+    * \param	n			Amount to add.
+    */
+    static void		count(Counter c, unsigned long long n = 1)
+			{
+			  (void )__sync_add_and_fetch(&(counters[c]), n);
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Counts the bytes in and out of a compressor.
+    * \param	png			True for PNG, false for JPEG.
+    * \param	in			Uncompressed bytes.
+    * \param	out			Compressed bytes.
+    */
+    static void		countCompression(bool png, unsigned long long in,
+    					 unsigned long long out)
+			{
+			  count((png)? PNG_BYTES_IN: JPEG_BYTES_IN, in);
+			  count((png)? PNG_BYTES_OUT: JPEG_BYTES_OUT, out);
+			}
+    static void		observeRequest(long us);
+    static void		observeCommand(const std::string &command, long us);
+    static void		observeObjectLoad(long us);
+    static void		format(std::string &out);
+    static void		formatHeader(std::string &out, const char *name,
+    				     const char *type, const char *help);
+    static void		formatSample(std::string &out, const char *name,
+    				     const std::string &labels, double value);
+};
+
+#endif
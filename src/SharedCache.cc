@@ -0,0 +1,576 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _SharedCache_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         SharedCache.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Tile cache held in a POSIX shared memory segment so that
+* 		it can be shared by all of the server processes on a host.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "Log.h"
+#include "SharedCache.h"
+
+using namespace std;
+
+#define SHARED_CACHE_MAGIC	(0x574c5a43)	/* "WLZC" */
+#define SHARED_CACHE_VERSION	(2)
+#define SHARED_CACHE_WAYS	(8)
+#define SHARED_CACHE_CLASSES	(3)
+#define SHARED_CACHE_LOCKS	(256)
+#define SHARED_CACHE_ALIGN	(64)
+
+/*!
+* \enum		_SharedCacheSlotState
+* \ingroup	WlzIIPServer
+* \brief	State of a shared cache slot. Slots are only read when
+* 		valid, a slot left in the writing state by a process that
+* 		died is treated as empty.
+*/
+typedef enum _SharedCacheSlotState
+{
+  SHARED_CACHE_SLOT_EMPTY = 0,
+  SHARED_CACHE_SLOT_WRITING,
+  SHARED_CACHE_SLOT_VALID
+} SharedCacheSlotState;
+
+/*!
+* \struct	_SharedCacheSlot
+* \ingroup	WlzIIPServer
+* \brief	Index entry of a shared cache slot, the tile data is held in
+* 		the class's data area.
+*/
+typedef struct _SharedCacheSlot
+{
+  TileKey		key;		/*!< Key of the tile. */
+  int			width;		/*!< Tile width. */
+  int			height;		/*!< Tile height. */
+  int			channels;	/*!< Number of channels. */
+  int			bpc;		/*!< Bits per channel. */
+  unsigned int		widthPadding;	/*!< Width padding. */
+  int			dataLength;	/*!< Bytes of tile data. */
+  unsigned char		state;		/*!< SharedCacheSlotState. */
+  unsigned char		ref;		/*!< CLOCK reference bit. */
+} SharedCacheSlot;
+
+/*!
+* \struct	_SharedCacheSet
+* \ingroup	WlzIIPServer
+* \brief	A set of slots with its CLOCK hand.
+*/
+typedef struct _SharedCacheSet
+{
+  unsigned int		hand;		/*!< CLOCK hand. */
+  SharedCacheSlot	slot[SHARED_CACHE_WAYS]; /*!< The slots. */
+} SharedCacheSet;
+
+/*!
+* \struct	_SharedCacheClass
+* \ingroup	WlzIIPServer
+* \brief	Slot size class, offsets are from the segment base.
+*/
+typedef struct _SharedCacheClass
+{
+  size_t		slotSize;	/*!< Data bytes per slot. */
+  size_t		nSets;		/*!< Number of sets. */
+  size_t		setOff;		/*!< Offset of the set array. */
+  size_t		dataOff;	/*!< Offset of the data area. */
+} SharedCacheClass;
+
+/*!
+* \struct	_SharedCacheHeader
+* \ingroup	WlzIIPServer
+* \brief	Header at the start of the shared memory segment.
+*/
+typedef struct _SharedCacheHeader
+{
+  volatile unsigned int	magic;		/*!< Set last when initialised. */
+  unsigned int		version;	/*!< Layout version. */
+  size_t		segSize;	/*!< Segment size. */
+  size_t		maxTileSize;	/*!< Largest cacheable tile. */
+  SharedCacheClass	cls[SHARED_CACHE_CLASSES]; /*!< Slot classes. */
+  volatile long		nEntries;	/*!< Number of valid slots. */
+  volatile long		nBytes;		/*!< Bytes of valid tile data. */
+  pthread_mutex_t	lock[SHARED_CACHE_LOCKS]; /*!< Set locks. */
+} SharedCacheHeader;
+
+static inline size_t SharedCacheAlign(size_t n)
+{
+  return((n + SHARED_CACHE_ALIGN - 1) & ~((size_t )SHARED_CACHE_ALIGN - 1));
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructor which creates or attaches to the named shared
+* 		memory segment.
+* \param	shmName			Name of the shared memory object,
+* 					eg "/wlziipsrv".
+* \param	max			Segment size in MB.
+* \param	maxTileSize		Size of the largest tile (in bytes)
+* 					which will be cached.
+*/
+SharedCache::SharedCache(const std::string &shmName, float max,
+			 size_t maxTileSize)
+throw(std::string):
+Cache(0)
+{
+  int		fd,
+  		created = 0;
+  struct stat	st;
+
+  name = shmName;
+  base = NULL;
+  hdr = NULL;
+  warnedOversize = 0;
+  segSize = (size_t )(max * 1024000);
+  if(segSize < sizeof(SharedCacheHeader) + (1024 * 1024))
+  {
+    throw string("SharedCache: segment size is too small.");
+  }
+  // The class of the largest tiles must hold at least one set
+  if(segSize < SharedCacheAlign(sizeof(SharedCacheHeader)) +
+               SharedCacheAlign(sizeof(SharedCacheSet)) +
+               (SHARED_CACHE_WAYS * SharedCacheAlign(maxTileSize)))
+  {
+    throw string("SharedCache: segment size is too small for the "
+                 "largest tile.");
+  }
+  if((fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0)
+  {
+    created = 1;
+    if(ftruncate(fd, segSize) != 0)
+    {
+      close(fd);
+      shm_unlink(name.c_str());
+      throw string("SharedCache: failed to size shared memory " + name);
+    }
+  }
+  else if(errno == EEXIST)
+  {
+    int		i;
+
+    if((fd = shm_open(name.c_str(), O_RDWR, 0600)) < 0)
+    {
+      throw string("SharedCache: failed to open shared memory " + name);
+    }
+    // Wait for the creating process to size the segment
+    for(i = 0; i < 50; ++i)
+    {
+      if((fstat(fd, &st) == 0) && ((size_t )st.st_size >= segSize))
+      {
+        break;
+      }
+      usleep(100000);
+    }
+    if((fstat(fd, &st) != 0) || ((size_t )st.st_size < segSize))
+    {
+      close(fd);
+      throw string("SharedCache: shared memory " + name +
+                   " has an incompatible size.");
+    }
+    segSize = st.st_size;
+  }
+  else
+  {
+    throw string("SharedCache: failed to create shared memory " + name);
+  }
+  base = (unsigned char *)mmap(NULL, segSize, PROT_READ | PROT_WRITE,
+  			       MAP_SHARED, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED)
+  {
+    base = NULL;
+    throw string("SharedCache: failed to map shared memory " + name);
+  }
+  hdr = (SharedCacheHeader *)base;
+  if(created)
+  {
+    initialise(maxTileSize);
+    LOG_NOTICE("SharedCache: created " << name << " of " << segSize <<
+               " bytes");
+  }
+  else
+  {
+    int		i;
+
+    for(i = 0; (i < 50) && (hdr->magic != SHARED_CACHE_MAGIC); ++i)
+    {
+      usleep(100000);
+    }
+    __sync_synchronize();
+    if((hdr->magic != SHARED_CACHE_MAGIC) ||
+       (hdr->version != SHARED_CACHE_VERSION) ||
+       (hdr->maxTileSize < maxTileSize))
+    {
+      munmap(base, segSize);
+      base = NULL;
+      throw string("SharedCache: shared memory " + name +
+                   " was not initialised by a compatible server.");
+    }
+    LOG_NOTICE("SharedCache: attached to " << name << " with " <<
+               hdr->nEntries << " tiles");
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Destructor, detaches from (but does not remove) the
+* 		shared memory segment.
+*/
+SharedCache::~SharedCache()
+{
+  if(base)
+  {
+    munmap(base, segSize);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Initialises a newly created segment. The available space
+* 		is divided equally between the slot classes which have
+* 		slot sizes of the largest tile size and a quarter and a
+* 		sixteenth of this, since compressed tiles are much smaller
+* 		than uncompressed ones.
+* \param	maxTileSize		Size of the largest tile.
+*/
+void		SharedCache::initialise(size_t maxTileSize)
+{
+  int		c;
+  size_t	off,
+		avail;
+  pthread_mutexattr_t attr;
+
+  memset(hdr, 0, sizeof(SharedCacheHeader));
+  hdr->version = SHARED_CACHE_VERSION;
+  hdr->segSize = segSize;
+  hdr->maxTileSize = SharedCacheAlign(maxTileSize);
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  for(c = 0; c < SHARED_CACHE_LOCKS; ++c)
+  {
+    pthread_mutex_init(&(hdr->lock[c]), &attr);
+  }
+  pthread_mutexattr_destroy(&attr);
+  off = SharedCacheAlign(sizeof(SharedCacheHeader));
+  avail = (segSize - off) / SHARED_CACHE_CLASSES;
+  for(c = 0; c < SHARED_CACHE_CLASSES; ++c)
+  {
+    SharedCacheClass *cls = &(hdr->cls[c]);
+    size_t	setBytes;
+
+    cls->slotSize = SharedCacheAlign(hdr->maxTileSize >> (2 * c));
+    setBytes = SharedCacheAlign(sizeof(SharedCacheSet)) +
+               (SHARED_CACHE_WAYS * cls->slotSize);
+    cls->nSets = avail / setBytes;
+    if(cls->nSets < 1)
+    {
+      cls->nSets = 1;
+    }
+    cls->setOff = off;
+    off += SharedCacheAlign(cls->nSets * sizeof(SharedCacheSet));
+    cls->dataOff = off;
+    off += cls->nSets * SHARED_CACHE_WAYS * cls->slotSize;
+    if(off > segSize)
+    {
+      // Only possible for tiny segments, drop the class and give its
+      // space to the smaller classes
+      cls->nSets = 0;
+      off = cls->setOff;
+    }
+  }
+  __sync_synchronize();
+  hdr->magic = SHARED_CACHE_MAGIC;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Locks a set lock, making it consistent if its previous
+* 		owner died while holding it. Slots being written by the
+* 		dead owner are left in the writing state and so are never
+* 		read.
+* \param	lock			The lock.
+*/
+void		SharedCache::lockSet(pthread_mutex_t *lock)
+{
+  if(pthread_mutex_lock(lock) == EOWNERDEAD)
+  {
+    LOG_WARN("SharedCache: recovering lock from dead process");
+    pthread_mutex_consistent(lock);
+  }
+}
+
+/*!
+* \return	The set for the key.
+* \ingroup	WlzIIPServer
+* \brief	Finds the set and set lock for the given key hash in the
+* 		given class.
+* \param	cls			Slot class.
+* \param	hash			Hash of the complete tile key.
+* \param	lock			Destination pointer for the set lock.
+*/
+SharedCacheSet	*SharedCache::getSet(int cls, unsigned long long hash,
+				     pthread_mutex_t **lock)
+{
+  SharedCacheClass *c = &(hdr->cls[cls]);
+  size_t	idx = (size_t )(hash % c->nSets);
+
+  *lock = &(hdr->lock[(idx * SHARED_CACHE_CLASSES + cls) %
+                      SHARED_CACHE_LOCKS]);
+  return((SharedCacheSet *)(base + c->setOff) + idx);
+}
+
+/*!
+* \return	Pointer to the slot's data.
+* \ingroup	WlzIIPServer
+* \brief	Computes the address of a slot's tile data.
+* \param	cls			Slot class.
+* \param	set			The set.
+* \param	way			Slot within the set.
+*/
+unsigned char	*SharedCache::getSlotData(int cls, SharedCacheSet *set,
+					  int way)
+{
+  SharedCacheClass *c = &(hdr->cls[cls]);
+  size_t	idx = set - (SharedCacheSet *)(base + c->setOff);
+
+  return(base + c->dataOff +
+         (idx * SHARED_CACHE_WAYS + way) * c->slotSize);
+}
+
+/*!
+* \return	True if the slot holds the given tile.
+* \ingroup	WlzIIPServer
+* \brief	Tests whether a slot holds the given tile.
+*/
+bool		SharedCache::slotMatches(const SharedCacheSlot *slot,
+					 const TileKey &key)
+{
+  return((slot->state == SHARED_CACHE_SLOT_VALID) &&
+         (slot->key == key));
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Inserts a tile into the shared cache, tiles larger than the
+* 		largest slot are not cached and a warning is logged for
+* 		the first of these.
+* \param	r			Tile to be inserted.
+*/
+void		SharedCache::insert(const RawTile &r)
+{
+  int		c,
+  		w;
+  pthread_mutex_t *lock;
+  SharedCacheSet *set;
+  SharedCacheSlot *slot = NULL;
+  TileKey	key;
+  TraceSpan	span("SharedCache::insert");
+
+  if((r.data == NULL) || (r.dataLength <= 0))
+  {
+    return;
+  }
+  if((size_t )r.dataLength > hdr->cls[0].slotSize)
+  {
+    if(__sync_bool_compare_and_swap(&warnedOversize, 0, 1))
+    {
+      LOG_WARN("SharedCache: tiles larger than " << hdr->cls[0].slotSize <<
+               " bytes are not cached, first seen " << r.dataLength <<
+	       " bytes");
+    }
+    return;
+  }
+  // Use the smallest class that the tile fits
+  for(c = SHARED_CACHE_CLASSES - 1; c > 0; --c)
+  {
+    if((hdr->cls[c].nSets > 0) &&
+       ((size_t )r.dataLength <= hdr->cls[c].slotSize))
+    {
+      break;
+    }
+  }
+  if(hdr->cls[c].nSets == 0)
+  {
+    return;
+  }
+  key = TileKey::ofTile(r);
+  set = getSet(c, key.hash(), &lock);
+  lockSet(lock);
+  for(w = 0; w < SHARED_CACHE_WAYS; ++w)
+  {
+    if(slotMatches(&(set->slot[w]), key))
+    {
+      set->slot[w].ref = 1;
+      pthread_mutex_unlock(lock);
+      return;
+    }
+  }
+  // Use an empty slot if there is one
+  for(w = 0; w < SHARED_CACHE_WAYS; ++w)
+  {
+    if(set->slot[w].state != SHARED_CACHE_SLOT_VALID)
+    {
+      slot = &(set->slot[w]);
+      break;
+    }
+  }
+  // Otherwise advance the CLOCK hand to find a victim
+  if(slot == NULL)
+  {
+    for(;;)
+    {
+      w = set->hand;
+      set->hand = (set->hand + 1) % SHARED_CACHE_WAYS;
+      if(set->slot[w].ref)
+      {
+        set->slot[w].ref = 0;
+      }
+      else
+      {
+        slot = &(set->slot[w]);
+	break;
+      }
+    }
+    __sync_fetch_and_sub(&(hdr->nEntries), 1);
+    __sync_fetch_and_sub(&(hdr->nBytes), (long )(slot->dataLength));
+    countEviction();
+  }
+  slot->state = SHARED_CACHE_SLOT_WRITING;
+  slot->key = key;
+  slot->width = r.width;
+  slot->height = r.height;
+  slot->channels = r.channels;
+  slot->bpc = r.bpc;
+  slot->widthPadding = r.width_padding;
+  slot->dataLength = r.dataLength;
+  slot->ref = 0;
+  memcpy(getSlotData(c, set, slot - set->slot), r.data, r.dataLength);
+  slot->state = SHARED_CACHE_SLOT_VALID;
+  __sync_fetch_and_add(&(hdr->nEntries), 1);
+  __sync_fetch_and_add(&(hdr->nBytes), (long )(r.dataLength));
+  pthread_mutex_unlock(lock);
+}
+
+/*!
+* \return	True if the tile was found.
+* \ingroup	WlzIIPServer
+* \brief	Looks for a tile in the shared cache, copying it into the
+* 		given tile if found.
+* \param	key			Tile key.
+* \param	tile			Destination tile.
+*/
+bool		SharedCache::getTile(const TileKey &key, RawTile &tile)
+{
+  int		cls;
+  unsigned long long hash;
+
+  hash = key.hash();
+  for(cls = 0; cls < SHARED_CACHE_CLASSES; ++cls)
+  {
+    int		w;
+    pthread_mutex_t *lock;
+    SharedCacheSet *set;
+
+    if(hdr->cls[cls].nSets == 0)
+    {
+      continue;
+    }
+    set = getSet(cls, hash, &lock);
+    lockSet(lock);
+    for(w = 0; w < SHARED_CACHE_WAYS; ++w)
+    {
+      SharedCacheSlot *slot = &(set->slot[w]);
+
+      if(slotMatches(slot, key))
+      {
+	void	*data;
+
+	tile.assign(getSlotData(cls, set, w), slot->dataLength);
+	if((data = tile.data) != NULL)
+	{
+	  tile.filename.clear();
+	  tile.fingerprint = key.fingerprint;
+	  tile.resolution = key.resolution;
+	  tile.tileNum = key.tileNum;
+	  tile.hSequence = key.hSequence;
+	  tile.vSequence = key.vSequence;
+	  tile.compressionType = (CompressionType )(key.compressionType);
+	  tile.quality = key.quality;
+	  tile.width = slot->width;
+	  tile.height = slot->height;
+	  tile.channels = slot->channels;
+	  tile.bpc = slot->bpc;
+	  tile.width_padding = slot->widthPadding;
+	  slot->ref = 1;
+	}
+	pthread_mutex_unlock(lock);
+	return(data != NULL);
+      }
+    }
+    pthread_mutex_unlock(lock);
+  }
+  return(false);
+}
+
+/*!
+* \return	Number of tiles in the shared cache.
+* \ingroup	WlzIIPServer
+* \brief	Returns the number of tiles in the shared cache (for all
+* 		processes).
+*/
+unsigned int	SharedCache::getNumElements()
+{
+  return((unsigned int )(hdr->nEntries));
+}
+
+/*!
+* \return	Size of the cached tile data in MB.
+* \ingroup	WlzIIPServer
+* \brief	Returns the size of the tile data held in the shared cache.
+*/
+float		SharedCache::getMemorySize()
+{
+  return((float )(hdr->nBytes / 1024000.0));
+}
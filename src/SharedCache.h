@@ -0,0 +1,102 @@
+#ifndef _SHAREDCACHE_H
+#define _SHAREDCACHE_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _SharedCache_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         SharedCache.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Tile cache held in a POSIX shared memory segment so that
+* 		it can be shared by all of the server processes on a host.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string>
+#include "Cache.h"
+#include "TileKey.h"
+
+struct _SharedCacheHeader;
+struct _SharedCacheSet;
+struct _SharedCacheSlot;
+
+/*!
+* \brief	Tile cache in a POSIX shared memory segment.
+*
+* 		The segment holds a small header followed by a number of
+* 		slot classes. Each class has fixed size data slots which
+* 		are organised as a set associative hash table with
+* 		SHARED_CACHE_WAYS slots per set. A tile is stored in the
+* 		smallest class which it fits, sets are replaced using
+* 		the CLOCK algorithm and each set is protected by one of
+* 		a fixed number of robust process shared mutexes, so a
+* 		process which dies while holding a lock does not block
+* 		the others.
+*
+* 		The first process to open the segment creates and
+* 		initialises it, subsequent processes attach to it. The
+* 		segment persists until it is removed (eg from /dev/shm).
+* \ingroup	WlzIIPServer
+*/
+class SharedCache: public Cache
+{
+  private:
+    std::string		name;			/*!< Shared memory name. */
+    size_t		segSize;		/*!< Segment size in bytes. */
+    unsigned char	*base;			/*!< Mapped segment. */
+    struct _SharedCacheHeader *hdr;		/*!< Segment header. */
+    volatile int	warnedOversize;		/*!< Set once a tile too large
+    						     to cache has been
+						     logged. */
+
+    void		initialise(size_t maxTileSize);
+    struct _SharedCacheSet *getSet(int cls, unsigned long long hash,
+    				   pthread_mutex_t **lock);
+    unsigned char	*getSlotData(int cls, struct _SharedCacheSet *set,
+    				     int way);
+    static void		lockSet(pthread_mutex_t *lock);
+    static bool		slotMatches(const struct _SharedCacheSlot *slot,
+    				    const TileKey &key);
+
+  public:
+    			SharedCache(const std::string &shmName, float max,
+				    size_t maxTileSize)
+			throw(std::string);
+    virtual		~SharedCache();
+    virtual void	insert(const RawTile &r);
+    virtual bool	getTile(const TileKey &key, RawTile &tile);
+    virtual unsigned int getNumElements();
+    virtual float	getMemorySize();
+};
+
+#endif
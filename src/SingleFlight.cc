@@ -0,0 +1,231 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _SingleFlight_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         SingleFlight.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Coalescing of concurrent renders of the same tile.
+* \ingroup	WlzIIPServer
+*/
+
+
+#include "Log.h"
+#include "SingleFlight.h"
+
+using namespace std;
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructor.
+*/
+SingleFlight::SingleFlight()
+{
+  nRender = 0;
+  nCoalesced = 0;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Destructor. There should be no renders in flight.
+*/
+SingleFlight::~SingleFlight()
+{
+  FlightMap::iterator it;
+
+  for(it = flights.begin(); it != flights.end(); ++it)
+  {
+    pthread_cond_destroy(&(it->second->cond));
+    delete it->second;
+  }
+}
+
+/*!
+* \return	True if the caller must render the tile, false if the tile
+* 		was rendered by another thread.
+* \ingroup	WlzIIPServer
+* \brief	Joins the render of the tile with the given key. If no
+* 		render is in flight the caller becomes the leader, it must
+* 		render the tile and then call either complete() or fail()
+* 		with the same key. Otherwise the caller waits for the
+* 		leader and is given a copy of its tile.
+* \param	key			Key of the tile to render.
+* \param	tile			Set to the rendered tile when false
+* 					is returned.
+* \exception	The leader's error string if its render failed.
+*/
+bool		SingleFlight::lead(const TileKey &key, RawTile &tile)
+		throw(std::string)
+{
+  bool		failed;
+  std::string	error;
+  Flight	*flt;
+  FlightMap::iterator it;
+
+  {
+    MutexLock	lock(mutex);
+
+    it = flights.find(key);
+    if(it == flights.end())
+    {
+      flt = new Flight;
+      pthread_cond_init(&(flt->cond), NULL);
+      flt->waiters = 0;
+      flt->done = false;
+      flt->failed = false;
+      flights[key] = flt;
+      ++nRender;
+      return(true);
+    }
+    flt = it->second;
+    ++(flt->waiters);
+    ++nCoalesced;
+    while(!(flt->done))
+    {
+      pthread_cond_wait(&(flt->cond), mutex.native());
+    }
+    failed = flt->failed;
+    if(failed)
+    {
+      error = flt->error;
+    }
+    else
+    {
+      tile = flt->tile;
+    }
+    // The last waiter out frees the completed flight.
+    if(--(flt->waiters) == 0)
+    {
+      pthread_cond_destroy(&(flt->cond));
+      delete flt;
+    }
+  }
+  LOG_INFO("SingleFlight :: Coalesced render of tile " << key.tileNum);
+  if(failed)
+  {
+    throw error;
+  }
+  return(false);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Completes a render led by the caller, passing a copy of the
+* 		tile to any waiting threads.
+* \param	key			Key given to lead().
+* \param	tile			The rendered tile.
+*/
+void		SingleFlight::complete(const TileKey &key, const RawTile &tile)
+{
+  finish(key, &tile, NULL);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Completes a failed render led by the caller, waiting threads
+* 		will throw the given error.
+* \param	key			Key given to lead().
+* \param	error			Error string.
+*/
+void		SingleFlight::fail(const TileKey &key, const std::string &error)
+{
+  finish(key, NULL, &error);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Removes the flight from the table and wakes its waiters,
+* 		the flight is freed here if there are none and otherwise
+* 		by the last waiter.
+* \param	key			Key given to lead().
+* \param	tile			The rendered tile or NULL.
+* \param	error			Error string or NULL.
+*/
+void		SingleFlight::finish(const TileKey &key, const RawTile *tile,
+				     const std::string *error)
+{
+  Flight	*flt;
+  FlightMap::iterator it;
+  MutexLock	lock(mutex);
+
+  it = flights.find(key);
+  if(it != flights.end())
+  {
+    flt = it->second;
+    flights.erase(it);
+    if(flt->waiters == 0)
+    {
+      pthread_cond_destroy(&(flt->cond));
+      delete flt;
+    }
+    else
+    {
+      if(tile)
+      {
+	flt->tile = *tile;
+      }
+      else
+      {
+	flt->failed = true;
+	flt->error = *error;
+      }
+      flt->done = true;
+      pthread_cond_broadcast(&(flt->cond));
+    }
+  }
+}
+
+/*!
+* \return	Number of renders.
+* \ingroup	WlzIIPServer
+* \brief	Returns the number of renders which have been led.
+*/
+unsigned long	SingleFlight::getRenderCount()
+{
+  MutexLock	lock(mutex);
+
+  return(nRender);
+}
+
+/*!
+* \return	Number of coalesced renders.
+* \ingroup	WlzIIPServer
+* \brief	Returns the number of renders which were avoided by waiting
+* 		for a render already in flight.
+*/
+unsigned long	SingleFlight::getCoalescedCount()
+{
+  MutexLock	lock(mutex);
+
+  return(nCoalesced);
+}
@@ -0,0 +1,108 @@
+#ifndef _SINGLEFLIGHT_H
+#define _SINGLEFLIGHT_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _SingleFlight_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         SingleFlight.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Coalescing of concurrent renders of the same tile.
+* \ingroup	WlzIIPServer
+*/
+
+#include <map>
+#include <string>
+#include <pthread.h>
+#include "RawTile.h"
+#include "TileKey.h"
+#include "Mutex.h"
+
+/*!
+* \brief	Single flight table for tile renders. The first thread to
+* 		miss the tile cache for a key becomes the leader and renders
+* 		the tile, any other thread which misses on the same key
+* 		while the render is in flight waits for and then shares
+* 		the leader's result rather than rendering the tile again.
+* \ingroup	WlzIIPServer
+*/
+class SingleFlight
+{
+  private:
+    /*!
+    * \brief	An in flight render.
+    */
+    struct Flight
+    {
+      pthread_cond_t	cond;			/*!< Signalled on completion.*/
+      int		waiters;		/*!< Number of waiting
+      						     threads. */
+      bool		done;			/*!< Set on completion. */
+      bool		failed;			/*!< Set if the render
+      						     failed. */
+      RawTile		tile;			/*!< The rendered tile. */
+      std::string	error;			/*!< Error if failed. */
+    };
+    struct KeyLess
+    {
+      bool		operator()(const TileKey &a, const TileKey &b) const
+      			{
+			  return(a < b);
+			}
+    };
+    typedef std::map<TileKey, Flight *, KeyLess> FlightMap;
+
+    Mutex		mutex;			/*!< Protects the table. */
+    FlightMap		flights;		/*!< Renders in flight. */
+    unsigned long	nRender;		/*!< Number of renders led. */
+    unsigned long	nCoalesced;		/*!< Number of renders
+    						     avoided by waiting. */
+
+    void		finish(const TileKey &key, const RawTile *tile,
+    			       const std::string *error);
+
+    			SingleFlight(const SingleFlight &);
+    SingleFlight	&operator=(const SingleFlight &);
+
+  public:
+    			SingleFlight();
+			~SingleFlight();
+    bool		lead(const TileKey &key, RawTile &tile)
+			throw(std::string);
+    void		complete(const TileKey &key, const RawTile &tile);
+    void		fail(const TileKey &key, const std::string &error);
+    unsigned long	getRenderCount();
+    unsigned long	getCoalescedCount();
+};
+
+#endif
@@ -0,0 +1,273 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _SlowLog_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         SlowLog.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Log of slow requests with the costs of their stages.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Log.h"
+#include "SlowLog.h"
+
+using namespace std;
+
+__thread SlowLogRecord	*slowLogRecord = NULL;
+__thread SlowLogSpan	*SlowLogSpan::current = NULL;
+
+long			SlowLog::threshold = 0;
+int			SlowLog::fd = -1;
+
+/* Names of the stages and caches as used in the log. */
+static const char	*slowLogStageNames[SlowLog::N_STAGES] =
+{
+  "load", "expression", "section", "composite", "encode", "write"
+};
+static const char	*slowLogCacheNames[SlowLog::N_CACHES] =
+{
+  "tile", "object", "view", "expression"
+};
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Configures the slow request log, this should be called
+* 		before any requests are processed.
+* \param	ms			Threshold in milliseconds, requests
+* 					taking longer are logged, zero to
+* 					disable the log.
+* \param	path			Log file, which is appended to.
+*/
+void		SlowLog::configure(int ms, const string &path)
+{
+  threshold = 0;
+  if(ms > 0)
+  {
+    if((fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0)
+    {
+      LOG_ERROR("SlowLog :: Failed to open " << path <<
+                ", slow requests will not be logged.");
+    }
+    else
+    {
+      threshold = 1000L * ms;
+    }
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Adds time to a stage of the calling thread's request.
+* \param	s			The stage.
+* \param	us			Time in microseconds.
+*/
+void		SlowLog::addTime(Stage s, long long us)
+{
+  SlowLogRecord	*rec = slowLogRecord;
+
+  if(rec)
+  {
+    (void )__sync_add_and_fetch(&(rec->stage[s]), us);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Counts a cache hit or miss for the calling thread's request.
+* \param	c			The cache.
+* \param	hit			True for a hit.
+*/
+void		SlowLog::countCache(CacheId c, bool hit)
+{
+  SlowLogRecord	*rec = slowLogRecord;
+
+  if(rec)
+  {
+    (void )__sync_add_and_fetch((hit)? &(rec->hits[c]): &(rec->misses[c]),
+    				1);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Sets the object file of the calling thread's request.
+* \param	file			Object file.
+*/
+void		SlowLog::setObject(const string &file)
+{
+  SlowLogRecord	*rec = slowLogRecord;
+
+  if(rec)
+  {
+    MutexLock	lock(rec->mtx);
+
+    rec->object = file;
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Sets the view hash of the calling thread's request.
+* \param	hash			View hash.
+*/
+void		SlowLog::setView(const string &hash)
+{
+  SlowLogRecord	*rec = slowLogRecord;
+
+  if(rec)
+  {
+    MutexLock	lock(rec->mtx);
+
+    rec->view = hash;
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Adds a selection expression to the calling thread's
+* 		request, unless it has already been added.
+* \param	exp			Selection expression.
+*/
+void		SlowLog::addSelector(const string &exp)
+{
+  SlowLogRecord	*rec = slowLogRecord;
+
+  if(rec)
+  {
+    MutexLock	lock(rec->mtx);
+
+    if((";" + rec->selectors + ";").find(";" + exp + ";") == string::npos)
+    {
+      if(rec->selectors.length() > 0)
+      {
+	rec->selectors += ";";
+      }
+      rec->selectors += exp;
+    }
+  }
+}
+
+/*!
+* \return	The string quoted, with any quotes, backslashes and
+* 		control characters escaped.
+* \ingroup	WlzIIPServer
+* \brief	Quotes a string for the log.
+* \param	s			Given string.
+*/
+static string	SlowLogQuote(const string &s)
+{
+  string	q = "\"";
+
+  for(size_t i = 0; i < s.length(); ++i)
+  {
+    unsigned char c = s[i];
+
+    if((c == '"') || (c == '\\'))
+    {
+      q += '\\';
+      q += c;
+    }
+    else if(c < ' ')
+    {
+      char	buf[8];
+
+      (void )snprintf(buf, sizeof(buf), "\\x%02x", c);
+      q += buf;
+    }
+    else
+    {
+      q += c;
+    }
+  }
+  return(q + "\"");
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Called as a request ends, all of the request's pool jobs
+* 		having completed. Appends the request to the log if it
+* 		took longer than the threshold.
+* \param	rec			The request's record.
+* \param	query			The request's query string.
+* \param	us			Time taken by the request in
+* 					microseconds.
+*/
+void		SlowLog::endRequest(SlowLogRecord *rec, const string &query,
+				    long us)
+{
+  if((rec != NULL) && (threshold > 0) && (us > threshold))
+  {
+    int		i;
+    char	buf[64];
+    time_t	t = time(NULL);
+    struct tm	tm;
+    string	line;
+
+    (void )strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S",
+		    localtime_r(&t, &tm));
+    line = buf;
+    (void )snprintf(buf, sizeof(buf), " pid=%d total_ms=%.1f",
+		    (int )getpid(), 1.0e-03 * us);
+    line += buf;
+    for(i = 0; i < N_STAGES; ++i)
+    {
+      (void )snprintf(buf, sizeof(buf), " %s_ms=%.1f",
+		      slowLogStageNames[i], 1.0e-03 * rec->stage[i]);
+      line += buf;
+    }
+    for(i = 0; i < N_CACHES; ++i)
+    {
+      (void )snprintf(buf, sizeof(buf), " %s_cache=%lu/%lu",
+		      slowLogCacheNames[i], rec->hits[i],
+		      rec->hits[i] + rec->misses[i]);
+      line += buf;
+    }
+    {
+      MutexLock	lock(rec->mtx);
+
+      line += " object=" + SlowLogQuote(rec->object) +
+	      " view=" + SlowLogQuote(rec->view) +
+	      " selectors=" + SlowLogQuote(rec->selectors);
+    }
+    line += " query=" + SlowLogQuote(query) + "\n";
+    if(write(fd, line.c_str(), line.length()) != (ssize_t )line.length())
+    {
+      LOG_ERROR("SlowLog :: Failed to write slow request");
+    }
+  }
+}
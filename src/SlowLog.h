@@ -0,0 +1,271 @@
+#ifndef _SLOWLOG_H
+#define _SLOWLOG_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _SlowLog_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         SlowLog.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Log of slow requests with the costs of their stages.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string>
+#include <sys/time.h>
+#include "Mutex.h"
+
+struct _SlowLogRecord;
+
+/*!
+* \brief	Costs of the request being processed by the calling thread,
+* 		NULL if slow requests are not being logged. Pool jobs carry
+* 		the record of the request which created them.
+* \ingroup	WlzIIPServer
+*/
+extern __thread struct _SlowLogRecord *slowLogRecord;
+
+/*!
+* \brief	Log of slow requests.
+*
+* 		While slow requests are being logged every request has a
+* 		record in which the time spent in each stage (summed over
+* 		all of the threads working for the request), the cache
+* 		hits and misses and the object, view and selection
+* 		expressions used are accumulated. Stage times are
+* 		exclusive: a stage nested in another (eg compositing
+* 		within rendering) pauses the outer stage. Requests which
+* 		take longer than the threshold are appended to the log,
+* 		one line each, with a single write so that the lines of
+* 		several processes are not interleaved. When logging is
+* 		disabled each stage costs only the test of a thread
+* 		local.
+* \ingroup	WlzIIPServer
+*/
+class SlowLog
+{
+  public:
+    /*!
+    * \brief	Request stages.
+    */
+    typedef enum _Stage
+    {
+      LOAD = 0,				/*!< Reading Woolz objects. */
+      EXPRESSION,			/*!< Evaluating selections. */
+      SECTION,				/*!< Sectioning and rendering. */
+      COMPOSITE,			/*!< Compositing into tiles. */
+      ENCODE,				/*!< Compressing tiles and
+      					     images. */
+      WRITE,				/*!< Writing the response. */
+      N_STAGES
+    } Stage;
+    /*!
+    * \brief	Caches of which the hits and misses are recorded.
+    */
+    typedef enum _CacheId
+    {
+      TILE_CACHE = 0,
+      OBJECT_CACHE,
+      VIEW_CACHE,
+      EXPRESSION_CACHE,
+      N_CACHES
+    } CacheId;
+
+  private:
+    static long		threshold;		/*!< Threshold in
+    						     microseconds, 0 when
+						     disabled. */
+    static int		fd;			/*!< Log file descriptor. */
+
+  public:
+    static void		configure(int ms, const std::string &path);
+    /*!
+    * \return	True if slow requests are being logged.
+    * \ingroup	WlzIIPServer
+    * \brief	Checks whether requests should have records.
+    */
+    static bool		isEnabled()
+			{
+			  return(threshold > 0);
+			}
+    static void		addTime(Stage s, long long us);
+    static void		countCache(CacheId c, bool hit);
+    static void		setObject(const std::string &file);
+    static void		setView(const std::string &hash);
+    static void		addSelector(const std::string &exp);
+    static void		endRequest(struct _SlowLogRecord *rec,
+    				   const std::string &query, long us);
+    /*!
+    * \return	Time in microseconds.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the time used to time stages.
+    */
+    static long long	now()
+			{
+			  struct timeval tv;
+
+			  (void )gettimeofday(&tv, NULL);
+			  return(tv.tv_sec * 1000000LL + tv.tv_usec);
+			}
+};
+
+/*!
+* \brief	Costs of a request.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _SlowLogRecord
+{
+  volatile long long	stage[SlowLog::N_STAGES]; /*!< Microseconds spent in
+  						     each stage. */
+  volatile unsigned long hits[SlowLog::N_CACHES]; /*!< Cache hits. */
+  volatile unsigned long misses[SlowLog::N_CACHES]; /*!< Cache misses. */
+  Mutex			mtx;			/*!< Protects the strings. */
+  std::string		object;			/*!< Object file. */
+  std::string		view;			/*!< View hash. */
+  std::string		selectors;		/*!< Selection expressions,
+  						     separated by ';'. */
+
+  			_SlowLogRecord()
+			{
+			  for(int i = 0; i < SlowLog::N_STAGES; ++i)
+			  {
+			    stage[i] = 0;
+			  }
+			  for(int i = 0; i < SlowLog::N_CACHES; ++i)
+			  {
+			    hits[i] = misses[i] = 0;
+			  }
+			}
+} SlowLogRecord;
+
+/*!
+* \brief	A timed stage of a request, from construction to
+* 		destruction. Nothing is timed unless the thread is
+* 		working for a request which has a record. The time of a
+* 		stage excludes that of any stage nested within it.
+* \ingroup	WlzIIPServer
+*/
+class SlowLogSpan
+{
+  private:
+    SlowLog::Stage	stage;			/*!< The stage. */
+    long long		start;			/*!< Start of the current
+    						     period, zero if not
+						     timed. */
+    long long		acc;			/*!< Time of the previous
+    						     periods. */
+    SlowLogSpan		*parent;		/*!< Enclosing span. */
+    static __thread SlowLogSpan *current;	/*!< Innermost span of the
+    						     thread. */
+
+    			SlowLogSpan(const SlowLogSpan &);
+    SlowLogSpan		&operator=(const SlowLogSpan &);
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor which starts the stage, pausing any
+    * 		enclosing stage.
+    * \param	s			The stage.
+    */
+    			SlowLogSpan(SlowLog::Stage s):
+			  stage(s), start(0), acc(0), parent(NULL)
+			{
+			  if(slowLogRecord != NULL)
+			  {
+			    start = SlowLog::now();
+			    parent = current;
+			    if(parent && parent->start)
+			    {
+			      parent->acc += start - parent->start;
+			    }
+			    current = this;
+			  }
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Destructor which ends the stage, resuming any enclosing
+    * 		stage.
+    */
+    			~SlowLogSpan()
+			{
+			  if(start != 0)
+			  {
+			    long long t = SlowLog::now();
+
+			    SlowLog::addTime(stage, acc + t - start);
+			    current = parent;
+			    if(parent && parent->start)
+			    {
+			      parent->start = t;
+			    }
+			  }
+			}
+};
+
+/*!
+* \brief	Scoped slow log context, used to attribute the costs of
+* 		work done on behalf of a request by another thread (eg a
+* 		pool job) to the request.
+* \ingroup	WlzIIPServer
+*/
+class SlowLogContext
+{
+  private:
+    SlowLogRecord	*saved;			/*!< Previous record. */
+
+    			SlowLogContext(const SlowLogContext &);
+    SlowLogContext	&operator=(const SlowLogContext &);
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor which sets the thread's record.
+    * \param	rec			Request record, may be NULL.
+    */
+    			SlowLogContext(SlowLogRecord *rec):
+			  saved(slowLogRecord)
+			{
+			  slowLogRecord = rec;
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Destructor which restores the previous record.
+    */
+    			~SlowLogContext()
+			{
+			  slowLogRecord = saved;
+			}
+};
+
+#endif
@@ -0,0 +1,361 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _StripEncoder_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         StripEncoder.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Encoder stage of the pipelined CVT command, which compresses
+* 		image strips and streams them to the client.
+* \ingroup	WlzIIPServer
+*/
+
+#include "Log.h"
+#include "StripEncoder.h"
+#include "Trace.h"
+
+using namespace std;
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructor which allocates the strip buffers and starts
+* 		the encoder thread.
+* \param	w			Output writer.
+* \param	j			JPEG compressor, used if the type is
+* 					JPEG.
+* \param	p			PNG compressor, used if the type is
+* 					PNG.
+* \param	pj			Parallel JPEG compressor used in place
+* 					of the JPEG compressor, may be NULL.
+* \param	t			Compression type, JPEG or PNG.
+* \param	ob			Buffer the compressor was initialised
+* 					with.
+* \param	stripSize		Size of each strip buffer, which must
+* 					allow for the compression overhead.
+* \param	depth			Number of strips which may be waiting
+* 					to be encoded, zero to encode strips
+* 					as they are put.
+*/
+#ifdef DEBUG
+StripEncoder::StripEncoder(FileWriter *w,
+#else
+StripEncoder::StripEncoder(FCGIWriter *w,
+#endif
+			   JPEGCompressor *j, PNGCompressor *p,
+			   ParallelJPEGCompressor *pj,
+			   CompressionType t, unsigned char *ob,
+			   size_t stripSize, int depth)
+{
+  int	nBuf;
+
+  out = w;
+  jpeg = j;
+  png = p;
+  pjpeg = (t == JPEG)? pj: NULL;
+  type = t;
+  lastOut = ob;
+  threaded = false;
+  finishing = false;
+  failed = false;
+  traceId = traceRequestId;
+  slowLog = slowLogRecord;
+  pthread_cond_init(&cnd, NULL);
+  if(depth > 0)
+  {
+    threaded = (pthread_create(&thr, NULL, encoderThread, this) == 0);
+    if(!threaded)
+    {
+      LOG_WARN("StripEncoder :: Failed to create encoder thread, " <<
+               "encoding serially");
+    }
+  }
+  // One buffer for each waiting strip, one being encoded and one being
+  // assembled.
+  nBuf = (threaded)? depth + 2: 1;
+  for(int i = 0; i < nBuf; ++i)
+  {
+    buffers.push_back(new unsigned char[stripSize]);
+    freeStrips.push_back(buffers.back());
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Destructor which abandons any strips which have not been
+* 		encoded and frees the strip buffers.
+*/
+StripEncoder::~StripEncoder()
+{
+  stopThread(true);
+  pthread_cond_destroy(&cnd);
+  for(size_t i = 0; i < buffers.size(); ++i)
+  {
+    delete[] buffers[i];
+  }
+}
+
+/*!
+* \return	A strip buffer.
+* \ingroup	WlzIIPServer
+* \brief	Gives a strip buffer to assemble the next strip in, waiting
+* 		for one to be freed by the encoder if all are in use.
+*/
+unsigned char *StripEncoder::getStrip()
+throw(string)
+{
+  unsigned char *strip;
+  MutexLock lock(mtx);
+
+  while(freeStrips.empty() && !failed)
+  {
+    pthread_cond_wait(&cnd, mtx.native());
+  }
+  if(failed)
+  {
+    throw(error);
+  }
+  strip = freeStrips.front();
+  freeStrips.pop_front();
+  return(strip);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Queues an assembled strip to be encoded and written.
+* \param	strip			Strip buffer given by getStrip().
+* \param	height			Number of rows in the strip.
+*/
+void StripEncoder::putStrip(unsigned char *strip, unsigned int height)
+throw(string)
+{
+  Strip s;
+
+  s.data = strip;
+  s.height = height;
+  if(threaded)
+  {
+    MutexLock lock(mtx);
+
+    if(failed)
+    {
+      throw(error);
+    }
+    fullStrips.push_back(s);
+    pthread_cond_broadcast(&cnd);
+  }
+  else
+  {
+    encode(s);
+    freeStrips.push_back(strip);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Waits for all queued strips to be written and then writes
+* 		the end of the image.
+*/
+void StripEncoder::finish()
+throw(string)
+{
+  unsigned int len;
+
+  stopThread(false);
+  if(failed)
+  {
+    throw(error);
+  }
+  if(pjpeg)
+  {
+    pjpeg->Finish();
+    writeBands(true);
+    return;
+  }
+  if(type == PNG)
+  {
+    len = png->Finish();
+    lastOut = png->getData();
+  }
+  else
+  {
+    len = jpeg->Finish();
+  }
+  if(out->putStr((const char *)lastOut, len) != (int )len)
+  {
+    LOG_ERROR("CVT :: Error writing jpeg EOI markers");
+  }
+  if(out->flush() == -1)
+  {
+    LOG_ERROR("CVT :: Error flushing image");
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Compresses a strip and writes it out. The JPEG compressor
+* 		writes its output over the strip, the PNG compressor to
+* 		its own output buffer.
+* \param	strip			Strip to encode.
+*/
+void StripEncoder::encode(const Strip &strip)
+{
+  unsigned int len;
+  TraceSpan	span("StripEncoder::encode");
+
+  if(pjpeg)
+  {
+    pjpeg->addRows(strip.data, strip.height);
+    writeBands(false);
+    return;
+  }
+  if(type == PNG)
+  {
+    len = png->CompressStrip(strip.data, strip.height);
+    lastOut = png->getData();
+  }
+  else
+  {
+    len = jpeg->CompressStrip(strip.data, strip.height);
+    lastOut = strip.data;
+  }
+  LOG_INFO("CVT :: Compressed data strip length is " << len);
+  if(out->putStr((const char *)lastOut, len) != (int )len)
+  {
+    LOG_ERROR("CVT :: Error writing jpeg strip data: " << len);
+  }
+  if(out->flush() == -1)
+  {
+    LOG_ERROR("CVT :: Error flushing jpeg tile");
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Writes out the bands which the parallel JPEG compressor has
+* 		encoded, in order.
+* \param	wait			Wait for and write all of the bands
+* 					which have been submitted.
+*/
+void StripEncoder::writeBands(bool wait)
+{
+  unsigned int len;
+  bool		written = false;
+  const unsigned char *data;
+
+  while(pjpeg->takeBand(&data, &len, wait))
+  {
+    if(out->putStr((const char *)data, len) != (int )len)
+    {
+      LOG_ERROR("CVT :: Error writing jpeg band data: " << len);
+    }
+    written = true;
+  }
+  if(written && (out->flush() == -1))
+  {
+    LOG_ERROR("CVT :: Error flushing jpeg tile");
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Stops and joins the encoder thread if it is running.
+* \param	abort			If true strips which have not been
+* 					encoded are abandoned, otherwise
+* 					they are encoded first.
+*/
+void StripEncoder::stopThread(bool abort)
+{
+  if(threaded)
+  {
+    mtx.lock();
+    if(abort && !failed)
+    {
+      failed = true;
+      error = "StripEncoder :: Encoding aborted";
+    }
+    finishing = true;
+    pthread_cond_broadcast(&cnd);
+    mtx.unlock();
+    (void )pthread_join(thr, NULL);
+    threaded = false;
+  }
+}
+
+/*!
+* \return	NULL.
+* \ingroup	WlzIIPServer
+* \brief	Encoder thread function which encodes strips in order until
+* 		the encoder is finished or fails.
+* \param	arg			The StripEncoder.
+*/
+void *StripEncoder::encoderThread(void *arg)
+{
+  StripEncoder *se = (StripEncoder *)arg;
+  // The thread works for the request which created the encoder
+  TraceContext tctx(se->traceId);
+  SlowLogContext sctx(se->slowLog);
+  MutexLock lock(se->mtx);
+
+  for(;;)
+  {
+    Strip s;
+
+    while(se->fullStrips.empty() && !(se->finishing) && !(se->failed))
+    {
+      pthread_cond_wait(&(se->cnd), se->mtx.native());
+    }
+    if(se->failed || se->fullStrips.empty())
+    {
+      break;
+    }
+    s = se->fullStrips.front();
+    se->fullStrips.pop_front();
+    se->mtx.unlock();
+    try
+    {
+      se->encode(s);
+    }
+    catch(const string &e)
+    {
+      se->mtx.lock();
+      se->failed = true;
+      se->error = e;
+      pthread_cond_broadcast(&(se->cnd));
+      break;
+    }
+    se->mtx.lock();
+    se->freeStrips.push_back(s.data);
+    pthread_cond_broadcast(&(se->cnd));
+  }
+  return(NULL);
+}
@@ -0,0 +1,141 @@
+#ifndef _STRIPENCODER_H
+#define _STRIPENCODER_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _StripEncoder_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         StripEncoder.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Encoder stage of the pipelined CVT command, which compresses
+* 		image strips and streams them to the client.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+#include "RawTile.h"
+#include "JPEGCompressor.h"
+#include "PNGCompressor.h"
+#include "ParallelJPEGCompressor.h"
+#include "Writer.h"
+#include "Mutex.h"
+
+/*!
+* \brief	Compresses the strips of a CVT image and writes them out
+* 		on a thread of its own, so that encoding overlaps the
+* 		rendering and assembly of the following strips. The
+* 		encoder owns a fixed number of strip buffers: a strip is
+* 		assembled into a buffer given by getStrip() and passed
+* 		back with putStrip(), the buffer being reused once the
+* 		strip has been written. getStrip() blocks while all of
+* 		the buffers are in use, which bounds the memory used by
+* 		the pipeline. With a depth of zero or if the thread can
+* 		not be created strips are encoded as they are put.
+*
+* 		If a ParallelJPEGCompressor is given it is used in place
+* 		of the JPEG compressor, the strips being encoded in bands
+* 		on the work pool.
+*
+* 		The compressor must have been initialised for the image
+* 		and its header written before the first strip is put.
+* \ingroup	WlzIIPServer
+*/
+class StripEncoder
+{
+  private:
+    /*!
+    * \brief	An assembled strip waiting to be encoded.
+    */
+    struct Strip
+    {
+      unsigned char	*data;			/*!< Strip buffer. */
+      unsigned int	height;			/*!< Strip height. */
+    };
+
+#ifdef DEBUG
+    FileWriter		*out;			/*!< Output. */
+#else
+    FCGIWriter		*out;			/*!< Output. */
+#endif
+    JPEGCompressor	*jpeg;			/*!< JPEG compressor. */
+    PNGCompressor	*png;			/*!< PNG compressor. */
+    ParallelJPEGCompressor *pjpeg;		/*!< Parallel JPEG
+    						     compressor or NULL. */
+    CompressionType	type;			/*!< JPEG or PNG. */
+    unsigned char	*lastOut;		/*!< Where the compressor
+    						     last wrote its output. */
+    std::vector<unsigned char *> buffers;	/*!< All strip buffers. */
+    std::deque<unsigned char *> freeStrips;	/*!< Unused strip buffers. */
+    std::deque<Strip>	fullStrips;		/*!< Strips to be encoded. */
+    bool		threaded;		/*!< Encoder thread running.*/
+    bool		finishing;		/*!< No more strips. */
+    bool		failed;			/*!< Encoding failed or was
+    						     aborted. */
+    std::string		error;			/*!< Error if failed. */
+    Mutex		mtx;			/*!< Protects the strips. */
+    pthread_cond_t	cnd;			/*!< Signalled on change. */
+    pthread_t		thr;			/*!< Encoder thread. */
+    unsigned long	traceId;		/*!< Traced request. */
+    SlowLogRecord	*slowLog;		/*!< Request cost record. */
+
+    void		encode(const Strip &strip);
+    void		writeBands(bool wait);
+    void		stopThread(bool abort);
+    static void		*encoderThread(void *arg);
+
+    			StripEncoder(const StripEncoder &);
+    StripEncoder	&operator=(const StripEncoder &);
+
+  public:
+#ifdef DEBUG
+    			StripEncoder(FileWriter *w,
+#else
+    			StripEncoder(FCGIWriter *w,
+#endif
+				     JPEGCompressor *j, PNGCompressor *p,
+				     ParallelJPEGCompressor *pj,
+				     CompressionType t, unsigned char *ob,
+				     size_t stripSize, int depth);
+			~StripEncoder();
+    unsigned char	*getStrip()
+    			throw(std::string);
+    void		putStrip(unsigned char *strip, unsigned int height)
+    			throw(std::string);
+    void		finish()
+    			throw(std::string);
+};
+
+#endif
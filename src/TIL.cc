@@ -129,15 +129,25 @@ void TIL::run( Session* session, std::string argument ){
   }
 
 
+  /* Queue all of the tiles so that they may be rendered concurrently,
+     they are still sent in order as each one becomes available
+   */
+  TileQueue tilequeue( session->tileCache, *session->image, session->jpeg, session->png,
+		       resolution, session->view->xangle, session->view->yangle, JPEG );
+  for( int i = startx; i <= endx; i++ ){
+    for( int j = starty; j <= endy; j++ ){
+      tilequeue.add( i + (j*ntlx) );
+    }
+  }
+
+
   for( int i = startx; i <= endx; i++ ){
     for( int j = starty; j <= endy; j++ ){
 
       int n = i + (j*ntlx);
 
-      // Get our tile using our tile manager
-      TileManager tilemanager( session->tileCache, *session->image, session->jpeg, session->png);
-      RawTile rawtile = tilemanager.getTile( resolution, n, session->view->xangle,
-					     session->view->yangle, JPEG );
+      // Get our tile from the queue
+      RawTile rawtile = tilequeue.next();
 
       int len = rawtile.dataLength;
 
@@ -53,6 +53,7 @@ static char _Task_h[] = "University of Edinburgh $Id$";
 #include "Timer.h"
 #include "Writer.h"
 #include "Cache.h"
+#include "Mutex.h"
 
 #include "ViewParameters.h"
 #include "WlzImage.h"
@@ -80,11 +81,15 @@ struct Session {
 
   int	complexSelection;
   imageCacheMapType *imageCache;
+  Mutex* imageCacheMutex;
   Cache* tileCache;
 
   /// sectioning parameters for a Woolz object
   ViewParameters *viewParams;
 
+  /// identifies the client, used to follow its access pattern
+  std::string client;
+
 #ifdef DEBUG
   FileWriter* out;
 #else
@@ -212,6 +217,9 @@ class OBJ : public Task {
   /// wlz_foreground_objects handler
   void wlz_foreground_objects();
 
+  /// server_stats request handler
+  void server_stats();
+
 };
 
 
@@ -0,0 +1,178 @@
+#ifndef _TILEKEY_H
+#define _TILEKEY_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _TileKey_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         TileKey.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Fixed size binary keys for the tile caches.
+* \ingroup	WlzIIPServer
+*/
+
+#include "Fingerprint.h"
+#include "RawTile.h"
+
+/*!
+* \brief	Key identifying a tile in a tile cache. The image and its
+* 		view and selection state are reduced to a fingerprint so
+* 		the key is a fixed size POD which can be hashed and
+* 		compared without any heap allocation.
+* \ingroup	WlzIIPServer
+*/
+struct TileKey
+{
+  Fingerprint		fingerprint;		/*!< Image, view and selection
+  						     fingerprint. */
+  int			resolution;		/*!< Resolution number. */
+  int			tileNum;		/*!< Tile number. */
+  int			hSequence;		/*!< Horizontal sequence
+  						     number. */
+  int			vSequence;		/*!< Vertical sequence
+  						     number. */
+  int			compressionType;	/*!< Compression type. */
+  int			quality;		/*!< Compression quality. */
+
+  /*!
+  * \return	New tile key.
+  * \ingroup	WlzIIPServer
+  * \brief	Makes a tile key from its components.
+  * \param	fp			Image fingerprint.
+  * \param	r			Resolution number.
+  * \param	t			Tile number.
+  * \param	h			Horizontal sequence number.
+  * \param	v			Vertical sequence number.
+  * \param	c			Compression type.
+  * \param	q			Compression quality.
+  */
+  static TileKey	make(const Fingerprint &fp, int r, int t, int h, int v,
+  			     CompressionType c, int q)
+			{
+			  TileKey k;
+
+			  k.fingerprint = fp;
+			  k.resolution = r;
+			  k.tileNum = t;
+			  k.hSequence = h;
+			  k.vSequence = v;
+			  k.compressionType = c;
+			  k.quality = q;
+			  return(k);
+			}
+  /*!
+  * \return	Key of the given tile.
+  * \ingroup	WlzIIPServer
+  * \brief	Makes a tile key from a tile's fingerprint and fields.
+  * \param	r			Given tile.
+  */
+  static TileKey	ofTile(const RawTile &r)
+			{
+			  return(make(r.fingerprint, r.resolution, r.tileNum,
+				      r.hSequence, r.vSequence,
+				      r.compressionType, r.quality));
+			}
+  bool			operator==(const TileKey &k) const
+			{
+			  return((fingerprint == k.fingerprint) &&
+			         (resolution == k.resolution) &&
+				 (tileNum == k.tileNum) &&
+				 (hSequence == k.hSequence) &&
+				 (vSequence == k.vSequence) &&
+				 (compressionType == k.compressionType) &&
+				 (quality == k.quality));
+			}
+  bool			operator!=(const TileKey &k) const
+			{
+			  return(!(*this == k));
+			}
+  /*!
+  * \return	True if this key orders before the given key.
+  * \ingroup	WlzIIPServer
+  * \brief	Strict weak ordering so that keys can be used in ordered
+  * 		containers.
+  * \param	k			Given key.
+  */
+  bool			operator<(const TileKey &k) const
+			{
+			  const int a[6] = {resolution, tileNum, hSequence,
+			  		    vSequence, compressionType, quality},
+				    b[6] = {k.resolution, k.tileNum,
+				    	    k.hSequence, k.vSequence,
+					    k.compressionType, k.quality};
+
+			  if(fingerprint.hi != k.fingerprint.hi)
+			  {
+			    return(fingerprint.hi < k.fingerprint.hi);
+			  }
+			  if(fingerprint.lo != k.fingerprint.lo)
+			  {
+			    return(fingerprint.lo < k.fingerprint.lo);
+			  }
+			  for(int i = 0; i < 6; ++i)
+			  {
+			    if(a[i] != b[i])
+			    {
+			      return(a[i] < b[i]);
+			    }
+			  }
+			  return(false);
+			}
+  /*!
+  * \return	64 bit hash of the key.
+  * \ingroup	WlzIIPServer
+  * \brief	Mixes the tile fields into the (already well mixed)
+  * 		fingerprint to give a hash suitable for indexing an open
+  * 		addressing or set associative table.
+  */
+  unsigned long long	hash() const
+			{
+			  unsigned long long h;
+
+			  h = fingerprint.lo ^ (fingerprint.hi * 0x9e3779b97f4a7c15ULL);
+			  h ^= ((unsigned long long )(unsigned int )resolution << 32) |
+			       (unsigned int )tileNum;
+			  h *= 0xff51afd7ed558ccdULL;
+			  h ^= ((unsigned long long )(unsigned int )hSequence << 32) |
+			       (unsigned int )vSequence;
+			  h *= 0xc4ceb9fe1a85ec53ULL;
+			  h ^= ((unsigned long long )(unsigned int )compressionType << 32) |
+			       (unsigned int )quality;
+			  h ^= h >> 33;
+			  h *= 0xff51afd7ed558ccdULL;
+			  h ^= h >> 33;
+			  return(h);
+			}
+};
+
+#endif
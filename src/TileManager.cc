@@ -43,11 +43,16 @@ static char _TileManager_cc[] = "University of Edinburgh $Id$";
 
 #include "Log.h"
 #include "TileManager.h"
+#include "TilePrefetcher.h"
+#include "SlowLog.h"
 
 using namespace std;
 
-RawTile TileManager::getNewTile(int resolution, int tile,
-                                int xangle, int yangle, CompressionType c){
+SingleFlight TileManager::renderFlights;
+
+RawTile TileManager::getNewTile(const Fingerprint &fp, int resolution,
+				int tile, int xangle, int yangle,
+				CompressionType c){
   LOG_INFO("TileManager :: Cache Miss for resolution: " << resolution <<
             ", tile: " << tile);
   LOG_INFO("TileManager :: Cache Size: " <<
@@ -55,10 +60,10 @@ RawTile TileManager::getNewTile(int resolution, int tile,
 	    tileCache->getMemorySize() << "MB");
 
   RawTile ttt;
-  int len = 0;
 
   // Get our raw tile
   ttt = image->getTile( xangle, yangle, resolution, tile);
+  ttt.fingerprint = fp;
 
   if( c == UNCOMPRESSED ){
     // Add to our tile cache
@@ -70,11 +75,35 @@ RawTile TileManager::getNewTile(int resolution, int tile,
   }
 
 
+  this->compress( &ttt, c );
+
+  // Queue the compressed tile to be written to the disk cache
+  TileKey dk;
+  if( this->getDiskKey( TileKey::ofTile( ttt ), dk ) ){
+    RawTile dt( ttt );
+    dt.fingerprint = dk.fingerprint;
+    DiskCache::get()->insert( dt );
+  }
+
+  // Add to our tile cache
+  LOG_COND_INFO(insert_timer.start());
+  tileCache->insert( ttt );
+  LOG_INFO("TileManager :: Tile cache insertion time: " <<
+            insert_timer.getTime() << "us");
+  return ttt;
+}
+
+
+
+void TileManager::compress( RawTile* ttt, CompressionType c ){
+
+  int len = 0;
+
   /* We need to crop our edge tiles if they are not the full tile size
    */
-  if(((ttt.width != image->getTileWidth()) ||
-     (ttt.height != image->getTileHeight())) && (c == JPEG || c == PNG)){
-    this->crop( &ttt );
+  if(((ttt->width != image->getTileWidth()) ||
+     (ttt->height != image->getTileHeight())) && (c == JPEG || c == PNG)){
+    this->crop( ttt );
   }
 
 
@@ -83,24 +112,24 @@ RawTile TileManager::getNewTile(int resolution, int tile,
   case JPEG:
 
     // Do our JPEG compression iff we have an 8 bit per channel image
-    if( ttt.bpc == 8 ){
+    if( ttt->bpc == 8 ){
       LOG_COND_INFO(compression_timer.start());
-      len = jpeg->Compress(ttt);
+      len = jpeg->Compress(*ttt);
       LOG_INFO("TileManager :: JPEG Compression Time: " <<
 	        compression_timer.getTime() << "us");
-      ttt.compressionType = JPEG;
+      ttt->compressionType = JPEG;
     }
     break;
 
   case PNG:
 
     // Do our PNG compression iff we have an 8 bit per channel image
-    if( ttt.bpc == 8 ){
+    if( ttt->bpc == 8 ){
       LOG_COND_INFO(compression_timer.start());
-      len = png->Compress( ttt );
+      len = png->Compress( *ttt );
       LOG_INFO("TileManager :: PNG Compression Time: " <<
 	        compression_timer.getTime() << "us");
-      ttt.compressionType = PNG;
+      ttt->compressionType = PNG;
     }
     break;
 
@@ -114,12 +143,51 @@ RawTile TileManager::getNewTile(int resolution, int tile,
   default:
     break;
   }
-  // Add to our tile cache
-  LOG_COND_INFO(insert_timer.start());
-  tileCache->insert( ttt );
-  LOG_INFO("TileManager :: Tile cache insertion time: " <<
-            insert_timer.getTime() << "us");
-  return ttt;
+}
+
+
+
+bool TileManager::getBackgroundTile( const Fingerprint &fp, int resolution, int tile,
+				     int xangle, int yangle, CompressionType c, RawTile &rawtile ){
+
+  RawTile bg;
+
+  if( !image->getBackgroundTile( xangle, yangle, resolution, tile, bg ) ) return false;
+
+  // Background tiles only differ in their size, channels and background
+  // value, so the cache holds just one of each for all tile numbers
+  FingerprintBuilder fb;
+  fb.add( string( "background" ) );
+  fb.add( (int) bg.width );
+  fb.add( (int) bg.height );
+  fb.add( bg.channels );
+  fb.add( bg.bpc );
+  fb.add( bg.data, bg.channels * bg.bpc / 8 );
+  Fingerprint bfp = fb.get();
+  int q = ( c == JPEG )? jpeg->getQuality(): ( c == PNG )? 100: 0;
+
+  if( !tileCache->getTile( TileKey::make( bfp, 0, 0, 0, 0, c, q ), rawtile ) ){
+    LOG_INFO("TileManager :: Background tile for resolution: " << resolution <<
+	      ", tile: " << tile);
+    bg.fingerprint = bfp;
+    bg.tileNum = 0;
+    bg.resolution = 0;
+    bg.hSequence = 0;
+    bg.vSequence = 0;
+    bg.filename = "";
+    if( c != UNCOMPRESSED ) this->compress( &bg, c );
+    tileCache->insert( bg );
+    rawtile = bg;
+  }
+
+  // Our copy is given the identity of the tile requested
+  rawtile.fingerprint = fp;
+  rawtile.tileNum = tile;
+  rawtile.resolution = resolution;
+  rawtile.hSequence = xangle;
+  rawtile.vSequence = yangle;
+  rawtile.filename = image->getImagePath();
+  return true;
 }
 
 
@@ -131,17 +199,17 @@ void TileManager::crop( RawTile *ttt ){
       return;
 
   int tw = image->getTileWidth();
-  int th = image->getTileHeight();
 
-  LOG_INFO("TileManager :: Edge tile: Base size: " << tw << "x" << th <<
+  LOG_INFO("TileManager :: Edge tile: Base size: " << tw << "x" <<
+            image->getTileHeight() <<
             ": This tile: " << ttt->width << "x" << ttt->height);
 
-  // Create a new buffer, fill it with the old data, then copy
-  // back the cropped part into the RawTile buffer
-  int len = tw * th * ttt->channels * ttt->bpc/8;
+  // Copy the cropped part into a new buffer, as the tile's data may be
+  // shared with other copies of the tile
+  int len = ttt->width * ttt->height * ttt->channels * ttt->bpc/8;
   unsigned char* buffer = (unsigned char*) malloc( len );
-  unsigned char* src_ptr = (unsigned char*) memcpy( buffer, ttt->data, len );
-  unsigned char* dst_ptr = (unsigned char*) ttt->data;
+  unsigned char* src_ptr = (unsigned char*) ttt->data;
+  unsigned char* dst_ptr = buffer;
 
   // Copy one scanline at a time
   for( unsigned int i=0; i<ttt->height; i++ ){
@@ -151,12 +219,43 @@ void TileManager::crop( RawTile *ttt ){
     src_ptr += tw * ttt->channels * ttt->bpc/8;
   }
 
-  free( buffer );
+  // Replace the data and reset the data length
+  ttt->adopt( buffer, ttt->width * ttt->height * ttt->channels * ttt->bpc/8 );
+
+}
+
+
+
+
+bool TileManager::getDiskKey( const TileKey& key, TileKey& dk ){
+
+  if( !DiskCache::get() || (key.compressionType == UNCOMPRESSED) ) return false;
 
-  // Reset the data length
-  len = ttt->width * ttt->height * ttt->channels * ttt->bpc/8;
-  ttt->dataLength = len;
+  Fingerprint ffp = image->getFileFingerprint();
+  if( ffp.isZero() ) return false;
 
+  FingerprintBuilder fb;
+  fb.add( key.fingerprint );
+  fb.add( ffp );
+  dk = key;
+  dk.fingerprint = fb.get();
+  return true;
+}
+
+
+
+
+bool TileManager::getDiskTile( const TileKey& key, RawTile& rawtile ){
+
+  TileKey dk;
+  if( !this->getDiskKey( key, dk ) ||
+      !DiskCache::get()->getTile( dk, rawtile ) ) return false;
+
+  LOG_INFO("TileManager :: Disk cache hit for resolution: " <<
+	    key.resolution << ", tile: " << key.tileNum);
+  rawtile.fingerprint = key.fingerprint;
+  tileCache->insert( rawtile );
+  return true;
 }
 
 
@@ -164,13 +263,19 @@ void TileManager::crop( RawTile *ttt ){
 
 RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle, CompressionType c ){
 
+  RawTile cached;
   RawTile* rawtile = NULL;
+  Fingerprint fp;
   string tileCompression;
   string compName;
 
 
   // Time the tile retrieval
   LOG_COND_INFO(tile_timer.start());
+  rendered = false;
+
+  // Reduce the image, view and selection state to a fingerprint just once
+  fp = image->getFingerprint();
 
   /* Try to get this tile from our cache first as a JPEG, then uncompressed
      Otherwise decode one from the source image and add it to the cache
@@ -179,36 +284,54 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
     {
 
     case JPEG:
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					  xangle, yangle, JPEG, jpeg->getQuality() )) ) break;
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					 xangle, yangle, DEFLATE, 0 )) ) break;
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					 xangle, yangle, UNCOMPRESSED, 0 )) ) break;
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, JPEG, jpeg->getQuality() ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, DEFLATE, 0 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, UNCOMPRESSED, 0 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
       break;
 
     case PNG:
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					  xangle, yangle, PNG, 100 )) ) break;
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					 xangle, yangle, DEFLATE, 0 )) ) break;
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					 xangle, yangle, UNCOMPRESSED, 0 )) ) break;
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, PNG, 100 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, DEFLATE, 0 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, UNCOMPRESSED, 0 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
       break;
 
     case DEFLATE:
 
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					 xangle, yangle, DEFLATE, 0 )) ) break;
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					 xangle, yangle, UNCOMPRESSED, 0 )) ) break;
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, DEFLATE, 0 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, UNCOMPRESSED, 0 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
       break;
 
 
     case UNCOMPRESSED:
 
-      if( (rawtile = tileCache->getTile( image->getHash(), resolution, tile,
-					 xangle, yangle, UNCOMPRESSED, 0 )) ) break;
+      if( tileCache->getTile( TileKey::make( fp, resolution, tile, xangle, yangle, UNCOMPRESSED, 0 ),
+			    cached ) ){
+	rawtile = &cached; break;
+      }
       break;
 
 
@@ -218,15 +341,55 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
     }
 
 
-  // If we haven't been able to get a tile, get a raw one
+  // If we haven't been able to get a tile, read it from the disk cache or
+  // get a raw one. Concurrent misses on the same tile share a single render.
   if( !rawtile ){
-    RawTile newtile = this->getNewTile( resolution, tile, xangle, yangle, c );
+    RawTile newtile;
+    bool found = false;
+    int q = ( c == JPEG )? jpeg->getQuality(): ( c == PNG )? 100: 0;
+    TileKey key = TileKey::make( fp, resolution, tile, xangle, yangle, c, q );
+    if( renderFlights.lead( key, newtile ) ){
+      try{
+	// Another leader may have finished since our cache miss
+	if( !tileCache->getTile( key, newtile ) &&
+	    !this->getBackgroundTile( fp, resolution, tile, xangle, yangle, c, newtile ) &&
+	    !this->getDiskTile( key, newtile ) ){
+	  newtile = this->getNewTile( fp, resolution, tile, xangle, yangle, c );
+	  rendered = true;
+	}
+	found = !rendered;
+      }
+      catch( const string &error ){
+	renderFlights.fail( key, error );
+	throw;
+      }
+      catch( ... ){
+	renderFlights.fail( key, "TileManager :: render failed" );
+	throw;
+      }
+      renderFlights.complete( key, newtile );
+    }
+    if( !prefetch ){
+      tileCache->countRequest( TileKey::ofTile( newtile ), found, newtile.dataLength );
+      SlowLog::countCache( SlowLog::TILE_CACHE, found );
+    }
     LOG_INFO("TileManager :: Total Tile Access Time: " <<
 	      tile_timer.getTime() << "us");
     return newtile;
   }
 
 
+  // Count the hit and the use of a prefetched tile
+  if( !prefetch ){
+    tileCache->countRequest( TileKey::ofTile( *rawtile ), true, rawtile->dataLength );
+    SlowLog::countCache( SlowLog::TILE_CACHE, true );
+  }
+  if( !prefetch && TilePrefetcher::isEnabled() ){
+    int q = ( c == JPEG )? jpeg->getQuality(): ( c == PNG )? 100: 0;
+    TilePrefetcher::used( TileKey::make( fp, resolution, tile, xangle, yangle, c, q ) );
+  }
+
+
   // Define our compression names
   switch( rawtile->compressionType ){
     case JPEG: compName = "JPEG"; break;
@@ -248,8 +411,8 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
 
   if( c == JPEG && rawtile->compressionType == UNCOMPRESSED ){
 
-    // Rawtile is a pointer to the cache data, so we need to create a copy of it in case we compress it
-    RawTile ttt( *rawtile );
+    // Rawtile shares the cached tile's data, which compression leaves untouched
+    RawTile &ttt = *rawtile;
 
     // Do our JPEG compression iff we have an 8 bit per channel image
     if( rawtile->bpc == 8 ){
@@ -282,8 +445,8 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
 
   if( c == PNG && rawtile->compressionType == UNCOMPRESSED ){
 
-    // Rawtile is a pointer to the cache data, so we need to create a copy of it in case we compress it
-    RawTile ttt( *rawtile );
+    // Rawtile shares the cached tile's data, which compression leaves untouched
+    RawTile &ttt = *rawtile;
 
     // Do our PNG compression iff we have an 8 bit per channel image
     if( rawtile->bpc == 8 ){
@@ -317,3 +480,137 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
             tile_timer.getTime() << " microseconds");
   return RawTile( *rawtile );
 }
+
+
+
+/// A job which renders one tile of a TileQueue using its own image and compressors
+
+class TileQueue::Job: public WorkPoolJob{
+
+ public:
+
+  Cache* tileCache;
+  IIPImage* image;
+  JPEGCompressor jpeg;
+  PNGCompressor png;
+  int resolution, tile, xangle, yangle;
+  CompressionType c;
+  RawTile rawtile;
+  bool failed;
+  std::string error;
+
+  Job( Cache* tc, IIPImage* im, int quality, int r, int t, int x, int y,
+       CompressionType ct ): jpeg( quality ){
+    tileCache = tc;
+    image = im;
+    resolution = r;
+    tile = t;
+    xangle = x;
+    yangle = y;
+    c = ct;
+    failed = false;
+  };
+
+  ~Job(){ delete image; };
+
+  void run(){
+    try{
+      TileManager tilemanager( tileCache, image, &jpeg, &png );
+      rawtile = tilemanager.getTile( resolution, tile, xangle, yangle, c );
+    }
+    catch( const std::string& e ){
+      failed = true;
+      error = e;
+    }
+    catch( ... ){
+      failed = true;
+      error = "TileQueue :: Unknown error rendering tile";
+    }
+  };
+
+};
+
+
+
+TileQueue::TileQueue( Cache* tc, IIPImage* im, JPEGCompressor* j, PNGCompressor* p,
+		      int r, int x, int y, CompressionType ct,
+		      unsigned int ahead ){
+  tileCache = tc;
+  image = im;
+  jpeg = j;
+  png = p;
+  resolution = r;
+  xangle = x;
+  yangle = y;
+  c = ct;
+  nSubmitted = 0;
+  nTaken = 0;
+  pool = WorkPool::get();
+  // Render up to two tiles per thread ahead of the one being taken
+  window = (pool)? 2 * (pool->getNumThreads() + 1): 0;
+  if( pool && (window < ahead) ) window = ahead;
+}
+
+
+
+TileQueue::~TileQueue(){
+  while( !jobs.empty() ){
+    pool->wait( jobs.front() );
+    delete jobs.front();
+    jobs.pop_front();
+  }
+}
+
+
+
+void TileQueue::add( int tile ){
+  tiles.push_back( tile );
+}
+
+
+
+void TileQueue::fill(){
+  while( (nSubmitted < tiles.size()) && (jobs.size() < window) ){
+    // The clones are made and destroyed by this thread, only the
+    // rendering is done by the pool
+    IIPImage* clone = image->clone();
+    if( clone == NULL ){
+      LOG_INFO("TileQueue :: Image can not be cloned, rendering serially");
+      window = 0;
+      break;
+    }
+    Job* job = new Job( tileCache, clone, jpeg->getQuality(), resolution,
+			tiles[nSubmitted], xangle, yangle, c );
+    jobs.push_back( job );
+    pool->submit( job );
+    ++nSubmitted;
+  }
+}
+
+
+
+RawTile TileQueue::next() throw(std::string){
+  if( nTaken >= tiles.size() ){
+    throw std::string( "TileQueue :: No more tiles" );
+  }
+  fill();
+  if( jobs.empty() ){
+    // Serial rendering using the caller's image and compressors
+    TileManager tilemanager( tileCache, image, jpeg, png );
+    int tile = tiles[nTaken];
+    ++nSubmitted;
+    ++nTaken;
+    return tilemanager.getTile( resolution, tile, xangle, yangle, c );
+  }
+  Job* job = jobs.front();
+  jobs.pop_front();
+  ++nTaken;
+  pool->wait( job );
+  RawTile rawtile = job->rawtile;
+  bool failed = job->failed;
+  std::string error = job->error;
+  delete job;
+  fill();
+  if( failed ) throw error;
+  return rawtile;
+}
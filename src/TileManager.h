@@ -48,12 +48,17 @@ static char _TileManager_h[] = "University of Edinburgh $Id$";
 */
 
 #include <fstream>
+#include <vector>
+#include <deque>
 
 #include "RawTile.h"
 #include "IIPImage.h"
 #include "JPEGCompressor.h"
 #include "PNGCompressor.h"
 #include "Cache.h"
+#include "DiskCache.h"
+#include "SingleFlight.h"
+#include "WorkPool.h"
 #include "Timer.h"
 
 
@@ -71,11 +76,21 @@ class TileManager{
   IIPImage* image;
   Timer compression_timer, tile_timer, insert_timer;
 
+  /// Whether tiles are being prefetched rather than requested
+  bool prefetch;
+
+  /// Whether the last tile had to be rendered
+  bool rendered;
+
+  /// Renders in flight, shared by all threads
+  static SingleFlight renderFlights;
+
   /// Get a new tile from the image file
   /**
    *  If the JPEG tile already exists in the cache, use that, otherwise check for
    *  an uncompressed tile. If that does not exist either, extract a tile from the
    *  image. If this is an edge tile, crop it.
+   *  @param fp fingerprint of the image's current state
    *  @param resolution resolution number
    *  @param tile tile number
    *  @param xangle horizontal sequence number
@@ -83,8 +98,49 @@ class TileManager{
    *  @param c CompressionType
    *  @return RawTile
    */
-  RawTile getNewTile( int resolution, int tile, int xangle, int yangle, CompressionType c );
+  RawTile getNewTile( const Fingerprint &fp, int resolution, int tile, int xangle, int yangle, CompressionType c );
+
+
+  /// Crop and compress a newly rendered tile
+  /** @param t pointer to the tile, which is compressed in place
+   *  @param c CompressionType
+   */
+  void compress( RawTile* t, CompressionType c );
+
+
+  /// Get a tile which lies wholly in the image background
+  /**
+   *  Such tiles only differ in their size, channels and background value, so
+   *  rather than one for each tile number a single shared tile is cached and
+   *  encoded for each of these and each compression type and quality.
+   *  @param fp fingerprint of the image's current state
+   *  @param resolution resolution number
+   *  @param tile tile number
+   *  @param xangle horizontal sequence number
+   *  @param yangle vertical sequence number
+   *  @param c CompressionType
+   *  @param rawtile set to the tile if it is background
+   *  @return true if the tile is background
+   */
+  bool getBackgroundTile( const Fingerprint &fp, int resolution, int tile, int xangle, int yangle,
+			  CompressionType c, RawTile &rawtile );
+
+
+  /// Make the key of a tile in the disk cache
+  /** The identity of the image file is added to the tile's key, so that
+   *  the tiles of a file which has been replaced are not found.
+   *  @param key tile key
+   *  @param dk set to the disk cache key
+   *  @return true if there is a disk cache and the tile may be held in it
+   */
+  bool getDiskKey( const TileKey& key, TileKey& dk );
 
+  /// Get a tile from the disk cache, adding it to the tile cache
+  /** @param key tile key
+   *  @param rawtile set to the tile if it is found
+   *  @return true if the tile was found
+   */
+  bool getDiskTile( const TileKey& key, RawTile& rawtile );
 
   /// Crop a tile to remove padding
   /** @param t pointer to tile to crop
@@ -107,9 +163,22 @@ class TileManager{
     image = im;
     jpeg = j;
     png = p;
+    prefetch = false;
+    rendered = false;
   };
 
 
+  /// Mark the tiles got as prefetched, so that they are not counted as uses
+  /// of earlier prefetches
+  /** @param p true if prefetching */
+  void setPrefetch( bool p ){ prefetch = p; };
+
+
+  /// Return whether the last tile got had to be rendered rather than being
+  /// found in the cache
+  bool wasRendered(){ return rendered; };
+
+
 
   /// Get a tile from the cache
   /**
@@ -126,6 +195,95 @@ class TileManager{
   RawTile getTile( int resolution, int tile, int xangle, int yangle, CompressionType c );
 
 
+  /// Return the number of tiles rendered after cache misses
+  static unsigned long getRenderCount() { return renderFlights.getRenderCount(); }
+
+
+  /// Return the number of renders avoided by waiting for the same tile
+  /// to be rendered by another thread
+  static unsigned long getCoalescedCount() { return renderFlights.getCoalescedCount(); }
+
+
+};
+
+
+
+/// Class to get a sequence of tiles, rendering them concurrently
+
+/** Tiles are rendered by the process's WorkPool, each job using its own
+ *  clone of the image (and so its own tile buffer and Woolz temporaries)
+ *  and its own compressors. A bounded number of tiles are rendered ahead
+ *  of the one being taken, so that the tiles are given back in the order
+ *  in which they were added without holding every tile of a large request.
+ *  If there is no pool or the image can not be cloned the tiles are
+ *  rendered serially as they are taken.
+ */
+class TileQueue{
+
+
+ private:
+
+  class Job;
+
+  Cache* tileCache;
+  JPEGCompressor* jpeg;
+  PNGCompressor* png;
+  IIPImage* image;
+  int resolution, xangle, yangle;
+  CompressionType c;
+  WorkPool* pool;
+  unsigned int window;
+  std::vector<int> tiles;
+  unsigned int nSubmitted, nTaken;
+  std::deque<Job*> jobs;
+
+  /// Submit jobs until the window is full
+  void fill();
+
+  TileQueue( const TileQueue& );
+  TileQueue& operator=( const TileQueue& );
+
+
+ public:
+
+
+  /// Constructor
+  /**
+   * @param tc pointer to tile cache object
+   * @param im pointer to IIPImage object
+   * @param j  pointer to JPEGCompressor object
+   * @param p  pointer to PNGCompressor object
+   * @param resolution resolution number
+   * @param xangle horizontal sequence number
+   * @param yangle vertical sequence number
+   * @param c CompressionType
+   * @param ahead minimum number of tiles to render ahead of the one taken
+   */
+  TileQueue( Cache* tc, IIPImage* im, JPEGCompressor* j, PNGCompressor* p,
+	     int resolution, int xangle, int yangle, CompressionType c,
+	     unsigned int ahead = 0 );
+
+
+  /// Destructor, waits for any tiles still being rendered
+  ~TileQueue();
+
+
+  /// Add a tile to the end of the queue
+  /** @param tile tile number
+   */
+  void add( int tile );
+
+
+  /// Return true if all the tiles added have been taken
+  bool empty() { return nTaken >= tiles.size(); };
+
+
+  /// Take the next tile in the order in which they were added
+  /** @return RawTile
+   */
+  RawTile next() throw(std::string);
+
+
 };
 
 
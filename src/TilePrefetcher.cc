@@ -0,0 +1,457 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _TilePrefetcher_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         TilePrefetcher.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Speculative prefetching of the tiles a client is likely to
+* 		request next.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdlib>
+#include <vector>
+#include "Log.h"
+#include "Task.h"
+#include "TilePrefetcher.h"
+#include "WorkPool.h"
+
+using namespace std;
+
+/*!
+* \brief	Number of clients for which the last tile is remembered.
+*/
+static const unsigned int	TILEPREFETCHER_MAX_CLIENTS = 1024;
+
+/*!
+* \brief	Number of prefetched tiles which are remembered to count
+* 		hits and waste.
+*/
+static const unsigned int	TILEPREFETCHER_MAX_TRACKED = 4096;
+
+int TilePrefetcher::radius = 0;
+int TilePrefetcher::maxQueue = 0;
+Mutex TilePrefetcher::mtx;
+TilePrefetcher::ClientMap TilePrefetcher::clients;
+unsigned long TilePrefetcher::clock = 0;
+map<TileKey, unsigned long> TilePrefetcher::prefetched;
+deque<pair<TileKey, unsigned long> > TilePrefetcher::prefetchOrder;
+unsigned long TilePrefetcher::nIssued = 0;
+unsigned long TilePrefetcher::nDropped = 0;
+unsigned long TilePrefetcher::nRendered = 0;
+unsigned long TilePrefetcher::nHit = 0;
+unsigned long TilePrefetcher::nWasted = 0;
+
+/*!
+* \brief	Low priority job which renders a single tile into the tile
+* 		cache. The job owns a clone of the image and a copy of the
+* 		view parameters, both of which are made by the request
+* 		thread, and its own compressors.
+* \ingroup	WlzIIPServer
+*/
+class TilePrefetcher::Job: public WorkPoolJob
+{
+  private:
+    Cache		*tileCache;		/*!< Shared tile cache. */
+    WlzImage		*image;			/*!< Clone of the image. */
+    ViewParameters	view;			/*!< View of the tile. */
+    JPEGCompressor	jpeg;			/*!< JPEG compressor. */
+    PNGCompressor	png;			/*!< PNG compressor. */
+    int			resolution;		/*!< Resolution number. */
+    int			tile;			/*!< Tile number. */
+    int			xangle;			/*!< Horizontal sequence
+    						     number. */
+    int			yangle;			/*!< Vertical sequence
+    						     number. */
+    CompressionType	c;			/*!< Compression type. */
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor, takes ownership of the image clone.
+    * \param	tc			Tile cache.
+    * \param	im			Clone of the image.
+    * \param	vp			View parameters to be copied.
+    * \param	d			Distance of the view.
+    * \param	r			Resolution number.
+    * \param	t			Tile number.
+    * \param	x			Horizontal sequence number.
+    * \param	y			Vertical sequence number.
+    * \param	ct			Compression type.
+    * \param	q			JPEG quality.
+    */
+    			Job(Cache *tc, WlzImage *im, const ViewParameters &vp,
+			    double d, int r, int t, int x, int y,
+			    CompressionType ct, int q):
+			  tileCache(tc), image(im), view(vp), jpeg(q),
+			  resolution(r), tile(t), xangle(x), yangle(y), c(ct)
+			{
+			  view.dist = d;
+			  image->setView(&view);
+			}
+    			~Job()
+			{
+			  delete image;
+			}
+    void		run()
+			{
+			  try
+			  {
+			    TileManager tm(tileCache, image, &jpeg, &png);
+
+			    tm.setPrefetch(true);
+			    (void )tm.getTile(resolution, tile, xangle, yangle,
+			                      c);
+			    if(tm.wasRendered())
+			    {
+			      int q = (c == JPEG)? jpeg.getQuality():
+			              (c == PNG)? 100: 0;
+
+			      TilePrefetcher::rendered(
+			          TileKey::make(image->getFingerprint(),
+				                resolution, tile, xangle, yangle,
+						c, q));
+			    }
+			  }
+			  catch(const string &error)
+			  {
+			    LOG_INFO("TilePrefetcher :: " << error);
+			  }
+			  catch(...)
+			  {
+			    LOG_INFO("TilePrefetcher :: prefetch failed");
+			  }
+			}
+};
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Enables prefetching if the process has a WorkPool. This
+* 		should be called once the pool has been started and before
+* 		any requests are processed.
+* \param	r			Number of tiles or sections to prefetch
+* 					ahead, zero disables prefetching.
+* \param	q			Maximum number of pending prefetches.
+*/
+void TilePrefetcher::start(int r, int q)
+{
+  if((r > 0) && (WorkPool::get() != NULL))
+  {
+    radius = r;
+    maxQueue = (q > 0)? q: 1;
+    LOG_NOTICE("Prefetching tiles with radius " << radius);
+  }
+}
+
+/*!
+* \return	Fingerprint of the image and view without the distance.
+* \ingroup	WlzIIPServer
+* \brief	Fingerprints everything that identifies a section other than
+* 		its distance, so that movement through the sections can be
+* 		distinguished from any other change of view.
+* \param	path			Image path.
+* \param	vp			View parameters.
+*/
+Fingerprint TilePrefetcher::planeFingerprint(const string &path,
+					     const ViewParameters *vp)
+{
+  int		nChan;
+  FingerprintBuilder fb;
+
+  fb.add(path);
+  fb.add(vp->scale);
+  fb.add(vp->yaw);
+  fb.add(vp->pitch);
+  fb.add(vp->roll);
+  fb.add((int )(vp->mode));
+  fb.add(vp->depth);
+  fb.add((int )(vp->rmd));
+  fb.add((int )(vp->alpha));
+  fb.add(&(vp->fixed), sizeof(WlzDVertex3));
+  fb.add(&(vp->fixed2), sizeof(WlzDVertex3));
+  fb.add(&(vp->up), sizeof(WlzDVertex3));
+  nChan = vp->map.getNChan();
+  fb.add(nChan);
+  for(int i = 0; i < nChan; ++i)
+  {
+    fb.add(vp->map.getChan(i), sizeof(ImageMapChan));
+  }
+  for(CompoundSelector *sel = vp->selector; sel != NULL; sel = sel->next)
+  {
+    unsigned char rgba[4];
+
+    rgba[0] = sel->r;
+    rgba[1] = sel->g;
+    rgba[2] = sel->b;
+    rgba[3] = sel->a;
+    fb.add(sel->fingerprint);
+    fb.add(rgba, 4);
+  }
+  return(fb.get());
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Computes the number of tile columns and rows at the given
+* 		resolution, in the same way as TIL.
+* \param	image			Image with the current view prepared.
+* \param	resolution		Resolution number.
+* \param	ntlx			Destination for the number of columns.
+* \param	ntly			Destination for the number of rows.
+*/
+void TilePrefetcher::tileGrid(IIPImage *image, int resolution,
+			      int *ntlx, int *ntly)
+{
+  unsigned int	w = image->getImageWidth(),
+  		h = image->getImageHeight(),
+		tw = image->getTileWidth(),
+		th = image->getTileHeight();
+  int		nRes = image->getNumResolutions();
+
+  for(int i = 0; i < (nRes - resolution - 1); ++i)
+  {
+    w /= 2;
+    h /= 2;
+  }
+  *ntlx = (tw > 0)? (w + tw - 1) / tw: 0;
+  *ntly = (th > 0)? (h + th - 1) / th: 0;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Called by JTL and PTL once a tile has been served. Compares
+* 		the tile with the last tile served to the same client and
+* 		if the client has moved by a single tile within the section
+* 		or by a distance step with the same tile, queues prefetches
+* 		of the tiles which continue the movement.
+* \param	session			The request's session.
+* \param	resolution		Resolution of the tile served.
+* \param	tile			Number of the tile served.
+* \param	c			Compression type of the tile served.
+*/
+void TilePrefetcher::served(Session *session, int resolution, int tile,
+			    CompressionType c)
+{
+  int		ntlx,
+  		ntly;
+  bool		moved = false;
+  Client	cur;
+  WlzImage	*image;
+  WorkPool	*pool;
+
+  if((radius <= 0) || ((pool = WorkPool::get()) == NULL) ||
+     (session->viewParams == NULL) ||
+     ((image = dynamic_cast<WlzImage *>(*(session->image))) == NULL))
+  {
+    return;
+  }
+  tileGrid(image, resolution, &ntlx, &ntly);
+  if((ntlx <= 0) || (ntly <= 0))
+  {
+    return;
+  }
+  cur.plane = planeFingerprint(image->getImagePath(), session->viewParams);
+  cur.dist = session->viewParams->dist;
+  cur.resolution = resolution;
+  cur.tile = tile;
+  cur.xangle = session->view->xangle;
+  cur.yangle = session->view->yangle;
+  cur.compression = c;
+  cur.quality = (c == JPEG)? session->jpeg->getQuality(): 0;
+  cur.dx = cur.dy = 0;
+  cur.step = 0.0;
+  /* Find the movement from the client's last tile. */
+  {
+    MutexLock	lock(mtx);
+    ClientMap::iterator it = clients.find(session->client);
+
+    if(it != clients.end())
+    {
+      const Client &prev = it->second;
+
+      if((prev.plane == cur.plane) &&
+         (prev.resolution == cur.resolution) &&
+	 (prev.xangle == cur.xangle) && (prev.yangle == cur.yangle) &&
+	 (prev.compression == cur.compression) &&
+	 (prev.quality == cur.quality))
+      {
+	if(prev.dist == cur.dist)
+	{
+	  int	dx = (cur.tile % ntlx) - (prev.tile % ntlx),
+		dy = (cur.tile / ntlx) - (prev.tile / ntlx);
+
+	  if((dx == 0) && (dy == 0))
+	  {
+	    /* A repeated request, keep the previous movement. */
+	    cur.dx = prev.dx;
+	    cur.dy = prev.dy;
+	    cur.step = prev.step;
+	  }
+	  else if((abs(dx) <= 1) && (abs(dy) <= 1))
+	  {
+	    cur.dx = dx;
+	    cur.dy = dy;
+	    moved = true;
+	  }
+	}
+	else if(prev.tile == cur.tile)
+	{
+	  cur.step = cur.dist - prev.dist;
+	  moved = true;
+	}
+      }
+    }
+    cur.stamp = ++clock;
+    clients[session->client] = cur;
+    if(clients.size() > TILEPREFETCHER_MAX_CLIENTS)
+    {
+      ClientMap::iterator oldest = clients.begin();
+
+      for(it = clients.begin(); it != clients.end(); ++it)
+      {
+	if(it->second.stamp < oldest->second.stamp)
+	{
+	  oldest = it;
+	}
+      }
+      clients.erase(oldest);
+    }
+  }
+  if(!moved)
+  {
+    return;
+  }
+  /* Queue the tiles which continue the movement, nearest first. */
+  for(int k = 1; k <= radius; ++k)
+  {
+    vector<pair<int, double> > ahead;
+
+    if(cur.step != 0.0)
+    {
+      ahead.push_back(make_pair(tile, cur.dist + cur.step * k));
+    }
+    else
+    {
+      int	x0 = tile % ntlx,
+      		y0 = tile / ntlx;
+
+      /* The ring of tiles at distance k which lie ahead of the pan. */
+      for(int j = -k; j <= k; ++j)
+      {
+	for(int i = -k; i <= k; ++i)
+	{
+	  int	x = x0 + i,
+	  	y = y0 + j;
+
+	  if(((abs(i) == k) || (abs(j) == k)) &&
+	     ((i * cur.dx + j * cur.dy) > 0) &&
+	     (x >= 0) && (x < ntlx) && (y >= 0) && (y < ntly))
+	  {
+	    ahead.push_back(make_pair(x + y * ntlx, cur.dist));
+	  }
+	}
+      }
+    }
+    for(unsigned int i = 0; i < ahead.size(); ++i)
+    {
+      WlzImage	*clone;
+      Job	*job;
+
+      if((clone = dynamic_cast<WlzImage *>(image->clone())) == NULL)
+      {
+	return;
+      }
+      job = new Job(session->tileCache, clone, *(session->viewParams),
+		    ahead[i].second, resolution, ahead[i].first,
+		    cur.xangle, cur.yangle, c, session->jpeg->getQuality());
+      if(pool->submitIdle(job, maxQueue))
+      {
+	(void )__sync_add_and_fetch(&nIssued, 1);
+      }
+      else
+      {
+	delete job;
+	(void )__sync_add_and_fetch(&nDropped, 1);
+	return;
+      }
+    }
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Records a tile rendered by a prefetch, forgetting the oldest
+* 		prefetched tile (which is then counted as wasted if it has
+* 		not been used) when too many are remembered.
+* \param	key			Key of the tile rendered.
+*/
+void TilePrefetcher::rendered(const TileKey &key)
+{
+  MutexLock	lock(mtx);
+  unsigned long	seq = ++nRendered;
+
+  prefetched[key] = seq;
+  prefetchOrder.push_back(make_pair(key, seq));
+  while(prefetchOrder.size() > TILEPREFETCHER_MAX_TRACKED)
+  {
+    map<TileKey, unsigned long>::iterator it;
+
+    /* Keys which have since been used or prefetched again are not
+     * wasted. */
+    it = prefetched.find(prefetchOrder.front().first);
+    if((it != prefetched.end()) &&
+       (it->second == prefetchOrder.front().second))
+    {
+      prefetched.erase(it);
+      ++nWasted;
+    }
+    prefetchOrder.pop_front();
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Called by TileManager when a tile is found in the cache,
+* 		counting a hit if the tile was prefetched.
+* \param	key			Key of the tile requested.
+*/
+void TilePrefetcher::used(const TileKey &key)
+{
+  MutexLock	lock(mtx);
+
+  if(prefetched.erase(key) > 0)
+  {
+    ++nHit;
+  }
+}
@@ -0,0 +1,174 @@
+#ifndef _TILEPREFETCHER_H
+#define _TILEPREFETCHER_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _TilePrefetcher_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         TilePrefetcher.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Speculative prefetching of the tiles a client is likely to
+* 		request next.
+* \ingroup	WlzIIPServer
+*/
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include "Fingerprint.h"
+#include "Mutex.h"
+#include "RawTile.h"
+#include "TileKey.h"
+
+class IIPImage;
+class ViewParameters;
+struct Session;
+
+/*!
+* \brief	Prefetches the tiles that a client is likely to request
+* 		next. Each tile served to a client is compared with the
+* 		previous tile served to the same client: if the client is
+* 		panning across a section the neighbouring tiles ahead of
+* 		it are prefetched, and if it is stepping through sections
+* 		the same tile in the following sections is prefetched.
+* 		Nothing is prefetched until a movement has been seen.
+*
+* 		Prefetched tiles are rendered by low priority jobs in the
+* 		WorkPool's idle queue, so only otherwise idle pool threads
+* 		are used, and are inserted into the tile cache by a
+* 		TileManager just as if they had been requested. The keys
+* 		of the tiles rendered are remembered (up to a limit) so
+* 		that the prefetches which are later used (hits) and those
+* 		which are not (wasted) can be counted.
+*
+* 		Only Woolz images are prefetched since they are the only
+* 		images which can be cloned for use by other threads.
+* \ingroup	WlzIIPServer
+*/
+class TilePrefetcher
+{
+  private:
+    class Job;
+
+    /*!
+    * \brief	Last tile served to a client and its movement.
+    */
+    struct Client
+    {
+      Fingerprint	plane;			/*!< Fingerprint of the image
+      						     and view without the
+						     distance. */
+      double		dist;			/*!< Distance of the view. */
+      int		resolution;		/*!< Resolution number. */
+      int		tile;			/*!< Tile number. */
+      int		xangle;			/*!< Horizontal sequence
+      						     number. */
+      int		yangle;			/*!< Vertical sequence
+      						     number. */
+      int		compression;		/*!< Compression type. */
+      int		quality;		/*!< Compression quality. */
+      int		dx;			/*!< Column step of a pan. */
+      int		dy;			/*!< Row step of a pan. */
+      double		step;			/*!< Distance step. */
+      unsigned long	stamp;			/*!< Time of last use. */
+    };
+    typedef std::map<std::string, Client> ClientMap;
+
+    static int		radius;			/*!< Tiles or sections to
+    						     prefetch ahead, zero
+						     if disabled. */
+    static int		maxQueue;		/*!< Maximum number of
+    						     pending prefetches. */
+    static Mutex	mtx;			/*!< Protects the clients and
+    						     the prefetched keys. */
+    static ClientMap	clients;		/*!< Clients by address. */
+    static unsigned long clock;			/*!< Stamps client use. */
+    static std::map<TileKey, unsigned long> prefetched;
+    						/*!< Prefetched and not yet
+						     used tiles with their
+						     render sequence numbers.*/
+    static std::deque<std::pair<TileKey, unsigned long> > prefetchOrder;
+    						/*!< Prefetched keys, oldest
+    						     first. */
+    static unsigned long nIssued;		/*!< Prefetches queued. */
+    static unsigned long nDropped;		/*!< Prefetches dropped since
+    						     the queue was full. */
+    static unsigned long nRendered;		/*!< Prefetches rendered. */
+    static unsigned long nHit;			/*!< Prefetched tiles used. */
+    static unsigned long nWasted;		/*!< Prefetched tiles
+    						     forgotten unused. */
+
+    static Fingerprint	planeFingerprint(const std::string &path,
+    					 const ViewParameters *vp);
+    static void		tileGrid(IIPImage *image, int resolution,
+    				 int *ntlx, int *ntly);
+    static void		rendered(const TileKey &key);
+
+  public:
+    static void		start(int r, int q);
+    /*!
+    * \return	True if tiles are prefetched.
+    * \ingroup	WlzIIPServer
+    * \brief	Checks whether prefetching is enabled.
+    */
+    static bool		isEnabled()
+    			{
+			  return(radius > 0);
+			}
+    static void		served(Session *session, int resolution, int tile,
+    			       CompressionType c);
+    static void		used(const TileKey &key);
+    static unsigned long getIssuedCount()
+    			{
+			  return(nIssued);
+			}
+    static unsigned long getDroppedCount()
+    			{
+			  return(nDropped);
+			}
+    static unsigned long getRenderedCount()
+    			{
+			  return(nRendered);
+			}
+    static unsigned long getHitCount()
+    			{
+			  return(nHit);
+			}
+    static unsigned long getWastedCount()
+    			{
+			  return(nWasted);
+			}
+};
+
+#endif
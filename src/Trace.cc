@@ -0,0 +1,291 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _Trace_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         Trace.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Lightweight tracing of the stages of requests, written as
+* 		Chrome trace event JSON.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include "Log.h"
+#include "Trace.h"
+
+using namespace std;
+
+__thread unsigned long	traceRequestId = 0;
+
+int			Trace::sample = 0;
+int			Trace::capacity = 8192;
+string			Trace::dir;
+volatile unsigned long	Trace::nRequests = 0;
+volatile int		Trace::dumpRequested = 0;
+Mutex			Trace::ringsMtx;
+vector<Trace::Ring *>	Trace::rings;
+Mutex			Trace::namesMtx;
+vector<string *>	Trace::names;
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Configures tracing, this should be called before any
+* 		requests are processed.
+* \param	s			Trace one request in this many, zero
+* 					to disable tracing.
+* \param	c			Number of spans kept for each thread.
+* \param	d			Directory in which the traces of
+* 					requests are written, if empty
+* 					they are only kept in the ring
+* 					buffers.
+*/
+void		Trace::configure(int s, int c, const string &d)
+{
+  sample = (s > 0)? s: 0;
+  capacity = (c > 16)? c: 16;
+  dir = d;
+}
+
+/*!
+* \return	The calling thread's ring buffer.
+* \ingroup	WlzIIPServer
+* \brief	Gives the calling thread's ring buffer, creating it on
+* 		first use. Rings persist for the life of the process, as
+* 		do the server's threads.
+*/
+Trace::Ring	*Trace::getRing()
+{
+  static __thread Ring *ring = NULL;
+
+  if(ring == NULL)
+  {
+    Ring *r = new Ring;
+
+    r->events.resize(capacity);
+    r->next = 0;
+    r->full = false;
+    {
+      MutexLock lock(ringsMtx);
+
+      r->tid = rings.size() + 1;
+      rings.push_back(r);
+    }
+    ring = r;
+  }
+  return(ring);
+}
+
+/*!
+* \return	Identifier of the traced request, zero if the request is
+* 		not traced.
+* \ingroup	WlzIIPServer
+* \brief	Called as the calling thread begins to process a request,
+* 		decides whether the request is traced.
+*/
+unsigned long	Trace::beginRequest()
+{
+  unsigned long id = 0;
+
+  if(sample > 0)
+  {
+    unsigned long n = __sync_add_and_fetch(&nRequests, 1);
+
+    if((n % sample) == 0)
+    {
+      id = n;
+    }
+  }
+  traceRequestId = id;
+  return(id);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Called as the calling thread finishes processing a request.
+* 		Writes the spans of a traced request to its own file and
+* 		then, if a dump has been requested, all the ring buffers.
+*/
+void		Trace::endRequest()
+{
+  unsigned long id = traceRequestId;
+
+  traceRequestId = 0;
+  if((id != 0) && (dir.length() > 0))
+  {
+    writeFile(id);
+  }
+  if(dumpRequested && __sync_bool_compare_and_swap(&dumpRequested, 1, 0))
+  {
+    writeFile(0);
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Records a span in the calling thread's ring buffer,
+* 		overwriting the oldest span when the buffer is full.
+* \param	name			Span name, which must persist.
+* \param	start			Start time.
+* \param	end			End time.
+*/
+void		Trace::record(const char *name, long long start,
+			      long long end)
+{
+  Ring *ring = getRing();
+  MutexLock lock(ring->mtx);
+  TraceEvent &e = ring->events[ring->next];
+
+  e.name = name;
+  e.start = start;
+  e.dur = end - start;
+  e.request = traceRequestId;
+  if(++(ring->next) >= ring->events.size())
+  {
+    ring->next = 0;
+    ring->full = true;
+  }
+}
+
+/*!
+* \return	Persistent copy of the name.
+* \ingroup	WlzIIPServer
+* \brief	Interns a span name which is not a string literal, eg the
+* 		name of a command. There should only be a few such names.
+* \param	name			Given name.
+*/
+const char	*Trace::intern(const string &name)
+{
+  MutexLock lock(namesMtx);
+
+  for(size_t i = 0; i < names.size(); ++i)
+  {
+    if(*(names[i]) == name)
+    {
+      return(names[i]->c_str());
+    }
+  }
+  names.push_back(new string(name));
+  return(names.back()->c_str());
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Writes spans as Chrome trace event JSON. Each ring is
+* 		copied under its lock and then written, so that recording
+* 		is not held up by the output.
+* \param	fP			Output file.
+* \param	request			Only spans of this request are
+* 					written, unless zero when all are.
+*/
+void		Trace::dump(FILE *fP, unsigned long request)
+{
+  int		pid = (int )getpid();
+  bool		first = true;
+  vector<Ring *> all;
+  vector<TraceEvent> events;
+
+  {
+    MutexLock lock(ringsMtx);
+
+    all = rings;
+  }
+  (void )fprintf(fP, "{\"traceEvents\":[");
+  for(size_t r = 0; r < all.size(); ++r)
+  {
+    {
+      MutexLock lock(all[r]->mtx);
+
+      events.clear();
+      if(all[r]->full)
+      {
+	events.insert(events.end(), all[r]->events.begin() + all[r]->next,
+		      all[r]->events.end());
+      }
+      events.insert(events.end(), all[r]->events.begin(),
+		    all[r]->events.begin() + all[r]->next);
+    }
+    for(size_t i = 0; i < events.size(); ++i)
+    {
+      const TraceEvent &e = events[i];
+
+      if((request == 0) || (e.request == request))
+      {
+	(void )fprintf(fP, "%s\n{\"name\":\"%s\",\"cat\":\"wlziipsrv\","
+		       "\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,"
+		       "\"tid\":%d,\"args\":{\"request\":%lu}}",
+		       (first)? "": ",", e.name, e.start, e.dur, pid,
+		       all[r]->tid, e.request);
+	first = false;
+      }
+    }
+  }
+  (void )fprintf(fP, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Writes the spans of a request, or all spans, to a file in
+* 		the trace directory (or /tmp if there is none).
+* \param	request			Traced request, zero for all spans.
+*/
+void		Trace::writeFile(unsigned long request)
+{
+  char		buf[64];
+  FILE		*fP;
+  string	path = (dir.length() > 0)? dir: string("/tmp");
+
+  if(request != 0)
+  {
+    (void )snprintf(buf, sizeof(buf), "/wlziipsrv-%d-%lu.json",
+		    (int )getpid(), request);
+  }
+  else
+  {
+    (void )snprintf(buf, sizeof(buf), "/wlziipsrv-%d-all-%ld.json",
+		    (int )getpid(), (long )time(NULL));
+  }
+  path += buf;
+  if((fP = fopen(path.c_str(), "w")) == NULL)
+  {
+    LOG_ERROR("Trace :: Failed to open " << path);
+  }
+  else
+  {
+    dump(fP, request);
+    (void )fclose(fP);
+    LOG_INFO("Trace :: Written " << path);
+  }
+}
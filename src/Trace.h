@@ -0,0 +1,241 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _Trace_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         Trace.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Lightweight tracing of the stages of requests, written as
+* 		Chrome trace event JSON for viewing in chrome://tracing or
+* 		Perfetto.
+* \ingroup	WlzIIPServer
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include "Mutex.h"
+
+/*!
+* \brief	Identifier of the traced request being processed by the
+* 		calling thread, zero if the thread's work is not being
+* 		traced. This is kept outside of the Trace class so that
+* 		the test made by each span is a single thread local load.
+* \ingroup	WlzIIPServer
+*/
+extern __thread unsigned long traceRequestId;
+
+/*!
+* \brief	A completed span.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _TraceEvent
+{
+  const char		*name;			/*!< Span name, which must
+  						     persist. */
+  long long		start;			/*!< Start in microseconds. */
+  long long		dur;			/*!< Duration in
+  						     microseconds. */
+  unsigned long		request;		/*!< Traced request. */
+} TraceEvent;
+
+/*!
+* \brief	Request tracing.
+*
+* 		One in every sample requests is traced. While a traced
+* 		request is processed the spans (see TraceSpan) of the
+* 		thread processing it, and of any pool jobs it submits,
+* 		are recorded. Each thread records its spans in its own
+* 		fixed size ring buffer, so the most recent spans are
+* 		kept and recording never allocates. When a traced request
+* 		ends its spans are written to a file in the trace
+* 		directory, and all of the ring buffers are written to a
+* 		file when a dump has been requested (eg by a signal).
+* 		When tracing is disabled, or a request is not sampled,
+* 		each span costs only the test of a thread local.
+* \ingroup	WlzIIPServer
+*/
+class Trace
+{
+  private:
+    /*!
+    * \brief	Ring buffer of a thread's spans.
+    */
+    struct Ring
+    {
+      int		tid;			/*!< Index of the thread. */
+      Mutex		mtx;			/*!< Protects the events. */
+      std::vector<TraceEvent> events;		/*!< The events. */
+      size_t		next;			/*!< Next event to write. */
+      bool		full;			/*!< All events written. */
+    };
+
+    static int		sample;			/*!< Trace one request in
+    						     this many, 0 disables
+						     tracing. */
+    static int		capacity;		/*!< Events per ring. */
+    static std::string	dir;			/*!< Trace directory. */
+    static volatile unsigned long nRequests;	/*!< Requests begun. */
+    static volatile int	dumpRequested;		/*!< Set to dump all the
+    						     rings. */
+    static Mutex	ringsMtx;		/*!< Protects the rings. */
+    static std::vector<Ring *> rings;		/*!< All threads' rings. */
+    static Mutex	namesMtx;		/*!< Protects the names. */
+    static std::vector<std::string *> names;	/*!< Interned span names. */
+
+    static Ring		*getRing();
+    static void		writeFile(unsigned long request);
+
+  public:
+    static void		configure(int s, int c, const std::string &d);
+    /*!
+    * \return	True if the caller's work is being traced.
+    * \ingroup	WlzIIPServer
+    * \brief	Checks whether spans should be recorded.
+    */
+    static bool		isActive()
+			{
+			  return(traceRequestId != 0);
+			}
+    /*!
+    * \return	Time in microseconds.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the time used to timestamp spans.
+    */
+    static long long	now()
+			{
+			  struct timeval tv;
+
+			  (void )gettimeofday(&tv, NULL);
+			  return(tv.tv_sec * 1000000LL + tv.tv_usec);
+			}
+    static unsigned long beginRequest();
+    static void		endRequest();
+    static void		record(const char *name, long long start,
+    			       long long end);
+    static const char	*intern(const std::string &name);
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Requests that all of the ring buffers are written out
+    * 		when the next request ends. This only sets a flag so
+    * 		it may be called from a signal handler.
+    */
+    static void		requestDump()
+			{
+			  dumpRequested = 1;
+			}
+    static void		dump(FILE *fP, unsigned long request);
+};
+
+/*!
+* \brief	A traced stage, timed from construction to destruction.
+* 		Nothing is recorded unless the thread's work is being
+* 		traced.
+* \ingroup	WlzIIPServer
+*/
+class TraceSpan
+{
+  private:
+    const char		*name;			/*!< Span name. */
+    long long		start;			/*!< Start time, zero if not
+    						     traced. */
+
+    			TraceSpan(const TraceSpan &);
+    TraceSpan		&operator=(const TraceSpan &);
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor which starts the span.
+    * \param	n			Span name, which must persist (eg a
+    * 					string literal or interned name).
+    */
+    			TraceSpan(const char *n): name(n), start(0)
+			{
+			  if(traceRequestId != 0)
+			  {
+			    start = Trace::now();
+			  }
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Destructor which ends the span.
+    */
+    			~TraceSpan()
+			{
+			  if(start != 0)
+			  {
+			    Trace::record(name, start, Trace::now());
+			  }
+			}
+};
+
+/*!
+* \brief	Scoped trace context, used to attribute the spans of
+* 		work done on behalf of a request by another thread (eg a
+* 		pool job) to the request.
+* \ingroup	WlzIIPServer
+*/
+class TraceContext
+{
+  private:
+    unsigned long	saved;			/*!< Previous request. */
+
+    			TraceContext(const TraceContext &);
+    TraceContext	&operator=(const TraceContext &);
+
+  public:
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Constructor which sets the thread's traced request.
+    * \param	request			Traced request, zero for none.
+    */
+    			TraceContext(unsigned long request):
+			  saved(traceRequestId)
+			{
+			  traceRequestId = request;
+			}
+    /*!
+    * \ingroup	WlzIIPServer
+    * \brief	Destructor which restores the previous request.
+    */
+    			~TraceContext()
+			{
+			  traceRequestId = saved;
+			}
+};
+
+#endif
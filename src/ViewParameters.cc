@@ -97,6 +97,7 @@ ViewParameters(const ViewParameters& viewParameters)
   queryPointType  = viewParameters.queryPointType;
   queryPoint      = viewParameters.queryPoint;
   alpha           = viewParameters.alpha;
+  map             = viewParameters.map;
   lastsel = NULL;
   selector = NULL;
 
@@ -148,6 +149,7 @@ ViewParameters:: operator=(const ViewParameters& viewParameters)
   queryPointType  = viewParameters.queryPointType;
   queryPoint      = viewParameters.queryPoint;
   alpha           = viewParameters.alpha;
+  map             = viewParameters.map;
 
   if (selector)
       delete selector;
@@ -185,7 +187,7 @@ ViewParameters:: operator==(const ViewParameters& vp) const
 {
   bool eq;
 
-  eq =  vp.dist  &&
+  eq =  dist  == vp.dist  &&
 	yaw   == vp.yaw   &&
 	pitch == vp.pitch &&
 	roll  == vp.roll  &&
@@ -45,6 +45,7 @@ static char _ViewParameters_h[] = "University of Edinburgh $Id$";
 
 #include <Wlz.h>
 #include <WlzExpression.h>
+#include "Fingerprint.h"
 
 #include <algorithm>
 #include <string>
@@ -124,7 +125,7 @@ class CompoundSelector
   public:
     /// Constructor
     CompoundSelector(): next(NULL), complexSelection(0), expression(NULL),
-                        r(0), g(0), b(0), a(0) {}
+                        r(0), g(0), b(0), a(0) {fingerprint.hi = fingerprint.lo = 0;}
 
     /// Destructor
     ~CompoundSelector()
@@ -147,6 +148,8 @@ class CompoundSelector
     unsigned char g;                   /*!< green value */
     unsigned char b;                   /*!< blue value */
     unsigned char a;                   /*!< alpha value */
+    Fingerprint fingerprint;           /*!< Fingerprint of the expression
+    					    string, zero until computed. */
 };
 
 /*! 
@@ -163,6 +163,8 @@ WlzExp 		*WlzExpMake(unsigned int nParam)
 * \return	Assigned expression or NULL on error.
 * \ingroup	WlzIIPServer
 * \brief	Assigns the given expression by incrementing it's linkcount.
+* 		The linkcount is updated atomically since copies of view
+* 		parameters may be released by tile prefetch threads.
 * \param	exp			Given expression.
 */
 WlzExp		*WlzExpAssign(WlzExp *exp)
@@ -175,7 +177,7 @@ WlzExp		*WlzExpAssign(WlzExp *exp)
     }
     else
     {
-      ++(exp->linkcount);
+      (void )__sync_add_and_fetch(&(exp->linkcount), 1);
     }
   }
   return(exp);
@@ -188,16 +190,12 @@ WlzExp		*WlzExpAssign(WlzExp *exp)
 */
 void 		WlzExpFree(WlzExp *e)
 {
-  if(e)
+  if(e && (e->linkcount >= 0))
   {
     int		idx;
     WlzExpOpParam  *p;
 
-    if(e->linkcount > 1)
-    {
-      --(e->linkcount);
-    }
-    else if(e->linkcount >= 0)
+    if(__sync_sub_and_fetch(&(e->linkcount), 1) <= 0)
     {
       p = e->param;
       e->linkcount = -1;
@@ -0,0 +1,669 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPAxisSection_c[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPAxisSection.c
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Fast extraction of sections which are aligned with the
+* 		axes of a 3D object. Most views of the objects served are
+* 		transverse, sagittal or coronal sections at unit scale,
+* 		for which each section pixel is a single voxel of the
+* 		object. These sections can be copied directly from the
+* 		object's value tables, avoiding the general affine
+* 		resampling of WlzGetSubSectionFromObject(). The sections
+* 		are identical to those given by WlzGetSubSectionFromObject()
+* 		with nearest neighbour interpolation.
+* \ingroup	WlzIIPServer
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <Wlz.h>
+#include "WlzIIPAxisSection.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+static int			WlzIIPAxisIsUnit(
+				  WlzDVertex3 d,
+				  WlzIVertex3 *dstU);
+static int			WlzIIPAxisLineIntervals(
+				  WlzPlaneDomain *pDom,
+				  int pl,
+				  int ln,
+				  int *dstNItv,
+				  WlzInterval **dstItv,
+				  int *dstKol1);
+static int			WlzIIPAxisInside(
+				  WlzPlaneDomain *pDom,
+				  int pl,
+				  int ln,
+				  int kl);
+static WlzUByte			*WlzIIPAxisRectPtr(
+				  WlzVoxelValues *vox,
+				  int pl,
+				  int ln,
+				  int kl,
+				  size_t gSz);
+static WlzObject		*WlzIIPAxisMask(
+				  WlzUByte *in,
+				  int line1,
+				  int kol1,
+				  int width,
+				  int height,
+				  WlzErrorNum *dstErr);
+
+/*!
+* \return	Non zero if the given vector is within tolerance of an
+* 		integer vector.
+* \ingroup	WlzIIPServer
+* \brief	Tests whether the given vector is (near) integral and if
+* 		so sets the destination integer vector.
+* \param	d			Given vector.
+* \param	dstU			Destination integer vector.
+*/
+static int	WlzIIPAxisIsUnit(WlzDVertex3 d, WlzIVertex3 *dstU)
+{
+  int		ok;
+  const double	eps = 1.0e-06;
+
+  dstU->vtX = WLZ_NINT(d.vtX);
+  dstU->vtY = WLZ_NINT(d.vtY);
+  dstU->vtZ = WLZ_NINT(d.vtZ);
+  ok = (fabs(d.vtX - dstU->vtX) < eps) &&
+       (fabs(d.vtY - dstU->vtY) < eps) &&
+       (fabs(d.vtZ - dstU->vtZ) < eps);
+  return(ok);
+}
+
+/*!
+* \return	Non zero if the view is axis aligned and the fast path
+* 		may be used.
+* \ingroup	WlzIIPServer
+* \brief	Tests whether sections of the given object, with the
+* 		given view and region, can be extracted by
+* 		WlzIIPAxisSection(). This requires the object to be a 3D
+* 		domain object with values and each step along a row or
+* 		column of the section to be a single voxel step along one
+* 		of the object's axes, from a section origin which lies on
+* 		a voxel. If the view is aligned then the voxel at the
+* 		first pixel of the region and the voxel steps along a row
+* 		and a column are set.
+* \param	gvnObj			Given 3D object.
+* \param	rgnObj			Region of the section required, only
+* 					its bounding box is used.
+* \param	view			Initialised view structure.
+* \param	dstOrg			Destination for the voxel at the first
+* 					pixel of the region, may be NULL.
+* \param	dstDX			Destination for the voxel step along a
+* 					section row, may be NULL.
+* \param	dstDY			Destination for the voxel step along a
+* 					section column, may be NULL.
+*/
+int		WlzIIPAxisSectionIsAligned(WlzObject *gvnObj,
+					   WlzObject *rgnObj,
+					   WlzThreeDViewStruct *view,
+					   WlzIVertex3 *dstOrg,
+					   WlzIVertex3 *dstDX,
+					   WlzIVertex3 *dstDY)
+{
+  int		ok;
+  WlzDVertex3	p0,
+  		p1,
+		p2;
+  WlzIVertex3	org,
+  		dX,
+		dY;
+
+  ok = (gvnObj != NULL) && (gvnObj->type == WLZ_3D_DOMAINOBJ) &&
+       (gvnObj->domain.core != NULL) && (gvnObj->values.core != NULL) &&
+       (rgnObj != NULL) && (rgnObj->type == WLZ_2D_DOMAINOBJ) &&
+       (rgnObj->domain.core != NULL) && (view != NULL) &&
+       (view->initialised != 0);
+  if(ok)
+  {
+    p0.vtX = rgnObj->domain.i->kol1;
+    p0.vtY = rgnObj->domain.i->line1;
+    p0.vtZ = view->dist;
+    p1 = p0;
+    p1.vtX += 1.0;
+    p2 = p0;
+    p2.vtY += 1.0;
+    ok = (Wlz3DSectionTransformInvVtx(&p0, view) == WLZ_ERR_NONE) &&
+         (Wlz3DSectionTransformInvVtx(&p1, view) == WLZ_ERR_NONE) &&
+         (Wlz3DSectionTransformInvVtx(&p2, view) == WLZ_ERR_NONE);
+  }
+  if(ok)
+  {
+    WLZ_VTX_3_SUB(p1, p1, p0);
+    WLZ_VTX_3_SUB(p2, p2, p0);
+    ok = WlzIIPAxisIsUnit(p0, &org) &&
+         WlzIIPAxisIsUnit(p1, &dX) &&
+	 WlzIIPAxisIsUnit(p2, &dY) &&
+         ((abs(dX.vtX) + abs(dX.vtY) + abs(dX.vtZ)) == 1) &&
+         ((abs(dY.vtX) + abs(dY.vtY) + abs(dY.vtZ)) == 1) &&
+	 ((dX.vtX * dY.vtX + dX.vtY * dY.vtY + dX.vtZ * dY.vtZ) == 0);
+  }
+  if(ok)
+  {
+    if(dstOrg)
+    {
+      *dstOrg = org;
+    }
+    if(dstDX)
+    {
+      *dstDX = dX;
+    }
+    if(dstDY)
+    {
+      *dstDY = dY;
+    }
+  }
+  return(ok);
+}
+
+/*!
+* \return	Non zero if the line is within the plane domain.
+* \ingroup	WlzIIPServer
+* \brief	Gets the intervals of a line of a plane domain. The
+* 		interval columns are relative to the returned first
+* 		column.
+* \param	pDom			Plane domain.
+* \param	pl			Plane.
+* \param	ln			Line.
+* \param	dstNItv			Destination for the number of
+* 					intervals.
+* \param	dstItv			Destination for the intervals, NULL
+* 					for a rectangular domain.
+* \param	dstKol1			Destination for the first column.
+*/
+static int	WlzIIPAxisLineIntervals(WlzPlaneDomain *pDom,
+					int pl, int ln,
+					int *dstNItv, WlzInterval **dstItv,
+					int *dstKol1)
+{
+  int		ok = 0;
+  WlzIntervalDomain *iDom;
+
+  if((pl >= pDom->plane1) && (pl <= pDom->lastpl) &&
+     ((iDom = pDom->domains[pl - pDom->plane1].i) != NULL) &&
+     (ln >= iDom->line1) && (ln <= iDom->lastln))
+  {
+    ok = 1;
+    *dstKol1 = iDom->kol1;
+    if(iDom->type == WLZ_INTERVALDOMAIN_INTVL)
+    {
+      WlzIntervalLine *itvLn;
+
+      itvLn = iDom->intvlines + ln - iDom->line1;
+      *dstNItv = itvLn->nintvs;
+      *dstItv = itvLn->intvs;
+    }
+    else
+    {
+      *dstNItv = 1;
+      *dstItv = NULL;
+    }
+  }
+  return(ok);
+}
+
+/*!
+* \return	Non zero if the voxel is within the domain.
+* \ingroup	WlzIIPServer
+* \brief	Tests whether a voxel is within a plane domain.
+* \param	pDom			Plane domain.
+* \param	pl			Plane.
+* \param	ln			Line.
+* \param	kl			Column.
+*/
+static int	WlzIIPAxisInside(WlzPlaneDomain *pDom, int pl, int ln, int kl)
+{
+  int		idx,
+  		kol1,
+  		nItv,
+		inside = 0;
+  WlzInterval	*itv;
+
+  if(WlzIIPAxisLineIntervals(pDom, pl, ln, &nItv, &itv, &kol1))
+  {
+    kl -= kol1;
+    if(itv == NULL)
+    {
+      inside = (kl >= 0) &&
+               (kl <= pDom->domains[pl - pDom->plane1].i->lastkl - kol1);
+    }
+    else
+    {
+      for(idx = 0; idx < nItv; ++idx)
+      {
+	if((kl >= itv[idx].ileft) && (kl <= itv[idx].iright))
+	{
+	  inside = 1;
+	  break;
+	}
+      }
+    }
+  }
+  return(inside);
+}
+
+/*!
+* \return	Pointer to the voxel's value or NULL if the plane does
+* 		not have a rectangular value table.
+* \ingroup	WlzIIPServer
+* \brief	Gets a pointer to a voxel value directly from a plane's
+* 		rectangular value table. The voxel must be within the
+* 		object's domain.
+* \param	vox			Voxel value table.
+* \param	pl			Plane.
+* \param	ln			Line.
+* \param	kl			Column.
+* \param	gSz			Size of the grey values.
+*/
+static WlzUByte	*WlzIIPAxisRectPtr(WlzVoxelValues *vox,
+				   int pl, int ln, int kl, size_t gSz)
+{
+  WlzUByte	*ptr = NULL;
+  WlzValues	val;
+
+  if((pl >= vox->plane1) && (pl <= vox->lastpl))
+  {
+    val = vox->values[pl - vox->plane1];
+    if(val.core &&
+       (WlzGreyTableTypeToTableType(val.core->type, NULL) ==
+        WLZ_GREY_TAB_RECT))
+    {
+      ptr = val.r->values.ubp +
+            (((size_t )(ln - val.r->line1) * val.r->width) +
+	     (kl - val.r->kol1)) * gSz;
+    }
+  }
+  return(ptr);
+}
+
+/*!
+* \return	Mask object, which may be empty, or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Makes a 2D domain object from a byte mask in which non
+* 		zero bytes are within the domain.
+* \param	in			Byte mask.
+* \param	line1			First line of the mask.
+* \param	kol1			First column of the mask.
+* \param	width			Width of the mask.
+* \param	height			Height of the mask.
+* \param	dstErr			Destination error pointer, may be NULL.
+*/
+static WlzObject *WlzIIPAxisMask(WlzUByte *in, int line1, int kol1,
+				 int width, int height, WlzErrorNum *dstErr)
+{
+  int		ln,
+  		kl,
+		nItv = 0;
+  WlzUByte	*p;
+  WlzInterval	*itv = NULL,
+  		*itvP;
+  WlzDomain	dom;
+  WlzValues	val;
+  WlzObject	*mskObj = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  dom.core = NULL;
+  val.core = NULL;
+  for(ln = 0; ln < height; ++ln)
+  {
+    p = in + ln * width;
+    for(kl = 0; kl < width; ++kl)
+    {
+      if(p[kl] && ((kl == 0) || !p[kl - 1]))
+      {
+        ++nItv;
+      }
+    }
+  }
+  if(nItv == 0)
+  {
+    mskObj = WlzMakeEmpty(&errNum);
+  }
+  else
+  {
+    if((itv = (WlzInterval *)AlcMalloc(nItv * sizeof(WlzInterval))) == NULL)
+    {
+      errNum = WLZ_ERR_MEM_ALLOC;
+    }
+    else
+    {
+      dom.i = WlzMakeIntervalDomain(WLZ_INTERVALDOMAIN_INTVL,
+				    line1, line1 + height - 1,
+				    kol1, kol1 + width - 1, &errNum);
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      dom.i->freeptr = AlcFreeStackPush(dom.i->freeptr, (void *)itv, NULL);
+      itvP = itv;
+      for(ln = 0; (errNum == WLZ_ERR_NONE) && (ln < height); ++ln)
+      {
+	WlzInterval *itv0 = itvP;
+
+	p = in + ln * width;
+	for(kl = 0; kl < width; ++kl)
+	{
+	  if(p[kl])
+	  {
+	    if((kl == 0) || !p[kl - 1])
+	    {
+	      itvP->ileft = kl;
+	    }
+	    if((kl == width - 1) || !p[kl + 1])
+	    {
+	      itvP->iright = kl;
+	      ++itvP;
+	    }
+	  }
+	}
+	errNum = WlzMakeInterval(line1 + ln, dom.i, itvP - itv0, itv0);
+      }
+    }
+    else
+    {
+      AlcFree(itv);
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      errNum = WlzStandardIntervalDomain(dom.i);
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      mskObj = WlzMakeMain(WLZ_2D_DOMAINOBJ, dom, val, NULL, NULL, &errNum);
+    }
+    if((mskObj == NULL) && dom.core)
+    {
+      (void )WlzFreeIntervalDomain(dom.i);
+    }
+  }
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return(mskObj);
+}
+
+/*!
+* \return	Section object or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Extracts the section of the given 3D object within the
+* 		bounding box of the given region, for a view which has
+* 		been tested using WlzIIPAxisSectionIsAligned(). The
+* 		returned object has a rectangular domain covering the
+* 		region and a rectangular value table of the object's grey
+* 		type, with the object's background value for pixels which
+* 		are outside of the object. When a section row runs along
+* 		the lines of a plane with a rectangular value table the
+* 		intervals of the row are copied directly, otherwise voxels
+* 		are gathered one at a time with a constant stride.
+* \param	gvnObj			Given 3D object.
+* \param	rgnObj			Region of the section required.
+* \param	view			Initialised, axis aligned, view
+* 					structure.
+* \param	dstMsk			Destination pointer for a mask object
+* 					with the domain of the section of the
+* 					object within the region, may be NULL.
+* \param	dstErr			Destination error pointer, may be NULL.
+*/
+WlzObject	*WlzIIPAxisSection(WlzObject *gvnObj, WlzObject *rgnObj,
+				   WlzThreeDViewStruct *view,
+				   WlzObject **dstMsk, WlzErrorNum *dstErr)
+{
+  int		ln,
+  		kl,
+		line1,
+		kol1,
+		width,
+		height,
+		tiled;
+  size_t	gSz = 0;
+  WlzUByte	*buf = NULL,
+  		*in = NULL;
+  WlzIVertex3	org,
+  		dX,
+		dY;
+  WlzGreyType	gType = WLZ_GREY_ERROR;
+  WlzPixelV	bkd;
+  WlzDomain	dom;
+  WlzValues	val;
+  WlzPlaneDomain *pDom = NULL;
+  WlzVoxelValues *vox = NULL;
+  WlzGreyValueWSpace *gVWSp = NULL;
+  WlzObject	*secObj = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  dom.core = NULL;
+  val.core = NULL;
+  if(!WlzIIPAxisSectionIsAligned(gvnObj, rgnObj, view, &org, &dX, &dY))
+  {
+    errNum = WLZ_ERR_PARAM_DATA;
+  }
+  else
+  {
+    line1 = rgnObj->domain.i->line1;
+    kol1 = rgnObj->domain.i->kol1;
+    width = rgnObj->domain.i->lastkl - kol1 + 1;
+    height = rgnObj->domain.i->lastln - line1 + 1;
+    pDom = gvnObj->domain.p;
+    gType = WlzGreyTypeFromObj(gvnObj, &errNum);
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    gSz = WlzGreySize(gType);
+    bkd = WlzGetBackground(gvnObj, &errNum);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      errNum = WlzValueConvertPixel(&bkd, bkd, gType);
+    }
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    tiled = WlzGreyTableIsTiled(gvnObj->values.core->type);
+    if(!tiled)
+    {
+      vox = gvnObj->values.vox;
+    }
+    gVWSp = WlzGreyValueMakeWSp(gvnObj, &errNum);
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    if(((buf = (WlzUByte *)AlcMalloc(width * height * gSz)) == NULL) ||
+       (dstMsk && ((in = (WlzUByte *)AlcCalloc(width * height, 1)) == NULL)))
+    {
+      errNum = WLZ_ERR_MEM_ALLOC;
+    }
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    WlzUByte	*dst;
+
+    /* Set the background. */
+    dst = buf;
+    for(kl = 0; kl < width; ++kl)
+    {
+      memcpy(dst, &(bkd.v), gSz);
+      dst += gSz;
+    }
+    for(ln = 1; ln < height; ++ln)
+    {
+      memcpy(buf + ln * width * gSz, buf, width * gSz);
+    }
+    for(ln = 0; ln < height; ++ln)
+    {
+      WlzIVertex3 pos;
+
+      pos.vtX = org.vtX + ln * dY.vtX;
+      pos.vtY = org.vtY + ln * dY.vtY;
+      pos.vtZ = org.vtZ + ln * dY.vtZ;
+      dst = buf + ln * width * gSz;
+      if((dX.vtX == 1) && !tiled &&
+         WlzIIPAxisRectPtr(vox, pos.vtZ, pos.vtY, pos.vtX, gSz))
+      {
+	int	idx,
+		itvKol1,
+		nItv;
+	WlzInterval *itv;
+
+	/* The row is along a line of a plane with a rectangular value
+	 * table, so copy the intervals of the line. */
+	if(WlzIIPAxisLineIntervals(pDom, pos.vtZ, pos.vtY,
+	                           &nItv, &itv, &itvKol1))
+	{
+	  for(idx = 0; idx < nItv; ++idx)
+	  {
+	    int	k0,
+	    	k1;
+
+	    if(itv)
+	    {
+	      k0 = itv[idx].ileft + itvKol1;
+	      k1 = itv[idx].iright + itvKol1;
+	    }
+	    else
+	    {
+	      k0 = itvKol1;
+	      k1 = pDom->domains[pos.vtZ - pDom->plane1].i->lastkl;
+	    }
+	    k0 = WLZ_MAX(k0, pos.vtX);
+	    k1 = WLZ_MIN(k1, pos.vtX + width - 1);
+	    if(k0 <= k1)
+	    {
+	      memcpy(dst + (k0 - pos.vtX) * gSz,
+		     WlzIIPAxisRectPtr(vox, pos.vtZ, pos.vtY, k0, gSz),
+		     (k1 - k0 + 1) * gSz);
+	      if(in)
+	      {
+		memset(in + ln * width + k0 - pos.vtX, 1, k1 - k0 + 1);
+	      }
+	    }
+	  }
+	}
+      }
+      else
+      {
+	/* Gather the voxels of the row. */
+        for(kl = 0; kl < width; ++kl)
+	{
+	  if(WlzIIPAxisInside(pDom, pos.vtZ, pos.vtY, pos.vtX))
+	  {
+	    WlzUByte *src = NULL;
+
+	    if(!tiled)
+	    {
+	      src = WlzIIPAxisRectPtr(vox, pos.vtZ, pos.vtY, pos.vtX, gSz);
+	    }
+	    if(src == NULL)
+	    {
+	      WlzGreyValueGet(gVWSp, pos.vtZ, pos.vtY, pos.vtX);
+	      src = (WlzUByte *)&(gVWSp->gVal[0]);
+	    }
+	    memcpy(dst, src, gSz);
+	    if(in)
+	    {
+	      in[ln * width + kl] = 1;
+	    }
+	  }
+	  dst += gSz;
+	  pos.vtX += dX.vtX;
+	  pos.vtY += dX.vtY;
+	  pos.vtZ += dX.vtZ;
+	}
+      }
+    }
+  }
+  WlzGreyValueFreeWSp(gVWSp);
+  /* Make the section object. */
+  if(errNum == WLZ_ERR_NONE)
+  {
+    WlzObjectType vType;
+
+    vType = WlzGreyTableType(WLZ_GREY_TAB_RECT, gType, &errNum);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      dom.i = WlzMakeIntervalDomain(WLZ_INTERVALDOMAIN_RECT,
+				    line1, line1 + height - 1,
+				    kol1, kol1 + width - 1, &errNum);
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      val.r = WlzMakeRectValueTb(vType, line1, line1 + height - 1,
+				 kol1, width, bkd, (int *)buf, &errNum);
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      val.r->freeptr = AlcFreeStackPush(val.r->freeptr, (void *)buf, NULL);
+      buf = NULL;
+      secObj = WlzMakeMain(WLZ_2D_DOMAINOBJ, dom, val, NULL, NULL, &errNum);
+    }
+    if(secObj == NULL)
+    {
+      if(dom.core)
+      {
+        (void )WlzFreeIntervalDomain(dom.i);
+      }
+      if(val.core)
+      {
+        (void )WlzFreeValueTb(val.v);
+      }
+    }
+  }
+  if((errNum == WLZ_ERR_NONE) && dstMsk)
+  {
+    *dstMsk = WlzIIPAxisMask(in, line1, kol1, width, height, &errNum);
+    if(errNum != WLZ_ERR_NONE)
+    {
+      (void )WlzFreeObj(secObj);
+      secObj = NULL;
+    }
+  }
+  AlcFree(buf);
+  AlcFree(in);
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return(secObj);
+}
+
+#ifdef __cplusplus
+}
+#endif
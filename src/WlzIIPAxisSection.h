@@ -0,0 +1,64 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPAxisSection_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPAxisSection.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Prototypes of functions for the fast extraction of axis
+* 		aligned sections within the Woolz IIP server.
+* \ingroup	WlzIIPServer
+*/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+extern int			WlzIIPAxisSectionIsAligned(
+				  WlzObject *gvnObj,
+				  WlzObject *rgnObj,
+				  WlzThreeDViewStruct *view,
+				  WlzIVertex3 *dstOrg,
+				  WlzIVertex3 *dstDX,
+				  WlzIVertex3 *dstDY);
+extern WlzObject		*WlzIIPAxisSection(
+				  WlzObject *gvnObj,
+				  WlzObject *rgnObj,
+				  WlzThreeDViewStruct *view,
+				  WlzObject **dstMsk,
+				  WlzErrorNum *dstErr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,351 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPAxisSectionBenchMain_c[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPAxisSectionBenchMain.c
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Microbenchmark for the extraction of axis aligned sections
+* 		in the Woolz IIP server. For each grey type a volume is
+* 		made and sections in each of the axis aligned orientations
+* 		are computed by both WlzGetSubSectionFromObject() and
+* 		WlzIIPAxisSection(). The times and speedup are reported
+* 		and the sections are checked to be identical.
+* \ingroup	WlzIIPServer
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <Wlz.h>
+#include "WlzIIPAxisSection.h"
+
+static WlzErrorNum		WlzIIPAxisBenchFill(
+				  WlzObject *obj,
+				  WlzGreyType gType);
+static int			WlzIIPAxisBenchCompare(
+				  WlzObject *obj0,
+				  WlzObject *obj1,
+				  WlzObject *rgnObj,
+				  WlzGreyType gType,
+				  WlzErrorNum *dstErr);
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Fills the rectangular value tables of the planes of the
+* 		given cuboid with a pattern which differs at every voxel.
+* \param	obj			Given cuboid object.
+* \param	gType			Grey type of the object.
+*/
+static WlzErrorNum WlzIIPAxisBenchFill(WlzObject *obj, WlzGreyType gType)
+{
+  int		pl,
+  		idx,
+		nVx;
+  unsigned int	v;
+  WlzRectValues	*rVal;
+  WlzVoxelValues *vox;
+
+  vox = obj->values.vox;
+  for(pl = vox->plane1; pl <= vox->lastpl; ++pl)
+  {
+    rVal = vox->values[pl - vox->plane1].r;
+    nVx = rVal->width * (rVal->lastln - rVal->line1 + 1);
+    for(idx = 0; idx < nVx; ++idx)
+    {
+      v = (unsigned int )((pl * 7919 + idx) * 2654435761u);
+      switch(gType)
+      {
+	case WLZ_GREY_UBYTE:
+	  rVal->values.ubp[idx] = (WlzUByte )(v >> 24);
+	  break;
+	case WLZ_GREY_SHORT:
+	  rVal->values.shp[idx] = (short )(v >> 16);
+	  break;
+	case WLZ_GREY_INT:
+	  rVal->values.inp[idx] = (int )v;
+	  break;
+	case WLZ_GREY_FLOAT:
+	  rVal->values.flp[idx] = (float )v * 1.0e-03f;
+	  break;
+	case WLZ_GREY_DOUBLE:
+	  rVal->values.dbp[idx] = (double )v * 1.0e-03;
+	  break;
+	case WLZ_GREY_RGBA:
+	  rVal->values.rgbp[idx] = v | 0xff000000;
+	  break;
+	default:
+	  return(WLZ_ERR_GREY_TYPE);
+      }
+    }
+  }
+  return(WLZ_ERR_NONE);
+}
+
+/*!
+* \return	Non zero if the two sections are identical within the
+* 		region.
+* \ingroup	WlzIIPServer
+* \brief	Compares the values of two sections at every pixel of
+* 		the given region.
+* \param	obj0			First section.
+* \param	obj1			Second section.
+* \param	rgnObj			Region with a rectangular domain.
+* \param	gType			Grey type of the sections.
+* \param	dstErr			Destination error pointer.
+*/
+static int	WlzIIPAxisBenchCompare(WlzObject *obj0, WlzObject *obj1,
+				       WlzObject *rgnObj, WlzGreyType gType,
+				       WlzErrorNum *dstErr)
+{
+  int		ln,
+  		kl,
+		same = 1;
+  size_t	gSz;
+  WlzGreyValueWSpace *gVWSp0 = NULL,
+  		*gVWSp1 = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  gSz = WlzGreySize(gType);
+  gVWSp0 = WlzGreyValueMakeWSp(obj0, &errNum);
+  if(errNum == WLZ_ERR_NONE)
+  {
+    gVWSp1 = WlzGreyValueMakeWSp(obj1, &errNum);
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    WlzIntervalDomain *iDom;
+
+    iDom = rgnObj->domain.i;
+    for(ln = iDom->line1; same && (ln <= iDom->lastln); ++ln)
+    {
+      for(kl = iDom->kol1; kl <= iDom->lastkl; ++kl)
+      {
+	WlzGreyValueGet(gVWSp0, 0, ln, kl);
+	WlzGreyValueGet(gVWSp1, 0, ln, kl);
+	if(memcmp(&(gVWSp0->gVal[0]), &(gVWSp1->gVal[0]), gSz) != 0)
+	{
+	  same = 0;
+	  break;
+	}
+      }
+    }
+  }
+  WlzGreyValueFreeWSp(gVWSp0);
+  WlzGreyValueFreeWSp(gVWSp1);
+  *dstErr = errNum;
+  return(same);
+}
+
+int 		main(int argc, char *argv[])
+{
+  int		option,
+  		ok = 1,
+		usage = 0,
+		nRep = 20,
+		sz = 256,
+		iT,
+		iV,
+		iR;
+  WlzObject	*vol = NULL,
+  		*rgnObj = NULL,
+		*sec0 = NULL,
+		*sec1 = NULL;
+  WlzThreeDViewStruct *view = NULL;
+  WlzDomain	dom;
+  WlzValues	val;
+  WlzPixelV	bkd;
+  double	t0,
+  		t1,
+		t2;
+  const char    *errMsgStr;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+  static char	optList[] = "hn:s:";
+  const WlzGreyType gTypes[] =
+  {
+    WLZ_GREY_UBYTE, WLZ_GREY_SHORT, WLZ_GREY_INT,
+    WLZ_GREY_FLOAT, WLZ_GREY_DOUBLE, WLZ_GREY_RGBA
+  };
+  const double	views[3][2] =
+  {
+    {0.0, 0.0}, {0.0, 90.0}, {90.0, 90.0}
+  };
+  const int	nGTypes = sizeof(gTypes) / sizeof(WlzGreyType),
+  		nViews = 3;
+
+  while((usage == 0) && ((option = getopt(argc, argv, optList)) != EOF))
+  {
+    switch(option)
+    {
+      case 'n':
+        usage = (sscanf(optarg, "%d", &nRep) != 1) || (nRep < 1);
+	break;
+      case 's':
+        usage = (sscanf(optarg, "%d", &sz) != 1) || (sz < 2);
+	break;
+      case 'h':
+      default:
+        usage = 1;
+	break;
+    }
+  }
+  if((usage == 0) && (optind != argc))
+  {
+    usage = 1;
+  }
+  ok = usage == 0;
+  if(ok)
+  {
+    (void )printf("%-8s %5s %5s %12s %12s %8s\n",
+		  "type", "theta", "phi", "general(ms)", "axis(ms)", "speedup");
+  }
+  for(iT = 0; ok && (iT < nGTypes); ++iT)
+  {
+    bkd.type = WLZ_GREY_INT;
+    bkd.v.inv = 0;
+    (void )WlzValueConvertPixel(&bkd, bkd, gTypes[iT]);
+    vol = WlzAssignObject(
+	  WlzMakeCuboid(0, sz - 1, 0, sz - 1, 0, sz - 1,
+			gTypes[iT], bkd, NULL, NULL, &errNum), NULL);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      errNum = WlzIIPAxisBenchFill(vol, gTypes[iT]);
+    }
+    for(iV = 0; (errNum == WLZ_ERR_NONE) && (iV < nViews); ++iV)
+    {
+      view = WlzMake3DViewStruct(WLZ_3D_VIEW_STRUCT, &errNum);
+      if(errNum == WLZ_ERR_NONE)
+      {
+	view->theta = views[iV][0] * WLZ_M_PI / 180.0;
+	view->phi = views[iV][1] * WLZ_M_PI / 180.0;
+	view->zeta = 0.0;
+	view->dist = sz / 2;
+	view->scale = 1.0;
+	view->view_mode = WLZ_UP_IS_UP_MODE;
+	view->fixed.vtX = view->fixed.vtY = view->fixed.vtZ = 0.0;
+	errNum = WlzInit3DViewStruct(view, vol);
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	val.core = NULL;
+	dom.i = WlzMakeIntervalDomain(WLZ_INTERVALDOMAIN_RECT,
+				      WLZ_NINT(view->minvals.vtY),
+				      WLZ_NINT(view->maxvals.vtY),
+				      WLZ_NINT(view->minvals.vtX),
+				      WLZ_NINT(view->maxvals.vtX), &errNum);
+	if(errNum == WLZ_ERR_NONE)
+	{
+	  rgnObj = WlzAssignObject(
+		   WlzMakeMain(WLZ_2D_DOMAINOBJ, dom, val, NULL, NULL,
+			       &errNum), NULL);
+	}
+      }
+      if((errNum == WLZ_ERR_NONE) &&
+         !WlzIIPAxisSectionIsAligned(vol, rgnObj, view, NULL, NULL, NULL))
+      {
+	ok = 0;
+	(void )fprintf(stderr, "%s: view %g %g is not axis aligned\n",
+		       *argv, views[iV][0], views[iV][1]);
+      }
+      if(ok && (errNum == WLZ_ERR_NONE))
+      {
+	t0 = AlcCPUTime();
+	for(iR = 0; (errNum == WLZ_ERR_NONE) && (iR < nRep); ++iR)
+	{
+	  (void )WlzFreeObj(sec0);
+	  sec0 = WlzAssignObject(
+		 WlzGetSubSectionFromObject(vol, rgnObj, view,
+					    WLZ_INTERPOLATION_NEAREST,
+					    NULL, &errNum), NULL);
+	}
+	t1 = AlcCPUTime();
+	for(iR = 0; (errNum == WLZ_ERR_NONE) && (iR < nRep); ++iR)
+	{
+	  (void )WlzFreeObj(sec1);
+	  sec1 = WlzAssignObject(
+		 WlzIIPAxisSection(vol, rgnObj, view, NULL, &errNum), NULL);
+	}
+	t2 = AlcCPUTime();
+	if((errNum == WLZ_ERR_NONE) &&
+	   !WlzIIPAxisBenchCompare(sec0, sec1, rgnObj, gTypes[iT], &errNum))
+	{
+	  ok = 0;
+	  (void )fprintf(stderr, "%s: sections differ for view %g %g\n",
+			 *argv, views[iV][0], views[iV][1]);
+	}
+	if(ok && (errNum == WLZ_ERR_NONE))
+	{
+	  (void )printf("%-8s %5g %5g %12.3f %12.3f %8.2f\n",
+			WlzStringFromGreyType(gTypes[iT], NULL),
+			views[iV][0], views[iV][1],
+			1000.0 * (t1 - t0) / nRep,
+			1000.0 * (t2 - t1) / nRep,
+			(t2 > t1)? (t1 - t0) / (t2 - t1): 0.0);
+	}
+      }
+      (void )WlzFreeObj(sec0);
+      (void )WlzFreeObj(sec1);
+      (void )WlzFreeObj(rgnObj);
+      sec0 = sec1 = rgnObj = NULL;
+      WlzFree3DViewStruct(view);
+      view = NULL;
+    }
+    (void )WlzFreeObj(vol);
+    vol = NULL;
+    if(errNum != WLZ_ERR_NONE)
+    {
+      ok = 0;
+      (void )WlzStringFromErrorNum(errNum, &errMsgStr);
+      (void )fprintf(stderr, "%s: failed to section %s volume (%s)\n",
+		     *argv, WlzStringFromGreyType(gTypes[iT], NULL),
+		     errMsgStr);
+    }
+  }
+  if(usage)
+  {
+    (void )fprintf(stderr,
+     	"Usage: %s [-h] [-n <repeats>] [-s <size>]\n"
+     	"Times the extraction of axis aligned sections from volumes of\n"
+	"each grey type using both the general and the axis aligned\n"
+	"code, checking that the sections are identical.\n"
+        "Options are:\n"
+        "  -h  Shows this usage message.\n"
+        "  -n  Number of times each section is computed.\n"
+        "  -s  Size of the (cubic) volumes.\n",
+        *argv);
+    ok = 0;
+  }
+  return(!ok);
+}
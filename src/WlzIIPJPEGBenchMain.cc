@@ -0,0 +1,283 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPJPEGBenchMain_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPJPEGBenchMain.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Benchmark for the restart marker parallel JPEG encoding
+* 		of large CVT images. A synthetic section is encoded in
+* 		bands using from one to the given number of threads and
+* 		the times and speedup are reported. Each encoding is
+* 		checked to be identical to the same image encoded by a
+* 		single compressor.
+* \ingroup	WlzIIPServer
+*/
+
+#define _MAIN_CC
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/time.h>
+#include "Log.h"
+#include "RawTile.h"
+#include "WorkPool.h"
+#include "ParallelJPEGCompressor.h"
+
+/*!
+* \return	Wall clock time in seconds.
+* \ingroup	WlzIIPServer
+* \brief	Gives the wall clock time.
+*/
+static double	WlzIIPJPEGBenchTime()
+{
+  struct timeval tv;
+
+  (void )gettimeofday(&tv, NULL);
+  return(tv.tv_sec + 1.0e-06 * tv.tv_usec);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Fills an image with a synthetic section: smooth gradients
+* 		with some structure and noise, so that it compresses like
+* 		a real section rather than like a flat image.
+* \param	img			Image data.
+* \param	width			Image width.
+* \param	height			Image height.
+* \param	nCh			Number of channels.
+*/
+static void	WlzIIPJPEGBenchFill(unsigned char *img, unsigned int width,
+				    unsigned int height, unsigned int nCh)
+{
+  unsigned int	x,
+  		y,
+		c,
+		v,
+		seed = 12345;
+
+  for(y = 0; y < height; ++y)
+  {
+    for(x = 0; x < width; ++x)
+    {
+      seed = seed * 1103515245 + 12345;
+      for(c = 0; c < nCh; ++c)
+      {
+        v = ((x * (c + 1)) / 37 + (y * (3 - c)) / 53 +
+	     ((((x >> 6) ^ (y >> 6)) & 1) << 6) + ((seed >> 16) & 15)) & 0xff;
+        *img++ = (unsigned char )v;
+      }
+    }
+  }
+}
+
+/*!
+* \return	The encoded image.
+* \ingroup	WlzIIPServer
+* \brief	Encodes the image strip by strip as the CVT command does.
+* \param	img			Image data.
+* \param	width			Image width.
+* \param	height			Image height.
+* \param	nCh			Number of channels.
+* \param	quality			JPEG quality factor.
+* \param	bandRows		Rows in each band.
+* \param	stripRows		Rows in each strip.
+*/
+static std::string WlzIIPJPEGBenchEncode(const unsigned char *img,
+				    unsigned int width, unsigned int height,
+				    unsigned int nCh, int quality,
+				    unsigned int bandRows,
+				    unsigned int stripRows)
+{
+  unsigned int	y,
+  		len;
+  const unsigned char *data;
+  std::string	out;
+  RawTile	image(0, 0, 0, 0, width, height, nCh, 8);
+  ParallelJPEGCompressor pjpeg(quality, bandRows);
+
+  pjpeg.InitCompression(image);
+  out.append((const char *)pjpeg.getHeader(), pjpeg.getHeaderSize());
+  for(y = 0; y < height; y += stripRows)
+  {
+    pjpeg.addRows(img + (size_t )y * width * nCh,
+                  (y + stripRows < height)? stripRows: height - y);
+    while(pjpeg.takeBand(&data, &len, false))
+    {
+      out.append((const char *)data, len);
+    }
+  }
+  pjpeg.Finish();
+  while(pjpeg.takeBand(&data, &len, true))
+  {
+    out.append((const char *)data, len);
+  }
+  return(out);
+}
+
+int 		main(int argc, char *argv[])
+{
+  int		option,
+  		ok = 1,
+		usage = 0,
+		nRep = 3,
+		sz = 8192,
+		nCh = 3,
+		quality = 75,
+		bandRows = 128,
+		maxThreads,
+		nT,
+		iR;
+  double	t0,
+  		t1,
+		t1Thr = 0.0;
+  std::string	ref,
+  		enc;
+  std::vector<unsigned char> img;
+  static char	optList[] = "hb:c:n:q:s:t:";
+
+  maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(maxThreads < 1)
+  {
+    maxThreads = 1;
+  }
+  while((usage == 0) && ((option = getopt(argc, argv, optList)) != EOF))
+  {
+    switch(option)
+    {
+      case 'b':
+        usage = (sscanf(optarg, "%d", &bandRows) != 1) || (bandRows < 1);
+	break;
+      case 'c':
+        usage = (sscanf(optarg, "%d", &nCh) != 1) ||
+	        (nCh < 1) || (nCh > 4);
+	break;
+      case 'n':
+        usage = (sscanf(optarg, "%d", &nRep) != 1) || (nRep < 1);
+	break;
+      case 'q':
+        usage = (sscanf(optarg, "%d", &quality) != 1) ||
+	        (quality < 0) || (quality > 100);
+	break;
+      case 's':
+        usage = (sscanf(optarg, "%d", &sz) != 1) || (sz < 1);
+	break;
+      case 't':
+        usage = (sscanf(optarg, "%d", &maxThreads) != 1) || (maxThreads < 1);
+	break;
+      case 'h':
+      default:
+        usage = 1;
+	break;
+    }
+  }
+  if((usage == 0) && (optind != argc))
+  {
+    usage = 1;
+  }
+  ok = usage == 0;
+  if(ok)
+  {
+    try
+    {
+      img.resize((size_t )sz * sz * nCh);
+      WlzIIPJPEGBenchFill(&(img[0]), sz, sz, nCh);
+      // A single band is encoded by a single compressor
+      ref = WlzIIPJPEGBenchEncode(&(img[0]), sz, sz, nCh, quality, sz, 100);
+      (void )printf("%d x %d x %d image, quality %d, %d row bands, "
+		    "%lu bytes\n",
+		    sz, sz, nCh, quality, bandRows,
+		    (unsigned long )ref.size());
+      (void )printf("%8s %12s %8s %10s\n",
+		    "threads", "time(ms)", "speedup", "MPixel/s");
+      for(nT = 1; ok && (nT <= maxThreads); ++nT)
+      {
+	// The thread taking the bands also encodes them while it waits
+	WorkPool::start(nT - 1);
+	t0 = WlzIIPJPEGBenchTime();
+	for(iR = 0; ok && (iR < nRep); ++iR)
+	{
+	  enc = WlzIIPJPEGBenchEncode(&(img[0]), sz, sz, nCh, quality,
+	  			      bandRows, 100);
+	  if(enc != ref)
+	  {
+	    ok = 0;
+	    (void )fprintf(stderr,
+	    		   "%s: %d thread encoding differs from a single "
+			   "compressor's\n", *argv, nT);
+	  }
+	}
+	t1 = (WlzIIPJPEGBenchTime() - t0) / nRep;
+	WorkPool::stop();
+	if(nT == 1)
+	{
+	  t1Thr = t1;
+	}
+	if(ok)
+	{
+	  (void )printf("%8d %12.1f %8.2f %10.1f\n",
+			nT, 1000.0 * t1, (t1 > 0.0)? t1Thr / t1: 0.0,
+			(t1 > 0.0)? 1.0e-06 * sz * sz / t1: 0.0);
+	}
+      }
+    }
+    catch(const std::string &e)
+    {
+      ok = 0;
+      (void )fprintf(stderr, "%s: %s\n", *argv, e.c_str());
+    }
+  }
+  if(usage)
+  {
+    (void )fprintf(stderr,
+     	"Usage: %s [-h] [-b <rows>] [-c <channels>] [-n <repeats>]\n"
+	"       [-q <quality>] [-s <size>] [-t <threads>]\n"
+     	"Times the parallel JPEG encoding of a synthetic section using\n"
+	"from one to the given number of threads, checking that each\n"
+	"encoding is identical to that of a single compressor.\n"
+        "Options are:\n"
+        "  -h  Shows this usage message.\n"
+        "  -b  Rows in each band.\n"
+        "  -c  Number of channels (1 to 4).\n"
+        "  -n  Number of times each encoding is timed.\n"
+        "  -q  JPEG quality factor.\n"
+        "  -s  Size of the (square) section.\n"
+        "  -t  Maximum number of threads.\n",
+        *argv);
+    ok = 0;
+  }
+  return(!ok);
+}
@@ -0,0 +1,522 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPReplayBenchMain_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPReplayBenchMain.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Offline benchmark which replays a file of IIP query strings
+* 		through the server's request processing, without FCGI,
+* 		and reports the latency of each command, the throughput
+* 		and the cache hit rates.
+* \ingroup	WlzIIPServer
+*/
+
+#define _MAIN_CC
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "Log.h"
+#include "Environment.h"
+#include "IIPServer.h"
+#include "DiskCache.h"
+#include "TileManager.h"
+#include "TilePrefetcher.h"
+#include "WlzImage.h"
+#include "WorkPool.h"
+#include "Trace.h"
+#include "SlowLog.h"
+
+#ifndef DEBUG
+#error "DEBUG must be defined so that the tasks write to a FileWriter."
+#endif
+
+/*!
+* \brief	Latency and output size of a single replayed request.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _WlzIIPReplayBenchSample
+{
+  int			command;	/*!< Index of the request's command. */
+  long			time;		/*!< Latency in microseconds. */
+  unsigned long long	bytes;		/*!< Bytes written. */
+} WlzIIPReplayBenchSample;
+
+/*!
+* \brief	State shared by the replay threads.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _WlzIIPReplayBenchState
+{
+  IIPServerState	*server;	/*!< Server state. */
+  FILE			*out;		/*!< Output for the responses. */
+  std::vector<std::string> queries;	/*!< Query strings. */
+  std::vector<int>	commands;	/*!< Command index of each query. */
+  unsigned long		nJobs;		/*!< Number of requests to replay. */
+  unsigned long		next;		/*!< Next request to replay. */
+  Mutex			mtx;		/*!< Protects the samples. */
+  std::vector<WlzIIPReplayBenchSample> samples; /*!< All samples. */
+} WlzIIPReplayBenchState;
+
+/*!
+* \return	Wall clock time in seconds.
+* \ingroup	WlzIIPServer
+* \brief	Gives the wall clock time.
+*/
+static double	WlzIIPReplayBenchTime()
+{
+  struct timeval tv;
+
+  (void )gettimeofday(&tv, NULL);
+  return(tv.tv_sec + 1.0e-06 * tv.tv_usec);
+}
+
+/*!
+* \return	The command, in upper case.
+* \ingroup	WlzIIPServer
+* \brief	Gives the command of a query string used to group the
+* 		latencies. This is the last command of the query, since
+* 		earlier commands (eg WLZ, DST, YAW) only set up the view
+* 		for the last which produces the response.
+* \param	query			Given query string.
+*/
+static std::string WlzIIPReplayBenchCommand(const std::string &query)
+{
+  std::string	cmd;
+  size_t	p0,
+  		p1;
+
+  p0 = query.find_last_of('&');
+  p0 = (p0 == std::string::npos)? 0: p0 + 1;
+  p1 = query.find_first_of('=', p0);
+  cmd = query.substr(p0, (p1 == std::string::npos)? std::string::npos:
+                                                    p1 - p0);
+  for(size_t i = 0; i < cmd.length(); ++i)
+  {
+    cmd[i] = toupper(cmd[i]);
+  }
+  return(cmd);
+}
+
+/*!
+* \return	Zero on success, non-zero if the file can not be read.
+* \ingroup	WlzIIPServer
+* \brief	Reads query strings from the given file, one per line.
+* 		Blank lines and lines starting with a '#' are skipped
+* 		and anything up to and including a '?' (ie the URL of a
+* 		logged request) is removed.
+* \param	fileName		File name, "-" for the standard input.
+* \param	queries			Destination for the query strings.
+*/
+static int	WlzIIPReplayBenchRead(const char *fileName,
+				      std::vector<std::string> &queries)
+{
+  FILE		*fP;
+  char		buf[8192];
+
+  fP = (strcmp(fileName, "-") == 0)? stdin: fopen(fileName, "r");
+  if(fP == NULL)
+  {
+    return(1);
+  }
+  while(fgets(buf, sizeof(buf), fP) != NULL)
+  {
+    std::string	query(buf);
+    size_t	p;
+
+    while((query.length() > 0) &&
+          isspace((unsigned char )query[query.length() - 1]))
+    {
+      query.erase(query.length() - 1);
+    }
+    if((p = query.find('?')) != std::string::npos)
+    {
+      query.erase(0, p + 1);
+    }
+    if((query.length() > 0) && (query[0] != '#'))
+    {
+      queries.push_back(query);
+    }
+  }
+  if(fP != stdin)
+  {
+    (void )fclose(fP);
+  }
+  return(0);
+}
+
+/*!
+* \return	Always NULL.
+* \ingroup	WlzIIPServer
+* \brief	Replay thread main loop. Each thread has its own
+* 		compressors and writer, as the server's worker threads
+* 		do, and takes requests until all have been replayed.
+* \param	data			Replay state shared by the threads.
+*/
+static void	*WlzIIPReplayBenchThread(void *data)
+{
+  WlzIIPReplayBenchState *bs = (WlzIIPReplayBenchState *)data;
+  JPEGCompressor jpeg(bs->server->jpegQuality);
+  PNGCompressor	png;
+  FileWriter	writer(bs->out);
+  std::vector<WlzIIPReplayBenchSample> samples;
+
+  for(;;)
+  {
+    unsigned long j = __sync_fetch_and_add(&(bs->next), 1);
+    unsigned long long b;
+    double	t;
+
+    if(j >= bs->nJobs)
+    {
+      break;
+    }
+    WlzIIPReplayBenchSample s;
+    const std::string &query = bs->queries[j % bs->queries.size()];
+
+    b = writer.getBytes();
+    t = WlzIIPReplayBenchTime();
+    IIPProcessRequest(bs->server, &jpeg, &png, &writer, query,
+		      "WlzIIPReplayBench");
+    s.time = (long )(1.0e06 * (WlzIIPReplayBenchTime() - t));
+    s.bytes = writer.getBytes() - b;
+    s.command = bs->commands[j % bs->queries.size()];
+    samples.push_back(s);
+  }
+  (void )writer.flush();
+  {
+    MutexLock lock(bs->mtx);
+
+    bs->samples.insert(bs->samples.end(), samples.begin(), samples.end());
+  }
+  return(NULL);
+}
+
+/*!
+* \return	The percentile in milliseconds.
+* \ingroup	WlzIIPServer
+* \brief	Gives the nearest rank percentile of sorted latencies.
+* \param	t			Sorted latencies in microseconds.
+* \param	p			Percentile in the range [0-100].
+*/
+static double	WlzIIPReplayBenchPercentile(const std::vector<long> &t,
+					    double p)
+{
+  size_t	i;
+
+  i = (size_t )ceil(0.01 * p * t.size());
+  i = (i > 0)? i - 1: 0;
+  i = (i < t.size())? i: t.size() - 1;
+  return(1.0e-03 * t[i]);
+}
+
+int 		main(int argc, char *argv[])
+{
+  int		option,
+  		ok = 1,
+		usage = 0,
+		nRepeats = 1,
+		nThreads = 1,
+		nStarted = 0;
+  double	t0,
+  		t1;
+  unsigned long long nBytes = 0;
+  const char	*outFile = "/dev/null",
+  		*queryFile = NULL,
+		*traceFile = NULL;
+  Cache::Policy	policy = Cache::LRU;
+  Cache		*tileCache = NULL;
+  FILE		*fP = NULL;
+  std::string	policyName;
+  std::vector<std::string> commandNames;
+  std::map<std::string, int> commandIndex;
+  std::vector<pthread_t> threads;
+  WlzIIPReplayBenchState bs;
+  static char	optList[] = "hn:o:t:T:";
+
+  while((usage == 0) && ((option = getopt(argc, argv, optList)) != EOF))
+  {
+    switch(option)
+    {
+      case 'n':
+        usage = (sscanf(optarg, "%d", &nRepeats) != 1) || (nRepeats < 1);
+	break;
+      case 'o':
+        outFile = optarg;
+	break;
+      case 't':
+        usage = (sscanf(optarg, "%d", &nThreads) != 1) || (nThreads < 1);
+	break;
+      case 'T':
+        traceFile = optarg;
+	break;
+      case 'h':
+      default:
+        usage = 1;
+	break;
+    }
+  }
+  if((usage == 0) && (optind + 1 == argc))
+  {
+    queryFile = argv[optind];
+  }
+  else
+  {
+    usage = 1;
+  }
+  ok = usage == 0;
+  if(ok)
+  {
+    if(WlzIIPReplayBenchRead(queryFile, bs.queries) != 0)
+    {
+      ok = 0;
+      (void )fprintf(stderr, "%s: Failed to read queries from %s\n",
+      		     *argv, queryFile);
+    }
+    else if(bs.queries.size() == 0)
+    {
+      ok = 0;
+      (void )fprintf(stderr, "%s: No queries in %s\n", *argv, queryFile);
+    }
+  }
+  if(ok && ((fP = fopen(outFile, "w")) == NULL))
+  {
+    ok = 0;
+    (void )fprintf(stderr, "%s: Failed to open %s\n", *argv, outFile);
+  }
+  if(ok)
+  {
+    // Set up the caches, pools and server state as the server does.
+    policyName = Environment::getTileCachePolicy();
+    if(!Cache::parsePolicy(policyName, policy))
+    {
+      policyName = "lru";
+    }
+    std::string wlz_preload = Environment::getWlzPreload();
+    if(wlz_preload.length())
+    {
+      WlzImage::preload(wlz_preload, Environment::getWlzPreloadThreads());
+    }
+    DiskCache::start(Environment::getDiskCacheDir(),
+		     Environment::getDiskCacheSize(),
+		     Environment::getDiskCacheQueue());
+    if(traceFile)
+    {
+      // Trace every request, keeping the spans for a single dump.
+      Trace::configure(1, Environment::getTraceBuffer(), "");
+    }
+    else
+    {
+      Trace::configure(Environment::getTraceSample(),
+		       Environment::getTraceBuffer(),
+		       Environment::getTraceDir());
+    }
+    SlowLog::configure(Environment::getSlowRequestThreshold(),
+		       Environment::getSlowRequestLog());
+    WorkPool::start(Environment::getRenderThreads());
+    TilePrefetcher::start(Environment::getPrefetchRadius(),
+			  Environment::getPrefetchQueue());
+    tileCache = new Cache(Environment::getMaxImageCacheSize(), policy);
+
+    imageCacheMapType imageCache;
+    Mutex	imageCacheMutex;
+    Mutex	acceptMutex;
+    IIPServerState state;
+
+    state.listenSocket = 0;
+    state.version = "WlzIIPReplayBench";
+    state.jpegQuality = Environment::getJPEGQuality();
+    state.maxCVT = Environment::getMaxCVT();
+    state.complexSelection = Environment::getComplexSelection();
+    state.imageCache = &imageCache;
+    state.imageCacheMutex = &imageCacheMutex;
+    state.tileCache = tileCache;
+    state.acceptMutex = &acceptMutex;
+    bs.server = &state;
+    bs.out = fP;
+    bs.next = 0;
+    bs.nJobs = (unsigned long )nRepeats * bs.queries.size();
+    for(size_t i = 0; i < bs.queries.size(); ++i)
+    {
+      std::string cmd = WlzIIPReplayBenchCommand(bs.queries[i]);
+      std::map<std::string, int>::iterator it = commandIndex.find(cmd);
+
+      if(it == commandIndex.end())
+      {
+        it = commandIndex.insert(std::make_pair(cmd,
+				   (int )commandNames.size())).first;
+	commandNames.push_back(cmd);
+      }
+      bs.commands.push_back(it->second);
+    }
+
+    // Replay the queries.
+    threads.resize(nThreads);
+    t0 = WlzIIPReplayBenchTime();
+    for(int i = 0; i < nThreads; ++i)
+    {
+      if(pthread_create(&(threads[nStarted]), NULL,
+                        WlzIIPReplayBenchThread, &bs) == 0)
+      {
+        ++nStarted;
+      }
+    }
+    if(nStarted == 0)
+    {
+      ok = 0;
+      (void )fprintf(stderr, "%s: Failed to create any threads\n", *argv);
+    }
+    for(int i = 0; i < nStarted; ++i)
+    {
+      (void )pthread_join(threads[i], NULL);
+    }
+    t1 = WlzIIPReplayBenchTime() - t0;
+    WorkPool::stop();
+    if(traceFile)
+    {
+      FILE	*tP;
+
+      if((tP = fopen(traceFile, "w")) == NULL)
+      {
+	(void )fprintf(stderr, "%s: Failed to open %s\n", *argv, traceFile);
+      }
+      else
+      {
+	Trace::dump(tP, 0);
+	(void )fclose(tP);
+      }
+    }
+
+    // Report the latency of each command, the throughput and the caches.
+    if(ok)
+    {
+      (void )printf("%d queries, %d repeats, %d threads, %s tile cache\n",
+		    (int )bs.queries.size(), nRepeats, nStarted,
+		    policyName.c_str());
+      (void )printf("%-10s %10s %10s %10s %10s %10s %14s\n",
+		    "command", "requests", "mean(ms)", "p50(ms)",
+		    "p95(ms)", "p99(ms)", "bytes");
+      for(std::map<std::string, int>::iterator it = commandIndex.begin();
+	  it != commandIndex.end(); ++it)
+      {
+	double	sum = 0.0;
+	unsigned long long bytes = 0;
+	std::vector<long> t;
+
+	for(size_t i = 0; i < bs.samples.size(); ++i)
+	{
+	  if(bs.samples[i].command == it->second)
+	  {
+	    t.push_back(bs.samples[i].time);
+	    sum += bs.samples[i].time;
+	    bytes += bs.samples[i].bytes;
+	  }
+	}
+	if(t.size() > 0)
+	{
+	  std::sort(t.begin(), t.end());
+	  (void )printf("%-10s %10lu %10.3f %10.3f %10.3f %10.3f %14llu\n",
+			it->first.c_str(), (unsigned long )t.size(),
+			1.0e-03 * sum / t.size(),
+			WlzIIPReplayBenchPercentile(t, 50.0),
+			WlzIIPReplayBenchPercentile(t, 95.0),
+			WlzIIPReplayBenchPercentile(t, 99.0),
+			bytes);
+	  nBytes += bytes;
+	}
+      }
+      (void )printf("Total: %lu requests in %.3fs, %.1f requests/s, "
+		    "%.3f MB/s out\n",
+		    (unsigned long )bs.samples.size(), t1,
+		    (t1 > 0.0)? bs.samples.size() / t1: 0.0,
+		    (t1 > 0.0)? 1.0e-06 * nBytes / t1: 0.0);
+      (void )printf("Tile cache: %lu requests, hit rate %.3f, "
+		    "byte hit rate %.3f\n",
+		    tileCache->getRequestCount(), tileCache->getHitRate(),
+		    tileCache->getByteHitRate());
+      (void )printf("Tiles rendered: %lu, renders coalesced: %lu\n",
+		    TileManager::getRenderCount(),
+		    TileManager::getCoalescedCount());
+      if(DiskCache::get())
+      {
+	DiskCache *diskCache = DiskCache::get();
+
+	(void )printf("Disk cache: %lu hits, %lu misses\n",
+		      diskCache->getHitCount(), diskCache->getMissCount());
+      }
+      if(TilePrefetcher::isEnabled())
+      {
+	(void )printf("Tiles prefetched: %lu, hits: %lu, wasted: %lu\n",
+		      TilePrefetcher::getRenderedCount(),
+		      TilePrefetcher::getHitCount(),
+		      TilePrefetcher::getWastedCount());
+      }
+    }
+    delete tileCache;
+    DiskCache::stop();
+    (void )fclose(fP);
+  }
+  if(usage)
+  {
+    (void )fprintf(stderr,
+     	"Usage: %s [-h] [-n <repeats>] [-o <file>] [-t <threads>]\n"
+	"       [-T <file>] <query file>\n"
+	"Replays a file of IIP query strings, one per line, through the\n"
+	"server's request processing without FCGI and reports the latency\n"
+	"of each command, the throughput, the bytes written and the tile\n"
+	"cache hit rates. The server's environment variables (eg\n"
+	"MAX_IMAGE_CACHE_SIZE, TILE_CACHE_POLICY, DISK_CACHE_DIR,\n"
+	"SLOW_REQUEST_MS) are used to configure the caches, pools and\n"
+	"logs. Query lines may be whole URLs, anything up to and\n"
+	"including a '?' is ignored.\n"
+        "Options are:\n"
+        "  -h  Shows this usage message.\n"
+        "  -n  Number of times to replay the queries.\n"
+        "  -o  File for the responses, /dev/null by default.\n"
+        "  -t  Number of concurrent replay threads.\n"
+        "  -T  Traces every request, writing the most recent spans of\n"
+	"      each thread to the given file as Chrome trace event JSON.\n",
+        *argv);
+    ok = 0;
+  }
+  return(!ok);
+}
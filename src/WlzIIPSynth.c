@@ -0,0 +1,481 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPSynth_c[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPSynth.c
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+* 
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Synthetic Woolz objects for benchmarking the Woolz IIP
+* 		server. Real atlas objects are not always available, so
+* 		these functions make reproducible 3D domain objects and
+* 		compound arrays of them, with any of the grey types
+* 		served and with either dense (cuboid) or sparse domains.
+* 		The grey values are a smooth field of overlapping blobs
+* 		with a little high frequency texture, so that the
+* 		sections compress much as those of real images do, and
+* 		the sparse domains are the brightest parts of the field.
+* \ingroup	WlzIIPServer
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <Wlz.h>
+#include "WlzIIPSynth.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*!
+* \def		WLZIIP_SYNTH_BLOBS
+* \ingroup	WlzIIPServer
+* \brief	Number of blobs in the synthetic grey value field.
+*/
+#define WLZIIP_SYNTH_BLOBS	(6)
+
+/*!
+* \struct	_WlzIIPSynthField
+* \ingroup	WlzIIPServer
+* \brief	Parameters of a synthetic grey value field.
+* 		Typedef: ::WlzIIPSynthField
+*/
+typedef struct _WlzIIPSynthField
+{
+  WlzIVertex3	size;			/*!< Size of the object. */
+  unsigned int	seed;			/*!< Seed of the texture. */
+  double	cen[WLZIIP_SYNTH_BLOBS][3]; /*!< Blob centres, relative to
+  					     the object's size. */
+  double	rad2[WLZIIP_SYNTH_BLOBS]; /*!< Squared blob radii. */
+} WlzIIPSynthField;
+
+static unsigned int		WlzIIPSynthRand(
+				  unsigned int *state);
+static void			WlzIIPSynthFieldInit(
+				  WlzIIPSynthField *fld,
+				  WlzIVertex3 size,
+				  unsigned int seed);
+static double			WlzIIPSynthFieldValue(
+				  const WlzIIPSynthField *fld,
+				  int kl,
+				  int ln,
+				  int pl);
+static WlzErrorNum		WlzIIPSynthFill(
+				  WlzObject *obj,
+				  WlzGreyType gType,
+				  const WlzIIPSynthField *fld,
+				  int *hist);
+
+/*!
+* \return	Pseudo random number in the range [0-65535].
+* \ingroup	WlzIIPServer
+* \brief	Simple linear congruential generator, used so that the
+* 		objects are the same on all platforms.
+* \param	state			Generator state.
+*/
+static unsigned int WlzIIPSynthRand(unsigned int *state)
+{
+  *state = *state * 1103515245u + 12345u;
+  return((*state >> 16) & 0xffff);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Initialises the parameters of a synthetic field from the
+* 		given seed.
+* \param	fld			Field to initialise.
+* \param	size			Size of the object.
+* \param	seed			Seed for the field.
+*/
+static void	WlzIIPSynthFieldInit(WlzIIPSynthField *fld, WlzIVertex3 size,
+				     unsigned int seed)
+{
+  int		idx,
+  		idC;
+  double	r;
+  unsigned int	state;
+
+  state = seed;
+  fld->size = size;
+  fld->seed = seed;
+  for(idx = 0; idx < WLZIIP_SYNTH_BLOBS; ++idx)
+  {
+    for(idC = 0; idC < 3; ++idC)
+    {
+      fld->cen[idx][idC] = 0.15 + 0.7 * WlzIIPSynthRand(&state) / 65535.0;
+    }
+    r = 0.15 + 0.2 * WlzIIPSynthRand(&state) / 65535.0;
+    fld->rad2[idx] = r * r;
+  }
+}
+
+/*!
+* \return	Field value in the range [0-1).
+* \ingroup	WlzIIPServer
+* \brief	Computes the value of a synthetic field at a voxel. This is
+* 		the brightest of the blobs, each of which falls from one
+* 		at its centre to zero at its radius, with some texture
+* 		added.
+* \param	fld			Field parameters.
+* \param	kl			Column of the voxel.
+* \param	ln			Line of the voxel.
+* \param	pl			Plane of the voxel.
+*/
+static double	WlzIIPSynthFieldValue(const WlzIIPSynthField *fld,
+				      int kl, int ln, int pl)
+{
+  int		idx;
+  unsigned int	h;
+  double	u[3],
+  		d,
+		v,
+		f = 0.0;
+
+  u[0] = (kl + 0.5) / fld->size.vtX;
+  u[1] = (ln + 0.5) / fld->size.vtY;
+  u[2] = (pl + 0.5) / fld->size.vtZ;
+  for(idx = 0; idx < WLZIIP_SYNTH_BLOBS; ++idx)
+  {
+    d = (u[0] - fld->cen[idx][0]) * (u[0] - fld->cen[idx][0]) +
+	(u[1] - fld->cen[idx][1]) * (u[1] - fld->cen[idx][1]) +
+	(u[2] - fld->cen[idx][2]) * (u[2] - fld->cen[idx][2]);
+    v = 1.0 - d / fld->rad2[idx];
+    if(v > f)
+    {
+      f = v;
+    }
+  }
+  h = ((unsigned int )kl * 73856093u) ^ ((unsigned int )ln * 19349663u) ^
+      ((unsigned int )pl * 83492791u) ^ fld->seed;
+  h *= 2654435761u;
+  f = 0.85 * f + 0.15 * ((h >> 16) & 0xffff) / 65536.0;
+  return(f);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Sets the grey values of the given 3D domain object from a
+* 		synthetic field.
+* \param	obj			Given 3D domain object with values.
+* \param	gType			Grey type of the object's values.
+* \param	fld			Field parameters.
+* \param	hist			If not NULL, a histogram of 256 bins
+* 					for byte values which is incremented
+* 					for every value set.
+*/
+static WlzErrorNum WlzIIPSynthFill(WlzObject *obj, WlzGreyType gType,
+				   const WlzIIPSynthField *fld, int *hist)
+{
+  int		pl,
+  		kl,
+		idx;
+  double	f;
+  WlzUByte	r,
+  		g,
+		b;
+  WlzDomain	dom;
+  WlzValues	val;
+  WlzObject	*obj2;
+  WlzPlaneDomain *pDom;
+  WlzVoxelValues *vox;
+  WlzIntervalWSpace iWSp;
+  WlzGreyWSpace	gWSp;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  pDom = obj->domain.p;
+  vox = obj->values.vox;
+  for(pl = pDom->plane1; (errNum == WLZ_ERR_NONE) && (pl <= pDom->lastpl);
+      ++pl)
+  {
+    dom = pDom->domains[pl - pDom->plane1];
+    val = vox->values[pl - vox->plane1];
+    if((dom.core == NULL) || (val.core == NULL))
+    {
+      continue;
+    }
+    obj2 = WlzMakeMain(WLZ_2D_DOMAINOBJ, dom, val, NULL, NULL, &errNum);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      errNum = WlzInitGreyScan(obj2, &iWSp, &gWSp);
+    }
+    while((errNum == WLZ_ERR_NONE) &&
+          ((errNum = WlzNextGreyInterval(&iWSp)) == WLZ_ERR_NONE))
+    {
+      for(kl = iWSp.lftpos, idx = 0; kl <= iWSp.rgtpos; ++kl, ++idx)
+      {
+	f = WlzIIPSynthFieldValue(fld, kl, iWSp.linpos, pl);
+	switch(gType)
+	{
+	  case WLZ_GREY_UBYTE:
+	    gWSp.u_grintptr.ubp[idx] = (WlzUByte )(255.0 * f);
+	    if(hist)
+	    {
+	      ++(hist[gWSp.u_grintptr.ubp[idx]]);
+	    }
+	    break;
+	  case WLZ_GREY_SHORT:
+	    gWSp.u_grintptr.shp[idx] = (short )(4095.0 * f);
+	    break;
+	  case WLZ_GREY_INT:
+	    gWSp.u_grintptr.inp[idx] = (int )(65535.0 * f);
+	    break;
+	  case WLZ_GREY_FLOAT:
+	    gWSp.u_grintptr.flp[idx] = (float )(4095.0 * f);
+	    break;
+	  case WLZ_GREY_DOUBLE:
+	    gWSp.u_grintptr.dbp[idx] = 4095.0 * f;
+	    break;
+	  case WLZ_GREY_RGBA:
+	    r = (WlzUByte )(255.0 * f);
+	    g = (WlzUByte )(255.0 * f * f);
+	    b = (WlzUByte )(255.0 * (1.0 - f));
+	    gWSp.u_grintptr.rgbp[idx] = (unsigned int )r |
+	    				((unsigned int )g << 8) |
+	    				((unsigned int )b << 16) |
+					0xff000000u;
+	    break;
+	  default:
+	    errNum = WLZ_ERR_GREY_TYPE;
+	    break;
+	}
+      }
+    }
+    if(errNum == WLZ_ERR_EOO)
+    {
+      errNum = WLZ_ERR_NONE;
+    }
+    (void )WlzFreeObj(obj2);
+  }
+  return(errNum);
+}
+
+/*!
+* \return	New 3D domain object or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Makes a synthetic 3D domain object with the given size and
+* 		grey type. If the fill fraction is one the domain is a
+* 		cuboid with rectangular value tables, as for most of the
+* 		grey images served, otherwise it is the brightest part
+* 		of the field covering (approximately) the given fraction
+* 		of the cuboid, with ragged value tables.
+* \param	size			Size of the object's bounding box.
+* \param	gType			Grey type, which must be one of
+* 					WLZ_GREY_UBYTE, WLZ_GREY_SHORT,
+* 					WLZ_GREY_INT, WLZ_GREY_FLOAT,
+* 					WLZ_GREY_DOUBLE or WLZ_GREY_RGBA.
+* \param	fill			Fraction of the bounding box covered
+* 					by the domain, in the range (0-1].
+* \param	seed			Seed for the field, objects made with
+* 					the same parameters and seed are
+* 					identical.
+* \param	dstErr			Destination error pointer, may be NULL.
+*/
+WlzObject	*WlzIIPSynthVolume(WlzIVertex3 size, WlzGreyType gType,
+				   double fill, unsigned int seed,
+				   WlzErrorNum *dstErr)
+{
+  int		idx,
+  		cnt;
+  double	nVx;
+  WlzPixelV	bkd,
+  		thrV;
+  WlzValues	val;
+  WlzObject	*vol = NULL,
+  		*mskObj = NULL,
+		*thrObj = NULL;
+  WlzIIPSynthField fld;
+  int		hist[256];
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  val.core = NULL;
+  switch(gType)
+  {
+    case WLZ_GREY_UBYTE:  /* FALLTHROUGH */
+    case WLZ_GREY_SHORT:  /* FALLTHROUGH */
+    case WLZ_GREY_INT:    /* FALLTHROUGH */
+    case WLZ_GREY_FLOAT:  /* FALLTHROUGH */
+    case WLZ_GREY_DOUBLE: /* FALLTHROUGH */
+    case WLZ_GREY_RGBA:
+      break;
+    default:
+      errNum = WLZ_ERR_GREY_TYPE;
+      break;
+  }
+  if((errNum == WLZ_ERR_NONE) &&
+     ((size.vtX < 1) || (size.vtY < 1) || (size.vtZ < 1) ||
+      (fill <= 0.0) || (fill > 1.0)))
+  {
+    errNum = WLZ_ERR_PARAM_DATA;
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    WlzIIPSynthFieldInit(&fld, size, seed);
+    bkd.type = WLZ_GREY_INT;
+    bkd.v.inv = 0;
+    (void )WlzValueConvertPixel(&bkd, bkd, gType);
+    if(fill >= 1.0)
+    {
+      vol = WlzMakeCuboid(0, size.vtZ - 1, 0, size.vtY - 1, 0, size.vtX - 1,
+			  gType, bkd, NULL, NULL, &errNum);
+    }
+    else
+    {
+      /* Make a byte image of the field and threshold it to give a
+       * domain covering the required fraction of the bounding box. */
+      thrV.type = WLZ_GREY_UBYTE;
+      thrV.v.ubv = 0;
+      mskObj = WlzAssignObject(
+	       WlzMakeCuboid(0, size.vtZ - 1, 0, size.vtY - 1,
+			     0, size.vtX - 1, WLZ_GREY_UBYTE, thrV,
+			     NULL, NULL, &errNum), NULL);
+      if(errNum == WLZ_ERR_NONE)
+      {
+	(void )memset(hist, 0, sizeof(hist));
+	errNum = WlzIIPSynthFill(mskObj, WLZ_GREY_UBYTE, &fld, hist);
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	nVx = fill * size.vtX * size.vtY * size.vtZ;
+	cnt = 0;
+	for(idx = 255; idx > 1; --idx)
+	{
+	  if((cnt += hist[idx]) >= nVx)
+	  {
+	    break;
+	  }
+	}
+	thrV.v.ubv = (WlzUByte )idx;
+	thrObj = WlzAssignObject(
+		 WlzThreshold(mskObj, thrV, WLZ_THRESH_HIGH, &errNum), NULL);
+      }
+      if((errNum == WLZ_ERR_NONE) && (thrObj->type != WLZ_3D_DOMAINOBJ))
+      {
+        errNum = WLZ_ERR_DOMAIN_DATA;
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	val.vox = WlzNewValuesVox(thrObj, gType, bkd, &errNum);
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	vol = WlzMakeMain(WLZ_3D_DOMAINOBJ, thrObj->domain, val,
+			  NULL, NULL, &errNum);
+      }
+      if((vol == NULL) && (val.core != NULL))
+      {
+        (void )WlzFreeVoxelValueTb(val.vox);
+      }
+      (void )WlzFreeObj(thrObj);
+      (void )WlzFreeObj(mskObj);
+    }
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    errNum = WlzIIPSynthFill(vol, gType, &fld, NULL);
+  }
+  if(errNum != WLZ_ERR_NONE)
+  {
+    (void )WlzFreeObj(vol);
+    vol = NULL;
+  }
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return(vol);
+}
+
+/*!
+* \return	New compound array object or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Makes a synthetic WLZ_COMPOUND_ARR_2 compound array of 3D
+* 		domain objects, as used for multi-channel images and
+* 		anatomy domains. Each component is made by
+* 		WlzIIPSynthVolume() with a different seed, so with
+* 		sparse domains the components partly overlap.
+* \param	size			Size of the components' bounding box.
+* \param	gType			Grey type of the components.
+* \param	fill			Fraction of the bounding box covered
+* 					by each component's domain.
+* \param	nCmp			Number of components.
+* \param	seed			Seed for the first component.
+* \param	dstErr			Destination error pointer, may be NULL.
+*/
+WlzObject	*WlzIIPSynthCompound(WlzIVertex3 size, WlzGreyType gType,
+				     double fill, int nCmp, unsigned int seed,
+				     WlzErrorNum *dstErr)
+{
+  int		idx;
+  WlzObject	**cmp = NULL;
+  WlzCompoundArray *cpd = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  if(nCmp < 1)
+  {
+    errNum = WLZ_ERR_PARAM_DATA;
+  }
+  else if((cmp = (WlzObject **)AlcCalloc(nCmp, sizeof(WlzObject *))) == NULL)
+  {
+    errNum = WLZ_ERR_MEM_ALLOC;
+  }
+  for(idx = 0; (errNum == WLZ_ERR_NONE) && (idx < nCmp); ++idx)
+  {
+    cmp[idx] = WlzAssignObject(
+	       WlzIIPSynthVolume(size, gType, fill, seed + idx, &errNum),
+	       NULL);
+  }
+  if(errNum == WLZ_ERR_NONE)
+  {
+    cpd = WlzMakeCompoundArray(WLZ_COMPOUND_ARR_2, 1, nCmp, cmp,
+			       WLZ_3D_DOMAINOBJ, &errNum);
+  }
+  if(cmp)
+  {
+    for(idx = 0; idx < nCmp; ++idx)
+    {
+      (void )WlzFreeObj(cmp[idx]);
+    }
+    AlcFree(cmp);
+  }
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return((WlzObject *)cpd);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,903 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPSynthBenchMain_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPSynthBenchMain.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Microbenchmarks of the stages of rendering tiles from
+* 		synthetic Woolz objects: sectioning at fixed and oblique
+* 		angles, projection, compositing, value mapping and JPEG
+* 		and PNG compression. The objects are made in process by
+* 		WlzIIPSynthVolume() and WlzIIPSynthCompound() for each
+* 		grey type with dense and sparse domains, each stage is
+* 		timed separately and the results are written as JSON
+* 		for regression tracking.
+* \ingroup	WlzIIPServer
+*/
+
+#define _MAIN_CC
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/time.h>
+#include <Wlz.h>
+#include "Log.h"
+#include "RawTile.h"
+#include "Compositor.h"
+#include "ImageMapLUT.h"
+#include "JPEGCompressor.h"
+#include "PNGCompressor.h"
+#include "WlzIIPAxisSection.h"
+#include "WlzIIPSynth.h"
+
+/*!
+* \brief	Objects, views and buffers used by the benchmark stages
+* 		for a single grey type and domain.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _WlzIIPSynthBenchCtx
+{
+  WlzObject		*vol;		/*!< Synthetic volume. */
+  WlzThreeDViewStruct	*fixedView;	/*!< Transverse view. */
+  WlzThreeDViewStruct	*obliqueView;	/*!< Oblique view. */
+  WlzObject		*rgnObj;	/*!< Tile region of the views. */
+  WlzObject		*secObj;	/*!< Fixed section of the volume. */
+  std::vector<WlzObject *> cmpSec;	/*!< Fixed sections of the
+  					     compound's components. */
+  WlzProjectIntMode	prjMode;	/*!< Projection mode. */
+  ImageMapLUT		*lut;		/*!< Value map. */
+  int			quality;	/*!< JPEG quality. */
+  int			tileSz;		/*!< Tile width and height. */
+  WlzIVertex2		pos;		/*!< Tile origin. */
+  std::vector<WlzUByte>	buf;		/*!< RGB tile buffer. */
+} WlzIIPSynthBenchCtx;
+
+/*!
+* \brief	A benchmark stage, which sets the number of bytes it
+* 		output.
+* \ingroup	WlzIIPServer
+*/
+typedef WlzErrorNum (*WlzIIPSynthBenchFn)(WlzIIPSynthBenchCtx *ctx,
+					  unsigned long long *bytes);
+
+/*!
+* \brief	Result of timing a stage.
+* \ingroup	WlzIIPServer
+*/
+typedef struct _WlzIIPSynthBenchResult
+{
+  std::string		grey;		/*!< Grey type. */
+  std::string		domain;		/*!< Dense or sparse. */
+  std::string		stage;		/*!< Stage name. */
+  double		meanMs;		/*!< Mean time in milliseconds. */
+  double		minMs;		/*!< Minimum time in milliseconds. */
+  unsigned long long	bytes;		/*!< Bytes output per repeat. */
+  std::string		error;		/*!< Error or empty on success. */
+} WlzIIPSynthBenchResult;
+
+/*!
+* \return	Wall clock time in seconds.
+* \ingroup	WlzIIPServer
+* \brief	Gives the wall clock time.
+*/
+static double	WlzIIPSynthBenchTime()
+{
+  struct timeval tv;
+
+  (void )gettimeofday(&tv, NULL);
+  return(tv.tv_sec + 1.0e-06 * tv.tv_usec);
+}
+
+/*!
+* \return	Woolz object or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Sections the given object within the region as
+* 		WlzImage::getSubSection() does, using the axis aligned
+* 		fast path when it applies.
+* \param	obj			Given 3D object.
+* \param	rgnObj			Region of the section.
+* \param	view			Initialised view.
+* \param	dstErr			Destination error pointer.
+*/
+static WlzObject *WlzIIPSynthBenchSection(WlzObject *obj, WlzObject *rgnObj,
+					  WlzThreeDViewStruct *view,
+					  WlzErrorNum *dstErr)
+{
+  WlzObject	*secObj = NULL;
+
+  *dstErr = WLZ_ERR_NONE;
+  if(WlzIIPAxisSectionIsAligned(obj, rgnObj, view, NULL, NULL, NULL))
+  {
+    secObj = WlzIIPAxisSection(obj, rgnObj, view, NULL, dstErr);
+  }
+  if(secObj == NULL)
+  {
+    secObj = WlzGetSubSectionFromObject(obj, rgnObj, view,
+					WLZ_INTERPOLATION_NEAREST, NULL,
+					dstErr);
+  }
+  return(secObj);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Composites a rendered section into the tile buffer as
+* 		WlzImage::convertDomainObjToRGB() and
+* 		WlzImage::convertValueObjToRGB() do.
+* \param	ctx			Benchmark context with the buffer.
+* \param	obj			Rendered 2D section.
+* \param	cmp			Compositor.
+* \param	lut			Value map, may be NULL.
+*/
+static WlzErrorNum WlzIIPSynthBenchComposite(WlzIIPSynthBenchCtx *ctx,
+					     WlzObject *obj,
+					     const Compositor &cmp,
+					     const ImageMapLUT *lut)
+{
+  const int	nCh = 3;
+  WlzUByte	*dst;
+  WlzIntervalWSpace iWSp;
+  WlzGreyWSpace	gWSp;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  if((obj == NULL) || (obj->type != WLZ_2D_DOMAINOBJ))
+  {
+    return(WLZ_ERR_NONE);
+  }
+  errNum = (obj->values.core == NULL)?
+	   WlzInitRasterScan(obj, &iWSp, WLZ_RASTERDIR_ILIC):
+	   WlzInitGreyScan(obj, &iWSp, &gWSp);
+  while((errNum == WLZ_ERR_NONE) &&
+	((errNum = (obj->values.core == NULL)?
+		   WlzNextInterval(&iWSp):
+		   WlzNextGreyInterval(&iWSp)) == WLZ_ERR_NONE))
+  {
+    int		n = iWSp.rgtpos - iWSp.lftpos + 1;
+
+    dst = &(ctx->buf[0]) + ((ctx->tileSz * (iWSp.linpos - ctx->pos.vtY)) +
+			   (iWSp.lftpos - ctx->pos.vtX)) * nCh;
+    if(obj->values.core == NULL)
+    {
+      cmp.domain(dst, n);
+    }
+    else
+    {
+      errNum = (lut)?
+	       cmp.mapped(dst, gWSp.u_grintptr, gWSp.pixeltype, n, lut):
+	       cmp.values(dst, gWSp.u_grintptr, gWSp.pixeltype, n);
+    }
+  }
+  if(errNum == WLZ_ERR_EOO)
+  {
+    errNum = WLZ_ERR_NONE;
+  }
+  return(errNum);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Clears the tile buffer to the background.
+* \param	ctx			Benchmark context with the buffer.
+*/
+static void	WlzIIPSynthBenchClear(WlzIIPSynthBenchCtx *ctx)
+{
+  const WlzUByte bkd[3] = {0, 0, 0};
+
+  Compositor::fill(&(ctx->buf[0]), ctx->tileSz * ctx->tileSz, bkd, 3);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Sections a tile of the volume with the fixed view.
+* \param	ctx			Benchmark context.
+* \param	bytes			Unused.
+*/
+static WlzErrorNum WlzIIPSynthBenchSectionFixed(WlzIIPSynthBenchCtx *ctx,
+						unsigned long long *bytes)
+{
+  WlzObject	*obj;
+  WlzErrorNum	errNum;
+
+  obj = WlzIIPSynthBenchSection(ctx->vol, ctx->rgnObj, ctx->fixedView,
+				&errNum);
+  (void )WlzFreeObj(obj);
+  return(errNum);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Sections a tile of the volume with the oblique view.
+* \param	ctx			Benchmark context.
+* \param	bytes			Unused.
+*/
+static WlzErrorNum WlzIIPSynthBenchSectionOblique(WlzIIPSynthBenchCtx *ctx,
+						  unsigned long long *bytes)
+{
+  WlzObject	*obj;
+  WlzErrorNum	errNum;
+
+  obj = WlzIIPSynthBenchSection(ctx->vol, ctx->rgnObj, ctx->obliqueView,
+				&errNum);
+  (void )WlzFreeObj(obj);
+  return(errNum);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Projects the volume with the oblique view and the context's
+* 		projection mode, normalising the values to bytes as
+* 		WlzImage::getSubProjFromObject() does.
+* \param	ctx			Benchmark context.
+* \param	bytes			Unused.
+*/
+static WlzErrorNum WlzIIPSynthBenchProject(WlzIIPSynthBenchCtx *ctx,
+					   unsigned long long *bytes)
+{
+  WlzObject	*prjObj,
+  		*bytObj = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  prjObj = WlzAssignObject(
+	   WlzProjectObjToPlane(ctx->vol, ctx->obliqueView, ctx->prjMode,
+				1, NULL, 0.0, &errNum), NULL);
+  if((errNum == WLZ_ERR_NONE) && (prjObj->values.core != NULL))
+  {
+    errNum = WlzGreyNormalise(prjObj, 0);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      bytObj = WlzConvertPix(prjObj, WLZ_GREY_UBYTE, &errNum);
+    }
+  }
+  (void )WlzFreeObj(bytObj);
+  (void )WlzFreeObj(prjObj);
+  return(errNum);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Composites the fixed section into the tile buffer without
+* 		a selector.
+* \param	ctx			Benchmark context.
+* \param	bytes			Unused.
+*/
+static WlzErrorNum WlzIIPSynthBenchCopy(WlzIIPSynthBenchCtx *ctx,
+					unsigned long long *bytes)
+{
+  Compositor	cmp(3, false, 0, 0, 0, 0);
+
+  WlzIIPSynthBenchClear(ctx);
+  return(WlzIIPSynthBenchComposite(ctx, ctx->secObj, cmp, NULL));
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Maps the values of the fixed section as it is composited,
+* 		or for RGBA values maps them and then composites them, as
+* 		WlzImage::renderObj() does.
+* \param	ctx			Benchmark context.
+* \param	bytes			Unused.
+*/
+static WlzErrorNum WlzIIPSynthBenchMap(WlzIIPSynthBenchCtx *ctx,
+				       unsigned long long *bytes)
+{
+  Compositor	cmp(3, false, 0, 0, 0, 0);
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  WlzIIPSynthBenchClear(ctx);
+  if((ctx->secObj == NULL) || (ctx->secObj->type != WLZ_2D_DOMAINOBJ))
+  {
+    errNum = WLZ_ERR_NONE;
+  }
+  else if(ctx->secObj->values.core == NULL)
+  {
+    errNum = WLZ_ERR_VALUES_NULL;
+  }
+  else if(WlzGreyTypeFromObj(ctx->secObj, NULL) != WLZ_GREY_RGBA)
+  {
+    errNum = WlzIIPSynthBenchComposite(ctx, ctx->secObj, cmp, ctx->lut);
+  }
+  else
+  {
+    WlzObject	*mapObj;
+
+    mapObj = WlzAssignObject(
+	     WlzLUTTransformObj(ctx->secObj, ctx->lut->getLUTObj(),
+				WLZ_GREY_RGBA, 0, 0, &errNum), NULL);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      errNum = WlzIIPSynthBenchComposite(ctx, mapObj, cmp, NULL);
+    }
+    (void )WlzFreeObj(mapObj);
+  }
+  return(errNum);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Blends the fixed sections of the compound's components
+* 		into the tile buffer, each with its own translucent
+* 		selector colour, as for a compound selection.
+* \param	ctx			Benchmark context.
+* \param	bytes			Unused.
+*/
+static WlzErrorNum WlzIIPSynthBenchBlend(WlzIIPSynthBenchCtx *ctx,
+					 unsigned long long *bytes)
+{
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  WlzIIPSynthBenchClear(ctx);
+  for(size_t i = 0; (errNum == WLZ_ERR_NONE) && (i < ctx->cmpSec.size());
+      ++i)
+  {
+    Compositor	cmp(3, true, (i & 1)? 255: 0, (i & 2)? 255: 0,
+		    (i & 4)? 0: 255, 128);
+
+    errNum = WlzIIPSynthBenchComposite(ctx, ctx->cmpSec[i], cmp, NULL);
+  }
+  return(errNum);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Compresses the tile buffer as a JPEG tile.
+* \param	ctx			Benchmark context.
+* \param	bytes			Set to the compressed size.
+*/
+static WlzErrorNum WlzIIPSynthBenchJPEG(WlzIIPSynthBenchCtx *ctx,
+					unsigned long long *bytes)
+{
+  RawTile	tile(0, 0, 0, 0, ctx->tileSz, ctx->tileSz, 3, 8);
+  JPEGCompressor jpeg(ctx->quality);
+
+  tile.assign(&(ctx->buf[0]), (int )ctx->buf.size());
+  *bytes = jpeg.Compress(tile);
+  return(WLZ_ERR_NONE);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Compresses the tile buffer as a PNG tile.
+* \param	ctx			Benchmark context.
+* \param	bytes			Set to the compressed size.
+*/
+static WlzErrorNum WlzIIPSynthBenchPNG(WlzIIPSynthBenchCtx *ctx,
+				       unsigned long long *bytes)
+{
+  RawTile	tile(0, 0, 0, 0, ctx->tileSz, ctx->tileSz, 3, 8);
+  PNGCompressor	png;
+
+  tile.assign(&(ctx->buf[0]), (int )ctx->buf.size());
+  *bytes = png.Compress(tile);
+  return((*bytes > 0)? WLZ_ERR_NONE: WLZ_ERR_WRITE_INCOMPLETE);
+}
+
+/*!
+* \return	The result.
+* \ingroup	WlzIIPServer
+* \brief	Runs a stage the given number of times, timing each run.
+* \param	ctx			Benchmark context.
+* \param	grey			Name of the grey type.
+* \param	domain			Name of the domain.
+* \param	stage			Name of the stage.
+* \param	fn			The stage.
+* \param	nRep			Number of times to run the stage.
+*/
+static WlzIIPSynthBenchResult WlzIIPSynthBenchRun(WlzIIPSynthBenchCtx *ctx,
+					const char *grey, const char *domain,
+					const char *stage,
+					WlzIIPSynthBenchFn fn, int nRep)
+{
+  WlzIIPSynthBenchResult res;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  res.grey = grey;
+  res.domain = domain;
+  res.stage = stage;
+  res.meanMs = res.minMs = 0.0;
+  res.bytes = 0;
+  try
+  {
+    for(int i = 0; (errNum == WLZ_ERR_NONE) && (i < nRep); ++i)
+    {
+      double	t;
+
+      t = WlzIIPSynthBenchTime();
+      errNum = (*fn)(ctx, &(res.bytes));
+      t = 1.0e03 * (WlzIIPSynthBenchTime() - t);
+      res.meanMs += t / nRep;
+      res.minMs = ((i == 0) || (t < res.minMs))? t: res.minMs;
+    }
+    if(errNum != WLZ_ERR_NONE)
+    {
+      res.error = WlzStringFromErrorNum(errNum, NULL);
+    }
+  }
+  catch(const std::string &e)
+  {
+    res.error = e;
+  }
+  return(res);
+}
+
+/*!
+* \return	Woolz error code.
+* \ingroup	WlzIIPServer
+* \brief	Makes an initialised view of the given object with the
+* 		fixed point at the centre of its bounding box.
+* \param	obj			Given 3D object.
+* \param	size			Size of the object's bounding box.
+* \param	theta			Yaw in degrees.
+* \param	phi			Pitch in degrees.
+* \param	dstErr			Destination error pointer.
+*/
+static WlzThreeDViewStruct *WlzIIPSynthBenchView(WlzObject *obj,
+					WlzIVertex3 size,
+					double theta, double phi,
+					WlzErrorNum *dstErr)
+{
+  WlzThreeDViewStruct *view;
+
+  view = WlzMake3DViewStruct(WLZ_3D_VIEW_STRUCT, dstErr);
+  if(*dstErr == WLZ_ERR_NONE)
+  {
+    view->theta = theta * WLZ_M_PI / 180.0;
+    view->phi = phi * WLZ_M_PI / 180.0;
+    view->zeta = 0.0;
+    view->dist = 0.0;
+    view->scale = 1.0;
+    view->view_mode = WLZ_UP_IS_UP_MODE;
+    view->fixed.vtX = size.vtX / 2;
+    view->fixed.vtY = size.vtY / 2;
+    view->fixed.vtZ = size.vtZ / 2;
+    *dstErr = WlzInit3DViewStruct(view, obj);
+  }
+  return(view);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Writes the given string as a JSON string.
+* \param	fP			Output file.
+* \param	s			Given string.
+*/
+static void	WlzIIPSynthBenchJSONString(FILE *fP, const std::string &s)
+{
+  (void )fputc('"', fP);
+  for(size_t i = 0; i < s.length(); ++i)
+  {
+    unsigned char c = s[i];
+
+    if((c == '"') || (c == '\\'))
+    {
+      (void )fprintf(fP, "\\%c", c);
+    }
+    else if(c < 0x20)
+    {
+      (void )fprintf(fP, "\\u%04x", c);
+    }
+    else
+    {
+      (void )fputc(c, fP);
+    }
+  }
+  (void )fputc('"', fP);
+}
+
+int 		main(int argc, char *argv[])
+{
+  int		option,
+  		ok = 1,
+		usage = 0,
+		nCmp = 4,
+		nRep = 10,
+		quality = 75,
+		tileSz = 256;
+  double	fill = 0.25;
+  const char	*outFile = NULL,
+  		*wlzPrefix = NULL,
+		*errMsgStr;
+  FILE		*fP = NULL;
+  WlzIVertex3	size;
+  std::vector<int> types;
+  std::vector<WlzIIPSynthBenchResult> results;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+  static char	optList[] = "hc:f:g:n:o:q:s:t:w:";
+  static const struct
+  {
+    const char	*name;
+    WlzGreyType	gType;
+    const char	*map;
+  } gTypes[] =
+  {
+    {"ubyte", WLZ_GREY_UBYTE, "GAMMA,0,255,0,255,0.5"},
+    {"short", WLZ_GREY_SHORT, "GAMMA,0,4095,0,255,0.5"},
+    {"int",   WLZ_GREY_INT,   "GAMMA,0,65535,0,255,0.5"},
+    {"float", WLZ_GREY_FLOAT, "GAMMA,0,4095,0,255,0.5"},
+    {"rgba",  WLZ_GREY_RGBA,  "GAMMA,0,255,0,255,0.5,"
+    			      "GAMMA,0,255,0,255,0.5,"
+			      "GAMMA,0,255,0,255,0.5"}
+  };
+  static const struct
+  {
+    const char	*name;
+    WlzProjectIntMode mode;
+  } prjModes[] =
+  {
+    {"project_none", WLZ_PROJECT_INT_MODE_NONE},
+    {"project_domain", WLZ_PROJECT_INT_MODE_DOMAIN},
+    {"project_values", WLZ_PROJECT_INT_MODE_VALUES}
+  };
+  const int	nGTypes = sizeof(gTypes) / sizeof(gTypes[0]),
+  		nPrjModes = sizeof(prjModes) / sizeof(prjModes[0]);
+
+  size.vtX = size.vtY = size.vtZ = 128;
+  while((usage == 0) && ((option = getopt(argc, argv, optList)) != EOF))
+  {
+    switch(option)
+    {
+      case 'c':
+        usage = (sscanf(optarg, "%d", &nCmp) != 1) || (nCmp < 1);
+	break;
+      case 'f':
+        usage = (sscanf(optarg, "%lg", &fill) != 1) ||
+	        (fill <= 0.0) || (fill >= 1.0);
+	break;
+      case 'g':
+        {
+	  char	*tok,
+	  	*str;
+
+	  str = optarg;
+	  while((usage == 0) && ((tok = strtok(str, ",")) != NULL))
+	  {
+	    int	i;
+
+	    str = NULL;
+	    for(i = 0; (i < nGTypes) && strcmp(tok, gTypes[i].name); ++i)
+	    {
+	    }
+	    types.push_back(i);
+	    usage = i >= nGTypes;
+	  }
+	}
+	break;
+      case 'n':
+        usage = (sscanf(optarg, "%d", &nRep) != 1) || (nRep < 1);
+	break;
+      case 'o':
+        outFile = optarg;
+	break;
+      case 'q':
+        usage = (sscanf(optarg, "%d", &quality) != 1) ||
+	        (quality < 1) || (quality > 100);
+	break;
+      case 's':
+        switch(sscanf(optarg, "%d,%d,%d",
+		      &(size.vtX), &(size.vtY), &(size.vtZ)))
+	{
+	  case 1:
+	    size.vtY = size.vtZ = size.vtX;
+	    break;
+	  case 3:
+	    break;
+	  default:
+	    usage = 1;
+	    break;
+	}
+	usage = usage || (size.vtX < 2) || (size.vtY < 2) || (size.vtZ < 2);
+	break;
+      case 't':
+        usage = (sscanf(optarg, "%d", &tileSz) != 1) || (tileSz < 16);
+	break;
+      case 'w':
+        wlzPrefix = optarg;
+	break;
+      case 'h':
+      default:
+        usage = 1;
+	break;
+    }
+  }
+  if((usage == 0) && (optind != argc))
+  {
+    usage = 1;
+  }
+  ok = usage == 0;
+  if(ok && types.empty())
+  {
+    for(int i = 0; i < nGTypes; ++i)
+    {
+      types.push_back(i);
+    }
+  }
+  if(ok)
+  {
+    fP = (outFile)? fopen(outFile, "w"): stdout;
+    if(fP == NULL)
+    {
+      ok = 0;
+      (void )fprintf(stderr, "%s: Failed to open %s\n", *argv, outFile);
+    }
+  }
+  for(size_t iT = 0; ok && (iT < types.size()); ++iT)
+  {
+    for(int iD = 0; ok && (iD < 2); ++iD)
+    {
+      const char *grey = gTypes[types[iT]].name,
+      		 *domain = (iD == 0)? "dense": "sparse";
+      WlzGreyType gType = gTypes[types[iT]].gType;
+      double	dFill = (iD == 0)? 1.0: fill;
+      WlzObject	*cpd = NULL;
+      WlzIIPSynthBenchCtx ctx;
+
+      ctx.vol = ctx.rgnObj = ctx.secObj = NULL;
+      ctx.fixedView = ctx.obliqueView = NULL;
+      ctx.prjMode = WLZ_PROJECT_INT_MODE_NONE;
+      ctx.lut = NULL;
+      ctx.quality = quality;
+      ctx.tileSz = tileSz;
+      ctx.buf.resize(tileSz * tileSz * 3);
+      // Make the objects, views, the tile region and sections.
+      ctx.vol = WlzAssignObject(
+      		WlzIIPSynthVolume(size, gType, dFill, 1, &errNum), NULL);
+      if(errNum == WLZ_ERR_NONE)
+      {
+        cpd = WlzAssignObject(
+	      WlzIIPSynthCompound(size, gType, dFill, nCmp, 101, &errNum),
+	      NULL);
+      }
+      if((errNum == WLZ_ERR_NONE) && wlzPrefix)
+      {
+	for(int iO = 0; (errNum == WLZ_ERR_NONE) && (iO < 2); ++iO)
+	{
+	  FILE	*oFP;
+	  std::string name = std::string(wlzPrefix) + "_" + grey + "_" +
+	  		     domain + ((iO == 0)? ".wlz": "_cpd.wlz");
+
+	  if((oFP = fopen(name.c_str(), "w")) == NULL)
+	  {
+	    errNum = WLZ_ERR_WRITE_EOF;
+	  }
+	  else
+	  {
+	    errNum = WlzWriteObj(oFP, (iO == 0)? ctx.vol: cpd);
+	    (void )fclose(oFP);
+	  }
+	}
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	ctx.fixedView = WlzIIPSynthBenchView(ctx.vol, size, 0.0, 0.0,
+					     &errNum);
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	ctx.obliqueView = WlzIIPSynthBenchView(ctx.vol, size, 30.0, 60.0,
+					       &errNum);
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	WlzDomain dom;
+	WlzValues val;
+
+	// A tile at the centre of the fixed view.
+	ctx.pos.vtX = WLZ_NINT((ctx.fixedView->minvals.vtX +
+				ctx.fixedView->maxvals.vtX - tileSz) / 2.0);
+	ctx.pos.vtY = WLZ_NINT((ctx.fixedView->minvals.vtY +
+				ctx.fixedView->maxvals.vtY - tileSz) / 2.0);
+	val.core = NULL;
+	dom.i = WlzMakeIntervalDomain(WLZ_INTERVALDOMAIN_RECT,
+				      ctx.pos.vtY, ctx.pos.vtY + tileSz - 1,
+				      ctx.pos.vtX, ctx.pos.vtX + tileSz - 1,
+				      &errNum);
+	if(errNum == WLZ_ERR_NONE)
+	{
+	  ctx.rgnObj = WlzAssignObject(
+		       WlzMakeMain(WLZ_2D_DOMAINOBJ, dom, val, NULL, NULL,
+				   &errNum), NULL);
+	}
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	ctx.secObj = WlzAssignObject(
+		     WlzIIPSynthBenchSection(ctx.vol, ctx.rgnObj,
+					     ctx.fixedView, &errNum), NULL);
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	WlzCompoundArray *ca = (WlzCompoundArray *)cpd;
+
+	for(int iC = 0; (errNum == WLZ_ERR_NONE) && (iC < ca->n); ++iC)
+	{
+	  WlzObject *obj;
+
+	  obj = WlzAssignObject(
+		WlzIIPSynthBenchSection(ca->o[iC], ctx.rgnObj,
+					ctx.fixedView, &errNum), NULL);
+	  if(obj)
+	  {
+	    ctx.cmpSec.push_back(obj);
+	  }
+	}
+      }
+      if(errNum == WLZ_ERR_NONE)
+      {
+	ImageMap map;
+
+	if(map.parse(gTypes[types[iT]].map))
+	{
+	  errNum = WLZ_ERR_PARAM_DATA;
+	}
+	else
+	{
+	  ctx.lut = ImageMapLUT::get(map, &errNum);
+	}
+      }
+      // Time the stages.
+      if(errNum == WLZ_ERR_NONE)
+      {
+	results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			  "section_fixed", WlzIIPSynthBenchSectionFixed,
+			  nRep));
+	results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			  "section_oblique", WlzIIPSynthBenchSectionOblique,
+			  nRep));
+	for(int iP = 0; iP < nPrjModes; ++iP)
+	{
+	  ctx.prjMode = prjModes[iP].mode;
+	  results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			    prjModes[iP].name, WlzIIPSynthBenchProject,
+			    nRep));
+	}
+	results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			  "composite_blend", WlzIIPSynthBenchBlend, nRep));
+	results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			  "map_lut", WlzIIPSynthBenchMap, nRep));
+	// Leaves the unmapped section in the buffer for compression.
+	results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			  "composite_copy", WlzIIPSynthBenchCopy, nRep));
+	results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			  "compress_jpeg", WlzIIPSynthBenchJPEG, nRep));
+	results.push_back(WlzIIPSynthBenchRun(&ctx, grey, domain,
+			  "compress_png", WlzIIPSynthBenchPNG, nRep));
+      }
+      else
+      {
+	ok = 0;
+	(void )WlzStringFromErrorNum(errNum, &errMsgStr);
+	(void )fprintf(stderr, "%s: failed to set up %s %s objects (%s)\n",
+		       *argv, domain, grey, errMsgStr);
+      }
+      if(ctx.lut)
+      {
+        ctx.lut->release();
+      }
+      for(size_t iC = 0; iC < ctx.cmpSec.size(); ++iC)
+      {
+        (void )WlzFreeObj(ctx.cmpSec[iC]);
+      }
+      (void )WlzFreeObj(ctx.secObj);
+      (void )WlzFreeObj(ctx.rgnObj);
+      (void )WlzFree3DViewStruct(ctx.fixedView);
+      (void )WlzFree3DViewStruct(ctx.obliqueView);
+      (void )WlzFreeObj(cpd);
+      (void )WlzFreeObj(ctx.vol);
+    }
+  }
+  if(ok)
+  {
+    (void )fprintf(fP,
+		   "{\n"
+		   "  \"benchmark\": \"WlzIIPSynthBench\",\n"
+		   "  \"size\": [%d, %d, %d],\n"
+		   "  \"tile\": %d,\n"
+		   "  \"fill\": %g,\n"
+		   "  \"components\": %d,\n"
+		   "  \"repeats\": %d,\n"
+		   "  \"quality\": %d,\n"
+		   "  \"simd\": %d,\n"
+		   "  \"results\": [",
+		   size.vtX, size.vtY, size.vtZ, tileSz, fill, nCmp, nRep,
+		   quality, Compositor::simdLevel());
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+      const WlzIIPSynthBenchResult &r = results[i];
+
+      (void )fprintf(fP, "%s\n    {\"grey\": \"%s\", \"domain\": \"%s\", "
+		     "\"stage\": \"%s\", ",
+		     (i > 0)? ",": "", r.grey.c_str(), r.domain.c_str(),
+		     r.stage.c_str());
+      if(r.error.empty())
+      {
+	(void )fprintf(fP, "\"mean_ms\": %.4f, \"min_ms\": %.4f, "
+		       "\"bytes\": %llu}",
+		       r.meanMs, r.minMs, r.bytes);
+      }
+      else
+      {
+        (void )fprintf(fP, "\"error\": ");
+	WlzIIPSynthBenchJSONString(fP, r.error);
+	(void )fprintf(fP, "}");
+      }
+    }
+    (void )fprintf(fP, "\n  ]\n}\n");
+  }
+  if(fP && (fP != stdout))
+  {
+    (void )fclose(fP);
+  }
+  if(usage)
+  {
+    (void )fprintf(stderr,
+     	"Usage: %s [-h] [-c <components>] [-f <fill>] [-g <types>]\n"
+	"       [-n <repeats>] [-o <file>] [-q <quality>] [-s <size>]\n"
+	"       [-t <tile size>] [-w <prefix>]\n"
+	"Makes synthetic Woolz volumes and compound objects of each grey\n"
+	"type with dense and sparse domains, and times the stages of\n"
+	"rendering a tile from them separately: sectioning with fixed and\n"
+	"oblique views, projection in each mode, compositing, value\n"
+	"mapping and JPEG and PNG compression. The results are written\n"
+	"as JSON.\n"
+        "Options are:\n"
+        "  -h  Shows this usage message.\n"
+        "  -c  Number of components of the compound objects.\n"
+        "  -f  Fraction of the bounding box covered by sparse domains.\n"
+        "  -g  Comma separated grey types from ubyte, short, int, float\n"
+        "      and rgba, all by default.\n"
+        "  -n  Number of times each stage is run.\n"
+        "  -o  Output file for the JSON results, the standard output by\n"
+        "      default.\n"
+        "  -q  JPEG quality.\n"
+        "  -s  Size of the volumes, either <n> or <x>,<y>,<z>.\n"
+        "  -t  Tile width and height.\n"
+        "  -w  Also write the objects to <prefix>_<type>_<domain>.wlz and\n"
+        "      <prefix>_<type>_<domain>_cpd.wlz files.\n",
+        *argv);
+    ok = 0;
+  }
+  return(!ok);
+}
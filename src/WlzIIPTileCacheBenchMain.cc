@@ -0,0 +1,247 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WlzIIPTileCacheBenchMain_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WlzIIPTileCacheBenchMain.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Benchmark for tile cache hits. Tiles are inserted into a
+* 		tile cache and then fetched and written out as the JTL
+* 		command does for a cache hit, counting the tile data
+* 		buffers allocated and bytes copied per hit.
+* \ingroup	WlzIIPServer
+*/
+
+#define _MAIN_CC
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/time.h>
+#include "Log.h"
+#include "RawTile.h"
+#include "TileKey.h"
+#include "Cache.h"
+#include "SharedCache.h"
+#include "Writer.h"
+
+/*!
+* \return	Wall clock time in seconds.
+* \ingroup	WlzIIPServer
+* \brief	Gives the wall clock time.
+*/
+static double	WlzIIPTileCacheBenchTime()
+{
+  struct timeval tv;
+
+  (void )gettimeofday(&tv, NULL);
+  return(tv.tv_sec + 1.0e-06 * tv.tv_usec);
+}
+
+/*!
+* \return	The tile.
+* \ingroup	WlzIIPServer
+* \brief	Makes a JPEG tile with the given tile number and data size
+* 		filled with pseudo random bytes.
+* \param	fp			Image fingerprint.
+* \param	t			Tile number.
+* \param	sz			Size of the tile data.
+*/
+static RawTile	WlzIIPTileCacheBenchTile(const Fingerprint &fp, int t,
+					 int sz)
+{
+  unsigned int	seed = 12345 + t;
+  unsigned char	*data;
+  RawTile	tile(t, 0, 0, 0, 256, 256, 3, 8);
+
+  if((data = (unsigned char *)malloc(sz)) != NULL)
+  {
+    for(int i = 0; i < sz; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      data[i] = (unsigned char )(seed >> 16);
+    }
+  }
+  tile.adopt(data, sz);
+  tile.fingerprint = fp;
+  tile.compressionType = JPEG;
+  tile.quality = 75;
+  return(tile);
+}
+
+int 		main(int argc, char *argv[])
+{
+  int		option,
+  		ok = 1,
+		usage = 0,
+		nTiles = 1000,
+		nHits = 100000,
+		sz = 16384,
+		shared = 0,
+		iH;
+  float		cacheMB = 100.0f;
+  unsigned long	nCopies;
+  unsigned long long nBytes;
+  double	t0,
+  		t1;
+  const char	*shmName = "/wlziiptilecachebench";
+  Cache::Policy	policy = Cache::LRU;
+  Cache		*cache = NULL;
+  FILE		*fP = NULL;
+  Fingerprint	fp;
+  static char	optList[] = "hc:m:n:p:r:s:S";
+
+  while((usage == 0) && ((option = getopt(argc, argv, optList)) != EOF))
+  {
+    switch(option)
+    {
+      case 'c':
+        usage = (sscanf(optarg, "%g", &cacheMB) != 1) || (cacheMB <= 0.0f);
+	break;
+      case 'm':
+        shmName = optarg;
+	break;
+      case 'n':
+        usage = (sscanf(optarg, "%d", &nTiles) != 1) || (nTiles < 1);
+	break;
+      case 'p':
+        usage = !Cache::parsePolicy(optarg, policy);
+	break;
+      case 'r':
+        usage = (sscanf(optarg, "%d", &nHits) != 1) || (nHits < 1);
+	break;
+      case 's':
+        usage = (sscanf(optarg, "%d", &sz) != 1) || (sz < 1);
+	break;
+      case 'S':
+        shared = 1;
+	break;
+      case 'h':
+      default:
+        usage = 1;
+	break;
+    }
+  }
+  if((usage == 0) && (optind != argc))
+  {
+    usage = 1;
+  }
+  ok = usage == 0;
+  if(ok && ((fP = fopen("/dev/null", "w")) == NULL))
+  {
+    ok = 0;
+    (void )fprintf(stderr, "%s: Failed to open /dev/null\n", *argv);
+  }
+  if(ok)
+  {
+    try
+    {
+      FileWriter writer(fP);
+
+      cache = (shared)? new SharedCache(shmName, cacheMB, sz + 4096):
+                        new Cache(cacheMB, policy);
+      fp = FingerprintBuilder::ofString("WlzIIPTileCacheBench");
+      for(int t = 0; t < nTiles; ++t)
+      {
+	cache->insert(WlzIIPTileCacheBenchTile(fp, t, sz));
+      }
+      (void )printf("%s cache, %d tiles of %d bytes, %u cached\n",
+		    (shared)? "shared": "private", nTiles, sz,
+		    cache->getNumElements());
+      nCopies = RawTile::getCopyCount();
+      nBytes = RawTile::getCopyBytes();
+      t0 = WlzIIPTileCacheBenchTime();
+      for(iH = 0; ok && (iH < nHits); ++iH)
+      {
+	RawTile	cached;
+	TileKey	key = TileKey::make(fp, 0, (iH * 7919) % nTiles, 0, 0,
+				    JPEG, 75);
+
+	// As TileManager::getTile() and JTL for a cache hit
+	if(cache->getTile(key, cached))
+	{
+	  RawTile tile(cached);
+
+	  cache->countRequest(key, true, tile.dataLength);
+	  if(writer.putStr((const char *)tile.data, tile.dataLength) !=
+	     tile.dataLength)
+	  {
+	    ok = 0;
+	    (void )fprintf(stderr, "%s: Failed to write tile\n", *argv);
+	  }
+	}
+      }
+      t1 = WlzIIPTileCacheBenchTime() - t0;
+      nCopies = RawTile::getCopyCount() - nCopies;
+      nBytes = RawTile::getCopyBytes() - nBytes;
+      if(ok)
+      {
+	(void )printf("%10s %14s %12s %14s\n",
+		      "hits", "time/hit(us)", "copies/hit", "bytes/hit");
+	(void )printf("%10d %14.3f %12.3f %14.1f\n",
+		      nHits, 1.0e06 * t1 / nHits,
+		      (double )nCopies / nHits, (double )nBytes / nHits);
+      }
+    }
+    catch(const std::string &e)
+    {
+      ok = 0;
+      (void )fprintf(stderr, "%s: %s\n", *argv, e.c_str());
+    }
+    delete cache;
+    (void )fclose(fP);
+  }
+  if(usage)
+  {
+    (void )fprintf(stderr,
+     	"Usage: %s [-h] [-c <size>] [-m <name>] [-n <tiles>] [-p <policy>]\n"
+	"       [-r <hits>] [-s <bytes>] [-S]\n"
+	"Times tile cache hits, fetching each tile and writing it out as\n"
+	"the JTL command does, and counts the tile data buffers allocated\n"
+	"and bytes copied for each hit.\n"
+        "Options are:\n"
+        "  -h  Shows this usage message.\n"
+        "  -c  Cache size in MB.\n"
+        "  -m  Shared memory name for the shared cache.\n"
+        "  -n  Number of tiles cached.\n"
+        "  -p  Eviction policy of the private cache: lru, slru or\n"
+        "      tinylfu.\n"
+        "  -r  Number of cache hits.\n"
+        "  -s  Size of each tile in bytes.\n"
+        "  -S  Use a shared memory cache.\n",
+        *argv);
+    ok = 0;
+  }
+  return(!ok);
+}
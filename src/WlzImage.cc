@@ -45,11 +45,21 @@ static char _WlzImage_cc[] = "University of Edinburgh $Id$";
 #include <WlzProto.h>
 #include <WlzExtFF.h>
 #include "Environment.h"
+#include "CompressedFile.h"
+#include "Compositor.h"
+#include "WlzIIPAxisSection.h"
+#include "Trace.h"
+#include "ServerStats.h"
+#include "SlowLog.h"
+#include "Timer.h"
 
-//#define __PERFORMANCE_DEBUG
-#ifdef __PERFORMANCE_DEBUG
 #include <sys/time.h>
-#endif
+#include <pthread.h>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+//#define __PERFORMANCE_DEBUG
 
 //#define __ALLOW_REMOTE_FILE
 #ifdef __ALLOW_REMOTE_FILE
@@ -88,9 +98,18 @@ WlzImage::WlzImage(): IIPImage() {
   lastTileHeight    = 0;
   ntlx              = 0;
   ntly              = 0; 
+  curRes            = 0;
+  mipLevel          = 0;
+  mipObject         = NULL;
+  resViewStr        = NULL;
+  resWidth          = 0;
+  resHeight         = 0;
+  fileFingerprint.hi = fileFingerprint.lo = 0;
   
   tile_height       = Environment::getWlzTileHeight();
   tile_width        = Environment::getWlzTileWidth();
+  sectionBand       = Environment::getWlzSectionCacheBand();
+  mipLevels         = Environment::getWlzMipLevels();
   
 };
 
@@ -116,9 +135,18 @@ WlzImage::WlzImage( const std::string& path): IIPImage( path ) {
   lastTileHeight    = 0;
   ntlx              = 0;
   ntly              = 0;
+  curRes            = 0;
+  mipLevel          = 0;
+  mipObject         = NULL;
+  resViewStr        = NULL;
+  resWidth          = 0;
+  resHeight         = 0;
+  fileFingerprint.hi = fileFingerprint.lo = 0;
   
   tile_height       = Environment::getWlzTileHeight();
   tile_width        = Environment::getWlzTileWidth();
+  sectionBand       = Environment::getWlzSectionCacheBand();
+  mipLevels         = Environment::getWlzMipLevels();
   fileSystemPrefix  = Environment::getFileSystemPrefix();
 };
 
@@ -139,7 +167,8 @@ WlzImage:: WlzImage( const WlzImage& image ): IIPImage( image ) {
   tile_height       = image.tile_height;
   numResolutions    = image.numResolutions;
   viewParams        = image.viewParams;
-  wlzViewStr        = image.wlzViewStr;
+  wlzViewStr        = (image.wlzViewStr)?
+                      WlzAssign3DViewStruct(image.wlzViewStr, NULL): NULL;
   number_of_tiles   = image.number_of_tiles;
   lastTileWidth     = image.lastTileWidth; 
   lastTileHeight    = image.lastTileHeight;
@@ -147,6 +176,18 @@ WlzImage:: WlzImage( const WlzImage& image ): IIPImage( image ) {
   ntly              = image.ntly; 
   tile_height       = image.tile_height;
   tile_width        = image.tile_width;
+  sectionBand       = image.sectionBand;
+  mipLevels         = image.mipLevels;
+  memcpy(background, image.background, sizeof(background));
+  objectKey         = image.objectKey;
+  fileFingerprint   = image.fileFingerprint;
+  // The current resolution is prepared again when it is needed
+  curRes            = 0;
+  mipLevel          = 0;
+  mipObject         = NULL;
+  resViewStr        = NULL;
+  resWidth          = 0;
+  resHeight         = 0;
   
   if (image.curViewParams != NULL){
     curViewParams   = new ViewParameters;
@@ -189,6 +230,7 @@ void WlzImage::prepareViewStruct()
 throw(string)
 {
   WlzErrorNum errNum = WLZ_ERR_NONE;
+  TraceSpan span("WlzImage::prepareViewStruct");
   
   if (!isViewChanged())
   {
@@ -205,11 +247,15 @@ throw(string)
   //generate cache hash
   string hash = generateHash(viewParams);
   LOG_DEBUG("WlzImage::prepareViewStruct() hash:" << hash);
+  SlowLog::setView(hash);
   if(wlzViewStr != NULL)
   {
     WlzFree3DViewStruct(wlzViewStr);
   }
-  wlzViewStr = WlzAssign3DViewStruct(wlzObjectCache.getVS(hash), NULL);
+  wlzViewStr = wlzObjectCache.getVS(hash);
+  ServerStats::count((wlzViewStr != NULL)? ServerStats::VIEW_CACHE_HITS:
+                                           ServerStats::VIEW_CACHE_MISSES);
+  SlowLog::countCache(SlowLog::VIEW_CACHE, wlzViewStr != NULL);
   if (wlzViewStr == NULL)  // cache miss?
   {
     
@@ -278,6 +324,448 @@ throw(string)
   return;
 }
 
+/*!
+ * \ingroup      WlzIIPServer
+ * \brief        Prepares the object and view structure used to render
+ * 		 tiles at the given IIP resolution. Each resolution below
+ * 		 the highest halves the scale. The coarsest mip level of
+ * 		 the object which still has at least one voxel per pixel
+ * 		 at this scale is chosen, so that zoomed out sections
+ * 		 sample far fewer voxels. The view structure for a mip
+ * 		 level has its fixed points and distance divided and its
+ * 		 scale multiplied by the level's sampling factor, so the
+ * 		 sections have the same geometry as those of the object.
+ * 		 Mip levels are only used for sections through 3D domain
+ * 		 objects with values. The view structure must already
+ * 		 have been prepared.
+ * \param	res			Requested resolution.
+ * \par      Source:
+ *                WlzImage.cc
+ */
+void WlzImage::prepareResolution(unsigned int res)
+throw(string)
+{
+  int		dRes;
+  double	resScale;
+  WlzObject	*initObj;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  if(res >= (unsigned int )numResolutions)
+  {
+    res = numResolutions - 1;
+  }
+  if(resViewStr && mipObject && (res == curRes))
+  {
+    return;
+  }
+  if(resViewStr != NULL)
+  {
+    WlzFree3DViewStruct(resViewStr);
+    resViewStr = NULL;
+  }
+  if(mipObject != NULL)
+  {
+    WlzFreeObj(mipObject);
+    mipObject = NULL;
+  }
+  dRes = numResolutions - 1 - res;
+  resScale = viewParams->scale / (1 << dRes);
+  resWidth = WLZ_MAX(image_width >> dRes, 1);
+  resHeight = WLZ_MAX(image_height >> dRes, 1);
+  mipLevel = 0;
+  if((mipLevels > 0) && (viewParams->rmd == RENDERMODE_SECT) &&
+     (wlzObject->type == WLZ_3D_DOMAINOBJ) && wlzObject->values.core)
+  {
+    while((mipLevel < mipLevels) &&
+          (resScale * (2 << mipLevel) < 1.0 + 1.0e-06))
+    {
+      ++mipLevel;
+    }
+  }
+  if(mipLevel > 0)
+  {
+    mipObject = getMipObject(wlzObject, objectKey, mipLevel, false,
+                             &errNum);
+    if(errNum != WLZ_ERR_NONE)
+    {
+      LOG_WARN(makeWlzErrorMessage(
+               "WlzImage::prepareResolution() failed to make mip level.",
+	       errNum));
+      (void )WlzFreeObj(mipObject);
+      mipObject = NULL;
+      mipLevel = 0;
+      errNum = WLZ_ERR_NONE;
+    }
+  }
+  if(mipObject == NULL)
+  {
+    mipObject = WlzAssignObject(wlzObject, NULL);
+  }
+  if((dRes == 0) && (mipLevel == 0))
+  {
+    resViewStr = WlzAssign3DViewStruct(wlzViewStr, NULL);
+  }
+  else
+  {
+    char	buf[64];
+    string	hash;
+
+    snprintf(buf, 64, ",R=%d,L=%d", dRes, mipLevel);
+    hash = generateHash(viewParams) + buf;
+    resViewStr = wlzObjectCache.getVS(hash);
+    if(resViewStr == NULL)
+    {
+      const double f = (double )(1 << mipLevel);
+
+      if((resViewStr = WlzAssign3DViewStruct(
+                       WlzMake3DViewStruct(WLZ_3D_VIEW_STRUCT, &errNum),
+		       NULL)) != NULL)
+      {
+	resViewStr->theta           = wlzViewStr->theta;
+	resViewStr->phi             = wlzViewStr->phi;
+	resViewStr->zeta            = wlzViewStr->zeta;
+	resViewStr->dist            = viewParams->dist / f;
+	resViewStr->fixed.vtX       = viewParams->fixed.vtX / f;
+	resViewStr->fixed.vtY       = viewParams->fixed.vtY / f;
+	resViewStr->fixed.vtZ       = viewParams->fixed.vtZ / f;
+	resViewStr->fixed_2.vtX     = viewParams->fixed2.vtX / f;
+	resViewStr->fixed_2.vtY     = viewParams->fixed2.vtY / f;
+	resViewStr->fixed_2.vtZ     = viewParams->fixed2.vtZ / f;
+	resViewStr->up              = viewParams->up;
+	resViewStr->view_mode       = viewParams->mode;
+	resViewStr->scale           = resScale * f;
+	resViewStr->voxelRescaleFlg = wlzViewStr->voxelRescaleFlg;
+	resViewStr->voxelSize[0]    = wlzViewStr->voxelSize[0];
+	resViewStr->voxelSize[1]    = wlzViewStr->voxelSize[1];
+	resViewStr->voxelSize[2]    = wlzViewStr->voxelSize[2];
+	initObj = (wlzObject->type == WLZ_COMPOUND_ARR_2)?
+		  ((WlzCompoundArray *)wlzObject)->o[0]: mipObject;
+	errNum = WlzInit3DViewStruct(resViewStr, initObj);
+      }
+      if(errNum != WLZ_ERR_NONE)
+      {
+        throw(
+	makeWlzErrorMessage(
+	  "WlzImage::prepareResolution() failed.", errNum));
+      }
+      wlzObjectCache.insert(resViewStr, hash);
+    }
+  }
+  curRes = res;
+  LOG_DEBUG("WlzImage::prepareResolution() resolution " << res <<
+            " mip level " << mipLevel << " image size " <<
+	    resWidth << " x " << resHeight);
+}
+
+/*!
+ * \return	Mip level object or NULL on error.
+ * \ingroup	WlzIIPServer
+ * \brief	Gets a downsampled (mip level) copy of the given object,
+ * 		sampled by a factor of two per level in each direction,
+ * 		from the object cache or by sampling the previous level.
+ * 		Grey values are averaged, RGBA values are point sampled.
+ * 		The returned object has been assigned.
+ * \param	obj			Given full resolution 3D object.
+ * \param	ois			Identification string of the object.
+ * \param	level			Mip level, must be greater than zero.
+ * \param	pin			Pin the mip level in the cache if true.
+ * \param	dstErr			Destination error pointer, may be NULL.
+ */
+WlzObject *WlzImage::getMipObject(WlzObject *obj, const std::string &ois,
+				  int level, bool pin, WlzErrorNum *dstErr)
+{
+  char		buf[32];
+  std::string	mipS;
+  WlzObject	*mipObj = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  snprintf(buf, 32, "&MIP=%d", level);
+  mipS = ois + buf;
+  mipObj = wlzObjectCache.get(mipS);
+  if(mipObj == NULL)
+  {
+    WlzObject	*srcObj;
+
+    srcObj = (level > 1)? getMipObject(obj, ois, level - 1, pin, &errNum):
+                          WlzAssignObject(obj, NULL);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      WlzIVertex3 samFac;
+      WlzGreyType gType;
+
+      samFac.vtX = samFac.vtY = samFac.vtZ = 2;
+      gType = WlzGreyTypeFromObj(srcObj, &errNum);
+      if(errNum == WLZ_ERR_NONE)
+      {
+	mipObj = WlzAssignObject(
+	         WlzSampleObj(srcObj, samFac,
+		              (gType == WLZ_GREY_RGBA)? WLZ_SAMPLEFN_POINT:
+			                                WLZ_SAMPLEFN_MEAN,
+			      &errNum), NULL);
+      }
+    }
+    (void )WlzFreeObj(srcObj);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      if(pin)
+      {
+        (void )wlzObjectCache.insertPinned(mipObj, mipS);
+      }
+      else
+      {
+        wlzObjectCache.insert(mipObj, mipS);
+      }
+    }
+  }
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return(mipObj);
+}
+
+/*!
+ * \return	Woolz object read from the file or NULL on error.
+ * \ingroup	WlzIIPServer
+ * \brief	Reads a Woolz object from the given file. Gzip and zstd
+ * 		compressed files are decompressed in process.
+ * \param	path			Full path of the file.
+ * \param	dstErr			Destination error pointer, may be NULL.
+ */
+WlzObject *WlzImage::readObject(const std::string &path, WlzErrorNum *dstErr)
+{
+  FILE		*fp = NULL;
+  WlzObject	*obj = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_FILE_OPEN;
+
+  try
+  {
+    fp = CompressedFile::open(path, Environment::getWlzDecompressThreads());
+  }
+  catch(const std::string &e)
+  {
+    LOG_DEBUG("WlzImage::readObject() " << e);
+    fp = NULL;
+  }
+  LOG_DEBUG("WlzImage::readObject() open of " << path << " " <<
+	    ((fp)? "successful": "unsuccessful"));
+  if(fp)
+  {
+    obj = WlzEffReadObj(fp, NULL, WLZEFF_FORMAT_WLZ, 0, 0, 0, &errNum);
+    LOG_DEBUG("WlzImage::readObject() read of " << path <<
+	      " Error code = " << WlzStringFromErrorNum(errNum, NULL));
+    fclose(fp);
+  }
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return(obj);
+}
+
+/*!
+ * \brief	State shared by the threads which preload objects.
+ * \ingroup	WlzIIPServer
+ */
+typedef struct _WlzImagePreload
+{
+  std::vector<std::string> paths;	/*!< Objects to load. */
+  std::string		prefix;		/*!< File system prefix. */
+  int			next;		/*!< Index of the next path to load,
+  					     only accessed atomically. */
+  size_t		bytes;		/*!< Bytes of objects pinned, only
+  					     accessed atomically. */
+} WlzImagePreload;
+
+/*!
+ * \return	Always NULL.
+ * \ingroup	WlzIIPServer
+ * \brief	Preload thread which reads and pins objects until there are
+ * 		none left to load.
+ * \param	data			The shared preload state.
+ */
+void *WlzImage::preloadThread(void *data)
+{
+  int		idx;
+  const int	nMipLevels = Environment::getWlzMipLevels();
+  WlzImagePreload *pl = (WlzImagePreload *)data;
+
+  while((idx = __sync_fetch_and_add(&(pl->next), 1)) <
+        (int )(pl->paths.size()))
+  {
+    const std::string &path = pl->paths[idx];
+    int		nMip = 0;
+    size_t	sz = 0;
+    struct timeval t0,
+    		t1;
+    WlzObject	*obj;
+    std::string	key;
+    WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+    gettimeofday(&t0, NULL);
+    key = wlzObjectCache.validateFile(path, pl->prefix + path, NULL);
+    obj = readObject(pl->prefix + path, &errNum);
+    if(obj && (obj->type != WLZ_3D_DOMAINOBJ) &&
+       (obj->type != WLZ_COMPOUND_ARR_2))
+    {
+      errNum = WLZ_ERR_OBJECT_TYPE;
+    }
+    if(obj && (errNum == WLZ_ERR_NONE))
+    {
+      obj = WlzAssignObject(obj, NULL);
+      try
+      {
+	sz = wlzObjectCache.insertPinned(obj, key);
+	(void )__sync_add_and_fetch(&(pl->bytes), sz);
+      }
+      catch(const std::string &e)
+      {
+	errNum = WLZ_ERR_MEM_ALLOC;
+      }
+      // Mip levels are built now too, so that zoomed out views of the
+      // object are also fast from the start.
+      if(obj->type == WLZ_3D_DOMAINOBJ && obj->values.core)
+      {
+	while((errNum == WLZ_ERR_NONE) && (nMip < nMipLevels))
+	{
+	  (void )WlzFreeObj(getMipObject(obj, key, ++nMip, true, &errNum));
+	}
+      }
+    }
+    (void )WlzFreeObj(obj);
+    gettimeofday(&t1, NULL);
+    if(errNum == WLZ_ERR_NONE)
+    {
+      LOG_NOTICE("Preloaded " << path << " in " <<
+                 (t1.tv_sec - t0.tv_sec) * 1000 +
+		 (t1.tv_usec - t0.tv_usec) / 1000 << "ms, size " <<
+		 (sz + 1024 * 1024 - 1) / (1024 * 1024) << "MB, with " <<
+		 nMip << " mip levels");
+    }
+    else
+    {
+      LOG_WARN(makeWlzErrorMessage("Failed to preload " + path + ".",
+                                   errNum));
+    }
+  }
+  return(NULL);
+}
+
+/*!
+ * \ingroup	WlzIIPServer
+ * \brief	Reads the listed objects, using several threads, and pins
+ * 		them in the object cache so that they are never evicted.
+ * 		This should be called before any requests are served.
+ * 		The list is separated by commas or white space, paths are
+ * 		relative to the file system prefix and must match the
+ * 		FIF paths of requests. An entry beginning with '@' is a
+ * 		manifest file containing one path per line, in which blank
+ * 		lines and lines beginning with '#' are ignored.
+ * \param	list			List of objects and manifest files.
+ * \param	nThreads		Number of threads to load with.
+ */
+void WlzImage::preload(const std::string &list, int nThreads)
+{
+  size_t	p0,
+  		p1;
+  WlzImagePreload pl;
+  const char	*sep = ", \t\n";
+
+  pl.next = 0;
+  pl.bytes = 0;
+  pl.prefix = Environment::getFileSystemPrefix();
+  p0 = list.find_first_not_of(sep);
+  while(p0 != std::string::npos)
+  {
+    std::string entry;
+
+    p1 = list.find_first_of(sep, p0);
+    entry = list.substr(p0, (p1 == std::string::npos)? p1: p1 - p0);
+    if(entry[0] == '@')
+    {
+      std::string line;
+      std::ifstream manifest(entry.substr(1).c_str());
+
+      if(!manifest)
+      {
+        LOG_WARN("Failed to open preload manifest " << entry.substr(1));
+      }
+      while(std::getline(manifest, line))
+      {
+	size_t	l0,
+		l1;
+
+        l0 = line.find_first_not_of(" \t\r");
+	l1 = line.find_last_not_of(" \t\r");
+	if((l0 != std::string::npos) && (line[l0] != '#'))
+	{
+	  pl.paths.push_back(line.substr(l0, l1 + 1 - l0));
+	}
+      }
+    }
+    else
+    {
+      pl.paths.push_back(entry);
+    }
+    p0 = list.find_first_not_of(sep, p1);
+  }
+  if(!pl.paths.empty())
+  {
+    int		nStarted = 0;
+    struct timeval t0,
+    		t1;
+    std::vector<pthread_t> threads;
+
+    gettimeofday(&t0, NULL);
+    if(nThreads > (int )(pl.paths.size()))
+    {
+      nThreads = pl.paths.size();
+    }
+    threads.resize(nThreads);
+    for(int i = 1; i < nThreads; ++i)
+    {
+      if(pthread_create(&(threads[nStarted]), NULL, preloadThread, &pl) == 0)
+      {
+        ++nStarted;
+      }
+    }
+    (void )preloadThread(&pl);
+    for(int i = 0; i < nStarted; ++i)
+    {
+      (void )pthread_join(threads[i], NULL);
+    }
+    gettimeofday(&t1, NULL);
+    LOG_NOTICE("Preloaded " << pl.paths.size() << " objects using " <<
+               nStarted + 1 << " threads in " <<
+	       (t1.tv_sec - t0.tv_sec) * 1000 +
+	       (t1.tv_usec - t0.tv_usec) / 1000 << "ms, " <<
+	       (pl.bytes + 1024 * 1024 - 1) / (1024 * 1024) << "MB loaded, " <<
+	       wlzObjectCache.getPinnedMemorySize() << "MB pinned");
+  }
+}
+
+/*!
+ * \return	Number of entries in the object cache.
+ * \ingroup	WlzIIPServer
+ * \brief	Returns the number of objects, sections and view structures
+ * 		held in the object cache, including pinned objects.
+ */
+unsigned int WlzImage::getObjectCacheCount()
+{
+  return(wlzObjectCache.getNumElements());
+}
+
+/*!
+ * \return	Bytes held by the object cache.
+ * \ingroup	WlzIIPServer
+ * \brief	Returns the number of bytes held by the object cache,
+ * 		including cached sections and pinned objects.
+ */
+size_t WlzImage::getObjectCacheBytes()
+{
+  return(wlzObjectCache.getMemoryBytes());
+}
+
 /*!
  * \ingroup      WlzIIPServer
  * \brief        Prepare the 3D Woolz object either by looking it up from the
@@ -291,16 +779,21 @@ throw(string)
 {
   WlzGreyType   gType;
   WlzErrorNum   errNum = WLZ_ERR_NONE;
+  TraceSpan     span("WlzImage::prepareObject");
   
   if(!wlzObject)
   {
     string filename;
-    int usepipe = 0;
     LOG_DEBUG("WlzImage::prepareObject() reloading");
     //check cache first
     filename = getFileName( );
     LOG_DEBUG("WlzImage::prepareObject() filename " << filename);
-    wlzObject  = WlzAssignObject(wlzObjectCache.get(filename), NULL);
+    SlowLog::setObject(filename);
+    // The key changes if the file has been replaced
+    objectKey = wlzObjectCache.validateFile(filename,
+                                            fileSystemPrefix + filename,
+					    &fileFingerprint);
+    wlzObject  = wlzObjectCache.get(objectKey);
 #ifdef __PERFORMANCE_DEBUG
     struct timeval tVal;
     struct timeval tVal2;
@@ -309,42 +802,17 @@ throw(string)
 #endif
     LOG_DEBUG("WlzImage::prepareObject() cache " <<
               (wlzObject != NULL)? "hit": "miss");
+    ServerStats::count((wlzObject != NULL)?
+                       ServerStats::OBJECT_CACHE_HITS:
+		       ServerStats::OBJECT_CACHE_MISSES);
+    SlowLog::countCache(SlowLog::OBJECT_CACHE, wlzObject != NULL);
     if (wlzObject == NULL)  // cache miss?
     {
+      Timer load_timer;
+      SlowLogSpan load_span(SlowLog::LOAD);
+      load_timer.start();
       // if not in cache then load
-      FILE *fp = NULL;
-      if (filename.substr(filename.length()-3, 3) == ".gz") {
-	string command = "gunzip -c ";
-	command += filename;
-	fp = popen( command.c_str(), "r");
-	usepipe = 1;
-      }
-      else
-      {
-	std::string fullFilename;
-
-	fullFilename = fileSystemPrefix + filename;
-	fp = fopen(fullFilename.c_str(), "r");
-        LOG_DEBUG("WlzImage::prepareObject() open of " <<
-	          fullFilename << " " <<
-		  ((fp)? "successful": "unsuccessful"));
-      }
-      
-      if (fp)
-      {
-	wlzObject = WlzEffReadObj( fp , NULL, WLZEFF_FORMAT_WLZ,
-	                           0, 0, 0, &errNum );
-        LOG_DEBUG("WlzImage::prepareObject() read of " << filename <<
-	          "Error code = " << WlzStringFromErrorNum(errNum, NULL));
-      }
-      
-      if (fp)
-      {
-	if (usepipe)
-	  pclose(fp);
-	else
-	  fclose(fp);
-      }
+      wlzObject = readObject(fileSystemPrefix + filename, &errNum);
       
 #ifdef __ALLOW_REMOTE_FILE
       /////???????????? Yiya added for remote wlz file
@@ -401,7 +869,8 @@ throw(string)
 	    throw("WlzImage::prepareObject() failed to read object "
 	          "from file " + filename + ".");
 	  }
-	  wlzObjectCache.insert(wlzObject , filename);
+	  ServerStats::observeObjectLoad(load_timer.getTime());
+	  wlzObjectCache.insert(wlzObject , objectKey);
     }
 #ifdef __PERFORMANCE_DEBUG
     gettimeofday(&tVal2, NULL);
@@ -581,7 +1050,34 @@ throw(string)
               number_of_tiles);
     
     
-    numResolutions = 1; // resoltions. currently only one resolution is used.
+    // Each mip level is also an IIP resolution, halving the image size,
+    // down to one which fits in a single tile.
+    numResolutions = 1;
+    {
+      unsigned int w = image_width,
+		   h = image_height;
+
+      while((numResolutions <= mipLevels) &&
+            ((w > tile_width) || (h > tile_height)))
+      {
+	w /= 2;
+	h /= 2;
+	++numResolutions;
+      }
+    }
+
+    // The view has changed so the current resolution must be prepared
+    // again
+    if(resViewStr != NULL)
+    {
+      WlzFree3DViewStruct(resViewStr);
+      resViewStr = NULL;
+    }
+    if(mipObject != NULL)
+    {
+      WlzFreeObj(mipObject);
+      mipObject = NULL;
+    }
     
     // Update current sections view status
     if (curViewParams == NULL)
@@ -621,6 +1117,16 @@ void WlzImage::closeImage() {
     WlzFree3DViewStruct( wlzViewStr ); 
     wlzViewStr  = NULL;
   }
+
+  // release the current resolution's view and object
+  if( resViewStr != NULL ){
+    WlzFree3DViewStruct( resViewStr );
+    resViewStr  = NULL;
+  }
+  if( mipObject != NULL ){
+    WlzFreeObj( mipObject );
+    mipObject = NULL;
+  }
   
   // release object 
   if( wlzObject != NULL ){
@@ -661,6 +1167,8 @@ WlzErrorNum			WlzImage::renderObj(
   WlzObject 	*renObj = NULL;
   WlzErrorNum 	errNum = WLZ_ERR_NONE;
   const int	dither = 0;
+  TraceSpan	span("WlzImage::renderObj");
+  SlowLogSpan	slowSpan(SlowLog::SECTION);
 
   // Render the object for the given tile domain.
   switch(viewParams->rmd)
@@ -670,14 +1178,22 @@ WlzErrorNum			WlzImage::renderObj(
 	WlzObject **mskP = NULL;
         WlzObject *mskObj = NULL;
 
+	/* Cut the tile from a cached section if section caching is
+	 * enabled. */
+	if(wlzObjectCache.sectionCacheEnabled())
+	{
+	  renObj = WlzAssignObject(
+	           getSubSectFromObject(gvnObj, tileObj, pos, sel, &errNum),
+		   NULL);
+	  break;
+	}
 	/* Get section image, masking it if an alpha channel is being used. */
         if(viewParams->alpha && gvnObj->values.core)
 	{
 	  mskP = &mskObj;
 	}
 	renObj = WlzAssignObject(
-		 WlzGetSubSectionFromObject(gvnObj, tileObj, wlzViewStr,
-		 			    interp, mskP, &errNum), NULL);
+		 getSubSection(gvnObj, tileObj, mskP, &errNum), NULL);
         if((errNum == WLZ_ERR_NONE) && 
 	   (renObj != NULL) && (mskObj != NULL))
 	{
@@ -718,27 +1234,31 @@ WlzErrorNum			WlzImage::renderObj(
     int nChan = viewParams->map.getNChan();
     if(nChan > 0)
     {
-      WlzObject *lutObj = NULL,
-      		*mapObj = NULL;
+      ImageMapLUT *lut;
 
-      lutObj = getMapLUTObj(&errNum);
+      lut = getMapLUT(&errNum);
       if(errNum == WLZ_ERR_NONE)
       {
-        WlzGreyType gType,
-		    mGType;
-
-	gType = WlzGreyTypeFromObj(renObj, NULL);
-	mGType = ((nChan > 1) || (gType == WLZ_GREY_RGBA))?
-	         WLZ_GREY_RGBA: WLZ_GREY_UBYTE;
-        mapObj = WlzAssignObject(
-	         WlzLUTTransformObj(renObj, lutObj, mGType,
-	                            0, dither, &errNum), NULL);
-      }
-      (void )WlzFreeObj(lutObj);
-      if(errNum == WLZ_ERR_NONE) {
-        errNum = convertValueObjToRGB(tileBuf, mapObj, pos, size, sel);
+	if(WlzGreyTypeFromObj(renObj, NULL) != WLZ_GREY_RGBA)
+	{
+	  // Map the values as they are composited.
+	  errNum = convertValueObjToRGB(tileBuf, renObj, pos, size, sel, lut);
+	}
+	else
+	{
+	  WlzObject *mapObj;
+
+	  mapObj = WlzAssignObject(
+		   WlzLUTTransformObj(renObj, lut->getLUTObj(), WLZ_GREY_RGBA,
+				      0, dither, &errNum), NULL);
+	  if(errNum == WLZ_ERR_NONE)
+	  {
+	    errNum = convertValueObjToRGB(tileBuf, mapObj, pos, size, sel);
+	  }
+	  (void )WlzFreeObj(mapObj);
+	}
+	lut->release();
       }
-      (void )WlzFreeObj(mapObj);
     }
     else
     {
@@ -797,7 +1317,13 @@ WlzObject 			*WlzImage::getSubProjFromObject(
       errNum = WLZ_ERR_PARAM_DATA;
       break;
   }
-  prjS = "PRJ=" + pS + "," + getHash() +
+  {
+    char	buf[32];
+
+    snprintf(buf, 32, ",R=%d,", numResolutions - 1 - (int )curRes);
+    pS += buf;
+  }
+  prjS = "PRJ=" + pS + getHash() +
          "SEL=" + WlzExpStr(sel->expression, NULL, NULL);;
   prjObj = getObjectFromCache(prjS);
   if(prjObj == NULL)
@@ -808,7 +1334,7 @@ WlzObject 			*WlzImage::getSubProjFromObject(
     if(errNum == WLZ_ERR_NONE)
     {
       t0 = WlzAssignObject(
-	   WlzProjectObjToPlane(gvnObj, wlzViewStr, itm, 1, NULL,
+	   WlzProjectObjToPlane(gvnObj, resViewStr, itm, 1, NULL,
 	                        viewParams->depth, &errNum), NULL);
     }
     if(errNum == WLZ_ERR_NONE)
@@ -859,94 +1385,442 @@ WlzObject 			*WlzImage::getSubProjFromObject(
 }
 
 /*!
-* \return	Look up table object.
+* \return	Woolz object or NULL on error.
+* \ingroup	WlzIIPServer
+* \brief	Gets the section of the given object within the bounding
+* 		box of the given region for the current view. When the
+* 		view is aligned with the axes of a 3D object the section
+* 		is copied directly from the object's value tables using
+* 		WlzIIPAxisSection(), otherwise (or should that fail) it is
+* 		computed by WlzGetSubSectionFromObject(). Both give the
+* 		same values with nearest neighbour interpolation.
+* \param	gvnObj			Given object to be sectioned.
+* \param	rgnObj			Object with the required domain.
+* \param	mskP			Destination pointer for a mask object,
+* 					may be NULL.
+* \param	dstErr			Destination error pointer, may be NULL.
+*/
+WlzObject			*WlzImage::getSubSection(
+				  WlzObject *gvnObj,
+				  WlzObject *rgnObj,
+				  WlzObject **mskP,
+				  WlzErrorNum *dstErr)
+{
+  WlzObject	*secObj = NULL;
+  WlzErrorNum	errNum = WLZ_ERR_NONE;
+
+  if((interp == WLZ_INTERPOLATION_NEAREST) &&
+     WlzIIPAxisSectionIsAligned(gvnObj, rgnObj, resViewStr,
+                                NULL, NULL, NULL))
+  {
+    secObj = WlzIIPAxisSection(gvnObj, rgnObj, resViewStr, mskP, &errNum);
+  }
+  if(secObj == NULL)
+  {
+    secObj = WlzGetSubSectionFromObject(gvnObj, rgnObj, resViewStr,
+    					interp, mskP, &errNum);
+  }
+  if(dstErr)
+  {
+    *dstErr = errNum;
+  }
+  return(secObj);
+}
+
+/*!
+* \return	Woolz object or NULL on error.
 * \ingroup	WlzIIPServer
-* \brief	Gets the value map look up table object using the object cache.
-* \param	iObj			Given object which must have
-* 					image values.
+* \brief	Gets the section of the given object which falls within the
+* 		given tile's domain by cutting it from a section which is
+* 		computed once for the view and kept in the object cache.
+* 		Sections are computed for bands of sectionBand tile rows,
+* 		or for the whole view if sectionBand is zero, so that all
+* 		the tiles of a band share a single plane setup and
+* 		sectioning. As for WlzImage::renderObj() the section is
+* 		masked if an alpha channel is being used.
+* \param	gvnObj			Given object to be sectioned.
+* \param	tileObj			Object with required tile domain.
+* \param	pos			Tile origin.
+* \param	sel			The selector (required for cache
+* 					string).
 * \param	dstErr			Destination error pointer, may be NULL.
 */
-WlzObject
-*WlzImage::getMapLUTObj(WlzErrorNum *dstErr)
+WlzObject 			*WlzImage::getSubSectFromObject(
+				  WlzObject *gvnObj,
+				  WlzObject *tileObj,
+				  WlzIVertex2 pos,
+				  CompoundSelector *sel,
+				  WlzErrorNum *dstErr)
 {
-  WlzObject	*lutObj = NULL;
+  int		band,
+  		bandHeight;
+  WlzIBox2	bBox;
+  std::string   secS;
+  WlzObject	*secObj = NULL,
+  		*subObj = NULL;
   WlzErrorNum	errNum = WLZ_ERR_NONE;
 
-  const ImageMap &map = viewParams->map;
-  if(map.getNChan() > 0)
+  bBox.xMin = WLZ_NINT(resViewStr->minvals.vtX);
+  bBox.yMin = WLZ_NINT(resViewStr->minvals.vtY);
+  bBox.xMax = bBox.xMin + (int )resWidth - 1;
+  bBox.yMax = bBox.yMin + (int )resHeight - 1;
+  bandHeight = (sectionBand > 0)? sectionBand * (int )tile_height:
+                                  (int )resHeight;
+  band = (pos.vtY - bBox.yMin) / bandHeight;
+  bBox.yMin += band * bandHeight;
+  bBox.yMax = WLZ_MIN(bBox.yMax, bBox.yMin + bandHeight - 1);
+  {
+    char	*eS = NULL;
+    char	buf[64];
+
+    if(sel && sel->expression)
+    {
+      eS = WlzExpStr(sel->expression, NULL, NULL);
+    }
+    snprintf(buf, 64, ",A=%d,B=%d,%d,R=%d", (viewParams->alpha)? 1: 0,
+             band, bandHeight, numResolutions - 1 - (int )curRes);
+    secS = "SEC=" + generateViewHash(viewParams) + buf +
+           "SEL=" + ((eS)? eS: "");
+    AlcFree(eS);
+  }
+  secObj = getObjectFromCache(secS);
+  if(secObj == NULL)
+  {
+    WlzDomain	dom;
+    WlzValues	val;
+    WlzObject	*bandObj = NULL,
+    		*mskObj = NULL,
+		*t0 = NULL;
+
+    val.core = NULL;
+    if((dom.i = WlzMakeIntervalDomain(WLZ_INTERVALDOMAIN_RECT,
+                                      bBox.yMin, bBox.yMax,
+				      bBox.xMin, bBox.xMax, &errNum)) != NULL)
+    {
+      bandObj = WlzAssignObject(
+                WlzMakeMain(WLZ_2D_DOMAINOBJ, dom, val, NULL, NULL, &errNum),
+		NULL);
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      t0 = WlzAssignObject(
+	   getSubSection(gvnObj, bandObj,
+			 (viewParams->alpha && gvnObj->values.core)?
+			 &mskObj: NULL, &errNum), NULL);
+    }
+    if((errNum == WLZ_ERR_NONE) && (t0 != NULL) && (mskObj != NULL))
+    {
+      secObj = WlzAssignObject(
+	       WlzGreyTransfer(mskObj, t0, 0, &errNum), NULL);
+    }
+    else
+    {
+      secObj = WlzAssignObject(t0, NULL);
+    }
+    (void )WlzFreeObj(t0);
+    (void )WlzFreeObj(mskObj);
+    (void )WlzFreeObj(bandObj);
+    if((errNum == WLZ_ERR_NONE) && (secObj == NULL))
+    {
+      errNum = WLZ_ERR_OBJECT_NULL;
+    }
+    if(errNum == WLZ_ERR_NONE)
+    {
+      wlzObjectCache.insertSection(secObj, secS);
+    }
+  }
+  if(errNum == WLZ_ERR_NONE)
   {
-    const string mapS = map.toString();
-    lutObj = getObjectFromCache(mapS);     // Increments the objects linkcount.
-    if(lutObj == NULL)
+    if(secObj->type == WLZ_EMPTY_OBJ)
+    {
+      subObj = WlzMakeEmpty(&errNum);
+    }
+    else
     {
-      lutObj = WlzAssignObject(map.createLUT(&errNum), NULL);
+      WlzObject *tmpObj = WlzIntersect2(tileObj, secObj, &errNum);
       if(errNum == WLZ_ERR_NONE)
       {
-	addObjectToCache(lutObj, mapS);
+	if(tmpObj->type == WLZ_EMPTY_OBJ)
+	{
+	  subObj = WlzMakeEmpty(&errNum);
+	}
+	else
+	{
+	  subObj = WlzMakeMain(tmpObj->type, tmpObj->domain, secObj->values,
+			       NULL, NULL, &errNum);
+	}
       }
+      (void )WlzFreeObj(tmpObj);
     }
   }
+  (void )WlzFreeObj(secObj);
   if(dstErr)
   {
     *dstErr = errNum;
   }
-  return(lutObj);
+  return(subObj);
+}
+
+/*!
+* \return	Compiled value map, which must be released using
+* 		ImageMapLUT::release(), or NULL if there is no map.
+* \ingroup	WlzIIPServer
+* \brief	Gets the compiled value map look up tables for the current
+* 		view from the cache of compiled maps.
+* \param	dstErr			Destination error pointer, may be NULL.
+*/
+ImageMapLUT
+*WlzImage::getMapLUT(WlzErrorNum *dstErr)
+{
+  return(ImageMapLUT::get(viewParams->map, dstErr));
 }
 
 /*!
  * \ingroup      WlzIIPServer
- * \brief        Generate the current tile
- * \param        seq not used
- * \param        ang not used
+ * \brief        Prepares the view for the given resolution and computes
+ * 		 the origin and size of the given tile in view coordinates.
  * \param        res requested resolution
  * \param        tile requested tile number
- * \return       RawTile raw tile data
+ * \param        pos destination for the tile origin
+ * \param        size destination for the tile size, which is smaller than
+ * 		 the tile width and height in the last column and row
  * \par      Source:
  *                WlzImage.cc
  */
-RawTile		WlzImage::getTile(int seq, int ang, unsigned int res,
-				  unsigned int tile)
+void		WlzImage::prepareTile(unsigned int res, unsigned int tile,
+				      WlzIVertex2 &pos, WlzIVertex2 &size)
 throw(string)
 {
-  int 		tw=0, th=0; //real tile width and height
-  WlzErrorNum 	errNum=WLZ_ERR_NONE;
-  string 	filename;
-  WlzObject     *tmpObj;
-  WlzIVertex3   pos;
-  WlzObject     *wlzSection = NULL;
-  
+  int		rtlx, rtly, rlw, rlh; //tiles and last tile size at resolution
+
   //seq = ang =  res  = 0;
   // force unused parameters to zero to, facilitate cache match
   loadImageInfo( 0, 0);
+  prepareResolution(res);
+  rlw = resWidth % tile_width;
+  rlh = resHeight % tile_height;
+  rtlx = (resWidth / tile_width) + (rlw == 0 ? 0 : 1);
+  rtly = (resHeight / tile_height) + (rlh == 0 ? 0 : 1);
   
   // Check that a valid tile number was given
-  if( tile >= number_of_tiles)
+  if( tile >= rtlx * rtly)
   {
     char tile_no[64];
     snprintf( tile_no, 64, "%d", tile );
     string tile_n = string( tile_no );
     throw("WlzImage::getTile() tile " + tile_n + " does not exist");
   }
-  tw = tile_width;
-  th = tile_height;
+  size.vtX = tile_width;
+  size.vtY = tile_height;
   // Alter the tile size if it's in the last column
-  if((tile % ntlx == ntlx - 1) && (lastTileWidth != 0))
+  if((tile % rtlx == rtlx - 1) && (rlw != 0))
   {
-    tw = lastTileWidth;
+    size.vtX = rlw;
   }
   // Alter the tile size if it's in the bottom row
-  if((tile / ntlx == ntly - 1) && (lastTileHeight != 0))
+  if((tile / rtlx == rtly - 1) && (rlh != 0))
+  {
+    size.vtY = rlh;
+  }
+  pos.vtX = (tile % rtlx) * tile_width +  WLZ_NINT(resViewStr->minvals.vtX);
+  pos.vtY = (tile / rtlx) * tile_height + WLZ_NINT(resViewStr->minvals.vtY);
+}
+
+/*!
+ * \return	Non zero if the section of the given object may intersect
+ * 		the given rectangle.
+ * \ingroup	WlzIIPServer
+ * \brief	Checks whether the section of the given object through the
+ * 		current view may intersect the given rectangle in view
+ * 		coordinates. The object's bounding box, grown by a voxel
+ * 		for interpolation, is cut by the section plane and the
+ * 		bounding rectangle of the cut is compared with the given
+ * 		rectangle. Only 3D domain objects are checked, any other
+ * 		object may intersect the rectangle.
+ * \param	obj			Given object.
+ * \param	pos			Origin of the rectangle.
+ * \param	size			Size of the rectangle.
+ */
+int		WlzImage::sectionMayIntersect(WlzObject *obj,
+					      WlzIVertex2 pos,
+					      WlzIVertex2 size)
+{
+  int		n = 0;
+  WlzDVertex2	cMin,
+  		cMax,
+		pts[20];
+  WlzDVertex3	vtx[8];
+  const double	eps = 1.0e-06;
+
+  if((obj == NULL) || (obj->type != WLZ_3D_DOMAINOBJ) ||
+     (obj->domain.core == NULL) || (resViewStr == NULL))
+  {
+    return(1);
+  }
+  for(int i = 0; i < 8; ++i)
+  {
+    vtx[i].vtX = ((i & 1)? obj->domain.p->lastkl + 1: obj->domain.p->kol1 - 1);
+    vtx[i].vtY = ((i & 2)? obj->domain.p->lastln + 1: obj->domain.p->line1 - 1);
+    vtx[i].vtZ = ((i & 4)? obj->domain.p->lastpl + 1: obj->domain.p->plane1 - 1);
+    if(Wlz3DSectionTransformVtx(vtx + i, resViewStr) != WLZ_ERR_NONE)
+    {
+      return(1);
+    }
+    vtx[i].vtZ -= resViewStr->dist;
+  }
+  /* Points where the box meets the section plane: corners on the plane
+   * and the crossings of the edges which span it. */
+  for(int i = 0; i < 8; ++i)
+  {
+    if(fabs(vtx[i].vtZ) < eps)
+    {
+      pts[n].vtX = vtx[i].vtX;
+      pts[n++].vtY = vtx[i].vtY;
+    }
+    for(int b = 1; b < 8; b <<= 1)
+    {
+      int	j = i | b;
+
+      if((j != i) && (vtx[i].vtZ * vtx[j].vtZ < 0.0))
+      {
+	double t = vtx[i].vtZ / (vtx[i].vtZ - vtx[j].vtZ);
+
+	pts[n].vtX = vtx[i].vtX + t * (vtx[j].vtX - vtx[i].vtX);
+	pts[n++].vtY = vtx[i].vtY + t * (vtx[j].vtY - vtx[i].vtY);
+      }
+    }
+  }
+  if(n > 0)
+  {
+    cMin = cMax = pts[0];
+    for(int i = 1; i < n; ++i)
+    {
+      cMin.vtX = WLZ_MIN(cMin.vtX, pts[i].vtX);
+      cMin.vtY = WLZ_MIN(cMin.vtY, pts[i].vtY);
+      cMax.vtX = WLZ_MAX(cMax.vtX, pts[i].vtX);
+      cMax.vtY = WLZ_MAX(cMax.vtY, pts[i].vtY);
+    }
+  }
+  return((n > 0) &&
+         (cMax.vtX + 1.0 >= pos.vtX) &&
+	 (cMin.vtX - 1.0 <= pos.vtX + size.vtX - 1) &&
+         (cMax.vtY + 1.0 >= pos.vtY) &&
+	 (cMin.vtY - 1.0 <= pos.vtY + size.vtY - 1));
+}
+
+/*!
+ * \return	True if the tile is wholly background.
+ * \ingroup	WlzIIPServer
+ * \brief	Checks whether a tile of the current section lies wholly
+ * 		outside the objects which would be rendered into it, using
+ * 		the bounding boxes of the objects (the selected components
+ * 		of a compound array) cut by the section plane. If so the
+ * 		tile buffer is filled with the background and the tile is
+ * 		given without any sectioning. Only sections are checked.
+ * \param	seq			Not used.
+ * \param	ang			Not used.
+ * \param	res			Requested resolution.
+ * \param	tile			Requested tile number.
+ * \param	bg			Destination for the background tile.
+ */
+bool		WlzImage::getBackgroundTile(int seq, int ang,
+					    unsigned int res,
+					    unsigned int tile, RawTile &bg)
+throw(string)
+{
+  int		inside = 0;
+  WlzIVertex2	pos,
+  		size;
+
+  prepareTile(res, tile, pos, size);
+  if(viewParams->rmd != RENDERMODE_SECT)
+  {
+    return(false);
+  }
+  WlzCompoundArray *array = (wlzObject->type == WLZ_COMPOUND_ARR_2)?
+                            (WlzCompoundArray* )wlzObject: NULL;
+  if(viewParams->selector && array)
+  {
+    int cpxExp = viewParams->selector->complexSelection;
+
+    for(CompoundSelector *iter = viewParams->selector;
+        (inside == 0) && iter; iter = iter->next)
+    {
+      if(iter->expression)
+      {
+	WlzObject *obj;
+
+	obj = WlzImageExpEval(cpxExp, iter->expression); // Assigns obj.
+	inside = (obj != NULL) && sectionMayIntersect(obj, pos, size);
+	(void )WlzFreeObj(obj);
+      }
+    }
+  }
+  else if(array)
+  {
+    inside = (array->n > 0) && array->o[0] &&
+             sectionMayIntersect(array->o[0], pos, size);
+  }
+  else
+  {
+    inside = sectionMayIntersect(mipObject, pos, size);
+  }
+  if(inside)
+  {
+    return(false);
+  }
+  int outchannels = getNumChannels();
+  if(!tile_buf)
   {
-    th = lastTileHeight;
+    tile_buf = (WlzUByte *)malloc(tile_width * tile_height * outchannels);
   }
+  Compositor::fill(tile_buf, size.vtX * size.vtY, background, outchannels);
+  LOG_DEBUG("WlzImage::getBackgroundTile() tile " << tile <<
+            " is background");
+  RawTile rawtile(tile, res, seq, ang, size.vtX, size.vtY, outchannels, bpp);
+  rawtile.data = tile_buf;
+  rawtile.dataLength = size.vtX * size.vtY * outchannels;
+  rawtile.width_padding = tile_width - size.vtX;
+  rawtile.filename = getImagePath();
+  bg = rawtile;
+  return(true);
+}
+
+/*!
+ * \ingroup      WlzIIPServer
+ * \brief        Generate the current tile
+ * \param        seq not used
+ * \param        ang not used
+ * \param        res requested resolution
+ * \param        tile requested tile number
+ * \return       RawTile raw tile data
+ * \par      Source:
+ *                WlzImage.cc
+ */
+RawTile		WlzImage::getTile(int seq, int ang, unsigned int res,
+				  unsigned int tile)
+throw(string)
+{
+  int 		tw=0, th=0; //real tile width and height
+  WlzErrorNum 	errNum=WLZ_ERR_NONE;
+  string 	filename;
+  WlzObject     *tmpObj;
+  WlzIVertex3   pos;
+  WlzIVertex2   pos2D;
+  WlzIVertex2   size;
+  WlzObject     *wlzSection = NULL;
+  
+  prepareTile(res, tile, pos2D, size);
+  tw = size.vtX;
+  th = size.vtY;
   if(errNum == WLZ_ERR_NONE)
   {
     /* Create maximum sized rectangular object */
     WlzDomain     domain;
     WlzValues     values;
     
-    pos.vtX = (tile % ntlx) * tile_width +  WLZ_NINT(wlzViewStr->minvals.vtX);
-    pos.vtY = (tile / ntlx) * tile_height + WLZ_NINT(wlzViewStr->minvals.vtY);
+    pos.vtX = pos2D.vtX;
+    pos.vtY = pos2D.vtY;
     if((domain.i = WlzMakeIntervalDomain(WLZ_INTERVALDOMAIN_RECT,
 					 WLZ_NINT(pos.vtY),
 					 WLZ_NINT(pos.vtY + th - 1),
@@ -969,13 +1843,6 @@ throw(string)
   gBufBox.zMin=0;
   gBufBox.zMax=0;
   
-  WlzIVertex2 pos2D;
-  WlzIVertex2 size;
-  pos2D.vtX = pos.vtX;
-  pos2D.vtY = pos.vtY;
-  size.vtX= tw;
-  size.vtY= th;
-  
   //recompute out channels
   int outchannels = getNumChannels();
   WlzCompoundArray *array = (wlzObject->type == WLZ_COMPOUND_ARR_2)?
@@ -985,11 +1852,7 @@ throw(string)
     tile_buf = (WlzUByte *)malloc(tile_width * tile_height * outchannels);
   }
   //init tile buffer
-  for (int i = 0; i < size.vtX * size.vtY; i++)
-  {
-    // TODO crazy way of doing this
-    memcpy(tile_buf + i * outchannels, background, outchannels);
-  }
+  Compositor::fill(tile_buf, size.vtX * size.vtY, background, outchannels);
   if(viewParams->selector)
   {
     //if selector existis
@@ -1014,7 +1877,7 @@ throw(string)
       else
       {
 	// use selector with lowest index
-	renderObj(tile_buf, wlzObject, tmpObj, pos2D, size, iter);
+	renderObj(tile_buf, mipObject, tmpObj, pos2D, size, iter);
 	break;
       }
       iter = iter->next;
@@ -1038,7 +1901,7 @@ throw(string)
     }
     else
     {
-      renderObj(tile_buf, wlzObject , tmpObj, pos2D, size, &sel);
+      renderObj(tile_buf, mipObject, tmpObj, pos2D, size, &sel);
     }
   }
   //free tileing object
@@ -1050,8 +1913,7 @@ throw(string)
   rawtile.data = tile_buf;
   rawtile.dataLength = tw * th * outchannels;
   rawtile.width_padding = tile_width - tw;
-  //get hash of the tile
-  rawtile.filename = getHash();
+  rawtile.filename = getImagePath();
   return(rawtile);
 }
 
@@ -1071,16 +1933,24 @@ WlzObject      *WlzImage::WlzImageExpEval(int cpxExp, WlzExp *exp)
   string   	cS;
   WlzObject	*cObj = NULL;
   WlzErrorNum   errNum = WLZ_ERR_NONE;
+  TraceSpan     span("WlzImage::WlzImageExpEval");
 
   eS = WlzExpStr(exp, NULL, NULL);
   if(eS)
   {
-    cS = getFileName() + string("&SEL=") + string(eS);
+    SlowLog::addSelector(eS);
+    cS = objectKey + string("&SEL=") + string(eS);
     AlcFree(eS);
     cObj = getObjectFromCache(cS);
+    ServerStats::count((cObj != NULL)?
+		       ServerStats::EXPRESSION_CACHE_HITS:
+		       ServerStats::EXPRESSION_CACHE_MISSES);
+    SlowLog::countCache(SlowLog::EXPRESSION_CACHE, cObj != NULL);
   }
   if(cObj == NULL)
   {
+    SlowLogSpan slowSpan(SlowLog::EXPRESSION);
+
     cObj = WlzExpEval(wlzObject, cpxExp, exp, &errNum);
     if(cObj)
     {
@@ -1590,6 +2460,8 @@ WlzImage::convertDomainObjToRGB(WlzUByte *cBuffer, WlzObject* obj,
 				CompoundSelector *sel)
 {
   WlzErrorNum	errNum = WLZ_ERR_NONE;
+  TraceSpan	span("WlzImage::composite");
+  SlowLogSpan	slowSpan(SlowLog::COMPOSITE);
 
   if(!cBuffer || !obj)
   {
@@ -1598,70 +2470,23 @@ WlzImage::convertDomainObjToRGB(WlzUByte *cBuffer, WlzObject* obj,
   else if(obj->type == WLZ_2D_DOMAINOBJ)
   {
     WlzIntervalWSpace iWSp;
+    int 	nCh = getNumChannels();
+    Compositor	cmp(nCh, sel != NULL,
+    		    (sel)? sel->r: 0, (sel)? sel->g: 0, (sel)? sel->b: 0,
+		    (sel)? sel->a: 0);
 
-    unsigned int r,
-    		 g,
-		 b,
-		 a,
-		 a1;
-    int 	 nCh = getNumChannels();
-
-    if(sel)
-    {
-      a = sel->a;
-      r = sel->r * a;
-      g = sel->g * a;
-      b = sel->b * a;
-      a1 = 255 - a;
-    }
-    else
-    {
-      a = 255;
-      r = 255 * 255;
-      g = 255 * 255;
-      b = 255 * 255;
-      a1 = 0;
-    }
     if((errNum = WlzInitRasterScan(obj, &iWSp,
 	                           WLZ_RASTERDIR_ILIC)) == WLZ_ERR_NONE)
     {
       while((errNum = WlzNextInterval(&iWSp)) == WLZ_ERR_NONE)
       {
-	int	i,
-		lnOff,
-		lnCOff,
-		iWidth;
-	WlzUByte *cBuf;
+	int	lnOff;
 
-	iWidth = iWSp.rgtpos - iWSp.lftpos + 1;
 	lnOff = ((size.vtX * (iWSp.linpos - pos.vtY)) +
 	         (iWSp.lftpos - pos.vtX))* nCh;
-	cBuf = cBuffer + lnOff;
 	/* Alpha blending src over dst in Porter Duff fashion while
 	 * keeping everything 0-255. */
-	if(nCh == 4)
-	{
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    unsigned int c;
-
-	    c = *cBuf; *cBuf++ = (r + (c * a1)) / 255;
-	    c = *cBuf; *cBuf++ = (g + (c * a1)) / 255;
-	    c = *cBuf; *cBuf++ = (b + (c * a1)) / 255;
-	    c = *cBuf; *cBuf++ =  a + (a1 * c)  / 255;
-	  }
-	}
-	else
-	{
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    unsigned int c;
-
-	    c = *cBuf; *cBuf++ = (r + (c * a1)) / 255;
-	    c = *cBuf; *cBuf++ = (g + (c * a1)) / 255;
-	    c = *cBuf; *cBuf++ = (b + (c * a1)) / 255;
-	  }
-	}
+	cmp.domain(cBuffer + lnOff, iWSp.rgtpos - iWSp.lftpos + 1);
       }
     }
     if(errNum == WLZ_ERR_EOO)
@@ -1682,14 +2507,20 @@ WlzImage::convertDomainObjToRGB(WlzUByte *cBuffer, WlzObject* obj,
  * \param       size       	Section bounding box size.
  * \param       sel        	Selector with the colour to be used for the
  * 				section.
+ * \param	lut		Optional compiled value map which is applied
+ * 				to the values as they are converted, may be
+ * 				NULL.
  */
 WlzErrorNum
 WlzImage::convertValueObjToRGB(WlzUByte *cBuffer,
 			       WlzObject* obj,
                                WlzIVertex2  pos, WlzIVertex2  size,
-			       CompoundSelector *sel)
+			       CompoundSelector *sel,
+			       const ImageMapLUT *lut)
 {
   WlzErrorNum	errNum = WLZ_ERR_NONE;
+  TraceSpan	span("WlzImage::composite");
+  SlowLogSpan	slowSpan(SlowLog::COMPOSITE);
 
   if(!cBuffer || !obj)
   {
@@ -1697,241 +2528,29 @@ WlzImage::convertValueObjToRGB(WlzUByte *cBuffer,
   }
   else if(obj->type == WLZ_2D_DOMAINOBJ)
   {
-    unsigned int r,
-    		 g,
-		 b,
-		 a,
-		 a1;
-    double	dr,
-    		dg,
-		db,
-		da,
-		da1;
     int 	outChan = getNumChannels();
-    bool 	copyGreyToRGB = outChan != channels;
+    Compositor	cmp(outChan, sel != NULL,
+    		    (sel)? sel->r: 0, (sel)? sel->g: 0, (sel)? sel->b: 0,
+		    (sel)? sel->a: 0);
     WlzIntervalWSpace     iWSp;
     WlzGreyWSpace         gWSp;
 
-    if(sel)
-    {
-      a = sel->a;
-      r = (sel->r * a) / 255;
-      g = (sel->g * a) / 255;
-      b = (sel->b * a) / 255;
-      a1 = 255 - a;
-    }
-    else
-    {
-      a = 255;
-      r = 255;
-      g = 255;
-      b = 255;
-      a1 = 0;
-    }
-    da = a / 255.0;
-    dr = r / 255.0;
-    dg = g / 255.0;
-    db = b / 255.0;
-    da1 = 1.0 - a;
     errNum = WlzInitGreyScan(obj, &iWSp, &gWSp);
     while((errNum == WLZ_ERR_NONE) &&
 	  ((errNum = WlzNextGreyInterval(&iWSp)) == WLZ_ERR_NONE))
     {
-      int	i,
-	      bOff,
-	      lnOff,
-	      lnCOff,
-	      iWidth;
-      WlzUByte *cBuf;
+      int	lnOff;
 
-      iWidth = iWSp.rgtpos - iWSp.lftpos + 1;
       lnOff = ((size.vtX * (iWSp.linpos - pos.vtY)) +
 	       (iWSp.lftpos - pos.vtX)) * outChan;
-      cBuf = cBuffer + lnOff;
       /* Alpha blending src over dst in Porter Duff fashion while
-       * keeping everything 0-255. */
-      switch(gWSp.pixeltype)
-      {
-	case WLZ_GREY_LONG:
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    double	 c,
-			 v;
-
-	    v = gWSp.u_grintptr.lnp[i];
-	    c = *cBuf; c = (dr * v) + (c * da1);
-	    *cBuf++ = (int )round(c);
-	    if(copyGreyToRGB)
-	    {
-	      c = *cBuf; c = (dg * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	      c = *cBuf; c = (db * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	    if((outChan == 2) || (outChan == 4))
-	    {
-	      c = *cBuf; c = da + (da1 * c);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	  }
-	  break;
-	case WLZ_GREY_INT:
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    double	 c,
-			 v;
-
-	    v = gWSp.u_grintptr.inp[i];
-	    c = *cBuf; c = (dr * v) + (c * da1);
-	    c = WLZ_CLAMP(c, 0, 255);
-	    *cBuf++ = (WlzUByte )round(c);
-	    if(copyGreyToRGB)
-	    {
-	      c = *cBuf; c = (dg * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	      c = *cBuf; c = (db * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	    if((outChan == 2) || (outChan == 4))
-	    {
-	      c = *cBuf; c = da + (da1 * c);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	  }
-	  break;
-	case WLZ_GREY_SHORT:
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    double	 c,
-			 v;
-
-	    v = gWSp.u_grintptr.shp[i];
-	    c = *cBuf; c = (dr * v) + (c * da1);
-	    c = WLZ_CLAMP(c, 0, 255);
-	    *cBuf++ = (WlzUByte )round(c);
-	    if(copyGreyToRGB)
-	    {
-	      c = *cBuf; c = (dg * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	      c = *cBuf; c = (db * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	    if((outChan == 2) || (outChan == 4))
-	    {
-	      c = *cBuf; c = da + (da1 * c);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	  }
-	  break;
-	case WLZ_GREY_UBYTE:
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    unsigned int c,
-			 v;
-
-	    v = gWSp.u_grintptr.ubp[i];
-	    c = *cBuf;
-	    *cBuf++ = ((r * v) + (c * a1)) / 255;
-	    if(copyGreyToRGB)
-	    {
-	      c = *cBuf; *cBuf++ = ((g * v) + (c * a1)) / 255;
-	      c = *cBuf; *cBuf++ = ((b * v) + (c * a1)) / 255;
-	    }
-	    if((outChan == 2) || (outChan == 4))
-	    {
-	      c = *cBuf; *cBuf++ = a + (a1 * c) / 255;
-	    }
-	  }
-	  break;
-	case WLZ_GREY_FLOAT:
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    double	 c,
-			 v;
-
-	    v = gWSp.u_grintptr.flp[i];
-	    c = *cBuf; c = (dr * v) + (c * da1);
-	    c = WLZ_CLAMP(c, 0, 255);
-	    *cBuf++ = (WlzUByte )round(c);
-	    if(copyGreyToRGB)
-	    {
-	      c = *cBuf; c = (dg * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	      c = *cBuf; c = (db * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	    if((outChan == 2) || (outChan == 4))
-	    {
-	      c = *cBuf; c = da + (da1 * c);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	  }
-	  break;
-	case WLZ_GREY_DOUBLE:
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    double	 c,
-			 v;
-
-	    v = gWSp.u_grintptr.flp[i];
-	    c = *cBuf; c = (dr * v) + (c * da1);
-	    c = WLZ_CLAMP(c, 0, 255);
-	    *cBuf++ = (WlzUByte )round(c);
-	    if(copyGreyToRGB)
-	    {
-	      c = *cBuf; c = (dg * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	      c = *cBuf; c = (db * v) + (c * da1);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	    if((outChan == 2) || (outChan == 4))
-	    {
-	      c = *cBuf; c = da + (da1 * c);
-	      c = WLZ_CLAMP(c, 0, 255);
-	      *cBuf++ = (WlzUByte )round(c);
-	    }
-	  }
-	  break;
-	case WLZ_GREY_RGBA:
-	  for(i = 0; i < iWidth; ++i)
-	  {
-	    unsigned int c,
-			 v,
-			 rv;
-
-	    rv = gWSp.u_grintptr.rgbp[i];
-	    c = *cBuf;
-	    *cBuf++ = ((r * WLZ_RGBA_RED_GET(rv))   + (c * a1)) / 255;
-	    c = *cBuf;
-	    *cBuf++ = ((g * WLZ_RGBA_GREEN_GET(rv)) + (c * a1)) / 255;
-	    c = *cBuf;
-	    *cBuf++ = ((b * WLZ_RGBA_BLUE_GET(rv))  + (c * a1)) / 255;
-	    if(outChan == 4)
-	    {
-	      c = *cBuf;
-	      v = WLZ_RGBA_ALPHA_GET(rv);
-	      *cBuf++ = a + (a1 * c) / 255;
-	    }
-	  }
-	  break;
-	default:
-	  errNum = WLZ_ERR_GREY_TYPE;
-	  break;
-      }
+       * keeping everything 0-255, using a kernel specialised for the
+       * grey type, number of channels and selector. */
+      errNum = (lut)?
+               cmp.mapped(cBuffer + lnOff, gWSp.u_grintptr, gWSp.pixeltype,
+			  iWSp.rgtpos - iWSp.lftpos + 1, lut):
+               cmp.values(cBuffer + lnOff, gWSp.u_grintptr, gWSp.pixeltype,
+      			  iWSp.rgtpos - iWSp.lftpos + 1);
     }
     if(errNum == WLZ_ERR_EOO)
     {
@@ -1964,14 +2583,10 @@ WlzImage::convertObjToRGB(WlzUByte *cbuffer, WlzObject *obj, WlzIVertex2 pos,
   }
   else
   {
-    int i = 0;
     int outchannel = getNumChannels();
     
     // Clear buffer
-    for(i=0;i<size.vtX*size.vtY;i++)
-    {
-      (void )memcpy(cbuffer + (i * channels), background, outchannel);
-    }
+    Compositor::fill(cbuffer, size.vtX * size.vtY, background, outchannel);
     // Set buffer values
     switch(obj->type)
     {
@@ -2047,6 +2662,22 @@ const std::string WlzImage::selString(const ViewParameters* view )
  *                WlzImage.cc
  */
 const std::string WlzImage::generateHash(const ViewParameters* view ) { 
+  if ( view == NULL)
+    view = curViewParams;
+  return(generateViewHash(view) + view->map.toString());
+};
+
+/*!
+ * \ingroup      WlzIIPServer
+ * \brief        Generate the image hash for a set of view parameters
+ *               without the value map. Sections are cached before the
+ *               map is applied, so they are shared by all maps.
+ * \param        view parameters
+ * \return       the hash string
+ * \par      Source:
+ *                WlzImage.cc
+ */
+const std::string WlzImage::generateViewHash(const ViewParameters* view ) { 
   if ( view == NULL)
     view = curViewParams;
   prepareObject();  // needs to have set channel number
@@ -2069,5 +2700,98 @@ const std::string WlzImage::generateHash(const ViewParameters* view ) {
 	   view->fixed2.vtX,
 	   view->fixed2.vtY,
 	   view->fixed2.vtZ);
-  return(getImagePath() + temp + view->map.toString());
+  return(objectKey + temp);
 };
+
+/*!
+ * \ingroup      WlzIIPServer
+ * \brief        Return a fingerprint of the image, view and selection
+ *               state, including the identity of the object's file so
+ *               that the tiles of a replaced file are no longer found.
+ *               This identifies the same state as getHash() but
+ *               is computed directly from the view parameters, without
+ *               formatting strings, so that tiles may be looked up
+ *               cheaply. The fingerprint of each selector's expression
+ *               is computed only once and kept in the selector.
+ * \return       the fingerprint
+ * \par      Source:
+ *                WlzImage.cc
+ */
+Fingerprint WlzImage::getFingerprint()
+{
+  int		nChan;
+  const ViewParameters *view;
+  FingerprintBuilder fb;
+
+  view = (viewParams)? viewParams: curViewParams;
+  prepareObject();  // needs to have set channel number
+  nChan = getNumChannels();
+  fb.add(objectKey);
+  fb.add(view->dist);
+  fb.add(view->scale);
+  fb.add(view->yaw);
+  fb.add(view->pitch);
+  fb.add(view->roll);
+  fb.add((int )(view->mode));
+  fb.add(view->depth);
+  fb.add((int )(view->rmd));
+  fb.add(nChan);
+  fb.add(&(view->fixed), sizeof(WlzDVertex3));
+  fb.add(&(view->fixed2), sizeof(WlzDVertex3));
+  nChan = view->map.getNChan();
+  fb.add(nChan);
+  for(int i = 0; i < nChan; ++i)
+  {
+    const ImageMapChan *mc = view->map.getChan(i);
+
+    fb.add((int )(mc->type));
+    fb.add(mc->il);
+    fb.add(mc->iu);
+    fb.add(mc->ol);
+    fb.add(mc->ou);
+    fb.add(mc->p0);
+    fb.add(mc->p1);
+  }
+  if(viewParams)
+  {
+    CompoundSelector *sel;
+
+    for(sel = viewParams->selector; sel != NULL; sel = sel->next)
+    {
+      unsigned char rgba[4];
+
+      if(sel->fingerprint.isZero())
+      {
+	char	*eStr;
+
+	eStr = WlzExpStr(sel->expression, NULL, NULL);
+	sel->fingerprint = FingerprintBuilder::ofString((eStr)? eStr: "");
+	AlcFree(eStr);
+      }
+      rgba[0] = sel->r;
+      rgba[1] = sel->g;
+      rgba[2] = sel->b;
+      rgba[3] = sel->a;
+      fb.add(sel->fingerprint);
+      fb.add(rgba, 4);
+    }
+  }
+  return(fb.get());
+}
+
+/*!
+ * \ingroup      WlzIIPServer
+ * \brief        Return a fingerprint of the identity of the object file
+ *               from which the image is rendered, as found when the
+ *               object was prepared. This is zero when the identity is
+ *               not known (eg for remote files), so it is used to key
+ *               tiles which outlive the process.
+ * \return       the fingerprint, zero if the file's identity is unknown
+ * \par      Source:
+ *                WlzImage.cc
+ */
+Fingerprint WlzImage::getFileFingerprint()
+{
+  prepareObject();
+  return(fileFingerprint);
+}
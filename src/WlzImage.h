@@ -48,6 +48,7 @@ static char _WlzImage_h[] = "University of Edinburgh $Id$";
 
 #include "WlzViewStructCache.h"
 #include "WlzObjectCache.h"
+#include "ImageMapLUT.h"
 
 
 /*! 
@@ -79,6 +80,36 @@ class WlzImage : public IIPImage
     int                 ntlx;               /*!< Number of tiles per row */
     int                 ntly;               /*!< Number of tiles per columns */
     WlzUByte	        background[4];      /*!< Background value */
+    int			sectionBand;        /*!< Number of tile rows in each
+    					         band of a cached section,
+						 zero for whole sections. */
+    int			mipLevels;          /*!< Maximum number of
+    						 downsampled (mip) levels of
+						 the object, each of which
+						 is also an IIP resolution. */
+    unsigned int	curRes;             /*!< Resolution for which
+    						 resViewStr and mipObject
+						 have been prepared. */
+    int			mipLevel;           /*!< Mip level of mipObject,
+    						 zero for the object itself. */
+    WlzObject		*mipObject;         /*!< Object rendered at the
+    						 current resolution. */
+    WlzThreeDViewStruct *resViewStr;        /*!< View structure used to
+    						 render mipObject at the
+						 current resolution. */
+    unsigned int	resWidth;           /*!< Image width at the current
+    						 resolution. */
+    unsigned int	resHeight;          /*!< Image height at the current
+    						 resolution. */
+    std::string		objectKey;          /*!< Object cache key of the
+    						 object, which includes the
+						 identity of its file. Keys
+						 of objects derived from the
+						 object start with this. */
+    Fingerprint		fileFingerprint;    /*!< Fingerprint of the object
+    						 file's path and identity
+						 when the object was
+						 prepared, zero if unknown. */
 
   public:
     // Constructors and destructor
@@ -106,13 +137,48 @@ class WlzImage : public IIPImage
 				  unsigned int r,
 				  unsigned int t)
       	        		throw(std::string);
+    bool			getBackgroundTile(
+    				  int x,
+				  int y,
+				  unsigned int r,
+				  unsigned int t,
+				  RawTile &bg)
+      	        		throw(std::string);
     string			getFileName();
     const std::string 		getHash();
+    Fingerprint			getFingerprint();
+    Fingerprint			getFileFingerprint();
+    /*!
+    * \ingroup      WlzIIPServer
+    * \brief        Copies the image, sharing the object and view so that
+    * 		    tiles may be rendered concurrently with this image.
+    */
+    IIPImage			*clone()
+    {
+      return(new WlzImage(*this));
+    };
     // Woolz operations
+    static WlzObject		*readObject(
+    				  const std::string &path,
+				  WlzErrorNum *dstErr);
+    static void			preload(
+    				  const std::string &list,
+				  int nThreads);
+    static unsigned int		getObjectCacheCount();
+    static size_t		getObjectCacheBytes();
     void			prepareObject()
     				throw(std::string);
     void			prepareViewStruct()
     				throw(std::string);
+    void			prepareResolution(
+    				  unsigned int res)
+    				throw(std::string);
+    static WlzObject		*getMipObject(
+    				  WlzObject *obj,
+				  const std::string &ois,
+				  int level,
+				  bool pin,
+				  WlzErrorNum *dstErr);
     bool			isViewChanged();
     WlzObject			*WlzImageExpEval(
 				  int cpxExp,
@@ -169,7 +235,7 @@ class WlzImage : public IIPImage
     {
       WlzObject     *obj;
 
-      obj  = WlzAssignObject(wlzObjectCache.get(ois), NULL);
+      obj  = wlzObjectCache.get(ois);
       return(obj);
     }
 
@@ -260,6 +326,8 @@ class WlzImage : public IIPImage
 
     // Internal functions
     protected:
+    static void			*preloadThread(
+    				  void *data);
     WlzErrorNum 		convertObjToRGB(
     				  WlzUByte * cbuf,
 				  WlzObject* obj,
@@ -276,7 +344,18 @@ class WlzImage : public IIPImage
 				  WlzObject *obj,
 				  WlzIVertex2  pos,
 				  WlzIVertex2  size,
-				  CompoundSelector *sel);
+				  CompoundSelector *sel,
+				  const ImageMapLUT *lut = NULL);
+    void			prepareTile(
+    				  unsigned int res,
+				  unsigned int tile,
+				  WlzIVertex2 &pos,
+				  WlzIVertex2 &size)
+				throw(std::string);
+    int				sectionMayIntersect(
+    				  WlzObject *obj,
+				  WlzIVertex2 pos,
+				  WlzIVertex2 size);
     WlzErrorNum 		renderObj(
     				  WlzUByte* tile_buf,
 				  WlzObject *wlzObject,
@@ -289,7 +368,18 @@ class WlzImage : public IIPImage
 				  WlzObject *tileObject,
 				  CompoundSelector *sel,
 				  WlzErrorNum *dstErr);
-    WlzObject 			*getMapLUTObj(
+    WlzObject			*getSubSection(
+    				  WlzObject *gvnObj,
+				  WlzObject *rgnObj,
+				  WlzObject **mskP,
+				  WlzErrorNum *dstErr);
+    WlzObject			*getSubSectFromObject(
+    				  WlzObject *wlzObject,
+				  WlzObject *tileObject,
+				  WlzIVertex2 pos,
+				  CompoundSelector *sel,
+				  WlzErrorNum *dstErr);
+    ImageMapLUT			*getMapLUT(
     				  WlzErrorNum *dstErr);
     WlzObject 			*mapValueObj(
     				  WlzObject *iObj,
@@ -297,6 +387,8 @@ class WlzImage : public IIPImage
     			   	  WlzErrorNum *dstErr);
     WlzDVertex3 		getCurrentPointInPlane();
     const std::string 		generateHash(const ViewParameters *view);
+    const std::string 		generateViewHash(
+    				  const ViewParameters *view);
     const std::string 		selString(const ViewParameters* view );
 
     /*!
@@ -39,6 +39,9 @@ static char _WlzObjectCache_cc[] = "University of Edinburgh $Id$";
 * \ingroup	WlzIIPServer
 */
 
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include "Log.h"
 #include "WlzObjectCache.h"
 
@@ -53,6 +56,10 @@ WlzObjectCache()
   size_t	 maxSz;
   
   enabled = 1;
+  secMaxSz = MBytesToBytes(Environment::getWlzSectionCacheSize());
+  secCurSz = 0;
+  pinSz = 0;
+  checkInterval = Environment::getWlzFileCheckInterval();
   maxItem = Environment::getMaxWlzObjCacheCount();
   maxSz = MBytesToBytes(Environment::getMaxWlzObjCacheSize());
   objCache = AlcLRUCacheNew(maxItem, maxSz,
@@ -72,8 +79,16 @@ WlzObjectCache()
 WlzObjectCache::
 ~WlzObjectCache()
 {
+  std::map<std::string, WlzObjCacheEntry *>::iterator it;
+
   LOG_NOTICE("WlzObjectCache released.\n");
   AlcLRUCacheFree(objCache, 1);
+  for(it = pinMap.begin(); it != pinMap.end(); ++it)
+  {
+    (void )WlzFreeObj(it->second->obj);
+    AlcFree(it->second->str);
+    AlcFree(it->second);
+  }
 }
 
 /*!
@@ -260,7 +275,8 @@ int		WlzObjectCache::
 * \ingroup	WlzIIPServer
 * \brief	This function is called when a cache entry is about to be
 * 		removed. This function frees the entry object and then the
-* 		entry itself.
+* 		entry itself. Pinned entries are never added to the LRU
+* 		cache so this function is never called for them.
 * \param	cache			The cache (unused).
 * \param	e			Cache entry.
 */
@@ -271,6 +287,10 @@ void		WlzObjectCache::
 
   if((ent = (WlzObjCacheEntry *)e) != NULL)
   {
+    if(ent->section && ent->owner)
+    {
+      ent->owner->secCurSz -= ent->sz;
+    }
     (void )WlzFreeObj(ent->obj);
     AlcFree(ent);
   }
@@ -321,52 +341,364 @@ void 		WlzObjectCache::
   LOG_INFO("WlzObjectCache::insert " << str);
   if(enabled)
   {
-    WlzObjCacheEntry *ent = NULL;
+    MutexLock	lock(mutex);
+
+    insertEntry(obj, str, 0);
+  }
+}
+
+/*!
+* \ingroup  	WlzIIPServer
+* \brief	Inserts a rendered section (or band of a section) into the
+* 		cache. Sections share the object cache's LRU and size limit,
+* 		so a new section may still cause the least recently used
+* 		objects to be evicted. They are also limited to the section
+* 		cache size, which bounds how much of the cache they can
+* 		take. When this limit would be exceeded the oldest sections
+* 		are removed. Nothing is done if section caching is disabled.
+* \param    	obj       		Section to be be inserted
+* \param    	str	  		String used to identify the section.
+*/
+void 		WlzObjectCache::
+		insertSection(WlzObject *obj, const std::string  str)
+		throw(std::string)
+{
+  if(enabled && (secMaxSz > 0))
+  {
+    size_t	sz;
+    MutexLock	lock(mutex);
 
-    if(((ent = (WlzObjCacheEntry *)
-	       AlcCalloc(1, sizeof(WlzObjCacheEntry))) != NULL) &&
-       ((ent->str = AlcStrDup(str.c_str())) != NULL))
+    sz = ComputeObjectSize(obj);
+    if(sz <= secMaxSz)
     {
-      int	newFlg = 0;
-      unsigned int key;
-      AlcLRUCItem *item = NULL;
-
-      ent->obj = NULL;
-      key = this->WlzObjCacheKeyFn(objCache, ent);
-      item = AlcLRUCItemFind(objCache, key, (void *)ent);
-      LOG_INFO("WlzObjectCache::insert item in cache=" <<
-	       (item != NULL)? 1: 0);
-      if(item == NULL)
+      while((secCurSz + sz > secMaxSz) && !secList.empty())
       {
-        size_t	sz;
+	WlzObjCacheEntry ent;
 
-	ent->obj = WlzAssignObject(obj, NULL);
-	sz = ComputeObjectSize(obj);
-	item = AlcLRUCEntryAddWithKey(objCache, sz, ent, key, &newFlg);
-	LOG_INFO("WlzObjectCache::insert sz=" << sz);
+	ent.str = (char *)(secList.front().c_str());
+	AlcLRUCEntryRemove(objCache, &ent);
+	secList.pop_front();
       }
-      LOG_INFO("WlzObjectCache::insert item added to cache=" <<
-	       (newFlg != 0)? 1: 0);
-      if(newFlg == 0)
+      // Drop strings of sections which the LRU has already evicted.
+      if(secList.size() > 2 * (size_t )(objCache->numItem) + 64)
       {
-	(void )WlzFreeObj(ent->obj);
-	AlcFree(ent->str);
-	AlcFree(ent);
+        std::list<std::string>::iterator it = secList.begin();
+
+	while(it != secList.end())
+	{
+	  WlzObjCacheEntry ent;
+
+	  ent.str = (char *)(it->c_str());
+	  if(AlcLRUCItemFind(objCache, WlzObjCacheKeyFn(objCache, &ent),
+	                     &ent) == NULL)
+	  {
+	    it = secList.erase(it);
+	  }
+	  else
+	  {
+	    ++it;
+	  }
+	}
       }
+      insertEntry(obj, str, 1);
+    }
+  }
+}
+
+/*!
+* \return	Approximate size of the object in bytes.
+* \ingroup  	WlzIIPServer
+* \brief	Inserts a pinned Woolz object. Pinned objects are held
+* 		outside of the LRU cache, so they are neither evicted nor
+* 		counted against its size limit. Any unpinned entry with
+* 		the same identification string is replaced.
+* \param    	obj       		WlzObj to be be inserted
+* \param    	str	  		String used to identify the object.
+*/
+size_t 		WlzObjectCache::
+		insertPinned(WlzObject *obj, const std::string  str)
+		throw(std::string)
+{
+  size_t	sz = 0;
+
+  if(enabled)
+  {
+    WlzObjCacheEntry *ent = NULL;
+    MutexLock	lock(mutex);
+
+    if(pinMap.find(str) != pinMap.end())
+    {
+      sz = pinMap[str]->sz;
+    }
+    else if(((ent = (WlzObjCacheEntry *)
+		    AlcCalloc(1, sizeof(WlzObjCacheEntry))) != NULL) &&
+	    ((ent->str = AlcStrDup(str.c_str())) != NULL))
+    {
+      AlcLRUCEntryRemove(objCache, ent);
+      ent->obj = WlzAssignObject(obj, NULL);
+      ent->sz = sz = ComputeObjectSize(obj);
+      ent->pinned = 1;
+      ent->owner = this;
+      pinMap[str] = ent;
+      pinSz += sz;
     }
     else
     {
       AlcFree(ent);
-      throw string("WlzObjectCache::insert - memory allocation failure.");
+      throw string("WlzObjectCache::insertPinned - memory allocation "
+                   "failure.");
     }
   }
+  return(sz);
+}
+
+/*!
+* \ingroup  	WlzIIPServer
+* \brief	Inserts a Woolz object entry, the cache must be locked.
+* 		Nothing is done if the object is pinned.
+* \param    	obj       		WlzObj to be be inserted
+* \param    	str	  		String used to identify the object.
+* \param	section			Non zero if the object is a section.
+*/
+void 		WlzObjectCache::
+		insertEntry(WlzObject *obj, const std::string &str,
+			    int section)
+{
+  WlzObjCacheEntry *ent = NULL;
+
+  if(pinMap.find(str) != pinMap.end())
+  {
+    return;
+  }
+  if(((ent = (WlzObjCacheEntry *)
+	     AlcCalloc(1, sizeof(WlzObjCacheEntry))) != NULL) &&
+     ((ent->str = AlcStrDup(str.c_str())) != NULL))
+  {
+    int	newFlg = 0;
+    unsigned int key;
+    AlcLRUCItem *item = NULL;
+
+    ent->obj = NULL;
+    ent->owner = this;
+    key = this->WlzObjCacheKeyFn(objCache, ent);
+    item = AlcLRUCItemFind(objCache, key, (void *)ent);
+    LOG_INFO("WlzObjectCache::insert item in cache=" <<
+	     (item != NULL)? 1: 0);
+    if(item == NULL)
+    {
+      ent->obj = WlzAssignObject(obj, NULL);
+      ent->sz = ComputeObjectSize(obj);
+      ent->section = section;
+      item = AlcLRUCEntryAddWithKey(objCache, ent->sz, ent, key, &newFlg);
+      LOG_INFO("WlzObjectCache::insert sz=" << ent->sz);
+    }
+    LOG_INFO("WlzObjectCache::insert item added to cache=" <<
+	     (newFlg != 0)? 1: 0);
+    if(newFlg == 0)
+    {
+      (void )WlzFreeObj(ent->obj);
+      AlcFree(ent->str);
+      AlcFree(ent);
+    }
+    else if(section)
+    {
+      secCurSz += ent->sz;
+      secList.push_back(str);
+    }
+  }
+  else
+  {
+    AlcFree(ent);
+    throw string("WlzObjectCache::insert - memory allocation failure.");
+  }
+}
+
+/*!
+* \return	Cache key of the file's object.
+* \ingroup	WlzIIPServer
+* \brief	Gives the key under which the object read from a file is
+* 		cached. Objects derived from it (eg mip levels, sections
+* 		and expression results) should be cached under keys which
+* 		start with this key. The key includes the identity of the
+* 		file, so when the file is replaced its objects are no
+* 		longer found.
+* \param	file			File name.
+* \param	stamp			Identity of the file.
+*/
+std::string	WlzObjectCache::
+		fileKey(const std::string &file, const WlzObjFileStamp &stamp)
+{
+  char		buf[80];
+
+  if(!stamp.found)
+  {
+    return(file);
+  }
+  (void )snprintf(buf, 80, "#%llx.%llx.%llx.%llx",
+                  (unsigned long long )stamp.dev,
+		  (unsigned long long )stamp.ino,
+		  (unsigned long long )stamp.mtime,
+		  (unsigned long long )stamp.size);
+  return(file + buf);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Removes the object read from a file which has been replaced,
+* 		and its mip levels, including any which are pinned. Other
+* 		objects derived from it are no longer found and are left to
+* 		be evicted by the LRU cache. The cache must be locked.
+* \param	key			Cache key of the file's object.
+*/
+void		WlzObjectCache::
+		removeFile(const std::string &key)
+{
+  int		nMip = Environment::getWlzMipLevels();
+  WlzObjCacheEntry ent;
+  std::map<std::string, WlzObjCacheEntry *>::iterator pit;
+
+  for(int i = 0; i <= nMip; ++i)
+  {
+    char	buf[32];
+    std::string	str = key;
+
+    if(i > 0)
+    {
+      (void )snprintf(buf, 32, "&MIP=%d", i);
+      str += buf;
+    }
+    ent.str = (char *)(str.c_str());
+    AlcLRUCEntryRemove(objCache, &ent);
+  }
+  pit = pinMap.begin();
+  while(pit != pinMap.end())
+  {
+    const std::string &str = pit->first;
+
+    if((str.compare(0, key.length(), key) == 0) &&
+       ((str.length() == key.length()) || (str[key.length()] == '&')))
+    {
+      pinSz -= pit->second->sz;
+      (void )WlzFreeObj(pit->second->obj);
+      AlcFree(pit->second->str);
+      AlcFree(pit->second);
+      pinMap.erase(pit++);
+    }
+    else
+    {
+      ++pit;
+    }
+  }
+}
+
+/*!
+* \return	Cache key of the file's object, see fileKey().
+* \ingroup	WlzIIPServer
+* \brief	Checks the identity (device, inode, modification time and
+* 		size) of a file from which objects are read, at most once
+* 		every WLZ_FILE_CHECK_INTERVAL seconds. If the file has been
+* 		replaced since it was last checked its object is removed
+* 		from the cache and the new key will not find any of the
+* 		objects, view structures, sections, expression results or
+* 		tiles derived from the old file.
+* \param	file			File name, as used to identify
+* 					the file's objects.
+* \param	path			File path, including any file
+* 					system prefix.
+* \param	fp			If not NULL set to a fingerprint of
+* 					the file's path and identity, or to
+* 					zero if the file was not found (eg
+* 					it is remote).
+*/
+std::string	WlzObjectCache::
+		validateFile(const std::string &file, const std::string &path,
+			     Fingerprint *fp)
+{
+  bool		check = true;
+  time_t	now = time(NULL);
+  WlzObjFileStamp stamp;
+  std::map<std::string, WlzObjFileStamp>::iterator it;
+
+  {
+    MutexLock	lock(mutex);
+
+    it = fileMap.find(file);
+    if((it != fileMap.end()) && (now - it->second.checked < checkInterval))
+    {
+      stamp = it->second;
+      check = false;
+    }
+  }
+  if(check)
+  {
+    struct stat	st;
+
+    // The file is checked without holding the lock, as it may be slow
+    memset(&stamp, 0, sizeof(stamp));
+    if(stat(path.c_str(), &st) == 0)
+    {
+      stamp.found = 1;
+      stamp.dev = st.st_dev;
+      stamp.ino = st.st_ino;
+      stamp.mtime = st.st_mtime;
+      stamp.size = st.st_size;
+    }
+    stamp.checked = now;
+    {
+      MutexLock	lock(mutex);
+
+      it = fileMap.find(file);
+      if(it == fileMap.end())
+      {
+	fileMap[file] = stamp;
+      }
+      else
+      {
+	WlzObjFileStamp &old = it->second;
+
+	if((old.found != stamp.found) || (old.dev != stamp.dev) ||
+	   (old.ino != stamp.ino) || (old.mtime != stamp.mtime) ||
+	   (old.size != stamp.size))
+	{
+	  LOG_NOTICE("WlzObjectCache::validateFile " << file <<
+	             " has changed");
+	  removeFile(fileKey(file, old));
+	}
+	old = stamp;
+      }
+    }
+  }
+  if(fp)
+  {
+    if(stamp.found)
+    {
+      FingerprintBuilder fb;
+      long long	v[4];
+
+      v[0] = stamp.dev;
+      v[1] = stamp.ino;
+      v[2] = stamp.mtime;
+      v[3] = stamp.size;
+      fb.add(path);
+      fb.add(v, sizeof(v));
+      *fp = fb.get();
+    }
+    else
+    {
+      fp->hi = fp->lo = 0;
+    }
+  }
+  return(fileKey(file, stamp));
 }
 
 /*!
 * \return	Pointer to the requested Woolz object or NULL if not found
 * 		in the cache.
 * \ingroup  	WlzIIPServer
-* \brief    	Gets a Woolz object from the cache .
+* \brief    	Gets a Woolz object from the cache. The object is assigned
+* 		while the cache is locked so that it can not be freed by
+* 		another thread evicting it, the caller must free the
+* 		returned object. Pinned objects are searched first.
 * \param    	str     		String identifying the required
 * 					object.
 */
@@ -380,13 +712,22 @@ WlzObject 	*WlzObjectCache::
     unsigned int	key;
     WlzObjCacheEntry ent;
     AlcLRUCItem *item;
+    std::map<std::string, WlzObjCacheEntry *>::iterator pit;
+    MutexLock	lock(mutex);
 
-    ent.str = (char *)(str.c_str());
-    key = this->WlzObjCacheKeyFn(objCache, &ent);
-    item = AlcLRUCItemFind(objCache, key, &ent);
-    if(item)
+    if((pit = pinMap.find(str)) != pinMap.end())
     {
-      obj = ((WlzObjCacheEntry *)(item->entry))->obj;
+      obj = WlzAssignObject(pit->second->obj, NULL);
+    }
+    else
+    {
+      ent.str = (char *)(str.c_str());
+      key = this->WlzObjCacheKeyFn(objCache, &ent);
+      item = AlcLRUCItemFind(objCache, key, &ent);
+      if(item)
+      {
+	obj = WlzAssignObject(((WlzObjCacheEntry *)(item->entry))->obj, NULL);
+      }
     }
 #ifdef WLZ_IIP_LOG
     if(obj)
@@ -407,7 +748,9 @@ WlzObject 	*WlzObjectCache::
 * \return	Pointer to the requested Woolz 3D view structure or NULL if
 *           	not found in the cache.
 * \ingroup	WlzIIPServer
-* \brief    	Gets a Woolz 3D view structure from the cache .
+* \brief    	Gets a Woolz 3D view structure from the cache. As for
+* 		WlzObjectCache::get() the view structure is assigned while
+* 		the cache is locked and the caller must free it.
 * \param    	str     		String identifying the required
 * 					3D view structure object.
 */
@@ -421,6 +764,7 @@ WlzThreeDViewStruct *WlzObjectCache::
     unsigned int	key;
     WlzObjCacheEntry ent;
     AlcLRUCItem *item;
+    MutexLock	lock(mutex);
 
     ent.str = (char *)(str.c_str());
     key = this->WlzObjCacheKeyFn(objCache, &ent);
@@ -430,9 +774,9 @@ WlzThreeDViewStruct *WlzObjectCache::
       WlzObject *obj;
 
       obj = ((WlzObjCacheEntry *)(item->entry))->obj;
-      if(obj && (obj->type = WLZ_3D_VIEW_STRUCT))
+      if(obj && (obj->type == WLZ_3D_VIEW_STRUCT))
       {
-	vs = obj->domain.vs3d;
+	vs = WlzAssign3DViewStruct(obj->domain.vs3d, NULL);
       }
     }
   }
@@ -442,7 +786,8 @@ WlzThreeDViewStruct *WlzObjectCache::
 /*!
 * \return   	The number of objects cached.
 * \ingroup	WlzIIPServer
-* \brief    	Returns the number of objects cached.
+* \brief    	Returns the number of objects cached, including pinned
+* 		objects.
 */
 unsigned int 	WlzObjectCache::
 		getNumElements()
@@ -451,7 +796,9 @@ unsigned int 	WlzObjectCache::
 
   if(objCache)
   {
-    n = objCache->numItem;
+    MutexLock	lock(mutex);
+
+    n = objCache->numItem + pinMap.size();
   }
   return(n);
 }
@@ -464,9 +811,54 @@ unsigned int 	WlzObjectCache::
 float 		WlzObjectCache::
 		getMemorySize()
 {
+  MutexLock	lock(mutex);
+
   return((float )BytesToMBytes(objCache->curSz));
 }
 
+/*!
+* \return	The number of MB of cached sections.
+* \ingroup	WlzIIPServer
+* \brief    	Returns the number of MB of sections stored in the object
+* 		cache.
+*/
+float 		WlzObjectCache::
+		getSectionMemorySize()
+{
+  MutexLock	lock(mutex);
+
+  return((float )BytesToMBytes(secCurSz));
+}
+
+/*!
+* \return	The number of MB of pinned objects.
+* \ingroup	WlzIIPServer
+* \brief    	Returns the number of MB of pinned objects, these are not
+* 		included in the object cache size.
+*/
+float 		WlzObjectCache::
+		getPinnedMemorySize()
+{
+  MutexLock	lock(mutex);
+
+  return((float )BytesToMBytes(pinSz));
+}
+
+/*!
+* \return	The number of bytes held by the cache.
+* \ingroup	WlzIIPServer
+* \brief    	Returns the number of bytes of cached objects, sections
+* 		and pinned objects. Sections are held in the LRU cache so
+* 		they are already included in its current size.
+*/
+size_t 		WlzObjectCache::
+		getMemoryBytes()
+{
+  MutexLock	lock(mutex);
+
+  return(((objCache)? objCache->curSz: 0) + pinSz);
+}
+
 /*!
 * \ingroup	WlzIIPServer
 * \brief    	Sets the maximum cache size. If size is less the currently
@@ -478,6 +870,8 @@ void 		WlzObjectCache::
 {
   if(objCache)
   {
+    MutexLock	lock(mutex);
+
     AlcLRUCacheMaxSz(objCache, BytesToMBytes(max));
   }
 };
@@ -46,10 +46,13 @@ static char _WlzObjectCache_h[] = "University of Edinburgh $Id$";
 #include <unistd.h>
 #include <iostream>
 #include <list>
+#include <map>
 #include <string>
 #include <Wlz.h>
 #include "RawTile.h"
+#include "Fingerprint.h"
 #include "Environment.h"
+#include "Mutex.h"
 
 /*!
 * \struct	_WlzObjCacheEntry
@@ -61,8 +64,34 @@ typedef struct _WlzObjCacheEntry
   char			*str;		/*!< Object identification string, eg
   					     file from which it was read. */
   WlzObject		*obj;		/*!< The Woolz object. */
+  size_t		sz;		/*!< Approximate size of the object
+  					     in bytes. */
+  int			section;	/*!< Non zero if the object is a
+  					     cached section. */
+  int			pinned;		/*!< Non zero if the object is
+  					     pinned, pinned entries are
+					     never in the LRU cache and
+					     so are never evicted. */
+  class WlzObjectCache	*owner;		/*!< The owning cache. */
 } WlzObjCacheEntry;
 
+/*!
+* \struct	_WlzObjFileStamp
+* \ingroup	WlzIIPServer
+* \brief	Identity of a file from which objects are read, used to
+* 		detect when the file has been replaced.
+*/
+typedef struct _WlzObjFileStamp
+{
+  int			found;		/*!< Non zero if the file was found. */
+  dev_t			dev;		/*!< Device. */
+  ino_t			ino;		/*!< Inode number. */
+  time_t		mtime;		/*!< Modification time. */
+  off_t			size;		/*!< Size in bytes. */
+  time_t		checked;	/*!< Time at which the file was last
+  					     checked. */
+} WlzObjFileStamp;
+
 /*!
 * \brief        Cache for Woolz objects within a Woolz IIP server.
 * \ingroup      WlzIIPServer
@@ -73,6 +102,26 @@ class WlzObjectCache
     int			enabled;		/*!< Used to enable and disable
     						     the cache. */
     AlcLRUCache		*objCache;		/*!< Woolz object cache. */
+    Mutex		mutex;			/*!< Serialises access to the
+    						     cache by the server's
+						     worker threads. */
+    size_t		secMaxSz;		/*!< Maximum bytes of cached
+    						     sections, zero disables
+						     section caching. */
+    size_t		secCurSz;		/*!< Bytes of cached sections.*/
+    std::list<std::string> secList;		/*!< Cached section strings in
+    						     insertion order, may
+						     include sections already
+						     evicted by the LRU. */
+    std::map<std::string, WlzObjCacheEntry *> pinMap; /*!< Pinned objects
+    						     which are held outside
+						     of the LRU cache. */
+    size_t		pinSz;			/*!< Bytes of pinned objects. */
+    std::map<std::string, WlzObjFileStamp> fileMap; /*!< Identities of
+    						     the files from which
+						     objects have been read. */
+    int			checkInterval;		/*!< Seconds between checks
+    						     of a file's identity. */
     inline size_t 	MBytesToBytes(size_t m)
     			{
 			  const int	c = 1024 * 1024;
@@ -86,6 +135,11 @@ class WlzObjectCache
 			  return((b + c - 1) / c);
 			};
     size_t		ComputeObjectSize(WlzObject *obj);
+    void		insertEntry(WlzObject *obj, const std::string &str,
+    				    int section);
+    static std::string	fileKey(const std::string &file,
+    				const WlzObjFileStamp &stamp);
+    void		removeFile(const std::string &key);
     static unsigned int WlzObjCacheKeyFn(AlcLRUCache *cache, const void *e);
     static int		WlzObjCacheCmpFn(const void *e0, const void *e1);
     static void		WlzObjCacheUnlinkFn(AlcLRUCache *cache, const void *e);
@@ -97,10 +151,24 @@ class WlzObjectCache
                 	throw(std::string);
     void 		insert(WlzObject *obj, const std::string  str)
                 	throw (std::string);
+    void 		insertSection(WlzObject *obj, const std::string  str)
+                	throw (std::string);
+    size_t 		insertPinned(WlzObject *obj, const std::string  str)
+                	throw (std::string);
+    bool		sectionCacheEnabled() const
+    			{
+			  return(secMaxSz > 0);
+			}
+    std::string		validateFile(const std::string &file,
+    				     const std::string &path,
+				     Fingerprint *fp);
     WlzObject 		*get(std::string str);
     WlzThreeDViewStruct *getVS(std::string str);
     unsigned int 	getNumElements();
     float 		getMemorySize();
+    float 		getSectionMemorySize();
+    float 		getPinnedMemorySize();
+    size_t		getMemoryBytes();
     void 		setMaxSize(size_t max);
 
 };
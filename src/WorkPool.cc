@@ -0,0 +1,363 @@
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WorkPool_cc[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WorkPool.cc
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Process wide work stealing thread pool used to render the
+* 		tiles of multi-tile requests concurrently and to prefetch
+* 		tiles when it is otherwise idle.
+* \ingroup	WlzIIPServer
+*/
+
+#include "Log.h"
+#include "WorkPool.h"
+
+using namespace std;
+
+WorkPool *WorkPool::pool = NULL;
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Constructor which starts the pool's threads.
+* \param	n			Number of threads.
+*/
+WorkPool::WorkPool(int n)
+{
+  nThreads = 0;
+  nextQueue = 0;
+  nQueued = 0;
+  nIdle = 0;
+  stopping = false;
+  pthread_cond_init(&workCnd, NULL);
+  pthread_cond_init(&doneCnd, NULL);
+  queues = new Queue[n];
+  threads = new Thread[n];
+  for(int i = 0; i < n; ++i)
+  {
+    threads[nThreads].pool = this;
+    threads[nThreads].id = nThreads;
+    if(pthread_create(&(threads[nThreads].thr), NULL, workerThread,
+                      &(threads[nThreads])) == 0)
+    {
+      ++nThreads;
+    }
+    else
+    {
+      LOG_ERROR("Failed to create work pool thread " << i);
+    }
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Destructor which stops and joins the pool's threads. Any
+* 		jobs which are still queued are not run, detached jobs
+* 		in the idle queue are deleted.
+*/
+WorkPool::~WorkPool()
+{
+  mtx.lock();
+  stopping = true;
+  pthread_cond_broadcast(&workCnd);
+  mtx.unlock();
+  for(int i = 0; i < nThreads; ++i)
+  {
+    (void )pthread_join(threads[i].thr, NULL);
+  }
+  while(!idle.jobs.empty())
+  {
+    delete idle.jobs.front();
+    idle.jobs.pop_front();
+  }
+  pthread_cond_destroy(&workCnd);
+  pthread_cond_destroy(&doneCnd);
+  delete[] threads;
+  delete[] queues;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Creates the process's pool if it does not yet exist. This
+* 		should be called before any requests are processed.
+* \param	n			Number of threads, no pool is created
+* 					if this is less than one.
+*/
+void WorkPool::start(int n)
+{
+  if((pool == NULL) && (n > 0))
+  {
+    pool = new WorkPool(n);
+    if(pool->nThreads == 0)
+    {
+      delete pool;
+      pool = NULL;
+    }
+    else
+    {
+      LOG_NOTICE("Started " << pool->nThreads << " work pool threads");
+    }
+  }
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Stops and destroys the process's pool. This should only be
+* 		called once no requests are being processed.
+*/
+void WorkPool::stop()
+{
+  delete pool;
+  pool = NULL;
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Queues a job to be run by the pool. The job must remain
+* 		valid until wait() has returned for it.
+* \param	job			Given job.
+*/
+void WorkPool::submit(WorkPoolJob *job)
+{
+  Queue *q = queues + (__sync_fetch_and_add(&nextQueue, 1) % nThreads);
+
+  job->done = false;
+  (void )__sync_add_and_fetch(&nQueued, 1);
+  q->mtx.lock();
+  q->jobs.push_back(job);
+  q->mtx.unlock();
+  mtx.lock();
+  pthread_cond_signal(&workCnd);
+  mtx.unlock();
+}
+
+/*!
+* \return	True if the job was queued, false if the idle queue is
+* 		full in which case the job remains owned by the caller.
+* \ingroup	WlzIIPServer
+* \brief	Queues a detached low priority job which will only be run
+* 		when the pool has no other work. Once queued the job is
+* 		owned by the pool, which deletes it after it has been run,
+* 		so it may not be waited for.
+* \param	job			Given job.
+* \param	maxIdle			Maximum number of jobs in the idle
+* 					queue.
+*/
+bool WorkPool::submitIdle(WorkPoolJob *job, int maxIdle)
+{
+  bool queued = false;
+
+  idle.mtx.lock();
+  if(nIdle < maxIdle)
+  {
+    job->done = false;
+    job->detached = true;
+    // A detached job may outlive the request which created it
+    job->slowLog = NULL;
+    idle.jobs.push_back(job);
+    (void )__sync_add_and_fetch(&nIdle, 1);
+    queued = true;
+  }
+  idle.mtx.unlock();
+  if(queued)
+  {
+    mtx.lock();
+    pthread_cond_signal(&workCnd);
+    mtx.unlock();
+  }
+  return(queued);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Waits for the given job to complete. Rather than just
+* 		blocking the calling thread runs queued jobs while it waits.
+* \param	job			Given job which has been submitted.
+*/
+void WorkPool::wait(WorkPoolJob *job)
+{
+  mtx.lock();
+  while(!job->done)
+  {
+    WorkPoolJob *other;
+
+    mtx.unlock();
+    if((other = take(-1)) != NULL)
+    {
+      execute(other);
+      mtx.lock();
+    }
+    else
+    {
+      mtx.lock();
+      if(!job->done)
+      {
+        pthread_cond_wait(&doneCnd, mtx.native());
+      }
+    }
+  }
+  mtx.unlock();
+}
+
+/*!
+* \return	A job or NULL if all the queues are empty.
+* \ingroup	WlzIIPServer
+* \brief	Takes a job, first from the front of the given thread's
+* 		own queue and then by stealing from the back of the other
+* 		queues. A thread which is not in the pool takes from the
+* 		front of the queues, since it is waiting for the oldest
+* 		jobs.
+* \param	id			Index of the calling pool thread, or
+* 					-1 for any other thread.
+*/
+WorkPoolJob *WorkPool::take(int id)
+{
+  WorkPoolJob *job = NULL;
+
+  if(nQueued > 0)
+  {
+    for(int i = 0; (job == NULL) && (i < nThreads); ++i)
+    {
+      int	k = (id + i + nThreads) % nThreads;
+      Queue	*q = queues + k;
+      MutexLock	lock(q->mtx);
+
+      if(!q->jobs.empty())
+      {
+	if((k == id) || (id < 0))
+	{
+	  job = q->jobs.front();
+	  q->jobs.pop_front();
+	}
+	else
+	{
+	  job = q->jobs.back();
+	  q->jobs.pop_back();
+	}
+      }
+    }
+    if(job)
+    {
+      (void )__sync_sub_and_fetch(&nQueued, 1);
+    }
+  }
+  return(job);
+}
+
+/*!
+* \return	A job or NULL if the idle queue is empty.
+* \ingroup	WlzIIPServer
+* \brief	Takes the oldest job from the idle queue.
+*/
+WorkPoolJob *WorkPool::takeIdle()
+{
+  WorkPoolJob *job = NULL;
+
+  if(nIdle > 0)
+  {
+    MutexLock	lock(idle.mtx);
+
+    if(!idle.jobs.empty())
+    {
+      job = idle.jobs.front();
+      idle.jobs.pop_front();
+      (void )__sync_sub_and_fetch(&nIdle, 1);
+    }
+  }
+  return(job);
+}
+
+/*!
+* \ingroup	WlzIIPServer
+* \brief	Runs a job and then marks it as done, waking any thread
+* 		that is waiting for it. The job must not be accessed once
+* 		it has been marked as done. Detached jobs are deleted.
+* 		The job's spans and costs are attributed to the request
+* 		which created it.
+* \param	job			Given job.
+*/
+void WorkPool::execute(WorkPoolJob *job)
+{
+  {
+    TraceContext ctx(job->traceId);
+    SlowLogContext slc(job->slowLog);
+
+    job->run();
+  }
+  if(job->detached)
+  {
+    delete job;
+    return;
+  }
+  mtx.lock();
+  job->done = true;
+  pthread_cond_broadcast(&doneCnd);
+  mtx.unlock();
+}
+
+/*!
+* \return	NULL.
+* \ingroup	WlzIIPServer
+* \brief	Pool thread function which runs jobs until the pool is
+* 		stopped.
+* \param	arg			The thread's WorkPool::Thread.
+*/
+void *WorkPool::workerThread(void *arg)
+{
+  Thread *thr = (Thread *)arg;
+  WorkPool *wp = thr->pool;
+  bool stop = false;
+
+  while(!stop)
+  {
+    WorkPoolJob *job;
+
+    if(((job = wp->take(thr->id)) != NULL) ||
+       (!(wp->stopping) && ((job = wp->takeIdle()) != NULL)))
+    {
+      wp->execute(job);
+    }
+    else
+    {
+      wp->mtx.lock();
+      while((wp->nQueued <= 0) && (wp->nIdle <= 0) && !(wp->stopping))
+      {
+        pthread_cond_wait(&(wp->workCnd), wp->mtx.native());
+      }
+      stop = wp->stopping;
+      wp->mtx.unlock();
+    }
+  }
+  return(NULL);
+}
@@ -0,0 +1,191 @@
+#ifndef _WORKPOOL_H
+#define _WORKPOOL_H
+#if defined(__GNUC__)
+#ident "University of Edinburgh $Id$"
+#else
+static char _WorkPool_h[] = "University of Edinburgh $Id$";
+#endif
+/*!
+* \file         WorkPool.h
+* \author       Bill Hill
+* \date         October 2026
+* \version      $Id$
+* \par
+* Address:
+*               MRC Human Genetics Unit,
+*               MRC Institute of Genetics and Molecular Medicine,
+*               University of Edinburgh,
+*               Western General Hospital,
+*               Edinburgh, EH4 2XU, UK.
+* \par
+* Copyright (C), [2012],
+* The University Court of the University of Edinburgh,
+* Old College, Edinburgh, UK.
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be
+* useful but WITHOUT ANY WARRANTY; without even the implied
+* warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+* PURPOSE.  See the GNU General Public License for more
+* details.
+*
+* You should have received a copy of the GNU General Public
+* License along with this program; if not, write to the Free
+* Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+* Boston, MA  02110-1301, USA.
+* \brief	Process wide work stealing thread pool used to render the
+* 		tiles of multi-tile requests concurrently and to prefetch
+* 		tiles when it is otherwise idle.
+* \ingroup	WlzIIPServer
+*/
+
+#include <deque>
+#include <pthread.h>
+#include "Mutex.h"
+#include "Trace.h"
+#include "SlowLog.h"
+
+class WorkPool;
+
+/*!
+* \brief	A unit of work for the pool. Derived classes implement
+* 		run() which must not throw, any error should be recorded
+* 		in the job for the submitting thread to pick up.
+* \ingroup	WlzIIPServer
+*/
+class WorkPoolJob
+{
+  friend class WorkPool;
+
+  private:
+    volatile bool	done;			/*!< Set once run() has
+    						     returned. */
+    bool		detached;		/*!< Deleted by the pool
+    						     once run. */
+    unsigned long	traceId;		/*!< Traced request of the
+    						     submitting thread. */
+    SlowLogRecord	*slowLog;		/*!< Cost record of the
+    						     submitting thread's
+						     request. */
+
+  public:
+    			WorkPoolJob(): done(false), detached(false),
+				       traceId(traceRequestId),
+				       slowLog(slowLogRecord) {}
+    virtual		~WorkPoolJob() {}
+    virtual void	run() = 0;
+    /*!
+    * \return	True once the job has been run.
+    * \ingroup	WlzIIPServer
+    * \brief	Checks whether the job is complete without waiting.
+    */
+    bool		isDone() const
+    			{
+			  return(done);
+			}
+};
+
+/*!
+* \brief	Work stealing pool of threads. Each thread has its own
+* 		queue, jobs are dealt out to the queues round robin.
+* 		A thread takes jobs from the front of its own queue
+* 		(oldest first, so that tiles complete roughly in the
+* 		order in which they are written out) and when that is
+* 		empty it steals from the back of the other queues.
+* 		A thread waiting for a job helps by running queued jobs
+* 		so that a request is never starved by others sharing
+* 		the pool. Low priority jobs are held in a separate idle
+* 		queue, they are only taken by pool threads when all the
+* 		other queues are empty and they are never run by waiting
+* 		threads. There is a single pool for the process, it
+* 		is created by start() and jobs may only be submitted
+* 		when get() returns a pool.
+* \ingroup	WlzIIPServer
+*/
+class WorkPool
+{
+  private:
+    /*!
+    * \brief	Per thread queue of jobs.
+    */
+    struct Queue
+    {
+      Mutex		mtx;			/*!< Protects the jobs. */
+      std::deque<WorkPoolJob *> jobs;		/*!< Queued jobs. */
+    };
+    /*!
+    * \brief	Argument passed to each pool thread.
+    */
+    struct Thread
+    {
+      WorkPool		*pool;			/*!< The pool. */
+      int		id;			/*!< Index of the thread
+      						     and its queue. */
+      pthread_t		thr;			/*!< The thread. */
+    };
+
+    int			nThreads;		/*!< Number of threads. */
+    Queue		*queues;		/*!< A queue per thread. */
+    Thread		*threads;		/*!< The threads. */
+    unsigned int	nextQueue;		/*!< Round robin counter. */
+    volatile int	nQueued;		/*!< Jobs in all queues. */
+    Queue		idle;			/*!< Low priority jobs. */
+    volatile int	nIdle;			/*!< Jobs in the idle queue.*/
+    bool		stopping;		/*!< Set to stop threads. */
+    Mutex		mtx;			/*!< Protects the conditions.*/
+    pthread_cond_t	workCnd;		/*!< Signalled on submit. */
+    pthread_cond_t	doneCnd;		/*!< Signalled when any job
+    						     completes. */
+    static WorkPool	*pool;			/*!< The process's pool. */
+
+    			WorkPool(int n);
+			~WorkPool();
+    WorkPoolJob		*take(int id);
+    WorkPoolJob		*takeIdle();
+    void		execute(WorkPoolJob *job);
+    static void		*workerThread(void *arg);
+
+    			WorkPool(const WorkPool &);
+    WorkPool		&operator=(const WorkPool &);
+
+  public:
+    static void		start(int n);
+    static void		stop();
+    /*!
+    * \return	The process's pool or NULL if there is none.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the pool, jobs should be run serially by the
+    * 		caller if there is no pool.
+    */
+    static WorkPool	*get()
+    			{
+			  return(pool);
+			}
+    /*!
+    * \return	Number of threads in the pool.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the number of pool threads.
+    */
+    int			getNumThreads() const
+    			{
+			  return(nThreads);
+			}
+    void		submit(WorkPoolJob *job);
+    void		wait(WorkPoolJob *job);
+    bool		submitIdle(WorkPoolJob *job, int maxIdle);
+    /*!
+    * \return	Number of jobs in the idle queue.
+    * \ingroup	WlzIIPServer
+    * \brief	Gives the number of low priority jobs waiting to run.
+    */
+    int			getNumIdle() const
+    			{
+			  return(nIdle);
+			}
+};
+
+#endif
@@ -29,6 +29,9 @@ static char _Writer_h[] = "University of Edinburgh $Id$";
 
 #include <fcgiapp.h>
 #include <cstdio>
+#include <cstring>
+#include "Trace.h"
+#include "SlowLog.h"
 
 
 /// Virtual base class for various writers
@@ -71,6 +74,7 @@ class FCGIWriter {
   FCGIWriter( FCGX_Stream* o ){ out = o; };
 
   int putStr( const char* msg, int len ){
+    SlowLogSpan slowSpan( SlowLog::WRITE );
     return FCGX_PutStr( msg, len, out );
   };
   int putS( const char* msg ){
@@ -80,6 +84,8 @@ class FCGIWriter {
     return FCGX_FPrintF( out, msg );
   };
   int flush(){
+    TraceSpan span( "Writer::flush" );
+    SlowLogSpan slowSpan( SlowLog::WRITE );
     return FCGX_FFlush( out );
   };
 
@@ -94,23 +100,38 @@ class FileWriter {
 
   FILE* out;
 
+  /// Number of bytes written
+  unsigned long long bytes;
+
  public:
 
-  FileWriter( FILE* o ){ out = o; };
+  FileWriter( FILE* o ){ out = o; bytes = 0; };
 
   int putStr( const char* msg, int len ){
-    return fwrite( (void*) msg, sizeof(char), len, out );
+    SlowLogSpan slowSpan( SlowLog::WRITE );
+    int n = fwrite( (void*) msg, sizeof(char), len, out );
+    if( n > 0 ) bytes += n;
+    return n;
   };
   int putS( const char* msg ){
-    return fputs( msg, out );
+    int n = fputs( msg, out );
+    if( n >= 0 ) bytes += strlen( msg );
+    return n;
   }
   int printf( const char* msg ){
-    return fprintf( out, msg );
+    int n = fprintf( out, msg );
+    if( n > 0 ) bytes += n;
+    return n;
   };
   int flush(){
+    TraceSpan span( "Writer::flush" );
+    SlowLogSpan slowSpan( SlowLog::WRITE );
     return fflush( out );
   };
 
+  /// Return the number of bytes written so far
+  unsigned long long getBytes(){ return bytes; };
+
 };
   
 